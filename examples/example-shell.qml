@@ -9,16 +9,21 @@ ShellRoot {
     PolkitAgent {
         id: polkitAgent
 
-        onShowAuthDialog: function(actionId, message, iconName) {
+        onShowAuthDialog: function(actionId, message, iconName, cookie) {
             console.log("Show auth dialog for:", actionId)
             console.log("Message:", message)
             authDialog.actionId = actionId
             authDialog.message = message
+            authDialog.cookie = cookie
             authDialog.visible = true
         }
 
-        onAuthorizationResult: function(authorized, actionId) {
+        onAuthorizationResult: function(authorized, actionId, cookie) {
             console.log("Authorization result for", actionId + ":", authorized ? "GRANTED" : "DENIED")
+            // Another prompt finishing must not close the one on screen
+            if (cookie && cookie !== authDialog.cookie) {
+                return
+            }
             authDialog.visible = false
 
             if (authorized) {
@@ -28,8 +33,11 @@ ShellRoot {
             }
         }
 
-        onAuthorizationError: function(error) {
+        onAuthorizationError: function(error, cookie) {
             console.log("Authorization error:", error)
+            if (cookie && cookie !== authDialog.cookie) {
+                return
+            }
             authDialog.visible = false
             resultText.text = "⚠️ Error: " + error
         }
@@ -133,6 +141,7 @@ ShellRoot {
 
         property string actionId: ""
         property string message: ""
+        property string cookie: ""
 
         Rectangle {
             anchors.fill: parent
@@ -189,7 +198,7 @@ ShellRoot {
                     text: "Cancel"
                     Layout.alignment: Qt.AlignHCenter
                     onClicked: {
-                        polkitAgent.cancelAuthorization()
+                        polkitAgent.cancelAuthorization(authDialog.cookie)
                         authDialog.visible = false
                     }
                 }
@@ -5,14 +5,21 @@ Item {
     id: polkitAgent
 
     // Public API
-    signal showAuthDialog(string actionId, string message, string iconName)
-    signal authorizationResult(bool authorized, string actionId)
-    signal authorizationError(string error)
+    // Every prompt carries its polkit cookie; several can be open at once
+    signal showAuthDialog(string actionId, string message, string iconName, string cookie)
+    signal authDialogUpdated(string message, string cookie)
+    signal authorizationResult(bool authorized, string actionId, string cookie)
+    signal authorizationError(string error, string cookie)
     signal connected()
     signal disconnected()
 
     property bool isConnected: socket.state === LocalSocket.ConnectedState
 
+    // Position in the agent's event log, kept across reconnects so only
+    // missed events are resent
+    property real lastEventSeq: 0
+    property string eventEpoch: ""
+
     // Request authorization for an action
     function checkAuthorization(actionId, details) {
         if (socket.state !== LocalSocket.ConnectedState) {
@@ -30,13 +37,16 @@ Item {
         return true
     }
 
-    // Cancel current authorization
-    function cancelAuthorization() {
+    // Cancel the prompt for cookie, or every prompt when no cookie is given
+    function cancelAuthorization(cookie) {
         if (socket.state !== LocalSocket.ConnectedState) return
 
         var message = {
             "type": "cancel_authorization"
         }
+        if (cookie) {
+            message.cookie = cookie
+        }
 
         socket.write(JSON.stringify(message) + "\n")
     }
@@ -108,24 +118,63 @@ Item {
     }
 
     function handleMessage(message) {
+        // Events replayed on reconnect may overlap ones already handled.
+        // Frames without event_seq (replies, welcome, resume_complete and the
+        // pending state sent after welcome) are always handled and never move
+        // lastEventSeq, so the resume delta that follows is not mistaken for
+        // duplicates. welcome and resume_complete report the log head as
+        // log_seq instead.
+        if (message.event_seq !== undefined) {
+            if (message.event_seq <= lastEventSeq) return
+            lastEventSeq = message.event_seq
+        }
+
         switch (message.type) {
+        case "welcome":
+            var resumeFrom = lastEventSeq
+            var resumeEpoch = eventEpoch
+            if (message.event_epoch !== eventEpoch) {
+                // A different agent instance numbers events from scratch
+                eventEpoch = message.event_epoch || ""
+                lastEventSeq = 0
+            }
+            if (resumeEpoch !== "") {
+                socket.write(JSON.stringify({
+                    "type": "resume",
+                    "last_seq": resumeFrom,
+                    "epoch": resumeEpoch
+                }) + "\n")
+            }
+            break
+
+        case "resume_complete":
+            eventEpoch = message.event_epoch
+            lastEventSeq = Math.max(lastEventSeq, message.log_seq)
+            break
+
         case "show_auth_dialog":
             polkitAgent.showAuthDialog(
                 message.action_id,
                 message.message,
-                message.icon_name
+                message.icon_name,
+                message.cookie || ""
             )
             break
 
+        case "auth_dialog_update":
+            polkitAgent.authDialogUpdated(message.message, message.cookie || "")
+            break
+
         case "authorization_result":
             polkitAgent.authorizationResult(
                 message.authorized,
-                message.action_id
+                message.action_id,
+                message.cookie || ""
             )
             break
 
         case "authorization_error":
-            polkitAgent.authorizationError(message.error)
+            polkitAgent.authorizationError(message.error, message.cookie || "")
             break
 
         default:
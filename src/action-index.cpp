@@ -0,0 +1,362 @@
+/*
+ * quickshell-polkit-agent
+ * Copyright (C) 2025 Benny Powers
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "action-index.h"
+#include "logging.h"
+
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QDateTime>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QLocale>
+#include <QSaveFile>
+#include <QSocketNotifier>
+#include <QStandardPaths>
+#include <QTimeZone>
+#include <QXmlStreamReader>
+
+#include <cerrno>
+#include <cstring>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+namespace {
+constexpr quint32 WATCH_MASK = IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_CLOSE_WRITE;
+
+QFileInfoList policyFiles(const QString &directory)
+{
+    return QDir(directory).entryInfoList({QStringLiteral("*.policy")}, QDir::Files, QDir::Name);
+}
+
+QDataStream &operator<<(QDataStream &out, const ActionMetadata &metadata)
+{
+    return out << metadata.vendor << metadata.vendorUrl << metadata.iconName << metadata.description
+               << metadata.allowAny << metadata.allowInactive << metadata.allowActive;
+}
+
+QDataStream &operator>>(QDataStream &in, ActionMetadata &metadata)
+{
+    return in >> metadata.vendor >> metadata.vendorUrl >> metadata.iconName >> metadata.description
+              >> metadata.allowAny >> metadata.allowInactive >> metadata.allowActive;
+}
+}
+
+ActionIndex::ActionIndex(const QStringList &directories, const QString &cachePath,
+                         const QString &locale, QObject *parent)
+    : QObject(parent)
+    , m_directories(directories)
+    , m_cachePath(cachePath)
+    , m_locale(locale.isEmpty() ? QLocale::system().name() : locale)
+    , m_built(false)
+    , m_loadedFromCache(false)
+    , m_inotifyFd(-1)
+    , m_inotifyNotifier(nullptr)
+{
+}
+
+ActionIndex::~ActionIndex()
+{
+    delete m_inotifyNotifier;
+    if (m_inotifyFd >= 0) {
+        ::close(m_inotifyFd);
+    }
+}
+
+QStringList ActionIndex::defaultDirectories()
+{
+    const QString overrideDirs = qEnvironmentVariable("QUICKSHELL_POLKIT_ACTIONS_DIR");
+    if (!overrideDirs.isEmpty()) {
+        return overrideDirs.split(':', Qt::SkipEmptyParts);
+    }
+    return {QStringLiteral("/usr/share/polkit-1/actions")};
+}
+
+QString ActionIndex::defaultCachePath()
+{
+    const QString overridePath = qEnvironmentVariable("QUICKSHELL_POLKIT_ACTION_CACHE");
+    if (overridePath == QLatin1String("0")) {
+        return QString();
+    }
+    if (!overridePath.isEmpty()) {
+        return overridePath;
+    }
+    const QString cacheDir = QStandardPaths::writableLocation(QStandardPaths::GenericCacheLocation);
+    return cacheDir.isEmpty() ? QString() : cacheDir + "/quickshell-polkit-agent/actions.cache";
+}
+
+const ActionMetadata *ActionIndex::lookup(const QString &actionId)
+{
+    if (!m_built) {
+        build();
+    }
+    const auto it = m_actions.constFind(actionId);
+    return it == m_actions.constEnd() ? nullptr : &it.value();
+}
+
+void ActionIndex::invalidate()
+{
+    if (m_built) {
+        qCDebug(polkitAgent) << "Polkit action files changed, dropping action index";
+    }
+    m_actions.clear();
+    m_built = false;
+    m_loadedFromCache = false;
+}
+
+void ActionIndex::build()
+{
+    // Watch first so a change made while we scan still invalidates the result
+    watchDirectories();
+
+    QElapsedTimer timer;
+    timer.start();
+    const QByteArray currentSignature = signature();
+    m_actions.clear();
+
+    if (!m_cachePath.isEmpty() && loadCache(currentSignature)) {
+        m_loadedFromCache = true;
+    } else {
+        for (const QString &directory : m_directories) {
+            for (const QFileInfo &info : policyFiles(directory)) {
+                QFile file(info.filePath());
+                if (!file.open(QIODevice::ReadOnly)) {
+                    qCWarning(polkitAgent) << "Cannot read polkit action file:" << info.filePath();
+                    continue;
+                }
+                if (!parsePolicy(file.readAll(), m_locale, &m_actions)) {
+                    qCWarning(polkitAgent) << "Skipping malformed polkit action file:" << info.filePath();
+                }
+            }
+        }
+        if (!m_cachePath.isEmpty()) {
+            saveCache(currentSignature);
+        }
+    }
+
+    m_built = true;
+    qCDebug(polkitAgent) << "Indexed" << m_actions.size() << "polkit actions in" << timer.elapsed() << "ms"
+                         << (m_loadedFromCache ? "(from cache)" : "");
+}
+
+bool ActionIndex::parsePolicy(const QByteArray &xml, const QString &locale, QHash<QString, ActionMetadata> *index)
+{
+    const QString language = locale.section('_', 0, 0);
+    QHash<QString, ActionMetadata> parsed;
+    QXmlStreamReader reader(xml);
+
+    if (!reader.readNextStartElement() || reader.name() != QLatin1String("policyconfig")) {
+        return false;
+    }
+
+    // vendor, vendor_url and icon_name at the top level apply to every action
+    ActionMetadata defaults;
+    while (reader.readNextStartElement()) {
+        const QStringView name = reader.name();
+        if (name == QLatin1String("vendor")) {
+            defaults.vendor = reader.readElementText().trimmed();
+        } else if (name == QLatin1String("vendor_url")) {
+            defaults.vendorUrl = reader.readElementText().trimmed();
+        } else if (name == QLatin1String("icon_name")) {
+            defaults.iconName = reader.readElementText().trimmed();
+        } else if (name == QLatin1String("action")) {
+            const QString id = reader.attributes().value(QLatin1String("id")).toString();
+            ActionMetadata action = defaults;
+            int descriptionRank = -1;  // 0 untranslated, 1 language match, 2 exact locale
+
+            while (reader.readNextStartElement()) {
+                const QStringView field = reader.name();
+                if (field == QLatin1String("description")) {
+                    const QString lang = reader.attributes().value(QLatin1String("xml:lang")).toString();
+                    const int rank = lang.isEmpty() ? 0 : lang == locale ? 2 : lang == language ? 1 : -1;
+                    const QString text = reader.readElementText().trimmed();
+                    if (rank > descriptionRank) {
+                        action.description = text;
+                        descriptionRank = rank;
+                    }
+                } else if (field == QLatin1String("vendor")) {
+                    action.vendor = reader.readElementText().trimmed();
+                } else if (field == QLatin1String("vendor_url")) {
+                    action.vendorUrl = reader.readElementText().trimmed();
+                } else if (field == QLatin1String("icon_name")) {
+                    action.iconName = reader.readElementText().trimmed();
+                } else if (field == QLatin1String("defaults")) {
+                    while (reader.readNextStartElement()) {
+                        const QStringView hint = reader.name();
+                        if (hint == QLatin1String("allow_any")) {
+                            action.allowAny = reader.readElementText().trimmed();
+                        } else if (hint == QLatin1String("allow_inactive")) {
+                            action.allowInactive = reader.readElementText().trimmed();
+                        } else if (hint == QLatin1String("allow_active")) {
+                            action.allowActive = reader.readElementText().trimmed();
+                        } else {
+                            reader.skipCurrentElement();
+                        }
+                    }
+                } else {
+                    reader.skipCurrentElement();  // message, annotate
+                }
+            }
+            if (!id.isEmpty()) {
+                parsed.insert(id, action);
+            }
+        } else {
+            reader.skipCurrentElement();
+        }
+    }
+
+    if (reader.hasError()) {
+        return false;
+    }
+    index->insert(parsed);
+    return true;
+}
+
+/*
+ * Identifies the exact set of files the index was built from
+ *
+ * Stat-only, so checking it costs a directory listing rather than a parse.
+ * Installs replace files by rename, which changes the mtime even when the
+ * size does not.
+ */
+QByteArray ActionIndex::signature() const
+{
+    QCryptographicHash hash(QCryptographicHash::Sha256);
+    hash.addData(m_locale.toUtf8());
+    for (const QString &directory : m_directories) {
+        hash.addData(QByteArrayView("\0d", 2));
+        hash.addData(directory.toUtf8());
+        for (const QFileInfo &info : policyFiles(directory)) {
+            hash.addData(QByteArrayView("\0f", 2));
+            hash.addData(info.fileName().toUtf8());
+            const qint64 stamp[] = {info.size(), info.lastModified(QTimeZone::UTC).toMSecsSinceEpoch()};
+            hash.addData(QByteArrayView(reinterpret_cast<const char *>(stamp), sizeof(stamp)));
+        }
+    }
+    return hash.result();
+}
+
+bool ActionIndex::loadCache(const QByteArray &expectedSignature)
+{
+    QFile file(m_cachePath);
+    if (!file.open(QIODevice::ReadOnly) || file.size() == 0) {
+        return false;
+    }
+
+    // Decode straight from the page cache; the file is never copied into a buffer
+    uchar *mapped = file.map(0, file.size());
+    if (!mapped) {
+        return false;
+    }
+    const QByteArray data = QByteArray::fromRawData(reinterpret_cast<const char *>(mapped), qsizetype(file.size()));
+    QDataStream in(data);
+    in.setVersion(QDataStream::Qt_6_0);
+
+    quint32 magic = 0;
+    quint32 version = 0;
+    QByteArray storedSignature;
+    quint32 count = 0;
+    in >> magic >> version >> storedSignature >> count;
+
+    bool loaded = false;
+    if (in.status() == QDataStream::Ok && magic == CACHE_MAGIC && version == CACHE_VERSION &&
+        storedSignature == expectedSignature) {
+        QHash<QString, ActionMetadata> actions;
+        actions.reserve(count);
+        for (quint32 i = 0; i < count && in.status() == QDataStream::Ok; ++i) {
+            QString id;
+            ActionMetadata metadata;
+            in >> id >> metadata;
+            actions.insert(id, metadata);
+        }
+        if (in.status() == QDataStream::Ok) {
+            m_actions = std::move(actions);
+            loaded = true;
+        } else {
+            qCWarning(polkitAgent) << "Ignoring truncated action cache:" << m_cachePath;
+        }
+    }
+
+    file.unmap(mapped);
+    return loaded;
+}
+
+void ActionIndex::saveCache(const QByteArray &currentSignature) const
+{
+    QDir().mkpath(QFileInfo(m_cachePath).absolutePath());
+    QSaveFile file(m_cachePath);
+    if (!file.open(QIODevice::WriteOnly)) {
+        qCWarning(polkitAgent) << "Cannot write action cache:" << m_cachePath << file.errorString();
+        return;
+    }
+
+    QDataStream out(&file);
+    out.setVersion(QDataStream::Qt_6_0);
+    out << CACHE_MAGIC << CACHE_VERSION << currentSignature << quint32(m_actions.size());
+    for (auto it = m_actions.constBegin(); it != m_actions.constEnd(); ++it) {
+        out << it.key() << it.value();
+    }
+    if (!file.commit()) {
+        qCWarning(polkitAgent) << "Cannot write action cache:" << m_cachePath << file.errorString();
+    }
+}
+
+void ActionIndex::watchDirectories()
+{
+    if (m_inotifyFd >= 0) {
+        return;
+    }
+    m_inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (m_inotifyFd < 0) {
+        // The index just stays as built; a restart picks up new actions
+        qCWarning(polkitAgent) << "inotify unavailable, action index will not refresh:" << strerror(errno);
+        return;
+    }
+    for (const QString &directory : m_directories) {
+        if (inotify_add_watch(m_inotifyFd, QFile::encodeName(directory).constData(), WATCH_MASK) < 0) {
+            qCDebug(polkitAgent) << "Not watching action directory" << directory << strerror(errno);
+        }
+    }
+    m_inotifyNotifier = new QSocketNotifier(m_inotifyFd, QSocketNotifier::Read, this);
+    connect(m_inotifyNotifier, &QSocketNotifier::activated, this, &ActionIndex::onInotifyReadable);
+}
+
+void ActionIndex::onInotifyReadable()
+{
+    alignas(struct inotify_event) char buffer[4096];
+    bool policyChanged = false;
+    for (;;) {
+        const ssize_t length = ::read(m_inotifyFd, buffer, sizeof(buffer));
+        if (length <= 0) {
+            break;
+        }
+        for (ssize_t offset = 0; offset < length;) {
+            const auto *event = reinterpret_cast<const struct inotify_event *>(buffer + offset);
+            offset += ssize_t(sizeof(struct inotify_event) + event->len);
+            // Package managers stage files under temporary names; only .policy files count
+            if (event->len == 0 || QByteArrayView(event->name).endsWith(".policy")) {
+                policyChanged = true;
+            }
+        }
+    }
+    if (policyChanged) {
+        invalidate();
+    }
+}
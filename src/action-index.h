@@ -0,0 +1,108 @@
+/*
+ * quickshell-polkit-agent
+ * Copyright (C) 2025 Benny Powers
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <QByteArray>
+#include <QHash>
+#include <QObject>
+#include <QString>
+#include <QStringList>
+
+class QSocketNotifier;
+
+/*
+ * What a .policy file says about one action
+ *
+ * description is already localized for the agent's locale. The allow*
+ * fields are polkit's implicit authorizations ("yes", "auth_admin",
+ * "auth_self_keep", ...), empty when the file does not set them.
+ */
+struct ActionMetadata {
+    QString vendor;
+    QString vendorUrl;
+    QString iconName;
+    QString description;
+    QString allowAny;
+    QString allowInactive;
+    QString allowActive;
+
+    bool isEmpty() const { return vendor.isEmpty() && description.isEmpty() && allowActive.isEmpty(); }
+};
+
+/*
+ * Action ID -> metadata index over polkit's action directories
+ *
+ * Parsing every .policy file takes tens of milliseconds, so nothing is
+ * read until the first lookup and afterwards each lookup is one hash
+ * probe. An inotify watch on the directories drops the index when a
+ * package adds, removes or replaces a file; the next lookup rebuilds it.
+ *
+ * The parsed index is also written to a cache file, keyed by a signature
+ * of the directory listing (names, sizes, mtimes) and the locale. A fresh
+ * agent whose signature matches maps the cache instead of parsing XML.
+ */
+class ActionIndex : public QObject
+{
+    Q_OBJECT
+
+public:
+    // An empty cachePath disables the on-disk cache
+    explicit ActionIndex(const QStringList &directories, const QString &cachePath = QString(),
+                         const QString &locale = QString(), QObject *parent = nullptr);
+    ~ActionIndex();
+
+    // QUICKSHELL_POLKIT_ACTIONS_DIR (colon-separated) or polkit's own directory
+    static QStringList defaultDirectories();
+    // QUICKSHELL_POLKIT_ACTION_CACHE, or under $XDG_CACHE_HOME; "0" disables
+    static QString defaultCachePath();
+
+    // nullptr for unknown actions; valid until the index is next rebuilt
+    const ActionMetadata *lookup(const QString &actionId);
+
+    void invalidate();
+    bool isBuilt() const { return m_built; }
+    bool loadedFromCache() const { return m_loadedFromCache; }
+    int size() const { return int(m_actions.size()); }
+
+    // Parse one policyconfig document into index; false on malformed XML
+    static bool parsePolicy(const QByteArray &xml, const QString &locale, QHash<QString, ActionMetadata> *index);
+
+    static constexpr quint32 CACHE_MAGIC = 0x51504149;  // "QPAI"
+    static constexpr quint32 CACHE_VERSION = 1;
+
+private slots:
+    void onInotifyReadable();
+
+private:
+    void build();
+    void watchDirectories();
+    QByteArray signature() const;
+    bool loadCache(const QByteArray &signature);
+    void saveCache(const QByteArray &signature) const;
+
+    QStringList m_directories;
+    QString m_cachePath;
+    QString m_locale;
+    QHash<QString, ActionMetadata> m_actions;
+    bool m_built;
+    bool m_loadedFromCache;
+
+    int m_inotifyFd;
+    QSocketNotifier *m_inotifyNotifier;
+};
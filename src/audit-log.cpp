@@ -0,0 +1,287 @@
+/*
+ * quickshell-polkit-agent
+ * Copyright (C) 2025 Benny Powers
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "audit-log.h"
+#include "logging.h"
+
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QDeadlineTimer>
+#include <QMutex>
+#include <QThread>
+#include <QWaitCondition>
+
+#include <array>
+#include <atomic>
+#include <cstring>
+
+#ifdef HAVE_SYSTEMD
+#include <syslog.h>
+#include <systemd/sd-journal.h>
+#endif
+
+namespace {
+
+struct AuditRecord {
+    qint64 timestampMs;
+    std::array<char, AuditLog::EVENT_SIZE> event;
+    std::array<char, AuditLog::RESULT_SIZE> result;
+    std::array<char, AuditLog::ACTION_ID_SIZE> actionId;
+    std::array<char, AuditLog::DETAILS_SIZE> details;
+};
+
+/*
+ * Bounded ring with one consumer at a time (drainMutex). head is only
+ * advanced by producers (serialized by producerMutex, uncontended in
+ * practice since audit events come from the event loop), tail only by the
+ * consumer, so neither side ever blocks the other.
+ */
+struct AuditRing {
+    std::array<AuditRecord, AuditLog::RING_CAPACITY> records;
+    std::atomic<quint64> head{0};
+    std::atomic<quint64> tail{0};
+    std::atomic<quint64> droppedSinceDrain{0};
+    std::atomic<quint64> droppedTotal{0};
+
+    QMutex producerMutex;
+    QMutex drainMutex;
+    QMutex wakeMutex;
+    QWaitCondition wake;
+
+    QThread *drainer = nullptr;      // Guarded by producerMutex
+    bool stopped = false;            // Guarded by producerMutex
+    std::atomic<bool> running{false};
+};
+
+AuditRing &ring()
+{
+    static AuditRing instance;
+    return instance;
+}
+
+// UTF-16 to UTF-8 into a fixed buffer, truncating at a code point boundary
+template <size_t N>
+void copyField(std::array<char, N> &dst, QStringView src)
+{
+    size_t out = 0;
+    for (qsizetype i = 0; i < src.size(); ++i) {
+        char32_t cp = src[i].unicode();
+        if (QChar::isHighSurrogate(cp) && i + 1 < src.size() && src[i + 1].isLowSurrogate()) {
+            cp = QChar::surrogateToUcs4(src[i], src[i + 1]);
+            ++i;
+        } else if (QChar::isSurrogate(cp)) {
+            cp = 0xFFFD;
+        }
+
+        char encoded[4];
+        size_t length;
+        if (cp < 0x80) {
+            encoded[0] = static_cast<char>(cp);
+            length = 1;
+        } else if (cp < 0x800) {
+            encoded[0] = static_cast<char>(0xC0 | (cp >> 6));
+            encoded[1] = static_cast<char>(0x80 | (cp & 0x3F));
+            length = 2;
+        } else if (cp < 0x10000) {
+            encoded[0] = static_cast<char>(0xE0 | (cp >> 12));
+            encoded[1] = static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+            encoded[2] = static_cast<char>(0x80 | (cp & 0x3F));
+            length = 3;
+        } else {
+            encoded[0] = static_cast<char>(0xF0 | (cp >> 18));
+            encoded[1] = static_cast<char>(0x80 | ((cp >> 12) & 0x3F));
+            encoded[2] = static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+            encoded[3] = static_cast<char>(0x80 | (cp & 0x3F));
+            length = 4;
+        }
+
+        if (out + length > N - 1) {
+            break;
+        }
+        memcpy(dst.data() + out, encoded, length);
+        out += length;
+    }
+    dst[out] = '\0';
+}
+
+void fillRecord(AuditRecord &record, QStringView event, QStringView details,
+                QStringView result, QStringView actionId)
+{
+    record.timestampMs = QDateTime::currentMSecsSinceEpoch();
+    copyField(record.event, event);
+    copyField(record.details, details);
+    copyField(record.result, result);
+    copyField(record.actionId, actionId);
+}
+
+void writeRecord(const AuditRecord &record)
+{
+#ifdef HAVE_SYSTEMD
+    // Only talk to the journal directly when our stderr goes there anyway,
+    // otherwise a terminal run would lose its audit trail
+    static const bool useJournal = !qEnvironmentVariableIsEmpty("JOURNAL_STREAM");
+    if (useJournal) {
+        sd_journal_send("MESSAGE=AUDIT: event=%s result=%s", record.event.data(), record.result.data(),
+                        "PRIORITY=%i", LOG_INFO,
+                        "EVENT=%s", record.event.data(),
+                        "RESULT=%s", record.result.data(),
+                        "ACTION_ID=%s", record.actionId.data(),
+                        "DETAILS=%s", record.details.data(),
+                        "AUDIT_TIMESTAMP_MS=%lld", static_cast<long long>(record.timestampMs),
+                        nullptr);
+        return;
+    }
+#endif
+
+    QString message = QString("[%1] event=%2")
+        .arg(QDateTime::fromMSecsSinceEpoch(record.timestampMs).toString(Qt::ISODate),
+             QString::fromUtf8(record.event.data()));
+
+    if (record.actionId[0] != '\0') {
+        message += QString(" action_id=%1").arg(QString::fromUtf8(record.actionId.data()));
+    }
+
+    if (record.details[0] != '\0') {
+        message += QString(" details=\"%1\"").arg(QString::fromUtf8(record.details.data()));
+    }
+
+    if (record.result[0] != '\0') {
+        message += QString(" result=%1").arg(QString::fromUtf8(record.result.data()));
+    }
+
+    qCInfo(polkitAgent) << "AUDIT:" << message;
+}
+
+void drain()
+{
+    AuditRing &r = ring();
+    QMutexLocker locker(&r.drainMutex);
+
+    quint64 tail = r.tail.load(std::memory_order_relaxed);
+    const quint64 head = r.head.load(std::memory_order_acquire);
+    for (; tail != head; ++tail) {
+        writeRecord(r.records[tail % AuditLog::RING_CAPACITY]);
+        r.tail.store(tail + 1, std::memory_order_release);
+    }
+
+    const quint64 dropped = r.droppedSinceDrain.exchange(0, std::memory_order_relaxed);
+    if (dropped > 0) {
+        AuditRecord record;
+        fillRecord(record, u"AUDIT_DROPPED", QString("records=%1").arg(dropped), u"OVERFLOW", {});
+        writeRecord(record);
+    }
+}
+
+void drainLoop()
+{
+    AuditRing &r = ring();
+    while (r.running.load(std::memory_order_acquire)) {
+        {
+            QMutexLocker locker(&r.wakeMutex);
+            r.wake.wait(&r.wakeMutex, QDeadlineTimer(AuditLog::DRAIN_INTERVAL_MS));
+        }
+        drain();
+    }
+    drain();
+}
+
+} // namespace
+
+void AuditLog::record(QStringView event, QStringView details, QStringView result, QStringView actionId)
+{
+    AuditRing &r = ring();
+    QMutexLocker locker(&r.producerMutex);
+
+    if (!r.drainer && !r.stopped) {
+        if (!QCoreApplication::instance()) {
+            // Nothing would stop the thread at exit; stay synchronous
+            locker.unlock();
+            AuditRecord record;
+            fillRecord(record, event, details, result, actionId);
+            writeRecord(record);
+            return;
+        }
+
+        r.running.store(true, std::memory_order_release);
+        r.drainer = QThread::create(drainLoop);
+        r.drainer->setObjectName(QStringLiteral("audit-log"));
+        r.drainer->start(QThread::LowPriority);
+        qAddPostRoutine(AuditLog::shutdown);
+    }
+
+    if (r.stopped) {
+        locker.unlock();
+        AuditRecord record;
+        fillRecord(record, event, details, result, actionId);
+        writeRecord(record);
+        return;
+    }
+
+    const quint64 head = r.head.load(std::memory_order_relaxed);
+    const quint64 pending = head - r.tail.load(std::memory_order_acquire);
+    if (pending >= static_cast<quint64>(RING_CAPACITY)) {
+        r.droppedSinceDrain.fetch_add(1, std::memory_order_relaxed);
+        r.droppedTotal.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    fillRecord(r.records[head % RING_CAPACITY], event, details, result, actionId);
+    r.head.store(head + 1, std::memory_order_release);
+
+    if (pending + 1 == static_cast<quint64>(BATCH_WAKE_THRESHOLD)) {
+        r.wake.wakeOne();
+    }
+}
+
+void AuditLog::flush()
+{
+    drain();
+}
+
+void AuditLog::shutdown()
+{
+    AuditRing &r = ring();
+    QThread *drainer = nullptr;
+    {
+        QMutexLocker locker(&r.producerMutex);
+        if (r.stopped) {
+            return;
+        }
+        r.stopped = true;
+        drainer = r.drainer;
+        r.drainer = nullptr;
+    }
+
+    if (drainer) {
+        r.running.store(false, std::memory_order_release);
+        {
+            QMutexLocker locker(&r.wakeMutex);
+            r.wake.wakeOne();
+        }
+        drainer->wait();
+        delete drainer;
+    }
+
+    // Anything recorded while the thread was stopping
+    drain();
+}
+
+quint64 AuditLog::droppedCount()
+{
+    return ring().droppedTotal.load(std::memory_order_relaxed);
+}
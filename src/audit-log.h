@@ -0,0 +1,65 @@
+/*
+ * quickshell-polkit-agent
+ * Copyright (C) 2025 Benny Powers
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <QStringView>
+#include <QtGlobal>
+
+/*
+ * Asynchronous audit log sink
+ *
+ * record() copies an event into a fixed-size ring of fixed-layout records
+ * (UTF-8, truncated to the field sizes below) and returns; it does no
+ * formatting, time-zone conversion or I/O. A background thread drains the
+ * ring every DRAIN_INTERVAL_MS, or as soon as BATCH_WAKE_THRESHOLD records
+ * are waiting, and writes each batch out:
+ *
+ *   - to the journal with structured fields (EVENT, RESULT, ACTION_ID,
+ *     DETAILS) when built with libsystemd and stderr is the journal
+ *   - otherwise as the familiar "AUDIT: [time] event=..." line on
+ *     polkit.agent
+ *
+ * When the ring is full new records are dropped and counted; the next
+ * drain reports the count as an AUDIT_DROPPED entry. Without a
+ * QCoreApplication, or after shutdown(), records are written synchronously.
+ */
+class AuditLog
+{
+public:
+    static void record(QStringView event, QStringView details, QStringView result, QStringView actionId);
+
+    // Write out everything recorded so far (blocks until the ring is empty)
+    static void flush();
+
+    // Drain and stop the background thread; later records are synchronous
+    static void shutdown();
+
+    // Records lost to a full ring over the process lifetime
+    static quint64 droppedCount();
+
+    static constexpr int RING_CAPACITY = 1024;
+    static constexpr int BATCH_WAKE_THRESHOLD = 64;
+    static constexpr int DRAIN_INTERVAL_MS = 100;
+
+    // Field sizes in bytes, including the terminator
+    static constexpr int EVENT_SIZE = 32;
+    static constexpr int RESULT_SIZE = 16;
+    static constexpr int ACTION_ID_SIZE = 128;
+    static constexpr int DETAILS_SIZE = 192;
+};
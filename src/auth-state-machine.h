@@ -0,0 +1,189 @@
+/*
+ * quickshell-polkit-agent
+ * Copyright (C) 2025 Benny Powers
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <QtGlobal>
+
+/*
+ * Authentication state machine
+ *
+ * Inspired by GDM's GdmSessionWorkerState pattern
+ * See: https://gitlab.gnome.org/GNOME/gdm/-/blob/main/daemon/gdm-session-worker.h
+ * SPDX-License-Identifier: GPL-2.0-or-later (for GDM reference pattern)
+ */
+enum class AuthenticationState {
+    IDLE = 0,                    // No authentication in progress
+    INITIATED,                   // Authentication request received, session created
+    WAITING_FOR_PASSWORD,        // Password prompt shown, waiting for user input
+    AUTHENTICATING,              // PAM is processing credentials
+    AUTHENTICATION_FAILED,       // PAM rejected credentials (recoverable)
+    MAX_RETRIES_EXCEEDED,        // Too many failed attempts (only cancel or timeout leave it)
+    COMPLETED,                   // Authentication succeeded
+    CANCELLED,                   // User cancelled authentication
+    ERROR                        // Unrecoverable error occurred
+};
+
+/*
+ * Legal transitions and what entering each state implies
+ *
+ * One row per source state with a bit per legal target, so checking a
+ * transition is an index and a mask. PolkitWrapper::setState() refuses and
+ * counts anything not in the table. The entry actions are the bookkeeping
+ * that used to follow individual setState() calls: restarting the
+ * inactivity deadline while the conversation moves, stopping it in terminal
+ * states, and recording that PAM is in a password conversation.
+ *
+ * Sessions leave the table by being cleaned up, never by returning to IDLE.
+ */
+namespace AuthStateMachine {
+
+constexpr int STATE_COUNT = static_cast<int>(AuthenticationState::ERROR) + 1;
+constexpr int EDGE_COUNT = STATE_COUNT * STATE_COUNT;
+
+enum EntryAction : quint8 {
+    NoAction = 0,
+    ResetTimeout = 1 << 0,    // The conversation moved: push back the inactivity deadline
+    StopTimeout = 1 << 1,     // Nothing left to time out
+    PasswordMethod = 1 << 2   // PAM is prompting for, or checking, a password
+};
+
+constexpr quint16 to(AuthenticationState state)
+{
+    return quint16(1u << static_cast<int>(state));
+}
+
+namespace detail {
+using S = AuthenticationState;
+
+// Every live state can be cancelled by the user or failed by a timeout or PAM error
+constexpr quint16 ABORT = to(S::CANCELLED) | to(S::ERROR);
+// Outcomes of Session::completed, which PAM may deliver without ever prompting (FIDO)
+constexpr quint16 OUTCOME = to(S::COMPLETED) | to(S::AUTHENTICATION_FAILED) | to(S::MAX_RETRIES_EXCEEDED);
+}
+
+constexpr quint16 TRANSITIONS[STATE_COUNT] = {
+    /* IDLE */                  to(detail::S::INITIATED) | detail::ABORT,
+    /* INITIATED */             to(detail::S::WAITING_FOR_PASSWORD) | to(detail::S::AUTHENTICATING) |
+                                detail::OUTCOME | detail::ABORT,
+    /* WAITING_FOR_PASSWORD */  to(detail::S::AUTHENTICATING) | detail::OUTCOME | detail::ABORT,
+    /* AUTHENTICATING */        to(detail::S::WAITING_FOR_PASSWORD) | detail::OUTCOME | detail::ABORT,
+    /* AUTHENTICATION_FAILED */ to(detail::S::WAITING_FOR_PASSWORD) | to(detail::S::AUTHENTICATING) |
+                                to(detail::S::COMPLETED) | to(detail::S::MAX_RETRIES_EXCEEDED) | detail::ABORT,
+    /* MAX_RETRIES_EXCEEDED */  detail::ABORT,
+    /* COMPLETED */             0,
+    /* CANCELLED */             0,
+    /* ERROR */                 0,
+};
+
+constexpr quint8 ENTRY_ACTIONS[STATE_COUNT] = {
+    /* IDLE */                  NoAction,
+    /* INITIATED */             ResetTimeout,
+    /* WAITING_FOR_PASSWORD */  ResetTimeout | PasswordMethod,
+    /* AUTHENTICATING */        ResetTimeout | PasswordMethod,
+    /* AUTHENTICATION_FAILED */ NoAction,
+    /* MAX_RETRIES_EXCEEDED */  NoAction,
+    /* COMPLETED */             StopTimeout,
+    /* CANCELLED */             StopTimeout,
+    /* ERROR */                 StopTimeout,
+};
+
+constexpr const char *STATE_NAMES[STATE_COUNT] = {
+    "IDLE", "INITIATED", "WAITING_FOR_PASSWORD", "AUTHENTICATING", "AUTHENTICATION_FAILED",
+    "MAX_RETRIES_EXCEEDED", "COMPLETED", "CANCELLED", "ERROR",
+};
+
+constexpr bool isLegal(AuthenticationState from, AuthenticationState target)
+{
+    return (TRANSITIONS[static_cast<int>(from)] >> static_cast<int>(target)) & 1u;
+}
+
+constexpr bool isTerminal(AuthenticationState state)
+{
+    return TRANSITIONS[static_cast<int>(state)] == 0;
+}
+
+constexpr quint8 entryActions(AuthenticationState state)
+{
+    return ENTRY_ACTIONS[static_cast<int>(state)];
+}
+
+constexpr int edgeIndex(AuthenticationState from, AuthenticationState target)
+{
+    return static_cast<int>(from) * STATE_COUNT + static_cast<int>(target);
+}
+
+constexpr const char *stateName(AuthenticationState state)
+{
+    return STATE_NAMES[static_cast<int>(state)];
+}
+
+namespace detail {
+constexpr bool noSelfLoops()
+{
+    for (int i = 0; i < STATE_COUNT; ++i) {
+        if (TRANSITIONS[i] & (1u << i)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+constexpr bool neverReentersIdle()
+{
+    for (int i = 0; i < STATE_COUNT; ++i) {
+        if (TRANSITIONS[i] & to(S::IDLE)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+constexpr bool liveStatesCanAbort()
+{
+    for (int i = 0; i < STATE_COUNT; ++i) {
+        if (TRANSITIONS[i] != 0 && (TRANSITIONS[i] & ABORT) != ABORT) {
+            return false;
+        }
+    }
+    return true;
+}
+
+constexpr bool terminalStatesStopTimeout()
+{
+    for (int i = 0; i < STATE_COUNT; ++i) {
+        if (TRANSITIONS[i] == 0 && !(ENTRY_ACTIONS[i] & StopTimeout)) {
+            return false;
+        }
+    }
+    return true;
+}
+}
+
+static_assert(sizeof(TRANSITIONS) / sizeof(TRANSITIONS[0]) == STATE_COUNT, "One transition row per state");
+static_assert(STATE_COUNT <= 16, "Transition rows are 16-bit masks");
+static_assert(detail::noSelfLoops(), "setState() treats same-state moves as no-ops");
+static_assert(detail::neverReentersIdle(), "Sessions end by cleanup, not by returning to IDLE");
+static_assert(detail::liveStatesCanAbort(), "A live session must always be cancellable and failable");
+static_assert(detail::terminalStatesStopTimeout(), "Terminal states must not leave a deadline armed");
+static_assert(isTerminal(AuthenticationState::COMPLETED) && isTerminal(AuthenticationState::CANCELLED) &&
+              isTerminal(AuthenticationState::ERROR), "COMPLETED, CANCELLED and ERROR are final");
+static_assert(!isLegal(AuthenticationState::MAX_RETRIES_EXCEEDED, AuthenticationState::AUTHENTICATING),
+              "No PAM attempt after the retry limit (faillock protection)");
+
+} // namespace AuthStateMachine
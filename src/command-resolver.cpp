@@ -0,0 +1,182 @@
+/*
+ * quickshell-polkit-agent
+ * Copyright (C) 2025 Benny Powers
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "command-resolver.h"
+#include "logging.h"
+#include <QCache>
+#include <QFile>
+#include <QMutex>
+
+namespace {
+
+struct CachedCommand {
+    qint64 startTime;  // Tells a recycled pid from the process that was resolved
+    QString command;
+};
+
+QMutex cacheMutex;
+QCache<qint64, CachedCommand> commandCache(CommandResolver::CACHE_SIZE);
+
+// Last path component of one argument, without allocating for the prefix
+QString baseName(const char *data, qsizetype length)
+{
+    const QByteArray arg = QByteArray::fromRawData(data, length);
+    const qsizetype slash = arg.lastIndexOf('/');
+    return QString::fromUtf8(data + slash + 1, length - slash - 1);
+}
+
+} // namespace
+
+QString CommandResolver::parseCommandLine(const QByteArray &cmdline)
+{
+    // Walk the NUL-separated arguments in place instead of splitting into a list
+    const char *data = cmdline.constData();
+    const qsizetype size = cmdline.size();
+
+    auto nextArg = [&](qsizetype from, qsizetype *length) -> qsizetype {
+        while (from < size && data[from] == '\0') {
+            from++;  // Skip empty arguments
+        }
+        if (from >= size) {
+            return -1;
+        }
+        qsizetype end = cmdline.indexOf('\0', from);
+        *length = (end == -1 ? size : end) - from;
+        return from;
+    };
+
+    qsizetype length = 0;
+    qsizetype start = nextArg(0, &length);
+    if (start < 0) {
+        return QString();
+    }
+
+    // Get the command name (remove path)
+    QString command = baseName(data + start, length);
+    if (command != "systemd-run" && command != "run0") {
+        return command;
+    }
+
+    // Look for the actual command after systemd-run options
+    qsizetype lastStart = -1;
+    qsizetype lastLength = 0;
+    bool skipValue = false;
+    qsizetype pos = start + length;
+    while ((start = nextArg(pos, &length)) >= 0) {
+        pos = start + length;
+        lastStart = start;
+        lastLength = length;
+
+        if (skipValue) {
+            skipValue = false;
+            if (data[start] != '-') {
+                continue;  // Value of the preceding option
+            }
+        }
+
+        if (data[start] == '-') {
+            // Skip option and its value if it takes one
+            if (!memchr(data + start, '=', length)) {
+                skipValue = true;
+            }
+            continue;
+        }
+
+        // Found the actual command
+        return baseName(data + start, length);
+    }
+
+    // Fallback to last argument
+    if (lastStart >= 0) {
+        return baseName(data + lastStart, lastLength);
+    }
+    return command;
+}
+
+qint64 CommandResolver::processStartTime(qint64 pid)
+{
+    QFile statFile(QString("/proc/%1/stat").arg(pid));
+    if (!statFile.open(QIODevice::ReadOnly)) {
+        return -1;
+    }
+    const QByteArray stat = statFile.readAll();
+
+    // comm (field 2) may contain spaces and parentheses; fields resume after the last ')'
+    qsizetype pos = stat.lastIndexOf(')');
+    if (pos < 0) {
+        return -1;
+    }
+
+    // Field 3 (state) follows ") "; start time is field 22
+    int field = 2;
+    while (pos < stat.size() && field < 22) {
+        pos = stat.indexOf(' ', pos + 1);
+        if (pos < 0) {
+            return -1;
+        }
+        field++;
+    }
+
+    bool ok = false;
+    qsizetype end = stat.indexOf(' ', pos + 1);
+    qint64 startTime = stat.mid(pos + 1, end < 0 ? -1 : end - pos - 1).toLongLong(&ok);
+    return ok ? startTime : -1;
+}
+
+QString CommandResolver::cached(qint64 pid)
+{
+    QMutexLocker locker(&cacheMutex);
+    const CachedCommand *entry = commandCache.object(pid);
+    return entry ? entry->command : QString();
+}
+
+QString CommandResolver::resolve(qint64 pid)
+{
+    const qint64 startTime = processStartTime(pid);
+    if (startTime < 0) {
+        qCDebug(polkitAgent) << "Could not read start time for PID:" << pid;
+        return QString();
+    }
+
+    {
+        QMutexLocker locker(&cacheMutex);
+        const CachedCommand *entry = commandCache.object(pid);
+        if (entry && entry->startTime == startTime) {
+            return entry->command;
+        }
+    }
+
+    // /proc/PID/cmdline has null-separated arguments
+    QFile cmdlineFile(QString("/proc/%1/cmdline").arg(pid));
+    if (!cmdlineFile.open(QIODevice::ReadOnly)) {
+        qCDebug(polkitAgent) << "Could not read cmdline for PID:" << pid;
+        return QString();
+    }
+
+    const QString command = parseCommandLine(cmdlineFile.readAll());
+    qCDebug(polkitAgent) << "Resolved command for PID" << pid << ":" << command;
+
+    // The process may have exited and its pid been reused while we read it
+    if (processStartTime(pid) != startTime) {
+        return QString();
+    }
+
+    QMutexLocker locker(&cacheMutex);
+    commandCache.insert(pid, new CachedCommand{startTime, command});  // Replaces a recycled pid's entry
+    return command;
+}
@@ -0,0 +1,52 @@
+/*
+ * quickshell-polkit-agent
+ * Copyright (C) 2025 Benny Powers
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <QByteArray>
+#include <QString>
+
+/*
+ * Resolves the command a run0/systemd-run subject is trying to start
+ *
+ * Reads /proc/<pid>/cmdline and caches the answer by pid together with the
+ * process start time, so the repeated prompts of a retry loop don't read
+ * cmdline again. resolve() checks the start time, so a recycled pid never
+ * returns a stale command; it is thread-safe and is meant to run off the
+ * thread that services polkitd's D-Bus calls. cached() touches no file and
+ * may be called there, but its answer is provisional until resolve() has
+ * confirmed it.
+ */
+class CommandResolver
+{
+public:
+    // Resolve the target command for pid (blocking, thread-safe); empty if unknown
+    static QString resolve(qint64 pid);
+
+    // Last command resolved for pid, without touching /proc; empty on a miss.
+    // Unverified: the pid may have been recycled since.
+    static QString cached(qint64 pid);
+
+    // Extract the command name from a NUL-separated cmdline buffer
+    static QString parseCommandLine(const QByteArray &cmdline);
+
+    // Process start time in clock ticks since boot (/proc/<pid>/stat field 22), -1 if unavailable
+    static qint64 processStartTime(qint64 pid);
+
+    static constexpr int CACHE_SIZE = 32;
+};
@@ -0,0 +1,167 @@
+/*
+ * quickshell-polkit-agent
+ * Copyright (C) 2025 Benny Powers
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "deadline-scheduler.h"
+
+#include <QCoreApplication>
+
+#include <algorithm>
+#include <limits>
+
+DeadlineScheduler::DeadlineScheduler(QObject *parent)
+    : QObject(parent)
+    , m_nextId(1)
+{
+    m_clock.start();
+    m_timer.setSingleShot(true);
+    connect(&m_timer, &QTimer::timeout, this, &DeadlineScheduler::onTimeout);
+}
+
+DeadlineScheduler *DeadlineScheduler::instance()
+{
+    static QPointer<DeadlineScheduler> scheduler;
+    if (!scheduler) {
+        scheduler = new DeadlineScheduler(QCoreApplication::instance());
+    }
+    return scheduler;
+}
+
+DeadlineScheduler::TimerId DeadlineScheduler::schedule(QObject *context, qint64 delayMs, Callback callback)
+{
+    const TimerId id = m_nextId++;
+    Entry &entry = m_entries[id];
+    entry.deadline = now() + qMax<qint64>(0, delayMs);
+    entry.context = context;
+    entry.callback = std::move(callback);
+    push(id, entry);
+    arm();
+    return id;
+}
+
+void DeadlineScheduler::reschedule(TimerId id, qint64 delayMs)
+{
+    auto it = m_entries.find(id);
+    if (it == m_entries.end()) {
+        return;
+    }
+    
+    it->deadline = now() + qMax<qint64>(0, delayMs);
+    
+    // Later than the queued item: it re-queues itself when it comes due
+    if (it->deadline < it->queuedDeadline) {
+        push(id, *it);
+        arm();
+    }
+}
+
+void DeadlineScheduler::cancel(TimerId id)
+{
+    // The heap item goes stale and is discarded when it reaches the top
+    if (m_entries.remove(id) > 0 && m_heap.size() > 2 * static_cast<size_t>(m_entries.size()) + 64) {
+        compact();
+    }
+}
+
+bool DeadlineScheduler::isScheduled(TimerId id) const
+{
+    return m_entries.contains(id);
+}
+
+qint64 DeadlineScheduler::remainingTime(TimerId id) const
+{
+    auto it = m_entries.constFind(id);
+    if (it == m_entries.constEnd()) {
+        return -1;
+    }
+    return qMax<qint64>(0, it->deadline - now());
+}
+
+int DeadlineScheduler::pendingCount() const
+{
+    return m_entries.size();
+}
+
+void DeadlineScheduler::push(TimerId id, Entry &entry)
+{
+    entry.queuedDeadline = entry.deadline;
+    m_heap.push_back({entry.deadline, id});
+    std::push_heap(m_heap.begin(), m_heap.end(), std::greater<HeapItem>());
+}
+
+void DeadlineScheduler::arm()
+{
+    // Discard stale items so the timer is armed for a live deadline
+    while (!m_heap.empty()) {
+        const HeapItem &top = m_heap.front();
+        auto it = m_entries.constFind(top.id);
+        if (it != m_entries.constEnd() && it->queuedDeadline == top.deadline) {
+            break;
+        }
+        std::pop_heap(m_heap.begin(), m_heap.end(), std::greater<HeapItem>());
+        m_heap.pop_back();
+    }
+    
+    if (m_heap.empty()) {
+        m_timer.stop();
+        return;
+    }
+    
+    const qint64 interval = qMax<qint64>(0, m_heap.front().deadline - now());
+    m_timer.start(static_cast<int>(qMin<qint64>(interval, std::numeric_limits<int>::max())));
+}
+
+void DeadlineScheduler::compact()
+{
+    m_heap.clear();
+    for (auto it = m_entries.begin(); it != m_entries.end(); ++it) {
+        it->queuedDeadline = it->deadline;
+        m_heap.push_back({it->deadline, it.key()});
+    }
+    std::make_heap(m_heap.begin(), m_heap.end(), std::greater<HeapItem>());
+}
+
+void DeadlineScheduler::onTimeout()
+{
+    const qint64 current = now();
+    
+    while (!m_heap.empty() && m_heap.front().deadline <= current) {
+        const HeapItem item = m_heap.front();
+        std::pop_heap(m_heap.begin(), m_heap.end(), std::greater<HeapItem>());
+        m_heap.pop_back();
+        
+        auto it = m_entries.find(item.id);
+        if (it == m_entries.end() || it->queuedDeadline != item.deadline) {
+            continue;  // Cancelled, or superseded by an earlier item
+        }
+        
+        if (it->deadline > current) {
+            // Pushed back since it was queued
+            push(item.id, *it);
+            continue;
+        }
+        
+        // Remove before calling: the callback may schedule or cancel freely
+        Entry entry = std::move(*it);
+        m_entries.erase(it);
+        if (entry.context) {
+            entry.callback();
+        }
+    }
+    
+    arm();
+}
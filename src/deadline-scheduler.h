@@ -0,0 +1,96 @@
+/*
+ * quickshell-polkit-agent
+ * Copyright (C) 2025 Benny Powers
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <QElapsedTimer>
+#include <QHash>
+#include <QObject>
+#include <QPointer>
+#include <QTimer>
+
+#include <functional>
+#include <vector>
+
+/*
+ * One-shot deadlines on a shared monotonic clock
+ *
+ * Connection heartbeats, client session expiry and per-cookie
+ * authentication timeouts all live in one min-heap, and a single QTimer is
+ * armed for the earliest of them. Nothing polls, so the cost is the same
+ * with one client or fifty.
+ *
+ * Deadlines that are pushed back (every heartbeat pushes back its
+ * connection's deadline) only update the entry; the stale heap item is
+ * re-queued when it comes due. Pushing a deadline back is O(1), scheduling,
+ * pulling forward and firing are O(log n).
+ *
+ * Callbacks run on the scheduler's thread and are skipped if their
+ * context object has been destroyed.
+ */
+class DeadlineScheduler : public QObject
+{
+    Q_OBJECT
+
+public:
+    using TimerId = quint64;  // 0 is never a valid id
+    using Callback = std::function<void()>;
+
+    explicit DeadlineScheduler(QObject *parent = nullptr);
+
+    // Process-wide scheduler shared by IPCServer and PolkitWrapper
+    static DeadlineScheduler *instance();
+
+    TimerId schedule(QObject *context, qint64 delayMs, Callback callback);
+
+    // Move an existing deadline to delayMs from now; unknown ids are ignored
+    void reschedule(TimerId id, qint64 delayMs);
+    void cancel(TimerId id);
+
+    bool isScheduled(TimerId id) const;
+    qint64 remainingTime(TimerId id) const;  // -1 if not scheduled
+    int pendingCount() const;
+
+private slots:
+    void onTimeout();
+
+private:
+    struct Entry {
+        qint64 deadline;        // When the callback is due
+        qint64 queuedDeadline;  // Deadline of this entry's live heap item
+        QPointer<QObject> context;
+        Callback callback;
+    };
+
+    struct HeapItem {
+        qint64 deadline;
+        TimerId id;
+        bool operator>(const HeapItem &other) const { return deadline > other.deadline; }
+    };
+
+    qint64 now() const { return m_clock.elapsed(); }
+    void push(TimerId id, Entry &entry);
+    void arm();
+    void compact();
+
+    QElapsedTimer m_clock;
+    QTimer m_timer;
+    QHash<TimerId, Entry> m_entries;
+    std::vector<HeapItem> m_heap;  // Min-heap on deadline, may hold stale items
+    TimerId m_nextId;
+};
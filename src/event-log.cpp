@@ -0,0 +1,74 @@
+/*
+ * quickshell-polkit-agent
+ * Copyright (C) 2025 Benny Powers
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "event-log.h"
+
+#include <QRandomGenerator>
+
+#include <algorithm>
+
+EventLog::EventLog()
+    : m_epoch(QString::number(QRandomGenerator::system()->generate64(), 16))
+{
+}
+
+quint64 EventLog::append(QJsonObject &message)
+{
+    const quint64 seq = ++m_lastSeq;
+    message["event_seq"] = static_cast<double>(seq);
+    m_ring[seq % CAPACITY] = message;
+    return seq;
+}
+
+int EventLog::size() const
+{
+    return static_cast<int>(std::min<quint64>(m_lastSeq - m_releasedThrough, CAPACITY));
+}
+
+bool EventLog::covers(quint64 afterSeq) const
+{
+    // A sequence from the future belongs to another instance
+    if (afterSeq > m_lastSeq) {
+        return false;
+    }
+    return m_lastSeq - afterSeq <= static_cast<quint64>(size());
+}
+
+QByteArray EventLog::framesAfter(quint64 afterSeq, WireEncoding encoding, int *count) const
+{
+    QByteArray frames;
+    int written = 0;
+    if (covers(afterSeq)) {
+        for (quint64 seq = afterSeq + 1; seq <= m_lastSeq; ++seq) {
+            frames.append(WireFormat::encode(m_ring[seq % CAPACITY], encoding));
+            written++;
+        }
+    }
+    if (count) {
+        *count = written;
+    }
+    return frames;
+}
+
+void EventLog::release()
+{
+    for (QJsonObject &event : m_ring) {
+        event = QJsonObject();
+    }
+    m_releasedThrough = m_lastSeq;
+}
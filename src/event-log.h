@@ -0,0 +1,70 @@
+/*
+ * quickshell-polkit-agent
+ * Copyright (C) 2025 Benny Powers
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <QByteArray>
+#include <QJsonObject>
+#include <QString>
+
+#include <array>
+
+#include "wire-format.h"
+
+/*
+ * Sequence-numbered history of broadcast events
+ *
+ * Every event the agent broadcasts is stamped with "event_seq", one more
+ * than the previous event, and kept in a fixed ring of the last CAPACITY
+ * events. A reconnecting client reports the last sequence it saw and gets
+ * exactly the events after it, so its reconnect cost follows what it
+ * missed. When the ring no longer reaches back that far, covers() is false
+ * and the caller falls back to a snapshot of live sessions instead.
+ *
+ * Sequences restart with the process, so each log has a random epoch; a
+ * client presenting another epoch is talking about a previous instance.
+ */
+class EventLog
+{
+public:
+    EventLog();
+
+    // Stamp message with the next sequence, remember it and return the sequence
+    quint64 append(QJsonObject &message);
+
+    quint64 lastSeq() const { return m_lastSeq; }
+    const QString &epoch() const { return m_epoch; }
+    int size() const;
+
+    // True if every event after afterSeq is still held
+    bool covers(quint64 afterSeq) const;
+
+    // Events after afterSeq, encoded back to back; count receives how many
+    QByteArray framesAfter(quint64 afterSeq, WireEncoding encoding, int *count = nullptr) const;
+
+    // Drop the held events but keep numbering; only lastSeq() stays covered
+    void release();
+
+    static constexpr int CAPACITY = 256;
+
+private:
+    std::array<QJsonObject, CAPACITY> m_ring;
+    quint64 m_lastSeq = 0;  // 0 until the first event
+    quint64 m_releasedThrough = 0;  // Events up to here were dropped by release()
+    QString m_epoch;
+};
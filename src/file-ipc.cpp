@@ -18,26 +18,30 @@
 
 #include "file-ipc.h"
 #include "polkit-wrapper.h"
-#include <QStandardPaths>
-#include <QDir>
+#include "message-validator.h"
+#include "logging.h"
 #include <QJsonDocument>
-#include <QFile>
-#include <QTextStream>
-#include <QDebug>
+#include <QSocketNotifier>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 FileIPC::FileIPC(PolkitWrapper *polkitWrapper, QObject *parent)
     : QObject(parent)
-    , m_watcher(new QFileSystemWatcher(this))
+    , m_inotifyFd(-1)
+    , m_inotifyNotifier(nullptr)
     , m_pollTimer(new QTimer(this))
+    , m_retireTimer(new QTimer(this))
     , m_polkitWrapper(polkitWrapper)
 {
-    // Set up file paths
-    QString runtimeDir = qEnvironmentVariable("XDG_RUNTIME_DIR");
-    if (runtimeDir.isEmpty()) {
-        runtimeDir = QString("/tmp");
-        m_requestFilePath = QString("%1/quickshell-polkit-requests-%2").arg(runtimeDir).arg(getuid());
-        m_responseFilePath = QString("%1/quickshell-polkit-responses-%2").arg(runtimeDir).arg(getuid());
-    } else {
+    // Only under the per-user runtime directory: in a shared /tmp the fixed
+    // names could be pre-created or symlinked by another user
+    const QString runtimeDir = qEnvironmentVariable("XDG_RUNTIME_DIR");
+    if (!runtimeDir.isEmpty()) {
         m_requestFilePath = QString("%1/quickshell-polkit-requests").arg(runtimeDir);
         m_responseFilePath = QString("%1/quickshell-polkit-responses").arg(runtimeDir);
     }
@@ -52,84 +56,244 @@ FileIPC::FileIPC(PolkitWrapper *polkitWrapper, QObject *parent)
                 this, &FileIPC::onAuthorizationError);
     }
 
-    // Set up response file monitoring
-    connect(m_watcher, &QFileSystemWatcher::fileChanged,
-            this, &FileIPC::onResponseFileChanged);
-    
-    // Fallback polling timer
-    m_pollTimer->setInterval(1000); // Check every second
+    // Fallback polling, only started if inotify is unavailable
+    m_pollTimer->setInterval(POLL_INTERVAL_MS);
     connect(m_pollTimer, &QTimer::timeout, this, &FileIPC::checkForResponses);
+
+    m_retireTimer->setSingleShot(true);
+    connect(m_retireTimer, &QTimer::timeout, this, &FileIPC::onRetireTimeout);
 }
 
 FileIPC::~FileIPC()
 {
+    m_requestFile.close();
+    closeResponseLog(&m_response);
+    closeResponseLog(&m_retired);
+    if (m_inotifyFd >= 0) {
+        ::close(m_inotifyFd);
+    }
+
     // Clean up files
+    if (m_requestFilePath.isEmpty()) {
+        return;
+    }
     QFile::remove(m_requestFilePath);
+    QFile::remove(m_requestFilePath + ".1");
     QFile::remove(m_responseFilePath);
 }
 
 bool FileIPC::initialize()
 {
-    qDebug() << "FileIPC: Initializing file-based IPC";
-    qDebug() << "Request file:" << m_requestFilePath;
-    qDebug() << "Response file:" << m_responseFilePath;
-
-    // Create empty files
-    QFile requestFile(m_requestFilePath);
-    if (!requestFile.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
-        qWarning() << "Failed to create request file:" << m_requestFilePath;
+    qCDebug(fileIpc) << "Initializing file-based IPC";
+    if (m_requestFilePath.isEmpty()) {
+        qCWarning(fileIpc) << "XDG_RUNTIME_DIR is not set; file-based IPC needs a private directory";
         return false;
     }
-    requestFile.close();
+    qCDebug(fileIpc) << "Request file:" << m_requestFilePath;
+    qCDebug(fileIpc) << "Response file:" << m_responseFilePath;
 
-    QFile responseFile(m_responseFilePath);
-    if (!responseFile.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
-        qWarning() << "Failed to create response file:" << m_responseFilePath;
+    if (!openRequestLog()) {
+        return false;
+    }
+    
+    if (!replaceWithEmptyFile(m_responseFilePath)) {
+        qCWarning(fileIpc) << "Failed to create response file:" << m_responseFilePath;
         return false;
     }
-    responseFile.close();
 
-    // Add response file to watcher
-    if (!m_watcher->addPath(m_responseFilePath)) {
-        qWarning() << "Failed to watch response file, using polling";
+    m_inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (m_inotifyFd >= 0) {
+        m_inotifyNotifier = new QSocketNotifier(m_inotifyFd, QSocketNotifier::Read, this);
+        connect(m_inotifyNotifier, &QSocketNotifier::activated, this, &FileIPC::onInotifyReadable);
+    }
+
+    if (!openResponseLog(&m_response)) {
+        qCWarning(fileIpc) << "Failed to open response file:" << m_responseFilePath << strerror(errno);
+        return false;
+    }
+    if (m_response.watch < 0) {
+        qCWarning(fileIpc) << "inotify unavailable, polling the response file every" << POLL_INTERVAL_MS << "ms";
         m_pollTimer->start();
     }
 
-    qDebug() << "FileIPC: Ready for file-based communication";
+    qCDebug(fileIpc) << "Ready for file-based communication";
     return true;
 }
 
-void FileIPC::onResponseFileChanged()
+bool FileIPC::replaceWithEmptyFile(const QString &path)
 {
+    // rename(2) swaps the name in one step, so readers and writers opening the
+    // path never see it missing or half-initialized
+    // mkostemp() creates a fresh 0600 file with O_EXCL, so nothing already at
+    // the temporary name (a planted file or symlink) is ever opened
+    const QByteArray target = QFile::encodeName(path);
+    QByteArray temporary = target + ".XXXXXX";
+    const int fd = ::mkostemp(temporary.data(), O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    ::close(fd);
+    if (::rename(temporary.constData(), target.constData()) != 0) {
+        ::unlink(temporary.constData());
+        return false;
+    }
+    return true;
+}
+
+bool FileIPC::openResponseLog(ResponseLog *log)
+{
+    const QByteArray path = QFile::encodeName(m_responseFilePath);
+    log->fd = ::open(path.constData(), O_RDONLY | O_CLOEXEC);
+    if (log->fd < 0) {
+        return false;
+    }
+    log->offset = 0;
+    log->partial.clear();
+
+    // Watches follow the inode, so a rotated-away log keeps its own watch
+    if (m_inotifyFd >= 0) {
+        log->watch = inotify_add_watch(m_inotifyFd, path.constData(), IN_MODIFY | IN_CLOSE_WRITE);
+    }
+    return true;
+}
+
+void FileIPC::closeResponseLog(ResponseLog *log)
+{
+    if (log->watch >= 0 && m_inotifyFd >= 0) {
+        inotify_rm_watch(m_inotifyFd, log->watch);
+    }
+    if (log->fd >= 0) {
+        ::close(log->fd);
+    }
+    *log = ResponseLog();
+}
+
+void FileIPC::onInotifyReadable()
+{
+    // Which log changed doesn't matter; draining both is a few pread() calls
+    alignas(struct inotify_event) char events[4096];
+    while (::read(m_inotifyFd, events, sizeof(events)) > 0) {
+    }
     checkForResponses();
 }
 
 void FileIPC::checkForResponses()
 {
-    QFile file(m_responseFilePath);
-    if (!file.open(QIODevice::ReadOnly)) {
+    if (m_retired.fd >= 0) {
+        drain(&m_retired);
+    }
+    drain(&m_response);
+
+    // Rotate only at a line boundary, so no line spans two generations
+    if (m_response.offset >= ROTATE_BYTES && m_response.partial.isEmpty() && m_retired.fd < 0) {
+        rotateResponseLog();
+    }
+}
+
+void FileIPC::drain(ResponseLog *log)
+{
+    if (log->fd < 0) {
         return;
     }
 
-    QTextStream stream(&file);
-    QString line;
-    while (stream.readLineInto(&line)) {
-        if (line.trimmed().isEmpty()) continue;
-        
-        QJsonParseError error;
-        QJsonDocument doc = QJsonDocument::fromJson(line.toUtf8(), &error);
-        if (error.error != QJsonParseError::NoError) {
-            qWarning() << "Failed to parse response JSON:" << error.errorString();
+    struct stat status;
+    if (::fstat(log->fd, &status) == 0 && status.st_size < log->offset) {
+        // A client truncated the log in place; what it wrote since is all new
+        qCWarning(fileIpc) << "Response file truncated by a client, reading from the start";
+        log->offset = 0;
+        log->partial.clear();
+    }
+
+    char buffer[4096];
+    for (;;) {
+        const ssize_t n = ::pread(log->fd, buffer, sizeof(buffer), log->offset);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            break;
+        }
+        log->offset += n;
+        log->partial.append(buffer, n);
+    }
+
+    qsizetype lineStart = 0;
+    qsizetype newline;
+    while ((newline = log->partial.indexOf('\n', lineStart)) != -1) {
+        const QByteArray line = log->partial.mid(lineStart, newline - lineStart).trimmed();
+        lineStart = newline + 1;
+        if (line.isEmpty()) {
             continue;
         }
 
+        QJsonParseError error;
+        const QJsonDocument doc = QJsonDocument::fromJson(line, &error);
+        if (error.error != QJsonParseError::NoError || !doc.isObject()) {
+            qCWarning(fileIpc) << "Failed to parse response JSON:" << error.errorString();
+            continue;
+        }
         handleResponse(doc.object());
     }
+    log->partial.remove(0, lineStart);
 
-    // Clear the response file after processing
-    file.close();
-    file.open(QIODevice::WriteOnly | QIODevice::Truncate);
-    file.close();
+    if (log->partial.size() > MAX_LINE_BYTES) {
+        qCWarning(fileIpc) << "Discarding unterminated response line over" << MAX_LINE_BYTES << "bytes";
+        log->partial.clear();
+    }
+}
+
+void FileIPC::rotateResponseLog()
+{
+    if (!replaceWithEmptyFile(m_responseFilePath)) {
+        qCWarning(fileIpc) << "Failed to rotate response file:" << strerror(errno);
+        return;
+    }
+
+    // Writers that opened the old inode before the rename may still append to it
+    m_retired = m_response;
+    m_response = ResponseLog();
+    if (!openResponseLog(&m_response)) {
+        qCWarning(fileIpc) << "Failed to reopen response file after rotation:" << strerror(errno);
+    }
+    m_retireTimer->start(RETIRE_GRACE_MS);
+    qCDebug(fileIpc) << "Rotated response file after" << m_retired.offset << "bytes";
+}
+
+void FileIPC::onRetireTimeout()
+{
+    drain(&m_retired);
+    closeResponseLog(&m_retired);
+}
+
+bool FileIPC::openRequestLog()
+{
+    if (!replaceWithEmptyFile(m_requestFilePath)) {
+        qCWarning(fileIpc) << "Failed to create request file:" << m_requestFilePath;
+        return false;
+    }
+    m_requestFile.setFileName(m_requestFilePath);
+    if (!m_requestFile.open(QIODevice::WriteOnly | QIODevice::Append | QIODevice::Unbuffered)) {
+        qCWarning(fileIpc) << "Failed to open request file:" << m_requestFile.errorString();
+        return false;
+    }
+    return true;
+}
+
+void FileIPC::rotateRequestLog()
+{
+    // Keep the full log reachable as .1 at every instant, then swap in a new one
+    const QByteArray current = QFile::encodeName(m_requestFilePath);
+    const QByteArray previous = current + ".1";
+    m_requestFile.close();
+    ::unlink(previous.constData());
+    if (::link(current.constData(), previous.constData()) != 0) {
+        qCWarning(fileIpc) << "Failed to keep rotated request file:" << strerror(errno);
+    }
+    if (!openRequestLog()) {
+        qCWarning(fileIpc) << "Request file unavailable after rotation";
+        return;
+    }
+    qCDebug(fileIpc) << "Rotated request file";
 }
 
 void FileIPC::onShowAuthDialog(const QString &actionId, const QString &message, const QString &iconName, const QString &cookie)
@@ -141,57 +305,76 @@ void FileIPC::onShowAuthDialog(const QString &actionId, const QString &message,
     request["icon_name"] = iconName;
     request["cookie"] = cookie;
 
-    qDebug() << "FileIPC: Writing auth dialog request";
+    qCDebug(fileIpc) << "Writing auth dialog request";
     writeRequest(request);
 }
 
-void FileIPC::onAuthorizationResult(bool authorized, const QString &actionId)
+void FileIPC::onAuthorizationResult(bool authorized, const QString &actionId, const QString &cookie)
 {
     QJsonObject request;
     request["type"] = "authorization_result";
     request["authorized"] = authorized;
     request["action_id"] = actionId;
+    request["cookie"] = cookie;
 
     writeRequest(request);
 }
 
-void FileIPC::onAuthorizationError(const QString &error)
+void FileIPC::onAuthorizationError(const QString &error, const QString &cookie)
 {
     QJsonObject request;
     request["type"] = "authorization_error";
     request["error"] = error;
+    request["cookie"] = cookie;
 
     writeRequest(request);
 }
 
 void FileIPC::writeRequest(const QJsonObject &message)
 {
-    QFile file(m_requestFilePath);
-    if (!file.open(QIODevice::WriteOnly | QIODevice::Append)) {
-        qWarning() << "Failed to open request file for writing";
+    if (!m_requestFile.isOpen()) {
+        qCWarning(fileIpc) << "Request file is not open, dropping" << message["type"].toString();
         return;
     }
 
-    QJsonDocument doc(message);
-    QTextStream stream(&file);
-    stream << doc.toJson(QJsonDocument::Compact) << "\n";
-    stream.flush();
-    file.close();
+    // One write(2) per line on an O_APPEND descriptor, so a line is never interleaved
+    const QByteArray line = QJsonDocument(message).toJson(QJsonDocument::Compact) + '\n';
+    if (m_requestFile.write(line) != line.size()) {
+        qCWarning(fileIpc) << "Failed to write request:" << m_requestFile.errorString();
+        return;
+    }
+    qCVerbose(fileIpc) << "Wrote request:" << message["type"].toString();
 
-    qDebug() << "FileIPC: Wrote request:" << doc.toJson(QJsonDocument::Compact);
+    if (m_requestFile.size() >= ROTATE_BYTES) {
+        rotateRequestLog();
+    }
 }
 
 void FileIPC::handleResponse(const QJsonObject &message)
 {
-    QString type = message["type"].toString();
-    qDebug() << "FileIPC: Handling response:" << type;
+    // Same schema as the socket; the file is just another untrusted client
+    const ValidationResult validation = MessageValidator::validateMessage(message);
+    if (!validation.valid) {
+        qCWarning(fileIpc) << "Invalid response:" << validation.error;
+        return;
+    }
+    qCDebug(fileIpc) << "Handling response:" << MessageValidator::messageTypeName(validation.type);
 
-    if (type == "submit_authentication") {
-        QString cookie = message["cookie"].toString();
-        QString response = message["response"].toString();
-        
-        if (m_polkitWrapper) {
-            m_polkitWrapper->submitAuthenticationResponse(cookie, response);
-        }
+    if (!m_polkitWrapper) {
+        return;
     }
-}
\ No newline at end of file
+
+    switch (validation.type) {
+    case MessageType::SubmitAuthentication:
+        m_polkitWrapper->submitAuthenticationResponse(message["cookie"].toString(),
+                                                      message["response"].toString());
+        break;
+    case MessageType::CancelAuthorization:
+        // An empty cookie cancels every session, as over the socket
+        m_polkitWrapper->cancelAuthorization(message["cookie"].toString());
+        break;
+    default:
+        qCDebug(fileIpc) << "Ignoring response type not supported over files";
+        break;
+    }
+}
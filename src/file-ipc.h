@@ -19,12 +19,38 @@
 #pragma once
 
 #include <QObject>
-#include <QFileSystemWatcher>
+#include <QByteArray>
+#include <QFile>
 #include <QTimer>
 #include <QJsonObject>
 
 class PolkitWrapper;
+class QSocketNotifier;
 
+/*
+ * File-based IPC for sandboxed clients that cannot use the socket
+ *
+ * Two append-only JSON-lines logs in $XDG_RUNTIME_DIR:
+ *
+ *   quickshell-polkit-requests   agent -> client (show_auth_dialog, results, errors)
+ *   quickshell-polkit-responses  client -> agent (submit_authentication, cancel_authorization)
+ *
+ * The request log stays open and each event is one appended line. Past
+ * ROTATE_BYTES it is rotated without a gap: the current log is hard-linked to
+ * "<name>.1" and an empty file is renamed over the name. A client reading by
+ * offset finishes the old inode when the name points at a new one.
+ *
+ * The response log is read from a remembered offset whenever inotify reports
+ * IN_MODIFY or IN_CLOSE_WRITE, so each wakeup reads only the new bytes. A
+ * trailing partial line waits for the next wakeup. Once everything before
+ * ROTATE_BYTES is consumed, an empty file is renamed over the log instead of
+ * truncating it. The old inode stays open for RETIRE_GRACE_MS to drain
+ * writers that still hold it, so no line is lost. Clients should open,
+ * append and close per message.
+ *
+ * Built with -DBUILD_FILE_IPC=ON and enabled at runtime with
+ * QUICKSHELL_POLKIT_FILE_IPC=1.
+ */
 class FileIPC : public QObject
 {
     Q_OBJECT
@@ -35,22 +61,54 @@ public:
 
     bool initialize();
 
+    QString requestFilePath() const { return m_requestFilePath; }
+    QString responseFilePath() const { return m_responseFilePath; }
+
+    static constexpr qint64 ROTATE_BYTES = 64 * 1024;
+    static constexpr qsizetype MAX_LINE_BYTES = 64 * 1024;  // Longer partial lines are discarded
+    static constexpr int RETIRE_GRACE_MS = 1000;
+    static constexpr int POLL_INTERVAL_MS = 1000;           // Only when inotify is unavailable
+
 private slots:
-    void onResponseFileChanged();
+    void onInotifyReadable();
     void checkForResponses();
+    void onRetireTimeout();
     
     // Slots for polkit wrapper signals
     void onShowAuthDialog(const QString &actionId, const QString &message, const QString &iconName, const QString &cookie);
-    void onAuthorizationResult(bool authorized, const QString &actionId);
-    void onAuthorizationError(const QString &error);
+    void onAuthorizationResult(bool authorized, const QString &actionId, const QString &cookie);
+    void onAuthorizationError(const QString &error, const QString &cookie);
 
 private:
+    // One generation of the response log, read by offset
+    struct ResponseLog {
+        int fd = -1;
+        int watch = -1;       // inotify watch descriptor for this inode
+        qint64 offset = 0;    // Bytes consumed so far
+        QByteArray partial;   // Bytes after the last '\n'
+    };
+
+    bool openResponseLog(ResponseLog *log);
+    void closeResponseLog(ResponseLog *log);
+    void drain(ResponseLog *log);
+    void rotateResponseLog();
+
+    bool openRequestLog();
+    void rotateRequestLog();
     void writeRequest(const QJsonObject &message);
     void handleResponse(const QJsonObject &message);
 
+    // Atomically replace path with an empty 0600 file
+    static bool replaceWithEmptyFile(const QString &path);
+
     QString m_requestFilePath;
     QString m_responseFilePath;
-    QFileSystemWatcher *m_watcher;
+    QFile m_requestFile;       // Open for appends for the lifetime of the transport
+    ResponseLog m_response;
+    ResponseLog m_retired;     // Replaced by rotation, drained until the grace period ends
+    int m_inotifyFd;
+    QSocketNotifier *m_inotifyNotifier;
     QTimer *m_pollTimer;
+    QTimer *m_retireTimer;
     PolkitWrapper *m_polkitWrapper;
-};
\ No newline at end of file
+};
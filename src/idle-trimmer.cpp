@@ -0,0 +1,175 @@
+/*
+ * quickshell-polkit-agent
+ * Copyright (C) 2025 Benny Powers
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "idle-trimmer.h"
+#include "logging.h"
+#include "metrics.h"
+
+#include <QCoreApplication>
+#include <QFile>
+
+#include <unistd.h>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+IdleTrimmer::IdleTrimmer(QObject *parent)
+    : QObject(parent)
+    , m_quietPeriodMs(0)
+    , m_busy(0)
+    , m_trimmed(false)
+    , m_countdown(0)
+{
+}
+
+IdleTrimmer *IdleTrimmer::instance()
+{
+    static QPointer<IdleTrimmer> trimmer;
+    if (!trimmer) {
+        trimmer = new IdleTrimmer(QCoreApplication::instance());
+    }
+    return trimmer;
+}
+
+qint64 IdleTrimmer::quietPeriodFromEnvironment()
+{
+    const QString value = qEnvironmentVariable("QUICKSHELL_POLKIT_IDLE_TRIM");
+    if (value.isEmpty()) {
+        return DEFAULT_QUIET_PERIOD_MS;
+    }
+    bool ok = false;
+    const qint64 seconds = value.toLongLong(&ok);
+    if (!ok || seconds < 0) {
+        qCWarning(polkitAgent) << "Ignoring invalid QUICKSHELL_POLKIT_IDLE_TRIM:" << value;
+        return DEFAULT_QUIET_PERIOD_MS;
+    }
+    return seconds * 1000;
+}
+
+void IdleTrimmer::setQuietPeriod(qint64 ms)
+{
+    m_quietPeriodMs = qMax<qint64>(ms, 0);
+    DeadlineScheduler::instance()->cancel(m_countdown);
+    m_countdown = 0;
+    if (m_busy == 0 && !m_trimmed) {
+        arm();
+    }
+}
+
+void IdleTrimmer::addHooks(QObject *context, Hook trim, Hook wake)
+{
+    m_hooks.push_back(Hooks{context, std::move(trim), std::move(wake)});
+}
+
+void IdleTrimmer::acquire()
+{
+    if (m_busy++ == 0) {
+        DeadlineScheduler::instance()->cancel(m_countdown);
+        m_countdown = 0;
+        if (m_trimmed) {
+            wake();
+        }
+    }
+}
+
+void IdleTrimmer::release()
+{
+    if (m_busy == 0) {
+        qCWarning(polkitAgent) << "IdleTrimmer released more often than acquired";
+        return;
+    }
+    if (--m_busy == 0) {
+        arm();
+    }
+}
+
+bool IdleTrimmer::isCountingDown() const
+{
+    return DeadlineScheduler::instance()->isScheduled(m_countdown);
+}
+
+void IdleTrimmer::arm()
+{
+    if (m_quietPeriodMs <= 0) {
+        return;
+    }
+    DeadlineScheduler *scheduler = DeadlineScheduler::instance();
+    if (scheduler->isScheduled(m_countdown)) {
+        scheduler->reschedule(m_countdown, m_quietPeriodMs);
+    } else {
+        m_countdown = scheduler->schedule(this, m_quietPeriodMs, [this]() {
+            m_countdown = 0;
+            trim();
+        });
+    }
+}
+
+bool IdleTrimmer::trim()
+{
+    if (m_busy > 0 || m_trimmed) {
+        return false;
+    }
+    DeadlineScheduler::instance()->cancel(m_countdown);
+    m_countdown = 0;
+
+    const qint64 before = residentKb();
+    for (const Hooks &hooks : m_hooks) {
+        if (hooks.context && hooks.trim) {
+            hooks.trim();
+        }
+    }
+#ifdef __GLIBC__
+    malloc_trim(0);
+#endif
+    const qint64 after = residentKb();
+
+    m_trimmed = true;
+    Metrics::increment(Metrics::Counter::IdleTrims);
+    qCInfo(polkitAgent) << "Idle: released caches, RSS" << before << "KiB ->" << after << "KiB";
+    emit trimmed(before, after);
+    return true;
+}
+
+void IdleTrimmer::wake()
+{
+    m_trimmed = false;
+    for (const Hooks &hooks : m_hooks) {
+        if (hooks.context && hooks.wake) {
+            hooks.wake();
+        }
+    }
+    qCDebug(polkitAgent) << "Leaving idle mode";
+    emit woken();
+}
+
+qint64 IdleTrimmer::residentKb()
+{
+    // "size resident shared ..." in pages
+    QFile statm(QStringLiteral("/proc/self/statm"));
+    if (!statm.open(QIODevice::ReadOnly)) {
+        return -1;
+    }
+    const QList<QByteArray> fields = statm.readAll().split(' ');
+    bool ok = false;
+    const qint64 pages = fields.size() > 1 ? fields.at(1).toLongLong(&ok) : 0;
+    const long pageSize = sysconf(_SC_PAGESIZE);
+    if (!ok || pageSize <= 0) {
+        return -1;
+    }
+    return pages * pageSize / 1024;
+}
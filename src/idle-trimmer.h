@@ -0,0 +1,105 @@
+/*
+ * quickshell-polkit-agent
+ * Copyright (C) 2025 Benny Powers
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <QObject>
+#include <QPointer>
+
+#include <functional>
+#include <vector>
+
+#include "deadline-scheduler.h"
+
+/*
+ * Memory trim after a quiet period
+ *
+ * Most of the day the agent has no client and no authentication session.
+ * Connections and sessions each hold the trimmer busy; once the last one
+ * has been gone for the quiet period, every registered trim hook releases
+ * what it can rebuild (the event history, spare table capacity), periodic
+ * timers stop, and malloc_trim() hands the freed heap back to the kernel.
+ * Resident set size is logged before and after.
+ *
+ * The next acquire() runs the wake hooks before returning, so the
+ * connection or authentication that woke the agent is served by the same
+ * code path as ever. Wake hooks only restart timers; nothing on that path
+ * blocks. Anything the waking request reads at once, such as the action
+ * index, is not trimmed.
+ *
+ * The quiet period comes from QUICKSHELL_POLKIT_IDLE_TRIM (seconds, 0
+ * disables). A trimmer without a quiet period never trims.
+ */
+class IdleTrimmer : public QObject
+{
+    Q_OBJECT
+
+public:
+    using Hook = std::function<void()>;
+
+    explicit IdleTrimmer(QObject *parent = nullptr);
+
+    // Process-wide trimmer shared by IPCServer and PolkitWrapper
+    static IdleTrimmer *instance();
+
+    // QUICKSHELL_POLKIT_IDLE_TRIM in seconds, DEFAULT_QUIET_PERIOD_MS if unset
+    static qint64 quietPeriodFromEnvironment();
+
+    // 0 disables trimming; otherwise the countdown starts if nothing is busy
+    void setQuietPeriod(qint64 ms);
+    qint64 quietPeriod() const { return m_quietPeriodMs; }
+
+    // Hooks are skipped once their context object is destroyed
+    void addHooks(QObject *context, Hook trim, Hook wake);
+
+    // A client connection or authentication session began or ended
+    void acquire();
+    void release();
+
+    int busyCount() const { return m_busy; }
+    bool isTrimmed() const { return m_trimmed; }
+    bool isCountingDown() const;
+
+    // Trim immediately if nothing is busy; false if it did not
+    bool trim();
+
+    // Current resident set size from /proc/self/statm, -1 if unavailable
+    static qint64 residentKb();
+
+    static constexpr qint64 DEFAULT_QUIET_PERIOD_MS = 5 * 60 * 1000;
+
+signals:
+    void trimmed(qint64 rssBeforeKb, qint64 rssAfterKb);
+    void woken();
+
+private:
+    struct Hooks {
+        QPointer<QObject> context;
+        Hook trim;
+        Hook wake;
+    };
+
+    void arm();
+    void wake();
+
+    std::vector<Hooks> m_hooks;
+    qint64 m_quietPeriodMs;
+    int m_busy;
+    bool m_trimmed;
+    DeadlineScheduler::TimerId m_countdown;
+};
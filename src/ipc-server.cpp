@@ -22,27 +22,91 @@
 #include "security.h"
 #include <QJsonDocument>
 #include <QJsonObject>
+#include <QJsonArray>
 #include <QDebug>
+#include "idle-trimmer.h"
 #include "logging.h"
+#include "latency-tracer.h"
+#include "metrics.h"
+#include "tracing.h"
 #include <QStandardPaths>
 #include <QDir>
 #include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
 #include <QTimer>
 #include <QDateTime>
+#include <QDeadlineTimer>
+#include <iterator>
+#include <utility>
+#include <fcntl.h>
 #include <unistd.h>
 
 IPCServer::IPCServer(PolkitWrapper *polkitWrapper, QObject *parent)
     : QObject(parent)
     , m_server(new QLocalServer(this))
-    , m_currentClient(nullptr)
-    , m_polkitWrapper(polkitWrapper)
-    , m_rateLimitTimer(new QTimer(this))
-    , m_heartbeatTimer(new QTimer(this))
-    , m_lastHeartbeat(0)
-    , m_clientConnectionVersion(0)
-    , m_sessionStartTime(0)
-    , m_sessionTimeoutTimer(new QTimer(this))
+    , m_socketActivated(false)
+    , m_polkitWrapper(nullptr)
+    , m_flushTimer(new QTimer(this))
+    , m_metricsTimer(nullptr)
+    , m_rateLimitedFrames(0)
+    , m_oversizedFrames(0)
+    , m_peerPolicy(PeerPolicy::fromEnvironment())
+    , m_connectionCounter(0)
 {
+    if (polkitWrapper) {
+        attachPolkitWrapper(polkitWrapper);
+    }
+    
+    // Connect server signals
+    connect(m_server, &QLocalServer::newConnection,
+            this, &IPCServer::onNewConnection);
+    
+    // Outgoing frames are written once per event-loop iteration
+    connect(m_flushTimer, &QTimer::timeout,
+            this, &IPCServer::onFlushTimeout);
+    m_flushTimer->setSingleShot(true);
+    m_flushTimer->setInterval(0);
+    
+    // Heartbeat and session deadlines are per client, on DeadlineScheduler
+    
+    // With no client left the history and spare capacity can go; the
+    // listening socket stays, and the next connection wakes us
+    IdleTrimmer::instance()->addHooks(this, [this]() {
+        m_eventLog.release();
+        m_outbox.squeeze();
+        m_clients.squeeze();
+        m_pendingFlush.squeeze();
+        if (m_metricsTimer) {
+            writeMetricsFile();  // Nothing changes while idle; leave a current file behind
+            m_metricsTimer->stop();
+        }
+    }, [this]() {
+        if (m_metricsTimer) {
+            m_metricsTimer->start();
+        }
+    });
+}
+
+IPCServer::~IPCServer()
+{
+    if (m_socketActivated) {
+        // The socket path belongs to the .socket unit and QLocalServer::close()
+        // would unlink it, breaking activation of the next instance. We are
+        // shutting down, so leave the server to be reclaimed with the process.
+        m_server->setParent(nullptr);
+        return;
+    }
+    
+    if (m_server->isListening()) {
+        m_server->close();
+    }
+}
+
+void IPCServer::attachPolkitWrapper(PolkitWrapper *polkitWrapper)
+{
+    m_polkitWrapper = polkitWrapper;
+    
     // Connect polkit wrapper signals
     connect(m_polkitWrapper, &PolkitWrapper::showAuthDialog,
             this, &IPCServer::onShowAuthDialog);
@@ -52,33 +116,60 @@ IPCServer::IPCServer(PolkitWrapper *polkitWrapper, QObject *parent)
             this, &IPCServer::onAuthorizationError);
     connect(m_polkitWrapper, &PolkitWrapper::showPasswordRequest,
             this, &IPCServer::onShowPasswordRequest);
+    connect(m_polkitWrapper, &PolkitWrapper::securityKeyPresenceChanged,
+            this, &IPCServer::onSecurityKeyPresenceChanged);
+    connect(m_polkitWrapper, &PolkitWrapper::authMessageUpdated,
+            this, &IPCServer::onAuthMessageUpdated);
     
-    // Connect server signals
-    connect(m_server, &QLocalServer::newConnection,
-            this, &IPCServer::onNewConnection);
-    
-    // Setup heartbeat timer
-    connect(m_heartbeatTimer, &QTimer::timeout,
-            this, &IPCServer::onHeartbeatTimeout);
-    m_heartbeatTimer->setSingleShot(false);
-    m_heartbeatTimer->setInterval(HEARTBEAT_INTERVAL_MS);
-    
-    // Setup session timeout timer
-    connect(m_sessionTimeoutTimer, &QTimer::timeout,
-            this, &IPCServer::onSessionTimeout);
-    m_sessionTimeoutTimer->setSingleShot(false);
-    m_sessionTimeoutTimer->setInterval(SecurityManager::SESSION_TIMEOUT_MS);
+    // Clients that connected before the agent was ready haven't seen this yet
+    if (!m_clients.isEmpty()) {
+        onSecurityKeyPresenceChanged(m_polkitWrapper->securityKeyPresent());
+    }
 }
 
-IPCServer::~IPCServer()
+int IPCServer::takeSystemdListenFd()
 {
-    if (m_server->isListening()) {
-        m_server->close();
+    // sd_listen_fds(3) protocol, implemented directly to avoid a libsystemd dependency
+    bool ok = false;
+    const qint64 listenPid = qEnvironmentVariable("LISTEN_PID").toLongLong(&ok);
+    if (!ok || listenPid != getpid()) {
+        return -1;
+    }
+    
+    const int listenFds = qEnvironmentVariable("LISTEN_FDS").toInt(&ok);
+    
+    // The fds are ours now; don't let child processes think they were activated
+    qunsetenv("LISTEN_PID");
+    qunsetenv("LISTEN_FDS");
+    qunsetenv("LISTEN_FDNAMES");
+    
+    if (!ok || listenFds < 1) {
+        return -1;
+    }
+    if (listenFds > 1) {
+        qCWarning(ipcServer) << "systemd passed" << listenFds << "sockets, using the first";
     }
+    
+    constexpr int SD_LISTEN_FDS_START = 3;
+    fcntl(SD_LISTEN_FDS_START, F_SETFD, FD_CLOEXEC);
+    return SD_LISTEN_FDS_START;
 }
 
 bool IPCServer::startServer()
 {
+    // Socket activation: the path already exists and accepts connections
+    const int listenFd = takeSystemdListenFd();
+    if (listenFd >= 0) {
+        if (!m_server->listen(static_cast<qintptr>(listenFd))) {
+            qCritical() << "Failed to adopt systemd socket:" << m_server->errorString();
+            return false;
+        }
+        m_socketActivated = true;
+        qCDebug(ipcServer) << "IPC server adopted systemd socket:" << m_server->fullServerName();
+        startMetricsExport();
+        return true;
+    }
+    
     // Check for custom socket path in environment (for testing)
     QString customSocketPath = qEnvironmentVariable("QUICKSHELL_POLKIT_SOCKET");
     QString fullSocketPath;
@@ -132,104 +223,373 @@ bool IPCServer::startServer()
     }
     
     qCDebug(ipcServer) << "IPC server listening on:" << fullSocketPath;
+    startMetricsExport();
     return true;
 }
 
-void IPCServer::onNewConnection()
+/*
+ * Periodic Prometheus text file for node_exporter's textfile collector
+ *
+ * Written next to the socket (RUNTIME_DIRECTORY under systemd) through
+ * QSaveFile, so a scraper never reads a half-written file.
+ */
+void IPCServer::startMetricsExport()
 {
-    if (m_currentClient) {
-        // Only allow one client for now
-        auto newClient = m_server->nextPendingConnection();
-        qCDebug(ipcServer) << "Rejecting additional client connection";
-        newClient->close();
-        newClient->deleteLater();
+    if (!Metrics::isEnabled() || m_metricsTimer) {
         return;
     }
     
-    m_currentClient = m_server->nextPendingConnection();
-    
-    connect(m_currentClient, &QLocalSocket::disconnected,
-            this, &IPCServer::onClientDisconnected);
-    connect(m_currentClient, &QLocalSocket::readyRead,
-            this, &IPCServer::onClientDataReady);
-    connect(m_currentClient, QOverload<QLocalSocket::LocalSocketError>::of(&QLocalSocket::errorOccurred),
-            [this](QLocalSocket::LocalSocketError error) {
-                qCDebug(ipcServer) << "Client socket error:" << error;
-            });
+    QString directory = qEnvironmentVariable("RUNTIME_DIRECTORY");
+    if (directory.isEmpty() && !m_server->fullServerName().isEmpty()) {
+        directory = QFileInfo(m_server->fullServerName()).absolutePath();
+    }
+    if (directory.isEmpty()) {
+        qCWarning(ipcServer) << "No runtime directory for the metrics file; get_stats only";
+        return;
+    }
     
-    qCDebug(ipcServer) << "Quickshell client connected, state:" << m_currentClient->state();
+    m_metricsPath = directory + "/metrics.prom";
+    m_metricsTimer = new QTimer(this);
+    connect(m_metricsTimer, &QTimer::timeout, this, &IPCServer::writeMetricsFile);
+    m_metricsTimer->start(METRICS_WRITE_INTERVAL_MS);
+    writeMetricsFile();
+    qCDebug(ipcServer) << "Writing metrics to" << m_metricsPath << "every" << METRICS_WRITE_INTERVAL_MS << "ms";
+}
+
+void IPCServer::writeMetricsFile()
+{
+    QSaveFile file(m_metricsPath);
+    if (!file.open(QIODevice::WriteOnly)) {
+        qCWarning(ipcServer) << "Cannot write metrics file" << m_metricsPath << file.errorString();
+        return;
+    }
+    file.write(Metrics::toPrometheus(metricsGauges()));
+    if (!file.commit()) {
+        qCWarning(ipcServer) << "Failed to replace metrics file" << m_metricsPath << file.errorString();
+    }
+}
+
+Metrics::Gauges IPCServer::metricsGauges() const
+{
+    Metrics::Gauges gauges;
+    gauges.clients = int(m_clients.size());
+    gauges.replaySessions = m_outbox.sessionCount();
+    for (const ClientConnection *client : m_clients) {
+        gauges.outputBytesPending += client->outputBuffer.size() + client->socket->bytesToWrite();
+    }
     
-    // Increment connection version to detect client restarts
-    m_clientConnectionVersion++;
-    m_lastHeartbeat = QDateTime::currentMSecsSinceEpoch();
-    m_sessionStartTime = SecurityManager::getCurrentTimestamp();
+    if (m_polkitWrapper) {
+        // Every state is reported, so a scraper sees zeros instead of missing series
+        constexpr AuthenticationState states[] = {
+            AuthenticationState::IDLE, AuthenticationState::INITIATED,
+            AuthenticationState::WAITING_FOR_PASSWORD, AuthenticationState::AUTHENTICATING,
+            AuthenticationState::AUTHENTICATION_FAILED, AuthenticationState::MAX_RETRIES_EXCEEDED,
+            AuthenticationState::COMPLETED, AuthenticationState::CANCELLED, AuthenticationState::ERROR,
+        };
+        int counts[std::size(states)] = {};
+        for (const SessionSnapshot &session : m_polkitWrapper->sessionSnapshots()) {
+            counts[static_cast<int>(session.state)]++;
+        }
+        for (AuthenticationState state : states) {
+            gauges.sessionsByState.append({PolkitWrapper::stateToString(state), counts[static_cast<int>(state)]});
+        }
+    }
+    return gauges;
+}
+
+void IPCServer::onNewConnection()
+{
+    while (m_server->hasPendingConnections()) {
+        QLocalSocket *socket = m_server->nextPendingConnection();
+        
+        // One syscall per connection establishes who the peer is; the
+        // decision is cached on the connection for every later frame
+        PeerCredentials peer = PeerCredentials::fromSocket(socket->socketDescriptor());
+        const PeerPolicy::Decision trust = m_peerPolicy.evaluate(peer);
+        if (trust == PeerPolicy::Decision::Denied) {
+            qCWarning(ipcServer) << "Refusing client connection:" << peer.describe();
+            SecurityManager::auditLog("CLIENT_REJECTED", peer.describe(), "DENIED");
+            Metrics::increment(Metrics::Counter::PeersDenied);
+            socket->abort();
+            socket->deleteLater();
+            continue;
+        }
+        
+        IdleTrimmer::instance()->acquire();
+        ClientConnection *client = new ClientConnection(socket);
+        client->peer = std::move(peer);
+        client->trust = trust;
+        m_clients.insert(socket, client);
+        
+        connect(socket, &QLocalSocket::disconnected,
+                this, &IPCServer::onClientDisconnected);
+        connect(socket, &QLocalSocket::readyRead,
+                this, &IPCServer::onClientDataReady);
+        connect(socket, QOverload<QLocalSocket::LocalSocketError>::of(&QLocalSocket::errorOccurred),
+                this, [](QLocalSocket::LocalSocketError error) {
+                    qCDebug(ipcServer) << "Client socket error:" << error;
+                });
+        
+        // Each connection gets its own version so clients can detect restarts
+        client->connectionVersion = ++m_connectionCounter;
+        Metrics::increment(Metrics::Counter::Connections);
+        client->lastHeartbeat = QDateTime::currentMSecsSinceEpoch();
+        client->sessionStartTime = SecurityManager::getCurrentTimestamp();
+        
+        qCDebug(ipcServer) << "Quickshell client connected, version:" << client->connectionVersion
+                           << client->peer.describe() << PeerPolicy::decisionName(trust)
+                           << "clients:" << m_clients.size();
+        TRACEPOINT(client_connected, client->connectionVersion, int(m_clients.size()));
+        
+        // Deadlines are tied to the connection object, so they can never
+        // fire for a client that is already gone
+        DeadlineScheduler *scheduler = DeadlineScheduler::instance();
+        client->heartbeatDeadline = scheduler->schedule(client, CONNECTION_TIMEOUT_MS,
+                                                        [this, client]() { onHeartbeatExpired(client); });
+        client->sessionDeadline = scheduler->schedule(client, SecurityManager::SESSION_TIMEOUT_MS,
+                                                      [this, client]() { onSessionExpired(client); });
+        
+        SecurityManager::auditLog("CLIENT_CONNECTED", QString("version=%1 %2 %3")
+                                  .arg(client->connectionVersion)
+                                  .arg(client->peer.describe(), QLatin1String(PeerPolicy::decisionName(trust))),
+                                  "SUCCESS");
+        
+        // Send welcome message with connection version
+        QJsonObject welcome;
+        welcome["type"] = "welcome";
+        welcome["message"] = "Connected to quickshell-polkit-agent";
+        welcome["connection_version"] = client->connectionVersion;
+        welcome["encodings"] = QJsonArray::fromStringList(WireFormat::supportedEncodings());
+        welcome["log_seq"] = static_cast<double>(m_eventLog.lastSeq());  // Not event_seq, which clients filter as an event
+        welcome["event_epoch"] = m_eventLog.epoch();
+        if (m_polkitWrapper) {
+            welcome["security_key_present"] = m_polkitWrapper->securityKeyPresent();
+        }
+        sendMessageToClient(client, welcome);
+        
+        // Replay anything queued while no client was connected
+        replayQueuedMessages(client);
+    }
+}
+
+void IPCServer::onClientDisconnected()
+{
+    QLocalSocket *socket = qobject_cast<QLocalSocket *>(sender());
+    ClientConnection *client = m_clients.take(socket);
+    if (!client) {
+        return;
+    }
     
-    // Start heartbeat and session monitoring
-    startHeartbeat();
-    m_sessionTimeoutTimer->start();
+    qCDebug(ipcServer) << "Quickshell client disconnected, version:" << client->connectionVersion
+                       << "error:" << socket->errorString();
+    TRACEPOINT(client_disconnected, client->connectionVersion, int(m_clients.size()));
     
-    SecurityManager::auditLog("CLIENT_CONNECTED", QString("version=%1").arg(m_clientConnectionVersion), "SUCCESS");
+    // Releases the ClientConnection too; deferred so in-flight handlers stay valid
+    m_pendingFlush.remove(socket);
+    socket->deleteLater();
     
-    // Send welcome message with connection version
-    QJsonObject welcome;
-    welcome["type"] = "welcome";
-    welcome["message"] = "Connected to quickshell-polkit-agent";
-    welcome["connection_version"] = m_clientConnectionVersion;
-    sendMessageToClient(welcome);
+    DeadlineScheduler::instance()->cancel(client->heartbeatDeadline);
+    DeadlineScheduler::instance()->cancel(client->sessionDeadline);
+    IdleTrimmer::instance()->release();
     
-    // Replay any queued messages
-    replayQueuedMessages();
+    SecurityManager::auditLog("CLIENT_DISCONNECTED", QString("version=%1 shed=%2 oversized=%3")
+                              .arg(client->connectionVersion)
+                              .arg(client->rateLimiter.totalShed())
+                              .arg(client->oversizedFrames), "SUCCESS");
+    qCDebug(ipcServer) << "Client connection cleaned up," << m_clients.size() << "clients remaining";
 }
 
-void IPCServer::onClientDisconnected()
+void IPCServer::onClientDataReady()
 {
-    if (m_currentClient) {
-        qCDebug(ipcServer) << "Quickshell client disconnected, error:" << m_currentClient->errorString();
-        m_currentClient->deleteLater();
-        m_currentClient = nullptr;
+    QLocalSocket *socket = qobject_cast<QLocalSocket *>(sender());
+    ClientConnection *client = m_clients.value(socket);
+    if (!client) return;
+    
+    const QByteArray received = socket->readAll();
+    Metrics::increment(Metrics::Counter::BytesIn, quint64(received.size()));
+    client->receiveBuffer.append(received);
+    
+    // Every complete frame is handled in this pass. JSON frames are split on the
+    // same '\n' framing we use for outgoing messages; receiveScanOffset remembers
+    // how much of a trailing partial frame was already searched so it is never
+    // re-scanned. CBOR items are self-delimiting and are decoded in place. The
+    // encoding is checked per frame because select_encoding switches it mid-stream.
+    QByteArray &buffer = client->receiveBuffer;
+    qsizetype frameStart = 0;
+    while (frameStart < buffer.size()) {
+        if (client->encoding == WireEncoding::Cbor) {
+            QJsonObject message;
+            qsizetype consumed = 0;
+            QString error;
+            WireFormat::DecodeStatus status = WireFormat::decodeCbor(buffer, frameStart, &message, &consumed, &error);
+            
+            if (status == WireFormat::DecodeStatus::Incomplete) {
+                break;
+            }
+            if (status == WireFormat::DecodeStatus::Invalid) {
+                // A CBOR sequence has no resynchronization point, so the stream is lost
+                qCWarning(ipcServer) << "Invalid CBOR from client:" << error;
+                SecurityManager::auditLog("MESSAGE_VALIDATION", "Invalid CBOR frame", "DISCONNECTED");
+                sendErrorToClient(client, "Invalid CBOR frame");
+                flushClient(client);
+                socket->disconnectFromServer();
+                return;
+            }
+            
+            const QByteArrayView frame(buffer.constData() + frameStart, consumed);
+            frameStart += consumed;
+            
+            // CBOR has no cheap way to find the type before decoding, but the
+            // binary decode is far cheaper than validation and dispatch
+            if (consumed > MAX_FRAME_SIZE) {
+                rejectOversizedFrame(client);
+            } else {
+                const RateLimiter::MessageClass messageClass =
+                    RateLimiter::classify(message.value("type").toString().toLatin1());
+                if (admitFrame(client, messageClass)) {
+                    handleClientMessage(client, message, frame, messageClass);
+                }
+            }
+        } else {
+            qsizetype newline = buffer.indexOf('\n', qMax(client->receiveScanOffset, frameStart));
+            if (newline == -1) {
+                break;
+            }
+            
+            // Reference the frame in place rather than copying it out of the buffer
+            const QByteArray frame = QByteArray::fromRawData(buffer.constData() + frameStart,
+                                                             newline - frameStart);
+            frameStart = newline + 1;
+            
+            if (client->discardingOversizedFrame) {
+                // Tail of a frame we already rejected
+                client->discardingOversizedFrame = false;
+                continue;
+            }
+            
+            // Shed from the raw bytes so a flooding client never costs us a parse
+            if (frame.size() > MAX_FRAME_SIZE) {
+                rejectOversizedFrame(client);
+                continue;
+            }
+            const RateLimiter::MessageClass messageClass = RateLimiter::classify(WireFormat::peekMessageType(frame));
+            if (!admitFrame(client, messageClass)) {
+                continue;
+            }
+            
+            processFrame(client, frame, messageClass);
+        }
         
-        // Stop heartbeat and session monitoring
-        stopHeartbeat();
-        m_sessionTimeoutTimer->stop();
+        // Handling a frame can disconnect the client (e.g. session expiry);
+        // its state is released with the socket, so stop processing input
+        if (!m_clients.contains(socket)) {
+            return;
+        }
+    }
+    
+    // Keep only the incomplete trailing frame
+    if (frameStart > 0) {
+        buffer.remove(0, frameStart);
+    }
+    client->receiveScanOffset = buffer.size();
+    
+    // Bound memory for a client that never completes a frame
+    if (buffer.size() > MAX_FRAME_SIZE) {
+        buffer.clear();
+        client->receiveScanOffset = 0;
+        rejectOversizedFrame(client);
         
-        SecurityManager::auditLog("CLIENT_DISCONNECTED", "Session ended", "SUCCESS");
-        qCDebug(ipcServer) << "Client connection cleaned up, ready for reconnection";
+        if (client->encoding == WireEncoding::Cbor) {
+            // No delimiter to skip to; the rest of the stream is unusable
+            flushClient(client);
+            socket->disconnectFromServer();
+            return;
+        }
+        client->discardingOversizedFrame = true;
     }
 }
 
-void IPCServer::onClientDataReady()
+bool IPCServer::admitFrame(ClientConnection *client, RateLimiter::MessageClass messageClass)
 {
-    if (!m_currentClient) return;
+    RateLimiter &limiter = client->rateLimiter;
+    const bool wasLimited = limiter.isLimited(messageClass);
     
-    QByteArray data = m_currentClient->readAll();
-    QJsonParseError error;
-    QJsonDocument doc = QJsonDocument::fromJson(data, &error);
+    if (limiter.admit(messageClass, QDeadlineTimer::current().deadline())) {
+        if (wasLimited) {
+            qCInfo(ipcServer) << "Client" << client->connectionVersion << RateLimiter::className(messageClass)
+                              << "traffic back under budget," << limiter.shedCount(messageClass) << "frames shed so far";
+        }
+        return true;
+    }
+    
+    ++m_rateLimitedFrames;
+    Metrics::messageRateLimited(messageClass);
+    
+    // Report once per overload episode; the rest are only counted
+    if (!wasLimited) {
+        qCWarning(ipcServer) << "Rate limit exceeded for" << RateLimiter::className(messageClass)
+                             << "messages from client" << client->connectionVersion;
+        sendErrorToClient(client, "Rate limit exceeded");
+        SecurityManager::auditLog("RATE_LIMIT", QString("Client exceeded %1 message rate limit")
+                                  .arg(RateLimiter::className(messageClass)), "BLOCKED");
+    }
+    return false;
+}
+
+void IPCServer::rejectOversizedFrame(ClientConnection *client)
+{
+    ++client->oversizedFrames;
+    ++m_oversizedFrames;
+    Metrics::increment(Metrics::Counter::OversizedFrames);
     
-    if (error.error != QJsonParseError::NoError) {
-        qCWarning(ipcServer) << "Invalid JSON from client:" << error.errorString();
+    qCWarning(ipcServer) << "Client frame exceeds" << MAX_FRAME_SIZE << "bytes, discarding";
+    SecurityManager::auditLog("MESSAGE_VALIDATION", QString("Frame exceeds %1 bytes").arg(MAX_FRAME_SIZE), "REJECTED");
+    sendErrorToClient(client, "Message too large");
+}
+
+void IPCServer::processFrame(ClientConnection *client, const QByteArray &frame,
+                             RateLimiter::MessageClass chargedClass)
+{
+    // Tolerate blank lines (and the '\r' of CRLF-terminated ones) between frames
+    bool blank = true;
+    for (char c : frame) {
+        if (c != ' ' && c != '\t' && c != '\r') {
+            blank = false;
+            break;
+        }
+    }
+    if (blank) {
         return;
     }
     
-    handleClientMessage(doc.object());
+    QJsonObject message;
+    QString error;
+    if (WireFormat::decodeJson(frame, &message, &error) != WireFormat::DecodeStatus::Complete) {
+        qCWarning(ipcServer) << "Invalid JSON from client:" << error;
+        Metrics::messageRejected(MessageType::Unknown);
+        return;
+    }
+    
+    handleClientMessage(client, message, frame, chargedClass);
 }
 
-void IPCServer::handleClientMessage(const QJsonObject &message)
+void IPCServer::handleClientMessage(ClientConnection *client, const QJsonObject &message, QByteArrayView frame,
+                                    RateLimiter::MessageClass chargedClass)
 {
-    // Check rate limiting first
-    if (!checkRateLimit()) {
-        qCWarning(ipcServer) << "Rate limit exceeded, dropping message";
-        sendErrorToClient("Rate limit exceeded");
-        SecurityManager::auditLog("RATE_LIMIT", "Client exceeded message rate limit", "BLOCKED");
+    // Rate limits were applied to the raw frame before parsing (admitFrame).
+    // The peek reads the first "type" key but the parsed object keeps the
+    // last, so a frame with duplicate keys (or a type the peek could not
+    // find) is also charged to the class it is actually handled as.
+    const RateLimiter::MessageClass handledClass = RateLimiter::classify(message.value("type").toString().toLatin1());
+    if (handledClass != chargedClass && !admitFrame(client, handledClass)) {
         return;
     }
     
     // Check session timeout
-    if (SecurityManager::isSessionExpired(m_sessionStartTime)) {
+    if (SecurityManager::isSessionExpired(client->sessionStartTime)) {
         qCWarning(ipcServer) << "Session expired, disconnecting client";
         SecurityManager::auditLog("SESSION_EXPIRED", "Client session timed out", "DISCONNECTED");
-        if (m_currentClient) {
-            m_currentClient->disconnectFromServer();
-        }
+        client->socket->disconnectFromServer();
         return;
     }
     
@@ -237,47 +597,102 @@ void IPCServer::handleClientMessage(const QJsonObject &message)
     ValidationResult validation = MessageValidator::validateMessage(message);
     if (!validation.valid) {
         qCWarning(ipcServer) << "Invalid message from client:" << validation.error;
-        sendErrorToClient("Invalid message: " + validation.error);
+        Metrics::messageRejected(validation.type);
+        TRACEPOINT(frame_rejected, client->connectionVersion, int(validation.type));
+        sendErrorToClient(client, "Invalid message: " + validation.error);
         SecurityManager::auditLog("MESSAGE_VALIDATION", validation.error, "REJECTED");
         return;
     }
     
-    // Optional HMAC verification (for future enhanced security)
-    if (message.contains("hmac")) {
-        if (!SecurityManager::verifyMessage(message)) {
+    // Optional HMAC verification, checked on the received bytes so the message
+    // is never re-encoded. Same-user peers were authenticated by SO_PEERCRED
+    // when they connected, so their frames skip the MAC entirely.
+    if (message.contains("hmac") && client->trust != PeerPolicy::Decision::Trusted) {
+        // Signed messages carry a per-connection sequence number; the window
+        // check is cheap so it runs first, but only an authenticated frame
+        // may advance the window
+        quint64 sequence = 0;
+        if (!SecurityManager::readSequence(message, &sequence) ||
+            !client->replayWindow.check(sequence)) {
+            qCWarning(ipcServer) << "Rejecting replayed or out-of-window message, seq" << sequence
+                                 << "highest" << client->replayWindow.highest();
+            SecurityManager::auditLog("REPLAY_DETECTED", QString("seq=%1").arg(sequence), "REJECTED");
+            Metrics::messageRejected(validation.type);
+            sendErrorToClient(client, "Replayed or stale message");
+            return;
+        }
+        
+        if (!client->authenticator.verifyFrame(frame, client->encoding) ||
+            !SecurityManager::isTimestampFresh(message)) {
             qCWarning(ipcServer) << "HMAC verification failed";
-            sendErrorToClient("Message authentication failed");
+            Metrics::messageRejected(validation.type);
+            sendErrorToClient(client, "Message authentication failed");
             return;
         }
-        qCDebug(ipcServer) << "Message HMAC verified successfully";
+        client->replayWindow.accept(sequence);
+        qCVerbose(ipcServer) << "Message HMAC verified successfully";
     }
     
-    QString type = message["type"].toString();
-    qCDebug(ipcServer) << "Received valid client message type:" << type;
+    const MessageType type = validation.type;
+    qCVerbose(ipcServer) << "Received valid client message type:" << MessageValidator::messageTypeName(type);
+    Metrics::messageReceived(type);
+    TRACEPOINT(frame_received, client->connectionVersion, int(type), MessageValidator::messageTypeName(type),
+               long(frame.size()));
     
-    if (type == "check_authorization") {
+    if (type == MessageType::Batch) {
+        handleBatch(client, message);
+    } else {
+        dispatchMessage(client, message, type);
+    }
+}
+
+void IPCServer::dispatchMessage(ClientConnection *client, const QJsonObject &message, MessageType type)
+{
+    // The socket is up before agent registration finishes
+    if (!m_polkitWrapper && (type == MessageType::CheckAuthorization ||
+                             type == MessageType::CancelAuthorization ||
+                             type == MessageType::SubmitAuthentication)) {
+        sendErrorToClient(client, "Agent is still starting");
+        return;
+    }
+    
+    switch (type) {
+    case MessageType::CheckAuthorization: {
         QString actionId = message["action_id"].toString();
         QString details = message["details"].toString();
         
         qCDebug(ipcServer) << "Client requesting authorization for:" << actionId;
-        SecurityManager::auditLog("AUTH_REQUEST", QString("action=%1").arg(actionId), "PROCESSING");
+        SecurityManager::auditLog("AUTH_REQUEST", QString(), "PROCESSING", actionId);
         
         // Reset session timeout on legitimate auth activity
-        resetSessionTimeout();
+        resetSessionTimeout(client);
         
         m_polkitWrapper->checkAuthorization(actionId, details);
+        break;
+    }
         
-    } else if (type == "cancel_authorization") {
-        qCDebug(ipcServer) << "Client cancelling authorization";
-        SecurityManager::auditLog("AUTH_CANCEL", "Client cancelled authentication", "CANCELLED");
-        m_polkitWrapper->cancelAuthorization();
+    case MessageType::CancelAuthorization: {
+        // Scoped to one prompt when the client names it; other sessions keep running
+        QString cookie = message["cookie"].toString();
+        qCDebug(ipcServer) << "Client cancelling" << (cookie.isEmpty() ? "all authorizations" : "one authorization");
+        qCDebug(polkitSensitive) << "Cancel for cookie:" << cookie;
+        SecurityManager::auditLog("AUTH_CANCEL",
+                                  cookie.isEmpty() ? "Client cancelled all authentication sessions"
+                                                   : "Client cancelled authentication session",
+                                  "CANCELLED");
+        m_polkitWrapper->cancelAuthorization(cookie);
         
         // Send cancellation acknowledgment to client
         QJsonObject cancelResponse;
         cancelResponse["type"] = "cancel_acknowledgment";
-        sendMessageToClient(cancelResponse);
+        if (!cookie.isEmpty()) {
+            cancelResponse["cookie"] = cookie;
+        }
+        sendMessageToClient(client, cancelResponse);
+        break;
+    }
         
-    } else if (type == "submit_authentication") {
+    case MessageType::SubmitAuthentication: {
         QString cookie = message["cookie"].toString();
         QString response = message["response"].toString();
         
@@ -286,79 +701,356 @@ void IPCServer::handleClientMessage(const QJsonObject &message)
         SecurityManager::auditLog("AUTH_SUBMIT", QString("response_length=%1").arg(response.length()), "SUBMITTED");
         
         // Reset session timeout on auth submission activity
-        resetSessionTimeout();
+        resetSessionTimeout(client);
         
         m_polkitWrapper->submitAuthenticationResponse(cookie, response);
+        break;
+    }
         
-    } else if (type == "heartbeat") {
+    case MessageType::Heartbeat: {
         // Update last heartbeat timestamp
-        m_lastHeartbeat = QDateTime::currentMSecsSinceEpoch();
-        qCDebug(ipcServer) << "Received heartbeat from client";
+        client->lastHeartbeat = QDateTime::currentMSecsSinceEpoch();
+        resetHeartbeatTimeout(client);
+        qCVerbose(ipcServer) << "Received heartbeat from client" << client->connectionVersion;
         
         // Reset session timeout on heartbeat (shows client is active)
-        resetSessionTimeout();
+        resetSessionTimeout(client);
         
         // Send heartbeat response
         QJsonObject heartbeatResponse;
         heartbeatResponse["type"] = "heartbeat_ack";
-        heartbeatResponse["timestamp"] = m_lastHeartbeat;
-        sendMessageToClient(heartbeatResponse);
+        heartbeatResponse["timestamp"] = client->lastHeartbeat;
+        sendMessageToClient(client, heartbeatResponse);
+        break;
+    }
         
-    } else {
+    case MessageType::SelectEncoding: {
+        WireEncoding encoding = client->encoding;
+        WireFormat::encodingFromName(message["encoding"].toString(), &encoding);
+        
+        // Acknowledge in the encoding the request arrived in; everything after
+        // the acknowledgment, in both directions, uses the new encoding
+        QJsonObject ack;
+        ack["type"] = "encoding_selected";
+        ack["encoding"] = WireFormat::encodingName(encoding);
+        sendMessageToClient(client, ack);
+        
+        qCDebug(ipcServer) << "Client" << client->connectionVersion << "switched to encoding"
+                           << WireFormat::encodingName(encoding);
+        client->encoding = encoding;
+        client->receiveScanOffset = 0;
+        break;
+    }
+        
+    case MessageType::Resume: {
+        // A reconnecting client names the last event it saw; send what it
+        // missed, or rebuild its view when the ring no longer reaches back
+        const double requested = message["last_seq"].toDouble();
+        const quint64 lastSeq = requested > 0 ? static_cast<quint64>(requested) : 0;
+        const bool sameInstance = message["epoch"].toString() == m_eventLog.epoch();
+        
+        QJsonObject complete;
+        complete["type"] = "resume_complete";
+        if (sameInstance && m_eventLog.covers(lastSeq)) {
+            int count = 0;
+            const QByteArray frames = m_eventLog.framesAfter(lastSeq, client->encoding, &count);
+            if (!frames.isEmpty()) {
+                writeFrame(client, frames, true);
+            }
+            complete["mode"] = "delta";
+            complete["events"] = count;
+            qCDebug(ipcServer) << "Client" << client->connectionVersion << "resumed after" << lastSeq
+                               << "with" << count << "missed events";
+        } else {
+            const int sessions = sendSessionSnapshot(client);
+            complete["mode"] = "snapshot";
+            complete["sessions"] = sessions;
+            qCDebug(ipcServer) << "Client" << client->connectionVersion << "asked to resume after" << lastSeq
+                               << "outside the event log, sent snapshot of" << sessions << "sessions";
+        }
+        complete["log_seq"] = static_cast<double>(m_eventLog.lastSeq());
+        complete["event_epoch"] = m_eventLog.epoch();
+        sendMessageToClient(client, complete);
+        break;
+    }
+        
+    case MessageType::GetStats: {
+        // Opt-in: counters reveal how often the user authenticates
+        if (!Metrics::isEnabled()) {
+            sendErrorToClient(client, "Metrics are disabled");
+            break;
+        }
+        QJsonObject stats = Metrics::toJson(metricsGauges());
+        stats["type"] = "stats";
+        sendMessageToClient(client, stats);
+        break;
+    }
+        
+    case MessageType::Batch:
+        // Batches are unpacked by handleBatch and may not nest (validateBatchItems)
+        sendErrorToClient(client, "Nested batch");
+        break;
+        
+    case MessageType::Unknown:
         // This should never happen due to validation, but keep as safety net
-        qCWarning(ipcServer) << "Unknown message type from client:" << type;
-        sendErrorToClient("Unknown message type: " + type);
+        qCWarning(ipcServer) << "Unknown message type from client:" << message["type"].toString();
+        sendErrorToClient(client, "Unknown message type: " + message["type"].toString());
+        break;
     }
 }
 
-void IPCServer::sendMessageToClient(const QJsonObject &message)
+/*
+ * Run a validated batch in order and answer with one batch frame
+ *
+ * The batch already passed the session, validation and HMAC checks as a
+ * unit. The envelope's own token is refunded and each sub-message is
+ * charged to its own rate-limit class instead, so a batch costs what its
+ * items would cost sent one by one and cannot raise a client's budget. While the batch runs,
+ * sendMessageToClient collects replies tagged with the sub-message's id;
+ * broadcasts are unaffected and go out as usual. The reply frame is sent
+ * even when no sub-message produced a reply, so the client knows the
+ * batch was processed.
+ */
+void IPCServer::handleBatch(ClientConnection *client, const QJsonObject &batch)
 {
-    qCDebug(ipcServer) << "sendMessageToClient called with message:" << message;
+    // The envelope paid one control token to be parsed and validated. Once
+    // valid it costs nothing of its own: each item is charged to its class
+    // below, as if it had been sent as a frame of its own.
+    client->rateLimiter.refund(RateLimiter::classify("batch"));
     
-    if (!m_currentClient || m_currentClient->state() != QLocalSocket::ConnectedState) {
-        qCDebug(ipcServer) << "Client not connected, queueing message";
-        queueMessage(message);
-        return;
+    const QJsonArray messages = batch.value("messages").toArray();
+    QJsonArray replies;
+    client->batchReplies = &replies;
+    
+    for (const QJsonValue &value : messages) {
+        const QJsonObject message = value.toObject();
+        const QString typeName = message.value("type").toString();
+        client->batchId = message.value("id");
+        
+        const qsizetype repliesBefore = replies.size();
+        if (!admitFrame(client, RateLimiter::classify(typeName.toLatin1()))) {
+            // admitFrame reports once per episode; a batch owes every id an answer
+            if (replies.size() == repliesBefore) {
+                sendErrorToClient(client, "Rate limit exceeded");
+            }
+            continue;
+        }
+        
+        const MessageType type = MessageValidator::messageType(typeName);
+        Metrics::messageReceived(type);
+        dispatchMessage(client, message, type);
     }
     
-    QJsonDocument doc(message);
-    QByteArray data = doc.toJson(QJsonDocument::Compact);
-    qCDebug(ipcServer) << "Sending to client:" << data;
-    m_currentClient->write(data + "\n");  // Add newline for SplitParser
-    m_currentClient->flush();
+    client->batchReplies = nullptr;
+    client->batchId = QJsonValue();
+    
+    QJsonObject response;
+    response["type"] = "batch";
+    response["replies"] = replies;
+    if (batch.contains("id")) {
+        response["id"] = batch.value("id");
+    }
+    sendMessageToClient(client, response);
 }
 
-void IPCServer::sendErrorToClient(const QString &error)
+bool IPCServer::isCriticalMessage(const QString &type)
 {
-    QJsonObject errorMessage;
-    errorMessage["type"] = "error";
-    errorMessage["error"] = error;
-    sendMessageToClient(errorMessage);
+    // Frames that drive the auth dialog; everything else can be regenerated or is advisory
+    return type == "show_auth_dialog" || type == "auth_dialog_update" || type == "password_request" ||
+           type == "authorization_result" || type == "authorization_error" ||
+           type == "welcome" || type == "encoding_selected" || type == "resume_complete" || type == "batch";
 }
 
-bool IPCServer::checkRateLimit()
+bool IPCServer::writeFrame(ClientConnection *client, const QByteArray &frame, bool critical)
 {
-    qint64 currentTime = QDateTime::currentMSecsSinceEpoch();
-    
-    // Add current message timestamp
-    m_messageTimestamps.enqueue(currentTime);
+    const qint64 backlog = client->socket->bytesToWrite() + client->outputBuffer.size();
     
-    // Remove timestamps older than the window
-    while (!m_messageTimestamps.isEmpty() && 
-           (currentTime - m_messageTimestamps.head()) > RATE_LIMIT_WINDOW_MS) {
-        m_messageTimestamps.dequeue();
+    if (backlog + frame.size() > OUTPUT_HARD_LIMIT) {
+        qCWarning(ipcServer) << "Client" << client->connectionVersion << "stalled with" << backlog
+                             << "bytes pending, disconnecting";
+        SecurityManager::auditLog("CLIENT_STALLED", QString("pending=%1").arg(backlog), "DISCONNECTED");
+        client->outputBuffer.clear();
+        client->promptsInBuffer.clear();
+        client->socket->abort();
+        return false;
     }
     
-    // Check if we exceed the rate limit
-    if (m_messageTimestamps.size() > MAX_MESSAGES_PER_SECOND) {
-        qCWarning(ipcServer) << "Rate limit exceeded:" << m_messageTimestamps.size() 
-                           << "messages in last" << RATE_LIMIT_WINDOW_MS << "ms";
+    if (!critical && backlog + frame.size() > OUTPUT_HIGH_WATERMARK) {
+        client->droppedFrames++;
+        Metrics::increment(Metrics::Counter::DroppedFrames);
+        qCVerbose(ipcServer) << "Client" << client->connectionVersion << "over watermark, dropped"
+                           << client->droppedFrames << "non-critical frames";
         return false;
     }
     
+    qCVerbose(ipcServer) << "Queueing for client" << client->connectionVersion << ":" << frame;
+    TRACEPOINT(frame_sent, client->connectionVersion, long(frame.size()), int(critical));
+    client->outputBuffer.append(frame);
+    scheduleFlush(client);
     return true;
 }
 
+void IPCServer::scheduleFlush(ClientConnection *client)
+{
+    m_pendingFlush.insert(client->socket);
+    if (!m_flushTimer->isActive()) {
+        m_flushTimer->start();
+    }
+}
+
+void IPCServer::flushClient(ClientConnection *client)
+{
+    m_pendingFlush.remove(client->socket);
+    
+    if (!client->pendingHeartbeatAck.isEmpty()) {
+        QJsonObject ack = client->pendingHeartbeatAck;
+        client->pendingHeartbeatAck = QJsonObject();
+        writeFrame(client, WireFormat::encode(ack, client->encoding), false);
+        m_pendingFlush.remove(client->socket);
+    }
+    
+    if (client->outputBuffer.isEmpty() ||
+        client->socket->state() != QLocalSocket::ConnectedState) {
+        client->outputBuffer.clear();
+        client->promptsInBuffer.clear();
+        return;
+    }
+    
+    // One write and one flush for everything produced since the last iteration
+    TRACEPOINT(client_flush, client->connectionVersion, long(client->outputBuffer.size()));
+    Metrics::increment(Metrics::Counter::BytesOut, quint64(client->outputBuffer.size()));
+    client->socket->write(client->outputBuffer);
+    client->outputBuffer.clear();
+    client->socket->flush();
+    
+    // The first client to receive a prompt marks it; later ones are no-ops
+    for (const QString &cookie : std::as_const(client->promptsInBuffer)) {
+        LatencyTracer::mark(cookie, LatencyTracer::Point::ClientWrite);
+    }
+    client->promptsInBuffer.clear();
+}
+
+void IPCServer::onFlushTimeout()
+{
+    const QSet<QLocalSocket *> pending = m_pendingFlush;
+    for (QLocalSocket *socket : pending) {
+        if (ClientConnection *client = m_clients.value(socket)) {
+            flushClient(client);
+        }
+    }
+    m_pendingFlush.clear();
+}
+
+void IPCServer::sendMessageToClient(ClientConnection *client, const QJsonObject &message)
+{
+    qCVerbose(ipcServer) << "sendMessageToClient called with message:" << message;
+    
+    if (client->batchReplies) {
+        QJsonObject reply = message;
+        reply["id"] = client->batchId;
+        client->batchReplies->append(reply);
+        return;
+    }
+    
+    if (client->socket->state() != QLocalSocket::ConnectedState) {
+        qCDebug(ipcServer) << "Client" << client->connectionVersion << "not connected, dropping reply";
+        return;
+    }
+    
+    const QString type = message["type"].toString();
+    if (type == "heartbeat_ack") {
+        // Only the newest ack matters to a client that has fallen behind
+        client->pendingHeartbeatAck = message;
+        scheduleFlush(client);
+        return;
+    }
+    
+    writeFrame(client, WireFormat::encode(message, client->encoding), isCriticalMessage(type));
+}
+
+void IPCServer::broadcastMessage(QJsonObject message)
+{
+    // Every broadcast is an event: numbered and kept for clients that resume
+    m_eventLog.append(message);
+    qCVerbose(ipcServer) << "broadcastMessage called with message:" << message;
+    
+    // Serialize at most once per encoding; clients sharing an encoding receive the same bytes
+    const QString type = message["type"].toString();
+    const bool critical = isCriticalMessage(type);
+    const QString tracedPrompt = type == "password_request" ? message["cookie"].toString() : QString();
+    QByteArray jsonFrame;
+    QByteArray cborFrame;
+    int delivered = 0;
+    
+    // Snapshot the table: a stalled client can be disconnected mid-loop
+    const QList<ClientConnection *> clients = m_clients.values();
+    for (ClientConnection *client : clients) {
+        if (client->socket->state() != QLocalSocket::ConnectedState) {
+            continue;
+        }
+        QByteArray &frame = client->encoding == WireEncoding::Cbor ? cborFrame : jsonFrame;
+        if (frame.isEmpty()) {
+            frame = WireFormat::encode(message, client->encoding);
+        }
+        if (writeFrame(client, frame, critical) && !tracedPrompt.isEmpty()) {
+            client->promptsInBuffer.append(tracedPrompt);  // Marked ClientWrite when flushed
+        }
+        delivered++;
+    }
+    
+    if (delivered == 0) {
+        qCDebug(ipcServer) << "No client connected, queueing message";
+        queueMessage(message);
+    }
+}
+
+/*
+ * Rebuild a client's view from live sessions
+ *
+ * Used when a resuming client's gap is older than the event log. The frames
+ * have the same shape as the originals but carry no event_seq: they are
+ * current state, and resume_complete tells the client where the log stands.
+ */
+int IPCServer::sendSessionSnapshot(ClientConnection *client)
+{
+    if (!m_polkitWrapper) {
+        return 0;
+    }
+    
+    const QList<SessionSnapshot> sessions = m_polkitWrapper->sessionSnapshots();
+    for (const SessionSnapshot &session : sessions) {
+        QJsonObject dialog;
+        dialog["type"] = "show_auth_dialog";
+        dialog["action_id"] = session.actionId;
+        dialog["message"] = session.message;
+        dialog["icon_name"] = session.iconName;
+        dialog["cookie"] = session.cookie;
+        addActionMetadata(dialog, session.metadata);
+        sendMessageToClient(client, dialog);
+        
+        if (!session.prompt.isEmpty() &&
+            (session.state == AuthenticationState::WAITING_FOR_PASSWORD ||
+             session.state == AuthenticationState::AUTHENTICATION_FAILED)) {
+            QJsonObject prompt;
+            prompt["type"] = "password_request";
+            prompt["action_id"] = session.actionId;
+            prompt["request"] = session.prompt;
+            prompt["echo"] = session.promptEcho;
+            prompt["cookie"] = session.cookie;
+            sendMessageToClient(client, prompt);
+        }
+    }
+    return int(sessions.size());
+}
+
+void IPCServer::sendErrorToClient(ClientConnection *client, const QString &error)
+{
+    QJsonObject errorMessage;
+    errorMessage["type"] = "error";
+    errorMessage["error"] = error;
+    sendMessageToClient(client, errorMessage);
+}
+
 void IPCServer::onShowAuthDialog(const QString &actionId, const QString &message, const QString &iconName, const QString &cookie)
 {
     QJsonObject response;
@@ -367,25 +1059,55 @@ void IPCServer::onShowAuthDialog(const QString &actionId, const QString &message
     response["message"] = message;
     response["icon_name"] = iconName;
     response["cookie"] = cookie;
+    if (m_polkitWrapper && !cookie.isEmpty()) {
+        addActionMetadata(response, m_polkitWrapper->sessionMetadata(cookie));
+    }
     
-    sendMessageToClient(response);
+    broadcastMessage(response);
 }
 
-void IPCServer::onAuthorizationResult(bool authorized, const QString &actionId)
+/*
+ * Optional show_auth_dialog fields from the action's .policy file
+ *
+ * Only present when the file sets them, so clients can keep treating
+ * polkitd's message as the baseline.
+ */
+void IPCServer::addActionMetadata(QJsonObject &dialog, const ActionMetadata &metadata)
+{
+    if (!metadata.vendor.isEmpty()) {
+        dialog["vendor"] = metadata.vendor;
+    }
+    if (!metadata.vendorUrl.isEmpty()) {
+        dialog["vendor_url"] = metadata.vendorUrl;
+    }
+    if (!metadata.description.isEmpty()) {
+        dialog["description"] = metadata.description;
+    }
+    if (!metadata.allowAny.isEmpty() || !metadata.allowInactive.isEmpty() || !metadata.allowActive.isEmpty()) {
+        QJsonObject defaults;
+        defaults["allow_any"] = metadata.allowAny;
+        defaults["allow_inactive"] = metadata.allowInactive;
+        defaults["allow_active"] = metadata.allowActive;
+        dialog["implicit_authorization"] = defaults;
+    }
+}
+
+void IPCServer::onAuthorizationResult(bool authorized, const QString &actionId, const QString &cookie)
 {
     // Audit log the authorization result
     QString result = authorized ? "GRANTED" : "DENIED";
-    SecurityManager::auditLog("AUTH_RESULT", QString("action=%1").arg(actionId), result);
+    SecurityManager::auditLog("AUTH_RESULT", QString(), result, actionId);
     
     QJsonObject response;
     response["type"] = "authorization_result";
     response["authorized"] = authorized;
     response["action_id"] = actionId;
+    response["cookie"] = cookie;
     
-    sendMessageToClient(response);
+    broadcastMessage(response);
 }
 
-void IPCServer::onAuthorizationError(const QString &error)
+void IPCServer::onAuthorizationError(const QString &error, const QString &cookie)
 {
     // Audit log the authorization error
     SecurityManager::auditLog("AUTH_ERROR", QString("error=\"%1\"").arg(error), "ERROR");
@@ -393,8 +1115,9 @@ void IPCServer::onAuthorizationError(const QString &error)
     QJsonObject response;
     response["type"] = "authorization_error";
     response["error"] = error;
+    response["cookie"] = cookie;
     
-    sendMessageToClient(response);
+    broadcastMessage(response);
 }
 
 void IPCServer::onShowPasswordRequest(const QString &actionId, const QString &request, bool echo, const QString &cookie)
@@ -406,98 +1129,96 @@ void IPCServer::onShowPasswordRequest(const QString &actionId, const QString &re
     response["echo"] = echo;
     response["cookie"] = cookie;
     
-    sendMessageToClient(response);
+    broadcastMessage(response);
 }
 
-void IPCServer::startHeartbeat()
+void IPCServer::onAuthMessageUpdated(const QString &cookie, const QString &message)
 {
-    qCDebug(ipcServer) << "Starting heartbeat monitoring";
-    m_heartbeatTimer->start();
+    QJsonObject response;
+    response["type"] = "auth_dialog_update";
+    response["cookie"] = cookie;
+    response["message"] = message;
+    
+    broadcastMessage(response);
+}
+
+void IPCServer::onSecurityKeyPresenceChanged(bool present)
+{
+    QJsonObject response;
+    response["type"] = "security_key_presence";
+    response["present"] = present;
+    
+    broadcastMessage(response);
 }
 
-void IPCServer::stopHeartbeat()
+void IPCServer::resetHeartbeatTimeout(ClientConnection *client)
 {
-    qCDebug(ipcServer) << "Stopping heartbeat monitoring";
-    m_heartbeatTimer->stop();
+    DeadlineScheduler::instance()->reschedule(client->heartbeatDeadline, CONNECTION_TIMEOUT_MS);
 }
 
-void IPCServer::resetSessionTimeout()
+void IPCServer::resetSessionTimeout(ClientConnection *client)
 {
     // Reset session start time to extend the session
-    m_sessionStartTime = SecurityManager::getCurrentTimestamp();
-    qCDebug(ipcServer) << "Session timeout reset due to activity";
+    client->sessionStartTime = SecurityManager::getCurrentTimestamp();
+    DeadlineScheduler::instance()->reschedule(client->sessionDeadline, SecurityManager::SESSION_TIMEOUT_MS);
+    qCVerbose(ipcServer) << "Session timeout reset due to activity";
 }
 
-void IPCServer::onHeartbeatTimeout()
+void IPCServer::onHeartbeatExpired(ClientConnection *client)
 {
-    qint64 currentTime = QDateTime::currentMSecsSinceEpoch();
-    qint64 timeSinceLastHeartbeat = currentTime - m_lastHeartbeat;
-    
-    if (timeSinceLastHeartbeat > CONNECTION_TIMEOUT_MS) {
-        qCWarning(ipcServer) << "Client heartbeat timeout after" << timeSinceLastHeartbeat << "ms";
-        
-        if (m_currentClient) {
-            m_currentClient->disconnectFromServer();
-        }
-    }
+    client->heartbeatDeadline = 0;
+    qCWarning(ipcServer) << "Client" << client->connectionVersion
+                         << "heartbeat timeout after" << CONNECTION_TIMEOUT_MS << "ms";
+    client->socket->disconnectFromServer();
 }
 
 void IPCServer::queueMessage(const QJsonObject &message)
 {
-    QString type = message["type"].toString();
-    
-    // Don't queue certain message types (heartbeat acks, errors, welcome)
-    if (type == "heartbeat_ack" || type == "error" || type == "welcome") {
-        qCDebug(ipcServer) << "Not queueing message of type:" << type;
-        return;
-    }
-    
-    // Limit queue size to prevent memory issues
-    static constexpr int MAX_QUEUED_MESSAGES = 50;
-    if (m_pendingMessages.size() >= MAX_QUEUED_MESSAGES) {
-        qCWarning(ipcServer) << "Message queue full, dropping oldest message";
-        m_pendingMessages.dequeue();
+    // Heartbeat acks, errors, welcome and presence are never stored; the
+    // outbox keeps only per-session dialog state and drops everything else
+    const quint64 evictedBefore = m_outbox.evictedCount();
+    if (m_outbox.record(message)) {
+        if (m_outbox.evictedCount() != evictedBefore) {
+            qCWarning(ipcServer) << "Replay outbox full, dropped the oldest pending session";
+        }
+        qCDebug(ipcServer) << "Stored" << message["type"].toString() << "for replay,"
+                           << m_outbox.sessionCount() << "sessions pending";
+    } else {
+        qCDebug(ipcServer) << "Not storing message of type:" << message["type"].toString();
     }
-    
-    m_pendingMessages.enqueue(message);
-    qCDebug(ipcServer) << "Queued message, queue size:" << m_pendingMessages.size();
 }
 
-void IPCServer::replayQueuedMessages()
+void IPCServer::replayQueuedMessages(ClientConnection *client)
 {
-    if (m_pendingMessages.isEmpty()) {
+    if (m_outbox.isEmpty()) {
         return;
     }
     
-    qCDebug(ipcServer) << "Replaying" << m_pendingMessages.size() << "queued messages";
+    // Sessions can also end without a result reaching the outbox (e.g. a
+    // cookie reused by polkitd), so check liveness at the last moment
+    PolkitWrapper *wrapper = m_polkitWrapper;
+    const int pending = m_outbox.sessionCount();
+    const QByteArray frames = m_outbox.takeFrames([wrapper](const QString &cookie) {
+        return !wrapper || wrapper->sessionHandle(cookie).isValid();
+    });
     
-    while (!m_pendingMessages.isEmpty()) {
-        QJsonObject message = m_pendingMessages.dequeue();
-        
-        // Send directly to avoid re-queueing
-        if (m_currentClient && m_currentClient->state() == QLocalSocket::ConnectedState) {
-            QJsonDocument doc(message);
-            QByteArray data = doc.toJson(QJsonDocument::Compact);
-            qCDebug(ipcServer) << "Replaying queued message:" << data;
-            m_currentClient->write(data + "\n");
-        }
-    }
+    qCDebug(ipcServer) << "Replaying" << pending << "pending sessions," << frames.size() << "bytes";
     
-    if (m_currentClient) {
-        m_currentClient->flush();
+    // One write, coalesced with the welcome frame; the client has not had a
+    // chance to select another encoding yet
+    if (!frames.isEmpty() && client->socket->state() == QLocalSocket::ConnectedState &&
+        client->encoding == ReplayOutbox::ENCODING) {
+        writeFrame(client, frames, true);
     }
 }
 
-void IPCServer::onSessionTimeout()
+void IPCServer::onSessionExpired(ClientConnection *client)
 {
-    if (SecurityManager::isSessionExpired(m_sessionStartTime)) {
-        qCWarning(ipcServer) << "Session timeout reached, disconnecting client";
-        SecurityManager::auditLog("SESSION_TIMEOUT", "Maximum session duration exceeded", "DISCONNECTED");
-        
-        if (m_currentClient) {
-            sendErrorToClient("Session timeout - please reconnect");
-            m_currentClient->disconnectFromServer();
-        }
-    }
+    client->sessionDeadline = 0;
+    qCWarning(ipcServer) << "Session timeout reached, disconnecting client" << client->connectionVersion;
+    SecurityManager::auditLog("SESSION_TIMEOUT", "Maximum session duration exceeded", "DISCONNECTED");
+    
+    sendErrorToClient(client, "Session timeout - please reconnect");
+    flushClient(client);
+    client->socket->disconnectFromServer();
 }
-
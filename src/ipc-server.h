@@ -21,66 +21,162 @@
 #include <QObject>
 #include <QLocalServer>
 #include <QLocalSocket>
+#include <QJsonArray>
 #include <QJsonObject>
 #include <QTimer>
-#include <QQueue>
+#include <QHash>
+#include <QSet>
+#include <QStringList>
+
+#include "action-index.h"
+#include "deadline-scheduler.h"
+#include "event-log.h"
+#include "metrics.h"
+#include "peer-credentials.h"
+#include "rate-limiter.h"
+#include "replay-outbox.h"
+#include "security.h"
+#include "wire-format.h"
 
 class PolkitWrapper;
 
+/*
+ * Per-connection client state
+ *
+ * Parented to its socket, so it is released by the socket's deleteLater()
+ * and stays valid while one of its frames is still being handled.
+ */
+class ClientConnection : public QObject
+{
+public:
+    explicit ClientConnection(QLocalSocket *clientSocket)
+        : QObject(clientSocket), socket(clientSocket) {}
+
+    QLocalSocket *socket;
+    PeerCredentials peer;                     // SO_PEERCRED, read once on accept
+    PeerPolicy::Decision trust = PeerPolicy::Decision::Denied;
+    int connectionVersion = 0;
+    qint64 lastHeartbeat = 0;
+    qint64 sessionStartTime = 0;
+    DeadlineScheduler::TimerId heartbeatDeadline = 0;  // Disconnect if no heartbeat by then
+    DeadlineScheduler::TimerId sessionDeadline = 0;    // Expire the session if idle until then
+    WireEncoding encoding = WireEncoding::Json;  // Negotiated with select_encoding
+
+    // Incremental '\n'-framed receive buffer
+    QByteArray receiveBuffer;
+    qsizetype receiveScanOffset = 0;        // Bytes of receiveBuffer already searched for '\n'
+    bool discardingOversizedFrame = false;  // Skipping the rest of a JSON frame that exceeded MAX_FRAME_SIZE
+
+    // Outgoing frames gathered until the next flush
+    QByteArray outputBuffer;
+    QJsonObject pendingHeartbeatAck;        // Latest unsent ack; older ones are coalesced away
+    QJsonArray *batchReplies = nullptr;     // Set while a batch runs: replies are collected, not written
+    QJsonValue batchId;                     // Correlation id of the sub-message being handled
+    int droppedFrames = 0;                  // Non-critical frames shed while over the watermark
+    QStringList promptsInBuffer;            // Cookies of password_request frames in outputBuffer (latency tracing)
+
+    // Load shedding, applied to raw frames before they are parsed
+    RateLimiter rateLimiter;
+    quint64 oversizedFrames = 0;            // Frames rejected for exceeding MAX_FRAME_SIZE
+
+    // Keyed once per connection, reset per signed frame; unused for trusted peers
+    MessageAuthenticator authenticator;
+    ReplayWindow replayWindow;              // Sequence numbers of signed frames
+};
+
 class IPCServer : public QObject
 {
     Q_OBJECT
 
 public:
-    explicit IPCServer(PolkitWrapper *polkitWrapper, QObject *parent = nullptr);
+    explicit IPCServer(PolkitWrapper *polkitWrapper = nullptr, QObject *parent = nullptr);
     ~IPCServer();
 
     bool startServer();
 
+    // Connect the polkit agent once it exists; until then auth requests are refused
+    void attachPolkitWrapper(PolkitWrapper *polkitWrapper);
+
+    // Client frames rejected before parsing, over the server's lifetime
+    quint64 rateLimitedFrameCount() const { return m_rateLimitedFrames; }
+    quint64 oversizedFrameCount() const { return m_oversizedFrames; }
+
 private slots:
     void onNewConnection();
     void onClientDisconnected();
     void onClientDataReady();
-    void onHeartbeatTimeout();
-    void onSessionTimeout();
+    void onFlushTimeout();
     
     // Slots for polkit wrapper signals
     void onShowAuthDialog(const QString &actionId, const QString &message, const QString &iconName, const QString &cookie);
-    void onAuthorizationResult(bool authorized, const QString &actionId);
-    void onAuthorizationError(const QString &error);
+    void onAuthorizationResult(bool authorized, const QString &actionId, const QString &cookie);
+    void onAuthorizationError(const QString &error, const QString &cookie);
     void onShowPasswordRequest(const QString &actionId, const QString &request, bool echo, const QString &cookie);
+    void onSecurityKeyPresenceChanged(bool present);
+    void onAuthMessageUpdated(const QString &cookie, const QString &message);
 
 private:
-    void sendMessageToClient(const QJsonObject &message);
-    void sendErrorToClient(const QString &error);
-    void handleClientMessage(const QJsonObject &message);
+    // Replies go to one client, polkit events fan out to every connected client
+    void sendMessageToClient(ClientConnection *client, const QJsonObject &message);
+    void sendErrorToClient(ClientConnection *client, const QString &error);
+    void broadcastMessage(QJsonObject message);
+    int sendSessionSnapshot(ClientConnection *client);
+    // False if the frame was shed or the client disconnected for stalling
+    bool writeFrame(ClientConnection *client, const QByteArray &frame, bool critical);
+    void scheduleFlush(ClientConnection *client);
+    void flushClient(ClientConnection *client);
+    static bool isCriticalMessage(const QString &type);
+    static void addActionMetadata(QJsonObject &dialog, const ActionMetadata &metadata);
+    
+    // Opt-in metrics exposure (QUICKSHELL_POLKIT_METRICS=1)
+    void startMetricsExport();
+    void writeMetricsFile();
+    Metrics::Gauges metricsGauges() const;
+    
+    bool admitFrame(ClientConnection *client, RateLimiter::MessageClass messageClass);
+    void rejectOversizedFrame(ClientConnection *client);
+    void processFrame(ClientConnection *client, const QByteArray &frame, RateLimiter::MessageClass chargedClass);
+    void handleClientMessage(ClientConnection *client, const QJsonObject &message, QByteArrayView frame,
+                             RateLimiter::MessageClass chargedClass);
+    void dispatchMessage(ClientConnection *client, const QJsonObject &message, MessageType type);
+    void handleBatch(ClientConnection *client, const QJsonObject &batch);
 
     QLocalServer *m_server;
-    QLocalSocket *m_currentClient;
+    bool m_socketActivated; // Listening socket inherited from systemd (LISTEN_FDS)
+    QHash<QLocalSocket *, ClientConnection *> m_clients;
     PolkitWrapper *m_polkitWrapper;
     
-    // Rate limiting
-    QQueue<qint64> m_messageTimestamps;
-    QTimer *m_rateLimitTimer;
-    static constexpr int MAX_MESSAGES_PER_SECOND = 10;
-    static constexpr int RATE_LIMIT_WINDOW_MS = 1000;
+    static constexpr int MAX_FRAME_SIZE = 64 * 1024;
     
-    // Connection management
-    QTimer *m_heartbeatTimer;
-    qint64 m_lastHeartbeat;
-    int m_clientConnectionVersion;
-    QQueue<QJsonObject> m_pendingMessages; // Queue messages when client disconnected
-    static constexpr int HEARTBEAT_INTERVAL_MS = 30000; // 30 seconds
-    static constexpr int CONNECTION_TIMEOUT_MS = 60000; // 60 seconds
+    // Output coalescing and back-pressure
+    QTimer *m_flushTimer;
+    QSet<QLocalSocket *> m_pendingFlush;
+    static constexpr qint64 OUTPUT_HIGH_WATERMARK = 64 * 1024;  // Shed non-critical frames above this
+    static constexpr qint64 OUTPUT_HARD_LIMIT = 1024 * 1024;    // Disconnect clients that stall past this
+    
+    QTimer *m_metricsTimer;  // Rewrites m_metricsPath while metrics are enabled
+    QString m_metricsPath;
+    static constexpr int METRICS_WRITE_INTERVAL_MS = 15000;
+    
+    // Load shedding totals across all clients
+    quint64 m_rateLimitedFrames;
+    quint64 m_oversizedFrames;
     
-    // Security and session management
-    qint64 m_sessionStartTime;
-    QTimer *m_sessionTimeoutTimer;
+    // Who may connect, decided once per connection from SO_PEERCRED
+    PeerPolicy m_peerPolicy;
+    
+    // Connection management
+    int m_connectionCounter; // Incremented per connection so clients can detect agent-side resets
+    ReplayOutbox m_outbox;   // Live session state held for the next client to connect
+    EventLog m_eventLog;     // Recent broadcasts by event_seq, for resume
+    static constexpr int CONNECTION_TIMEOUT_MS = 60000; // 60 seconds without a heartbeat
     
-    bool checkRateLimit();
-    void startHeartbeat();
-    void stopHeartbeat();
-    void resetSessionTimeout();
+    // Per-client deadlines on the shared DeadlineScheduler
+    void resetHeartbeatTimeout(ClientConnection *client);
+    void resetSessionTimeout(ClientConnection *client);
+    void onHeartbeatExpired(ClientConnection *client);
+    void onSessionExpired(ClientConnection *client);
     void queueMessage(const QJsonObject &message);
-    void replayQueuedMessages();
+    void replayQueuedMessages(ClientConnection *client);
+    static int takeSystemdListenFd();
 };
\ No newline at end of file
@@ -0,0 +1,177 @@
+/*
+ * quickshell-polkit-agent
+ * Copyright (C) 2025 Benny Powers
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "latency-tracer.h"
+#include "logging.h"
+#include "metrics.h"
+#include <QElapsedTimer>
+#include <QHash>
+#include <QStringList>
+#include <algorithm>
+
+namespace {
+
+constexpr int POINT_COUNT = static_cast<int>(LatencyTracer::Point::Count);
+
+struct Trace {
+    QString actionId;
+    qint64 marks[POINT_COUNT];  // ns on the tracer clock, -1 when not reached
+};
+
+// Per-point time since the previous reached point, plus time-to-prompt
+struct SpanStats {
+    int count = 0;
+    qint64 totalNs = 0;
+    qint64 maxNs = 0;
+
+    void add(qint64 ns)
+    {
+        count++;
+        totalNs += ns;
+        maxNs = std::max(maxNs, ns);
+    }
+};
+
+struct TracerState {
+    QElapsedTimer clock;
+    QHash<QString, Trace> traces;
+    SpanStats spans[POINT_COUNT];
+    SpanStats timeToPrompt;
+    int finished = 0;
+
+    TracerState() { clock.start(); }
+};
+
+TracerState &state()
+{
+    static TracerState tracer;
+    return tracer;
+}
+
+QString formatMs(qint64 ns)
+{
+    return QString::number(ns / 1e6, 'f', 1) + "ms";
+}
+
+} // namespace
+
+const char *LatencyTracer::pointName(Point point)
+{
+    switch (point) {
+    case Point::InitiateAuthentication: return "initiate";
+    case Point::SessionInitiate: return "session_initiate";
+    case Point::MessageTransformed: return "message_transformed";
+    case Point::FirstRequest: return "first_request";
+    case Point::PasswordRequestEmitted: return "prompt_emitted";
+    case Point::ClientWrite: return "client_write";
+    case Point::ResponseSubmitted: return "response_submitted";
+    case Point::Completed: return "completed";
+    case Point::Count: break;
+    }
+    return "unknown";
+}
+
+void LatencyTracer::begin(const QString &cookie, const QString &actionId)
+{
+    // The traces also feed the latency histograms when metrics are exposed
+    if (!polkitLatency().isInfoEnabled() && !Metrics::isEnabled()) {
+        return;
+    }
+
+    TracerState &tracer = state();
+    Trace trace;
+    trace.actionId = actionId;
+    std::fill(std::begin(trace.marks), std::end(trace.marks), -1);
+    trace.marks[static_cast<int>(Point::InitiateAuthentication)] = tracer.clock.nsecsElapsed();
+    tracer.traces.insert(cookie, trace);
+}
+
+void LatencyTracer::mark(const QString &cookie, Point point)
+{
+    TracerState &tracer = state();
+    auto it = tracer.traces.find(cookie);
+    if (it == tracer.traces.end()) {
+        return;
+    }
+
+    qint64 &slot = it->marks[static_cast<int>(point)];
+    if (slot < 0) {
+        slot = tracer.clock.nsecsElapsed();
+    }
+}
+
+void LatencyTracer::finish(const QString &cookie)
+{
+    TracerState &tracer = state();
+    auto it = tracer.traces.find(cookie);
+    if (it == tracer.traces.end()) {
+        return;
+    }
+
+    const Trace trace = *it;
+    tracer.traces.erase(it);
+
+    // Offsets from initiateAuthentication, plus the segment each point closes
+    const qint64 start = trace.marks[0];
+    qint64 previous = start;
+    QStringList offsets;
+    for (int i = 1; i < POINT_COUNT; ++i) {
+        if (trace.marks[i] < 0) {
+            continue;
+        }
+        tracer.spans[i].add(trace.marks[i] - previous);
+        previous = trace.marks[i];
+        offsets << QString("%1=+%2").arg(pointName(static_cast<Point>(i)), formatMs(trace.marks[i] - start));
+    }
+
+    const qint64 promptWrite = trace.marks[static_cast<int>(Point::ClientWrite)];
+    if (promptWrite >= 0) {
+        tracer.timeToPrompt.add(promptWrite - start);
+        Metrics::observe(Metrics::Histogram::TimeToPrompt, promptWrite - start);
+    }
+
+    const qint64 submitted = trace.marks[static_cast<int>(Point::ResponseSubmitted)];
+    const qint64 completed = trace.marks[static_cast<int>(Point::Completed)];
+    if (submitted >= 0 && completed >= submitted) {
+        Metrics::observe(Metrics::Histogram::PamCompletion, completed - submitted);
+    }
+
+    qCDebug(polkitLatency).noquote() << "Auth latency for" << trace.actionId << offsets.join(' ');
+
+    if (++tracer.finished % SUMMARY_INTERVAL != 0) {
+        return;
+    }
+
+    QStringList summary;
+    for (int i = 1; i < POINT_COUNT; ++i) {
+        const SpanStats &span = tracer.spans[i];
+        if (span.count == 0) {
+            continue;
+        }
+        summary << QString("%1 avg=%2 max=%3").arg(pointName(static_cast<Point>(i)),
+                                                 formatMs(span.totalNs / span.count),
+                                                 formatMs(span.maxNs));
+    }
+    if (tracer.timeToPrompt.count > 0) {
+        summary.prepend(QString("time_to_prompt avg=%1 max=%2").arg(formatMs(tracer.timeToPrompt.totalNs / tracer.timeToPrompt.count),
+                                                                   formatMs(tracer.timeToPrompt.maxNs)));
+    }
+
+    qCInfo(polkitLatency).noquote() << "Auth latency summary over" << tracer.finished << "sessions:"
+                                    << summary.join("; ");
+}
@@ -0,0 +1,64 @@
+/*
+ * quickshell-polkit-agent
+ * Copyright (C) 2025 Benny Powers
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <QString>
+
+/*
+ * Time-to-prompt latency tracing
+ *
+ * Records monotonic timestamps per auth cookie at fixed points of the
+ * pipeline, from polkitd calling initiateAuthentication() to PAM completing.
+ * When a session ends its offsets are logged to polkit.latency (debug), and
+ * every SUMMARY_INTERVAL sessions an aggregate of each point's time since the
+ * previous point is logged (info). That shows where the time goes: the setuid
+ * helper, message transformation, or the IPC hop to the client.
+ *
+ * Only the first occurrence of each point is kept, so retries don't skew
+ * time-to-prompt. Finished traces also feed the time-to-prompt and PAM
+ * completion histograms in Metrics.
+ */
+class LatencyTracer
+{
+public:
+    enum class Point {
+        InitiateAuthentication = 0,  // Listener::initiateAuthentication() entry
+        SessionInitiate,             // Agent::Session::initiate() called
+        MessageTransformed,          // transformAuthMessage() returned
+        FirstRequest,                // First Session::request from the helper
+        PasswordRequestEmitted,      // showPasswordRequest emitted
+        ClientWrite,                 // password_request written to the client socket
+        ResponseSubmitted,           // Session::setResponse() called
+        Completed,                   // Session::completed received
+        Count
+    };
+
+    // Start a trace for a new cookie at InitiateAuthentication
+    static void begin(const QString &cookie, const QString &actionId);
+
+    // Record a point for an active trace (ignored if unknown or already marked)
+    static void mark(const QString &cookie, Point point);
+
+    // Log and aggregate the trace, then forget the cookie
+    static void finish(const QString &cookie);
+
+    static const char *pointName(Point point);
+
+    static constexpr int SUMMARY_INTERVAL = 10;
+};
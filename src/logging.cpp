@@ -3,5 +3,6 @@
 // Define logging categories
 Q_LOGGING_CATEGORY(polkitAgent, "polkit.agent")
 Q_LOGGING_CATEGORY(polkitSensitive, "polkit.sensitive") // Disabled by default for security
+Q_LOGGING_CATEGORY(polkitLatency, "polkit.latency", QtInfoMsg) // Summaries by default, per-session spans at debug
 Q_LOGGING_CATEGORY(ipcServer, "ipc.server")
 Q_LOGGING_CATEGORY(fileIpc, "ipc.file")
\ No newline at end of file
@@ -5,5 +5,20 @@
 // Logging categories for different components
 Q_DECLARE_LOGGING_CATEGORY(polkitAgent)
 Q_DECLARE_LOGGING_CATEGORY(polkitSensitive) // For sensitive auth cookie logs
+Q_DECLARE_LOGGING_CATEGORY(polkitLatency)   // Auth pipeline timing
 Q_DECLARE_LOGGING_CATEGORY(ipcServer)
-Q_DECLARE_LOGGING_CATEGORY(fileIpc)
\ No newline at end of file
+Q_DECLARE_LOGGING_CATEGORY(fileIpc)
+
+/*
+ * Per-message and per-transition debug output
+ *
+ * Equivalent to qCDebug() unless the build sets QUICKSHELL_POLKIT_NO_VERBOSE_LOG
+ * (-DENABLE_VERBOSE_LOGGING=OFF), in which case the statement and its
+ * arguments are compiled out, category check included. The hot-path sites
+ * have tracepoints (tracing.h) for production debugging instead.
+ */
+#ifdef QUICKSHELL_POLKIT_NO_VERBOSE_LOG
+#define qCVerbose(category) QT_NO_QDEBUG_MACRO()
+#else
+#define qCVerbose(category) qCDebug(category)
+#endif
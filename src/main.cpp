@@ -18,11 +18,18 @@
 
 #include <QCoreApplication>
 #include <QDebug>
+#include <QTimer>
+#include <memory>
 #include <signal.h>
 
 #include "polkit-wrapper.h"
+#include "idle-trimmer.h"
 #include "ipc-server.h"
 #include "security.h"
+#include "startup-profile.h"
+#ifdef HAVE_FILE_IPC
+#include "file-ipc.h"
+#endif
 
 void signalHandler(int signal)
 {
@@ -32,6 +39,7 @@ void signalHandler(int signal)
 
 int main(int argc, char *argv[])
 {
+    StartupProfile::start();
     QCoreApplication app(argc, argv);
     app.setApplicationName("quickshell-polkit-agent");
     app.setApplicationVersion("1.0.0");
@@ -42,33 +50,82 @@ int main(int argc, char *argv[])
     
     qDebug() << "Starting Quickshell Polkit Agent...";
     
+    StartupProfile::mark("app_init");
+    
     // Initialize security manager
     SecurityManager::initialize();
-    
-    // Create polkit wrapper
-    PolkitWrapper polkitWrapper;
+    StartupProfile::mark("security_init");
     
     // Check if running in test mode (skip polkit registration)
     bool testMode = !qEnvironmentVariable("QUICKSHELL_POLKIT_SOCKET").isEmpty();
     
-    // Register as polkit agent (skip in test mode)
-    if (!testMode && !polkitWrapper.registerAgent()) {
-        qCritical() << "Failed to register as polkit agent - exiting";
-        return 1;
-    }
+    // Declared before the server so the server (which references it) is destroyed first
+    std::unique_ptr<PolkitWrapper> polkitWrapper;
+#ifdef HAVE_FILE_IPC
+    std::unique_ptr<FileIPC> fileIpc;  // Optional transport for clients without socket access
+#endif
     
-    // Create and start IPC server
-    IPCServer server(&polkitWrapper);
+    // Start listening before registration so clients connecting during login
+    // never find a missing socket. With socket activation this adopts the
+    // inherited listening fd instead.
+    IPCServer server;
     if (!server.startServer()) {
         qCritical() << "Failed to start IPC server - exiting";
         return 1;
     }
+    StartupProfile::mark("ipc_listen");
     
-    if (testMode) {
-        qDebug() << "Running in test mode - polkit registration skipped";
-    }
+    // Create and register the polkit agent once the event loop runs; clients
+    // that connect meanwhile are accepted and get their welcome immediately
+    auto agentReady = [&]() {
+        StartupProfile::mark("agent_register");
+        server.attachPolkitWrapper(polkitWrapper.get());
+        
+#ifdef HAVE_FILE_IPC
+        if (qEnvironmentVariable("QUICKSHELL_POLKIT_FILE_IPC") == QLatin1String("1")) {
+            fileIpc = std::make_unique<FileIPC>(polkitWrapper.get());
+            if (!fileIpc->initialize()) {
+                qWarning() << "File IPC unavailable, continuing with the socket only";
+                fileIpc.reset();
+            }
+        }
+#endif
+        
+        if (testMode) {
+            qDebug() << "Running in test mode - polkit registration skipped";
+        } else {
+            qDebug() << "Quickshell Polkit Agent ready - registered as system polkit agent after"
+                     << polkitWrapper->registrationAttempts() << "attempt(s)";
+        }
+        StartupProfile::report("agent ready");
+    };
+    
+    QTimer::singleShot(0, &app, [&]() {
+        StartupProfile::mark("event_loop");
+        polkitWrapper = std::make_unique<PolkitWrapper>();
+        StartupProfile::mark("agent_create");
+        
+        // Register as polkit agent (skip in test mode). Attempts are retried
+        // from the event loop, so clients keep being served while polkitd starts.
+        if (testMode) {
+            agentReady();
+            return;
+        }
+        QObject::connect(polkitWrapper.get(), &PolkitWrapper::agentRegistered, &app, agentReady);
+        QObject::connect(polkitWrapper.get(), &PolkitWrapper::agentRegistrationFailed, &app, []() {
+            qCritical() << "Failed to register as polkit agent - exiting";
+            QCoreApplication::exit(1);
+        });
+        polkitWrapper->registerAgentWithRetry();
+    });
+    
+    // Counts down from now: a login with no prompt trims after the quiet period
+    IdleTrimmer::instance()->setQuietPeriod(IdleTrimmer::quietPeriodFromEnvironment());
     
-    qDebug() << "Quickshell Polkit Agent ready - registered as system polkit agent";
+    StartupProfile::report("ready for clients");
+    int result = app.exec();
     
-    return app.exec();
+    // Write out queued audit records before exit
+    SecurityManager::shutdown();
+    return result;
 }
\ No newline at end of file
@@ -0,0 +1,306 @@
+/*
+ * quickshell-polkit-agent
+ * Copyright (C) 2025 Benny Powers
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "message-rules.h"
+#include "logging.h"
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QStandardPaths>
+
+namespace {
+
+const QString RUN0_ACTION_ID = QStringLiteral("org.freedesktop.systemd1.manage-units");
+
+} // namespace
+
+// =============================================================================
+// MessageRule
+// =============================================================================
+
+MessageRule::Template MessageRule::compileTemplate(const QString &text, QStringList *detailKeys, bool *usesCommand)
+{
+    Template parts;
+    qsizetype pos = 0;
+
+    auto appendLiteral = [&parts](const QString &literal) {
+        if (literal.isEmpty()) {
+            return;
+        }
+        if (!parts.isEmpty() && parts.last().kind == TemplatePart::Literal) {
+            parts.last().text += literal;
+        } else {
+            parts.append({TemplatePart::Literal, literal});
+        }
+    };
+
+    while (pos < text.size()) {
+        const qsizetype open = text.indexOf('{', pos);
+        const qsizetype close = open < 0 ? -1 : text.indexOf('}', open);
+        if (close < 0) {
+            appendLiteral(text.mid(pos));
+            break;
+        }
+
+        appendLiteral(text.mid(pos, open - pos));
+        const QString name = text.mid(open + 1, close - open - 1);
+
+        if (name == QLatin1String("message")) {
+            parts.append({TemplatePart::Message, QString()});
+        } else if (name == QLatin1String("action_id")) {
+            parts.append({TemplatePart::ActionId, QString()});
+        } else if (name == QLatin1String("command")) {
+            parts.append({TemplatePart::Command, QString()});
+            *usesCommand = true;
+        } else if (name.startsWith(QLatin1String("detail."))) {
+            const QString key = name.mid(7);
+            parts.append({TemplatePart::Detail, key});
+            if (!detailKeys->contains(key)) {
+                detailKeys->append(key);
+            }
+        } else {
+            // Unknown placeholder, keep it verbatim
+            appendLiteral(text.mid(open, close - open + 1));
+        }
+        pos = close + 1;
+    }
+
+    return parts;
+}
+
+QString MessageRule::renderTemplate(const Template &parts, const MessageContext &context, bool commandKnown)
+{
+    QString result;
+    for (const TemplatePart &part : parts) {
+        switch (part.kind) {
+        case TemplatePart::Literal:
+            result += part.text;
+            break;
+        case TemplatePart::Message:
+            result += context.message;
+            break;
+        case TemplatePart::ActionId:
+            result += context.actionId;
+            break;
+        case TemplatePart::Command:
+            result += commandKnown ? context.command : QStringLiteral("command");
+            break;
+        case TemplatePart::Detail:
+            result += context.details.value(part.text);
+            break;
+        }
+    }
+    return result;
+}
+
+bool MessageRule::matches(const QString &message, const DetailLookup &lookup) const
+{
+    if (m_hasMessagePattern && !m_messagePattern.match(message).hasMatch()) {
+        return false;
+    }
+
+    for (const QString &key : m_requiredDetailKeys) {
+        if (lookup(key).isEmpty()) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+QString MessageRule::render(const MessageContext &context) const
+{
+    // A "command" equal to the action id carries no information
+    const bool commandKnown = !context.command.isEmpty() && context.command != context.actionId;
+
+    if (m_needsCommand && !commandKnown && m_hasUnresolvedTemplate) {
+        return renderTemplate(m_unresolvedTemplate, context, false);
+    }
+    return renderTemplate(m_template, context, commandKnown);
+}
+
+// =============================================================================
+// MessageRules
+// =============================================================================
+
+QString MessageRules::configPath()
+{
+    const QString overridePath = qEnvironmentVariable("QUICKSHELL_POLKIT_MESSAGE_RULES");
+    if (!overridePath.isEmpty()) {
+        return overridePath;
+    }
+    return QStandardPaths::locate(QStandardPaths::GenericConfigLocation,
+                                  QStringLiteral("quickshell-polkit-agent/message-rules.json"));
+}
+
+MessageRules MessageRules::load()
+{
+    MessageRules rules;
+
+    const QString path = configPath();
+    if (!path.isEmpty()) {
+        QFile file(path);
+        if (file.open(QIODevice::ReadOnly)) {
+            QString error;
+            if (!rules.loadJson(file.readAll(), &error)) {
+                qCWarning(polkitAgent) << "Ignoring message rules in" << path << ":" << error;
+            } else {
+                qCDebug(polkitAgent) << "Loaded" << rules.ruleCount() << "message rules from" << path;
+            }
+        } else {
+            qCWarning(polkitAgent) << "Could not open message rules file:" << path;
+        }
+    }
+
+    rules.addBuiltinRules(qEnvironmentVariable("QUICKSHELL_POLKIT_RUN0_MESSAGE"));
+    return rules;
+}
+
+bool MessageRules::loadJson(const QByteArray &json, QString *error)
+{
+    QJsonParseError parseError;
+    const QJsonDocument doc = QJsonDocument::fromJson(json, &parseError);
+    if (parseError.error != QJsonParseError::NoError || !doc.isObject()) {
+        if (error) {
+            *error = parseError.error != QJsonParseError::NoError ? parseError.errorString()
+                                                                   : QStringLiteral("Top level must be an object");
+        }
+        return false;
+    }
+
+    const QJsonObject root = doc.object();
+    const QJsonArray rules = root["rules"].toArray();
+    for (const QJsonValue &value : rules) {
+        const QJsonObject rule = value.toObject();
+
+        QStringList detailKeys;
+        for (const QJsonValue &key : rule["detail_keys"].toArray()) {
+            detailKeys.append(key.toString());
+        }
+
+        QString ruleError;
+        if (!addRule(rule["action"].toString(), rule["message_regex"].toString(), detailKeys,
+                     rule["template"].toString(), rule["template_unresolved"].toString(), &ruleError)) {
+            qCWarning(polkitAgent) << "Skipping message rule for" << rule["action"].toString() << ":" << ruleError;
+        }
+    }
+
+    if (root.contains("fallback")) {
+        m_fallback = MessageRule();
+        m_fallback.m_template = MessageRule::compileTemplate(root["fallback"].toString(),
+                                                             &m_fallback.m_referencedDetailKeys,
+                                                             &m_fallback.m_needsCommand);
+        m_hasFallback = true;
+    }
+
+    return true;
+}
+
+void MessageRules::addBuiltinRules(const QString &run0Template)
+{
+    // systemd run0 / systemd-run transient service requests
+    QString withCommand = QStringLiteral("Authentication required to run '{command}' with elevated privileges");
+    QString withoutCommand = QStringLiteral("Authentication required to run command with elevated privileges");
+    if (!run0Template.isEmpty()) {
+        // Custom template, %1 is the command (or "command" until it is known)
+        withCommand = QString(run0Template).replace("%1", "{command}");
+        withoutCommand = QString();
+    }
+
+    addRule(RUN0_ACTION_ID, QStringLiteral("(?i)transient"), QStringList(),
+            withCommand, withoutCommand, nullptr);
+}
+
+bool MessageRules::addRule(const QString &action, const QString &messageRegex, const QStringList &detailKeys,
+                           const QString &templateText, const QString &unresolvedText, QString *error)
+{
+    if (action.isEmpty() || templateText.isEmpty()) {
+        if (error) {
+            *error = QStringLiteral("Rules need an action and a template");
+        }
+        return false;
+    }
+
+    MessageRule rule;
+    if (!messageRegex.isEmpty()) {
+        rule.m_messagePattern = QRegularExpression(messageRegex);
+        if (!rule.m_messagePattern.isValid()) {
+            if (error) {
+                *error = QStringLiteral("Invalid message_regex: ") + rule.m_messagePattern.errorString();
+            }
+            return false;
+        }
+        rule.m_messagePattern.optimize();
+        rule.m_hasMessagePattern = true;
+    }
+
+    rule.m_requiredDetailKeys = detailKeys;
+    rule.m_referencedDetailKeys = detailKeys;
+    rule.m_template = MessageRule::compileTemplate(templateText, &rule.m_referencedDetailKeys, &rule.m_needsCommand);
+    if (!unresolvedText.isEmpty()) {
+        bool unresolvedUsesCommand = false;
+        rule.m_unresolvedTemplate = MessageRule::compileTemplate(unresolvedText, &rule.m_referencedDetailKeys,
+                                                                 &unresolvedUsesCommand);
+        rule.m_hasUnresolvedTemplate = true;
+    }
+
+    if (action.endsWith(QLatin1String(".*"))) {
+        m_prefixRules[action.chopped(2)].append(rule);
+    } else {
+        m_exactRules[action].append(rule);
+    }
+    m_ruleCount++;
+    return true;
+}
+
+const MessageRule *MessageRules::matchBucket(const QHash<QString, QList<MessageRule>> &index, const QString &key,
+                                             const QString &message, const MessageRule::DetailLookup &lookup) const
+{
+    auto it = index.constFind(key);
+    if (it == index.constEnd()) {
+        return nullptr;
+    }
+
+    for (const MessageRule &rule : *it) {
+        if (rule.matches(message, lookup)) {
+            return &rule;
+        }
+    }
+    return nullptr;
+}
+
+const MessageRule *MessageRules::match(const QString &actionId, const QString &message,
+                                       const MessageRule::DetailLookup &lookup) const
+{
+    if (const MessageRule *rule = matchBucket(m_exactRules, actionId, message, lookup)) {
+        return rule;
+    }
+
+    // Longest dotted prefix first
+    if (!m_prefixRules.isEmpty()) {
+        qsizetype dot = actionId.size();
+        while ((dot = actionId.lastIndexOf('.', dot - 1)) > 0) {
+            if (const MessageRule *rule = matchBucket(m_prefixRules, actionId.left(dot), message, lookup)) {
+                return rule;
+            }
+        }
+    }
+
+    return m_hasFallback ? &m_fallback : nullptr;
+}
@@ -0,0 +1,137 @@
+/*
+ * quickshell-polkit-agent
+ * Copyright (C) 2025 Benny Powers
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <QHash>
+#include <QList>
+#include <QRegularExpression>
+#include <QString>
+#include <QStringList>
+#include <functional>
+
+/*
+ * Values a message template can refer to
+ *
+ * details holds only the keys the matched rule references, so callers don't
+ * copy the whole PolkitQt1::Details map.
+ */
+struct MessageContext {
+    QString actionId;
+    QString message;
+    QString command;                  // Resolved subject command, empty if not known (yet)
+    QHash<QString, QString> details;
+};
+
+/*
+ * One compiled rewrite rule
+ *
+ * Templates are split into literal and placeholder parts at load time:
+ *   {message}      original polkit message
+ *   {action_id}    polkit action id
+ *   {command}      command the subject runs (resolved from /proc, may arrive later)
+ *   {detail.KEY}   value of a PolkitQt1::Details key
+ * While {command} is unknown, unresolvedTemplate is used if the rule has one;
+ * otherwise {command} renders as "command".
+ */
+class MessageRule
+{
+public:
+    using DetailLookup = std::function<QString(const QString &key)>;
+
+    bool matches(const QString &message, const DetailLookup &lookup) const;
+    QString render(const MessageContext &context) const;
+
+    bool needsCommand() const { return m_needsCommand; }
+    const QStringList &referencedDetailKeys() const { return m_referencedDetailKeys; }
+
+private:
+    friend class MessageRules;
+
+    struct TemplatePart {
+        enum Kind { Literal, Message, ActionId, Command, Detail };
+        Kind kind;
+        QString text;  // Literal text, or the detail key
+    };
+    using Template = QList<TemplatePart>;
+
+    static Template compileTemplate(const QString &text, QStringList *detailKeys, bool *usesCommand);
+    static QString renderTemplate(const Template &parts, const MessageContext &context, bool commandKnown);
+
+    QRegularExpression m_messagePattern;  // Invalid/empty pattern matches everything
+    bool m_hasMessagePattern = false;
+    QStringList m_requiredDetailKeys;
+    Template m_template;
+    Template m_unresolvedTemplate;
+    bool m_hasUnresolvedTemplate = false;
+    bool m_needsCommand = false;
+    QStringList m_referencedDetailKeys;
+};
+
+/*
+ * Data-driven polkit message rewriting
+ *
+ * Rules are read once from a JSON file:
+ *
+ *   {
+ *     "rules": [
+ *       { "action": "org.freedesktop.udisks2.*",
+ *         "message_regex": "(?i)encrypted",
+ *         "detail_keys": ["drive.name"],
+ *         "template": "Unlock {detail.drive.name}" }
+ *     ],
+ *     "fallback": "{message}"
+ *   }
+ *
+ * "action" is an exact id, or a dot-separated prefix ending in ".*". Rules are
+ * indexed by hash: a request probes its exact id, then each dotted prefix from
+ * longest to shortest. Within one key the first rule whose regex and detail
+ * keys match wins. Rules from the config file precede the built-in ones.
+ */
+class MessageRules
+{
+public:
+    // Config file, then built-ins (run0)
+    static MessageRules load();
+
+    // Append rules from a JSON document; invalid rules are skipped with a warning
+    bool loadJson(const QByteArray &json, QString *error = nullptr);
+
+    // Built-in run0 rule; run0Template uses %1 for the command (QUICKSHELL_POLKIT_RUN0_MESSAGE)
+    void addBuiltinRules(const QString &run0Template = QString());
+
+    const MessageRule *match(const QString &actionId, const QString &message,
+                             const MessageRule::DetailLookup &lookup) const;
+
+    int ruleCount() const { return m_ruleCount; }
+
+    // QUICKSHELL_POLKIT_MESSAGE_RULES, else $XDG_CONFIG_HOME or $XDG_CONFIG_DIRS
+    static QString configPath();
+
+private:
+    bool addRule(const QString &action, const QString &messageRegex, const QStringList &detailKeys,
+                 const QString &templateText, const QString &unresolvedText, QString *error);
+    const MessageRule *matchBucket(const QHash<QString, QList<MessageRule>> &index, const QString &key,
+                                   const QString &message, const MessageRule::DetailLookup &lookup) const;
+
+    QHash<QString, QList<MessageRule>> m_exactRules;
+    QHash<QString, QList<MessageRule>> m_prefixRules;  // Keyed by prefix without ".*"
+    MessageRule m_fallback;
+    bool m_hasFallback = false;
+    int m_ruleCount = 0;
+};
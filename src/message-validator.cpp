@@ -1,172 +1,373 @@
 #include "message-validator.h"
+#include <QAnyStringView>
+#include <QJsonArray>
 #include <QJsonValue>
+#include <array>
+#include <iterator>
 
-const QStringList MessageValidator::VALID_MESSAGE_TYPES = {
-    "check_authorization",
-    "cancel_authorization", 
-    "submit_authentication",
-    "heartbeat"
+namespace {
+
+// What a field's value must look like beyond its JSON type and length
+enum class FieldCheck {
+    None,
+    ActionId,  // Non-empty, reverse DNS (contains a dot)
+    Cookie,    // Non-empty, [A-Za-z0-9_-]
+    Encoding   // "json" or "cbor"
 };
 
-ValidationResult MessageValidator::validateMessage(const QJsonObject &message)
+enum class FieldKind {
+    String,
+    Number,
+    Array    // maxLength bounds the element count
+};
+
+struct FieldSchema {
+    const char *name;
+    FieldKind kind;
+    bool required;
+    int maxLength;
+    FieldCheck check;
+};
+
+struct MessageSchema {
+    MessageType type;
+    const char *name;
+    const FieldSchema *fields;
+    int fieldCount;
+};
+
+template <size_t N>
+constexpr MessageSchema makeSchema(MessageType type, const char *name, const FieldSchema (&fields)[N])
 {
-    // First validate message type
-    auto typeResult = validateMessageType(message);
-    if (!typeResult.valid) {
-        return typeResult;
+    return {type, name, fields, int(std::size(fields))};
+}
+
+constexpr FieldSchema CHECK_AUTHORIZATION_FIELDS[] = {
+    {"action_id", FieldKind::String, true, MessageValidator::MAX_ACTION_ID_LENGTH, FieldCheck::ActionId},
+    {"details", FieldKind::String, false, MessageValidator::MAX_STRING_LENGTH, FieldCheck::None},
+};
+
+// Without a cookie every session is cancelled
+constexpr FieldSchema CANCEL_AUTHORIZATION_FIELDS[] = {
+    {"cookie", FieldKind::String, false, MessageValidator::MAX_COOKIE_LENGTH, FieldCheck::Cookie},
+};
+
+constexpr FieldSchema SUBMIT_AUTHENTICATION_FIELDS[] = {
+    {"cookie", FieldKind::String, true, MessageValidator::MAX_COOKIE_LENGTH, FieldCheck::Cookie},
+    {"response", FieldKind::String, true, MessageValidator::MAX_RESPONSE_LENGTH, FieldCheck::None},
+};
+
+constexpr FieldSchema HEARTBEAT_FIELDS[] = {
+    {"timestamp", FieldKind::Number, false, 0, FieldCheck::None},
+};
+
+constexpr FieldSchema SELECT_ENCODING_FIELDS[] = {
+    {"encoding", FieldKind::String, true, MessageValidator::MAX_ENCODING_LENGTH, FieldCheck::Encoding},
+};
+
+// Epoch is optional so a client that lost it still gets a snapshot
+constexpr FieldSchema RESUME_FIELDS[] = {
+    {"last_seq", FieldKind::Number, true, 0, FieldCheck::None},
+    {"epoch", FieldKind::String, false, MessageValidator::MAX_EPOCH_LENGTH, FieldCheck::None},
+};
+
+// Sub-messages are checked individually by validateBatchItems
+constexpr FieldSchema BATCH_FIELDS[] = {
+    {"messages", FieldKind::Array, true, MessageValidator::MAX_BATCH_MESSAGES, FieldCheck::None},
+};
+
+// Indexed by MessageType
+constexpr MessageSchema SCHEMAS[] = {
+    makeSchema(MessageType::CheckAuthorization, "check_authorization", CHECK_AUTHORIZATION_FIELDS),
+    makeSchema(MessageType::CancelAuthorization, "cancel_authorization", CANCEL_AUTHORIZATION_FIELDS),
+    makeSchema(MessageType::SubmitAuthentication, "submit_authentication", SUBMIT_AUTHENTICATION_FIELDS),
+    makeSchema(MessageType::Heartbeat, "heartbeat", HEARTBEAT_FIELDS),
+    makeSchema(MessageType::SelectEncoding, "select_encoding", SELECT_ENCODING_FIELDS),
+    makeSchema(MessageType::Resume, "resume", RESUME_FIELDS),
+    {MessageType::GetStats, "get_stats", nullptr, 0},  // No fields beyond the envelope
+    makeSchema(MessageType::Batch, "batch", BATCH_FIELDS),
+};
+
+static_assert(std::size(SCHEMAS) == static_cast<size_t>(MessageType::Unknown),
+              "Every MessageType needs a schema");
+static_assert([] {
+    for (size_t i = 0; i < std::size(SCHEMAS); ++i) {
+        if (SCHEMAS[i].type != MessageType(i)) {
+            return false;
+        }
     }
-    
-    QString type = message["type"].toString();
-    
-    // Validate specific message types
-    if (type == "check_authorization") {
-        return validateCheckAuthorization(message);
-    } else if (type == "cancel_authorization") {
-        return validateCancelAuthorization(message);
-    } else if (type == "submit_authentication") {
-        return validateSubmitAuthentication(message);
-    } else if (type == "heartbeat") {
-        return validateHeartbeat(message);
+    return true;
+}(), "SCHEMAS must be in MessageType order");
+
+// Keys any message may carry (type, the optional HMAC envelope, and a
+// correlation id that batch replies echo back)
+constexpr const char *ENVELOPE_KEYS[] = {"type", "hmac", "timestamp", "seq", "id"};
+
+// Cookies should be alphanumeric + limited special chars for security
+constexpr auto COOKIE_CHARSET = [] {
+    std::array<bool, 128> table{};
+    for (char c = '0'; c <= '9'; ++c) table[c] = true;
+    for (char c = 'a'; c <= 'z'; ++c) table[c] = true;
+    for (char c = 'A'; c <= 'Z'; ++c) table[c] = true;
+    table['-'] = true;
+    table['_'] = true;
+    return table;
+}();
+
+bool isEnvelopeKey(QAnyStringView key)
+{
+    for (const char *envelopeKey : ENVELOPE_KEYS) {
+        if (key == QLatin1String(envelopeKey)) {
+            return true;
+        }
     }
-    
-    return ValidationResult::failure("Unknown message type: " + type);
+    return false;
 }
 
-ValidationResult MessageValidator::validateCheckAuthorization(const QJsonObject &message)
+ValidationResult checkField(const FieldSchema &field, const QJsonValue &value)
 {
-    // action_id is required
-    auto actionResult = validateString(message, "action_id", true, MAX_ACTION_ID_LENGTH);
-    if (!actionResult.valid) {
-        return actionResult;
+    const QLatin1String name(field.name);
+    
+    if (field.kind == FieldKind::Number) {
+        if (!value.isDouble()) {
+            return ValidationResult::failure(QString("%1 must be a number").arg(name));
+        }
+        return ValidationResult::success();
     }
     
-    // details is optional
-    if (message.contains("details")) {
-        auto detailsResult = validateString(message, "details", false, MAX_STRING_LENGTH);
-        if (!detailsResult.valid) {
-            return detailsResult;
+    if (field.kind == FieldKind::Array) {
+        if (!value.isArray()) {
+            return ValidationResult::failure(QString("Field %1 must be an array").arg(name));
+        }
+        const qsizetype count = value.toArray().size();
+        if (count == 0) {
+            return ValidationResult::failure(QString("%1 cannot be empty").arg(name));
+        }
+        if (count > field.maxLength) {
+            return ValidationResult::failure(QString("Field %1 exceeds maximum of %2 entries").arg(name).arg(field.maxLength));
         }
+        return ValidationResult::success();
+    }
+    
+    if (!value.isString()) {
+        return ValidationResult::failure(QString("Field %1 must be a string").arg(name));
     }
     
-    // Additional security: validate action_id format (basic sanity check)
-    QString actionId = message["action_id"].toString();
-    if (actionId.isEmpty()) {
-        return ValidationResult::failure("action_id cannot be empty");
+    const QString str = value.toString();
+    if (str.length() > field.maxLength) {
+        return ValidationResult::failure(QString("Field %1 exceeds maximum length of %2 characters").arg(name).arg(field.maxLength));
     }
     
-    // Action IDs should be reverse DNS style: org.example.action
-    if (!actionId.contains('.')) {
-        return ValidationResult::failure("action_id must contain at least one dot (reverse DNS format)");
+    switch (field.check) {
+    case FieldCheck::None:
+        break;
+    case FieldCheck::ActionId:
+        if (str.isEmpty()) {
+            return ValidationResult::failure(QString("%1 cannot be empty").arg(name));
+        }
+        // Action IDs should be reverse DNS style: org.example.action
+        if (!str.contains('.')) {
+            return ValidationResult::failure(QString("%1 must contain at least one dot (reverse DNS format)").arg(name));
+        }
+        break;
+    case FieldCheck::Cookie:
+        if (str.isEmpty()) {
+            return ValidationResult::failure(QString("%1 cannot be empty").arg(name));
+        }
+        for (QChar c : str) {
+            if (c.unicode() >= COOKIE_CHARSET.size() || !COOKIE_CHARSET[c.unicode()]) {
+                return ValidationResult::failure(QString("%1 contains invalid characters").arg(name));
+            }
+        }
+        break;
+    case FieldCheck::Encoding:
+        if (str != QLatin1String("json") && str != QLatin1String("cbor")) {
+            return ValidationResult::failure("Unsupported encoding: " + str);
+        }
+        break;
     }
     
     return ValidationResult::success();
 }
 
-ValidationResult MessageValidator::validateCancelAuthorization(const QJsonObject &message)
+} // namespace
+
+MessageType MessageValidator::messageType(const QString &type)
 {
-    // Cancel authorization has no additional fields to validate
-    // Just ensure no unexpected fields are present
-    QStringList allowedKeys = {"type"};
-    
-    for (auto it = message.begin(); it != message.end(); ++it) {
-        if (!allowedKeys.contains(it.key())) {
-            return ValidationResult::failure("Unexpected field in cancel_authorization: " + it.key());
+    for (const MessageSchema &schema : SCHEMAS) {
+        if (type == QLatin1String(schema.name)) {
+            return schema.type;
         }
     }
-    
-    return ValidationResult::success();
+    return MessageType::Unknown;
 }
 
-ValidationResult MessageValidator::validateSubmitAuthentication(const QJsonObject &message)
+const char *MessageValidator::messageTypeName(MessageType type)
 {
-    // cookie is required
-    auto cookieResult = validateString(message, "cookie", true, MAX_COOKIE_LENGTH);
-    if (!cookieResult.valid) {
-        return cookieResult;
-    }
-    
-    // response is required
-    auto responseResult = validateString(message, "response", true, MAX_RESPONSE_LENGTH);
-    if (!responseResult.valid) {
-        return responseResult;
+    if (type == MessageType::Unknown) {
+        return "unknown";
     }
-    
-    // Additional validation for cookie format
-    QString cookie = message["cookie"].toString();
-    if (cookie.isEmpty()) {
-        return ValidationResult::failure("cookie cannot be empty");
+    return SCHEMAS[static_cast<int>(type)].name;
+}
+
+ValidationResult MessageValidator::validateMessage(const QJsonObject &message)
+{
+    // First validate message type
+    MessageType type = MessageType::Unknown;
+    auto typeResult = validateMessageType(message, &type);
+    if (!typeResult.valid) {
+        return typeResult;
     }
     
-    // Cookies should be alphanumeric + limited special chars for security
-    for (QChar c : cookie) {
-        if (!c.isLetterOrNumber() && c != '-' && c != '_') {
-            return ValidationResult::failure("cookie contains invalid characters");
-        }
+    ValidationResult result = validateAgainstSchema(message, type);
+    if (result.valid && type == MessageType::Batch) {
+        result = validateBatchItems(message);
     }
-    
-    return ValidationResult::success();
+    result.type = type;
+    return result;
 }
 
-ValidationResult MessageValidator::validateHeartbeat(const QJsonObject &message)
+ValidationResult MessageValidator::validateAgainstSchema(const QJsonObject &message, MessageType type)
 {
-    // Heartbeat has no additional fields to validate besides type
-    // Just ensure no unexpected fields are present
-    QStringList allowedKeys = {"type", "timestamp"};
+    const MessageSchema &schema = SCHEMAS[static_cast<int>(type)];
     
-    for (auto it = message.begin(); it != message.end(); ++it) {
-        if (!allowedKeys.contains(it.key())) {
-            return ValidationResult::failure("Unexpected field in heartbeat: " + it.key());
+    // Single pass: every key is either a schema field, an envelope key, or an error
+    quint32 seen = 0;
+    for (auto it = message.constBegin(); it != message.constEnd(); ++it) {
+        const QAnyStringView key = it.keyView();  // No QString per key
+        
+        int index = -1;
+        for (int i = 0; i < schema.fieldCount; ++i) {
+            if (key == QLatin1String(schema.fields[i].name)) {
+                index = i;
+                break;
+            }
+        }
+        
+        if (index < 0) {
+            if (isEnvelopeKey(key)) {
+                continue;
+            }
+            return ValidationResult::failure(QString("Unexpected field in %1: %2")
+                                             .arg(QLatin1String(schema.name), key.toString()));
+        }
+        
+        seen |= 1u << index;
+        auto fieldResult = checkField(schema.fields[index], it.value());
+        if (!fieldResult.valid) {
+            return fieldResult;
         }
     }
     
-    // If timestamp is provided, validate it's a number
-    if (message.contains("timestamp")) {
-        QJsonValue timestamp = message["timestamp"];
-        if (!timestamp.isDouble()) {
-            return ValidationResult::failure("timestamp must be a number");
+    for (int i = 0; i < schema.fieldCount; ++i) {
+        if (schema.fields[i].required && !(seen & (1u << i))) {
+            return ValidationResult::failure(QString("Missing required field: %1")
+                                             .arg(QLatin1String(schema.fields[i].name)));
         }
     }
     
     return ValidationResult::success();
 }
 
-ValidationResult MessageValidator::validateString(const QJsonObject &obj, const QString &key, bool required, int maxLength)
+ValidationResult MessageValidator::validateCheckAuthorization(const QJsonObject &message)
+{
+    return validateAgainstSchema(message, MessageType::CheckAuthorization);
+}
+
+ValidationResult MessageValidator::validateCancelAuthorization(const QJsonObject &message)
+{
+    return validateAgainstSchema(message, MessageType::CancelAuthorization);
+}
+
+ValidationResult MessageValidator::validateSubmitAuthentication(const QJsonObject &message)
 {
-    if (!obj.contains(key)) {
-        if (required) {
-            return ValidationResult::failure("Missing required field: " + key);
+    return validateAgainstSchema(message, MessageType::SubmitAuthentication);
+}
+
+ValidationResult MessageValidator::validateHeartbeat(const QJsonObject &message)
+{
+    return validateAgainstSchema(message, MessageType::Heartbeat);
+}
+
+ValidationResult MessageValidator::validateSelectEncoding(const QJsonObject &message)
+{
+    return validateAgainstSchema(message, MessageType::SelectEncoding);
+}
+
+ValidationResult MessageValidator::validateResume(const QJsonObject &message)
+{
+    return validateAgainstSchema(message, MessageType::Resume);
+}
+
+ValidationResult MessageValidator::validateGetStats(const QJsonObject &message)
+{
+    return validateAgainstSchema(message, MessageType::GetStats);
+}
+
+ValidationResult MessageValidator::validateBatch(const QJsonObject &message)
+{
+    ValidationResult result = validateAgainstSchema(message, MessageType::Batch);
+    return result.valid ? validateBatchItems(message) : result;
+}
+
+/*
+ * A batch is accepted or rejected as a whole
+ *
+ * Every sub-message must be a valid message in its own right and carry a
+ * correlation id. Signatures belong on the batch, not its parts. Nested
+ * batches and select_encoding, which would switch the encoding under the
+ * reply frame, are refused.
+ */
+ValidationResult MessageValidator::validateBatchItems(const QJsonObject &message)
+{
+    const QJsonArray items = message.value(QLatin1String("messages")).toArray();
+    for (qsizetype i = 0; i < items.size(); ++i) {
+        if (!items.at(i).isObject()) {
+            return ValidationResult::failure(QString("messages[%1] must be an object").arg(i));
+        }
+        const QJsonObject item = items.at(i).toObject();
+        
+        const QJsonValue id = item.value(QLatin1String("id"));
+        const bool validId = id.isDouble() ||
+                             (id.isString() && !id.toString().isEmpty() &&
+                              id.toString().length() <= MAX_CORRELATION_ID_LENGTH);
+        if (!validId) {
+            return ValidationResult::failure(QString("messages[%1] needs a string or number id").arg(i));
+        }
+        if (item.contains(QLatin1String("hmac"))) {
+            return ValidationResult::failure(QString("messages[%1]: sign the batch, not its messages").arg(i));
+        }
+        
+        const MessageType type = messageType(item.value(QLatin1String("type")).toString());
+        if (type == MessageType::Batch || type == MessageType::SelectEncoding) {
+            return ValidationResult::failure(QString("messages[%1]: %2 cannot be batched")
+                                             .arg(i).arg(QLatin1String(messageTypeName(type))));
+        }
+        
+        const ValidationResult itemResult = validateMessage(item);
+        if (!itemResult.valid) {
+            return ValidationResult::failure(QString("messages[%1]: %2").arg(i).arg(itemResult.error));
         }
-        return ValidationResult::success();
-    }
-    
-    QJsonValue value = obj[key];
-    if (!value.isString()) {
-        return ValidationResult::failure("Field " + key + " must be a string");
-    }
-    
-    QString str = value.toString();
-    if (str.length() > maxLength) {
-        return ValidationResult::failure(QString("Field %1 exceeds maximum length of %2 characters").arg(key).arg(maxLength));
     }
-    
     return ValidationResult::success();
 }
 
-ValidationResult MessageValidator::validateMessageType(const QJsonObject &obj)
+ValidationResult MessageValidator::validateMessageType(const QJsonObject &obj, MessageType *type)
 {
-    if (!obj.contains("type")) {
+    auto it = obj.constFind(QLatin1String("type"));
+    if (it == obj.constEnd()) {
         return ValidationResult::failure("Missing required field: type");
     }
     
-    QJsonValue typeValue = obj["type"];
-    if (!typeValue.isString()) {
+    if (!it.value().isString()) {
         return ValidationResult::failure("Field 'type' must be a string");
     }
     
-    QString type = typeValue.toString();
-    if (!VALID_MESSAGE_TYPES.contains(type)) {
-        return ValidationResult::failure("Invalid message type: " + type);
+    const QString typeName = it.value().toString();
+    *type = messageType(typeName);
+    if (*type == MessageType::Unknown) {
+        return ValidationResult::failure("Invalid message type: " + typeName);
     }
     
     return ValidationResult::success();
-}
\ No newline at end of file
+}
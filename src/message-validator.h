@@ -4,9 +4,23 @@
 #include <QString>
 #include <QStringList>
 
+// Client-to-agent message types, in schema table order
+enum class MessageType {
+    CheckAuthorization,
+    CancelAuthorization,
+    SubmitAuthentication,
+    Heartbeat,
+    SelectEncoding,
+    Resume,
+    GetStats,
+    Batch,
+    Unknown
+};
+
 struct ValidationResult {
     bool valid;
     QString error;
+    MessageType type = MessageType::Unknown;  // Resolved type, for dispatch without string compares
     
     ValidationResult(bool v = true, const QString &e = QString()) 
         : valid(v), error(e) {}
@@ -26,19 +40,28 @@ public:
     static ValidationResult validateCancelAuthorization(const QJsonObject &message);
     static ValidationResult validateSubmitAuthentication(const QJsonObject &message);
     static ValidationResult validateHeartbeat(const QJsonObject &message);
+    static ValidationResult validateSelectEncoding(const QJsonObject &message);
+    static ValidationResult validateResume(const QJsonObject &message);
+    static ValidationResult validateGetStats(const QJsonObject &message);
+    static ValidationResult validateBatch(const QJsonObject &message);
     
-private:
-    // Helper validation functions
-    static ValidationResult validateString(const QJsonObject &obj, const QString &key, 
-                                         bool required = true, int maxLength = 1024);
-    static ValidationResult validateMessageType(const QJsonObject &obj);
+    // Type lookup without allocating; Unknown for anything not in the schema table
+    static MessageType messageType(const QString &type);
+    static const char *messageTypeName(MessageType type);
     
     // Security limits
     static constexpr int MAX_STRING_LENGTH = 4096;
     static constexpr int MAX_ACTION_ID_LENGTH = 256;
     static constexpr int MAX_COOKIE_LENGTH = 128;
     static constexpr int MAX_RESPONSE_LENGTH = 8192; // For passwords/FIDO responses
+    static constexpr int MAX_ENCODING_LENGTH = 16;
+    static constexpr int MAX_EPOCH_LENGTH = 32;
+    static constexpr int MAX_BATCH_MESSAGES = 16;
+    static constexpr int MAX_CORRELATION_ID_LENGTH = 64;
     
-    // Allowed message types
-    static const QStringList VALID_MESSAGE_TYPES;
-};
\ No newline at end of file
+private:
+    // Check every key of message against the schema for type in one pass
+    static ValidationResult validateAgainstSchema(const QJsonObject &message, MessageType type);
+    static ValidationResult validateMessageType(const QJsonObject &obj, MessageType *type);
+    static ValidationResult validateBatchItems(const QJsonObject &message);
+};
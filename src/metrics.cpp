@@ -0,0 +1,397 @@
+/*
+ * quickshell-polkit-agent
+ * Copyright (C) 2025 Benny Powers
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "metrics.h"
+#include <QJsonArray>
+#include <atomic>
+
+namespace {
+
+constexpr int COUNTER_COUNT = static_cast<int>(Metrics::Counter::Count);
+constexpr int HISTOGRAM_COUNT = static_cast<int>(Metrics::Histogram::Count);
+constexpr int TYPE_COUNT = static_cast<int>(MessageType::Unknown) + 1;  // Unknown counts unparseable frames
+constexpr int CLASS_COUNT = static_cast<int>(RateLimiter::MessageClass::Count);
+
+using Cell = std::atomic<quint64>;
+static_assert(Cell::is_always_lock_free, "Metrics must not take a lock on the hot path");
+
+struct HistogramCells {
+    Cell buckets[Metrics::BUCKET_COUNT];
+    Cell count;
+    Cell sumNs;
+};
+
+struct Registry {
+    Cell counters[COUNTER_COUNT];
+    Cell received[TYPE_COUNT];
+    Cell rejected[TYPE_COUNT];
+    Cell rateLimited[CLASS_COUNT];
+    HistogramCells histograms[HISTOGRAM_COUNT];
+    Cell transitions[AuthStateMachine::EDGE_COUNT];  // Indexed by AuthStateMachine::edgeIndex
+};
+
+// Namespace scope and zero-initialized, so recording needs no guard check
+Registry g_registry;
+
+void add(Cell &cell, quint64 amount = 1)
+{
+    cell.fetch_add(amount, std::memory_order_relaxed);
+}
+
+quint64 load(const Cell &cell)
+{
+    return cell.load(std::memory_order_relaxed);
+}
+
+int typeIndex(MessageType type)
+{
+    return static_cast<int>(type);
+}
+
+const char *METRIC_PREFIX = "quickshell_polkit_";
+
+// Indexed by Metrics::Counter and Metrics::Histogram
+const char *const COUNTER_HELP[] = {
+    "Raw bytes read from client sockets",
+    "Bytes written to client sockets",
+    "Client frames rejected for exceeding the frame size limit",
+    "Non-critical frames shed over the output watermark",
+    "Client connections accepted",
+    "Failed PAM attempts",
+    "Client connections refused by the peer credential policy",
+    "Session state changes refused as illegal transitions",
+    "Memory trims after a quiet period without clients or sessions",
+};
+const char *const HISTOGRAM_HELP[] = {
+    "Time from initiateAuthentication to the password prompt reaching the client socket",
+    "Time from response submission to PAM completing",
+};
+static_assert(sizeof(COUNTER_HELP) / sizeof(COUNTER_HELP[0]) == COUNTER_COUNT, "Every Counter needs help text");
+static_assert(sizeof(HISTOGRAM_HELP) / sizeof(HISTOGRAM_HELP[0]) == HISTOGRAM_COUNT, "Every Histogram needs help text");
+
+void appendHelp(QByteArray &out, const QByteArray &name, const char *type, const char *help)
+{
+    out += "# HELP " + name + ' ' + help + '\n';
+    out += "# TYPE " + name + ' ' + type + '\n';
+}
+
+// Edges are recorded only for legal transitions, so visiting those is enough
+template<typename Visit>
+void forEachEdge(Visit visit)
+{
+    for (int from = 0; from < AuthStateMachine::STATE_COUNT; ++from) {
+        for (int to = 0; to < AuthStateMachine::STATE_COUNT; ++to) {
+            const auto source = static_cast<AuthenticationState>(from);
+            const auto target = static_cast<AuthenticationState>(to);
+            if (AuthStateMachine::isLegal(source, target)) {
+                visit(source, target, load(g_registry.transitions[AuthStateMachine::edgeIndex(source, target)]));
+            }
+        }
+    }
+}
+
+void appendSample(QByteArray &out, const QByteArray &name, const QByteArray &labels, double value)
+{
+    out += name;
+    if (!labels.isEmpty()) {
+        out += '{' + labels + '}';
+    }
+    out += ' ' + QByteArray::number(value, 'g', 15) + '\n';
+}
+
+} // namespace
+
+void Metrics::increment(Counter counter, quint64 amount)
+{
+    add(g_registry.counters[static_cast<int>(counter)], amount);
+}
+
+void Metrics::messageReceived(MessageType type)
+{
+    add(g_registry.received[typeIndex(type)]);
+}
+
+void Metrics::messageRejected(MessageType type)
+{
+    add(g_registry.rejected[typeIndex(type)]);
+}
+
+void Metrics::messageRateLimited(RateLimiter::MessageClass messageClass)
+{
+    add(g_registry.rateLimited[static_cast<int>(messageClass)]);
+}
+
+void Metrics::observe(Histogram histogram, qint64 ns)
+{
+    if (ns < 0) {
+        return;
+    }
+
+    HistogramCells &cells = g_registry.histograms[static_cast<int>(histogram)];
+    const qint64 ms = ns / 1000000;
+    int bucket = 0;
+    while (bucket < BUCKET_COUNT - 1 && ms > BUCKET_BOUNDS_MS[bucket]) {
+        ++bucket;
+    }
+    add(cells.buckets[bucket]);
+    add(cells.count);
+    add(cells.sumNs, quint64(ns));
+}
+
+void Metrics::stateTransition(AuthenticationState from, AuthenticationState to)
+{
+    add(g_registry.transitions[AuthStateMachine::edgeIndex(from, to)]);
+}
+
+quint64 Metrics::counter(Counter counter)
+{
+    return load(g_registry.counters[static_cast<int>(counter)]);
+}
+
+quint64 Metrics::received(MessageType type)
+{
+    return load(g_registry.received[typeIndex(type)]);
+}
+
+quint64 Metrics::rejected(MessageType type)
+{
+    return load(g_registry.rejected[typeIndex(type)]);
+}
+
+quint64 Metrics::rateLimited(RateLimiter::MessageClass messageClass)
+{
+    return load(g_registry.rateLimited[static_cast<int>(messageClass)]);
+}
+
+quint64 Metrics::histogramCount(Histogram histogram)
+{
+    return load(g_registry.histograms[static_cast<int>(histogram)].count);
+}
+
+quint64 Metrics::transitionCount(AuthenticationState from, AuthenticationState to)
+{
+    return load(g_registry.transitions[AuthStateMachine::edgeIndex(from, to)]);
+}
+
+bool Metrics::isEnabled()
+{
+    static const bool enabled = qEnvironmentVariable("QUICKSHELL_POLKIT_METRICS") == QLatin1String("1");
+    return enabled;
+}
+
+const char *Metrics::counterName(Counter counter)
+{
+    switch (counter) {
+    case Counter::BytesIn: return "bytes_in";
+    case Counter::BytesOut: return "bytes_out";
+    case Counter::OversizedFrames: return "oversized_frames";
+    case Counter::DroppedFrames: return "dropped_frames";
+    case Counter::Connections: return "connections";
+    case Counter::AuthRetries: return "auth_retries";
+    case Counter::PeersDenied: return "peers_denied";
+    case Counter::IllegalTransitions: return "illegal_transitions";
+    case Counter::IdleTrims: return "idle_trims";
+    case Counter::Count: break;
+    }
+    return "unknown";
+}
+
+const char *Metrics::histogramName(Histogram histogram)
+{
+    switch (histogram) {
+    case Histogram::TimeToPrompt: return "time_to_prompt";
+    case Histogram::PamCompletion: return "pam_completion";
+    case Histogram::Count: break;
+    }
+    return "unknown";
+}
+
+QJsonObject Metrics::toJson(const Gauges &gauges)
+{
+    QJsonObject counters;
+    for (int i = 0; i < COUNTER_COUNT; ++i) {
+        counters[counterName(static_cast<Counter>(i))] = double(load(g_registry.counters[i]));
+    }
+
+    QJsonObject received;
+    QJsonObject rejected;
+    for (int i = 0; i < TYPE_COUNT; ++i) {
+        const char *name = MessageValidator::messageTypeName(static_cast<MessageType>(i));
+        received[name] = double(load(g_registry.received[i]));
+        rejected[name] = double(load(g_registry.rejected[i]));
+    }
+
+    QJsonObject rateLimited;
+    for (int i = 0; i < CLASS_COUNT; ++i) {
+        rateLimited[RateLimiter::className(static_cast<RateLimiter::MessageClass>(i))] =
+            double(load(g_registry.rateLimited[i]));
+    }
+
+    QJsonObject sessions;
+    for (const auto &entry : gauges.sessionsByState) {
+        sessions[entry.first] = entry.second;
+    }
+    QJsonObject gaugeValues;
+    gaugeValues["clients"] = gauges.clients;
+    gaugeValues["replay_sessions"] = gauges.replaySessions;
+    gaugeValues["output_bytes_pending"] = double(gauges.outputBytesPending);
+    gaugeValues["sessions"] = sessions;
+
+    QJsonObject histograms;
+    for (int h = 0; h < HISTOGRAM_COUNT; ++h) {
+        const HistogramCells &cells = g_registry.histograms[h];
+        QJsonArray buckets;
+        for (int b = 0; b < BUCKET_COUNT; ++b) {
+            QJsonObject bucket;
+            if (b < BUCKET_COUNT - 1) {
+                bucket["le_ms"] = BUCKET_BOUNDS_MS[b];
+            }
+            bucket["count"] = double(load(cells.buckets[b]));
+            buckets.append(bucket);
+        }
+        QJsonObject histogram;
+        histogram["count"] = double(load(cells.count));
+        histogram["sum_ms"] = double(load(cells.sumNs)) / 1e6;
+        histogram["buckets"] = buckets;
+        histograms[histogramName(static_cast<Histogram>(h))] = histogram;
+    }
+
+    // Only edges taken at least once, keyed FROM->TO
+    QJsonObject transitions;
+    forEachEdge([&transitions](AuthenticationState from, AuthenticationState to, quint64 count) {
+        if (count > 0) {
+            const QString edge = QString("%1->%2").arg(QLatin1String(AuthStateMachine::stateName(from)),
+                                                       QLatin1String(AuthStateMachine::stateName(to)));
+            transitions[edge] = double(count);
+        }
+    });
+
+    QJsonObject stats;
+    stats["counters"] = counters;
+    stats["received"] = received;
+    stats["rejected"] = rejected;
+    stats["rate_limited"] = rateLimited;
+    stats["gauges"] = gaugeValues;
+    stats["histograms"] = histograms;
+    stats["transitions"] = transitions;
+    return stats;
+}
+
+/*
+ * Prometheus text exposition format (version 0.0.4)
+ *
+ * Histogram buckets are cumulative and in seconds, as the format expects.
+ */
+QByteArray Metrics::toPrometheus(const Gauges &gauges)
+{
+    QByteArray out;
+    const QByteArray prefix(METRIC_PREFIX);
+
+    for (int i = 0; i < COUNTER_COUNT; ++i) {
+        const QByteArray name = prefix + counterName(static_cast<Counter>(i)) + "_total";
+        appendHelp(out, name, "counter", COUNTER_HELP[i]);
+        appendSample(out, name, QByteArray(), double(load(g_registry.counters[i])));
+    }
+
+    const QByteArray receivedName = prefix + "messages_received_total";
+    appendHelp(out, receivedName, "counter", "Valid client messages by type");
+    for (int i = 0; i < TYPE_COUNT; ++i) {
+        appendSample(out, receivedName,
+                     QByteArray("type=\"") + MessageValidator::messageTypeName(static_cast<MessageType>(i)) + '"',
+                     double(load(g_registry.received[i])));
+    }
+
+    const QByteArray rejectedName = prefix + "messages_rejected_total";
+    appendHelp(out, rejectedName, "counter", "Client messages rejected by validation or authentication");
+    for (int i = 0; i < TYPE_COUNT; ++i) {
+        appendSample(out, rejectedName,
+                     QByteArray("type=\"") + MessageValidator::messageTypeName(static_cast<MessageType>(i)) + '"',
+                     double(load(g_registry.rejected[i])));
+    }
+
+    const QByteArray limitedName = prefix + "messages_rate_limited_total";
+    appendHelp(out, limitedName, "counter", "Client frames shed before parsing, by rate limit class");
+    for (int i = 0; i < CLASS_COUNT; ++i) {
+        appendSample(out, limitedName,
+                     QByteArray("class=\"") + RateLimiter::className(static_cast<RateLimiter::MessageClass>(i)) + '"',
+                     double(load(g_registry.rateLimited[i])));
+    }
+
+    appendHelp(out, prefix + "clients", "gauge", "Connected clients");
+    appendSample(out, prefix + "clients", QByteArray(), gauges.clients);
+    appendHelp(out, prefix + "replay_sessions", "gauge", "Sessions held for the next client to connect");
+    appendSample(out, prefix + "replay_sessions", QByteArray(), gauges.replaySessions);
+    appendHelp(out, prefix + "output_bytes_pending", "gauge", "Unflushed output across clients");
+    appendSample(out, prefix + "output_bytes_pending", QByteArray(), double(gauges.outputBytesPending));
+
+    const QByteArray sessionsName = prefix + "sessions";
+    appendHelp(out, sessionsName, "gauge", "Live authentication sessions by state");
+    for (const auto &entry : gauges.sessionsByState) {
+        appendSample(out, sessionsName, "state=\"" + entry.first.toLatin1() + '"', entry.second);
+    }
+
+    const QByteArray transitionsName = prefix + "state_transitions_total";
+    appendHelp(out, transitionsName, "counter", "Authentication session state changes by edge");
+    forEachEdge([&out, &transitionsName](AuthenticationState from, AuthenticationState to, quint64 count) {
+        if (count > 0) {
+            appendSample(out, transitionsName,
+                         QByteArray("from=\"") + AuthStateMachine::stateName(from) + "\",to=\"" +
+                             AuthStateMachine::stateName(to) + '"',
+                         double(count));
+        }
+    });
+
+    for (int h = 0; h < HISTOGRAM_COUNT; ++h) {
+        const HistogramCells &cells = g_registry.histograms[h];
+        const QByteArray name = prefix + histogramName(static_cast<Histogram>(h)) + "_seconds";
+        appendHelp(out, name, "histogram", HISTOGRAM_HELP[h]);
+
+        quint64 cumulative = 0;
+        for (int b = 0; b < BUCKET_COUNT; ++b) {
+            cumulative += load(cells.buckets[b]);
+            const QByteArray le = b < BUCKET_COUNT - 1 ? QByteArray::number(BUCKET_BOUNDS_MS[b] / 1000.0, 'g', 6)
+                                                       : QByteArray("+Inf");
+            appendSample(out, name + "_bucket", "le=\"" + le + '"', double(cumulative));
+        }
+        appendSample(out, name + "_sum", QByteArray(), double(load(cells.sumNs)) / 1e9);
+        appendSample(out, name + "_count", QByteArray(), double(load(cells.count)));
+    }
+
+    return out;
+}
+
+#ifdef BUILD_TESTING
+void Metrics::testReset()
+{
+    auto clear = [](Cell *cells, int count) {
+        for (int i = 0; i < count; ++i) {
+            cells[i].store(0, std::memory_order_relaxed);
+        }
+    };
+    clear(g_registry.counters, COUNTER_COUNT);
+    clear(g_registry.received, TYPE_COUNT);
+    clear(g_registry.rejected, TYPE_COUNT);
+    clear(g_registry.rateLimited, CLASS_COUNT);
+    clear(g_registry.transitions, AuthStateMachine::EDGE_COUNT);
+    for (HistogramCells &cells : g_registry.histograms) {
+        clear(cells.buckets, BUCKET_COUNT);
+        cells.count.store(0, std::memory_order_relaxed);
+        cells.sumNs.store(0, std::memory_order_relaxed);
+    }
+}
+#endif
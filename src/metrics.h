@@ -0,0 +1,103 @@
+/*
+ * quickshell-polkit-agent
+ * Copyright (C) 2025 Benny Powers
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <QByteArray>
+#include <QJsonObject>
+#include <QList>
+#include <QPair>
+#include <QString>
+
+#include "auth-state-machine.h"
+#include "message-validator.h"
+#include "rate-limiter.h"
+
+/*
+ * In-process runtime metrics
+ *
+ * Counters and histogram buckets are fixed arrays of relaxed atomics, so
+ * recording is a single uncontended fetch_add with no lock or allocation
+ * and is always on. Reading them (get_stats, the Prometheus text file) is
+ * opt-in with QUICKSHELL_POLKIT_METRICS=1 and happens off the hot path.
+ *
+ * Values that already live elsewhere (connected clients, queued replay
+ * state, sessions by state) are not mirrored here; the caller samples them
+ * into Gauges when rendering.
+ */
+class Metrics
+{
+public:
+    enum class Counter {
+        BytesIn = 0,         // Raw bytes read from client sockets
+        BytesOut,            // Bytes written to client sockets
+        OversizedFrames,     // Frames rejected for exceeding MAX_FRAME_SIZE
+        DroppedFrames,       // Non-critical frames shed over the output watermark
+        Connections,         // Clients accepted
+        AuthRetries,         // PAM rejections that left the session retryable or locked out
+        PeersDenied,         // Connections refused by the SO_PEERCRED policy
+        IllegalTransitions,  // State changes refused by AuthStateMachine
+        IdleTrims,           // Times IdleTrimmer released memory after a quiet period
+        Count
+    };
+
+    enum class Histogram {
+        TimeToPrompt = 0,    // initiateAuthentication to password_request written
+        PamCompletion,       // Response submitted to Session::completed
+        Count
+    };
+
+    // Point-in-time values sampled by the caller at render time
+    struct Gauges {
+        int clients = 0;
+        int replaySessions = 0;            // Sessions held in the replay outbox
+        qint64 outputBytesPending = 0;     // Unflushed output across clients
+        QList<QPair<QString, int>> sessionsByState;
+    };
+
+    static void increment(Counter counter, quint64 amount = 1);
+    static void messageReceived(MessageType type);
+    static void messageRejected(MessageType type);
+    static void messageRateLimited(RateLimiter::MessageClass messageClass);
+    static void observe(Histogram histogram, qint64 ns);
+    static void stateTransition(AuthenticationState from, AuthenticationState to);
+
+    static quint64 counter(Counter counter);
+    static quint64 received(MessageType type);
+    static quint64 rejected(MessageType type);
+    static quint64 rateLimited(RateLimiter::MessageClass messageClass);
+    static quint64 histogramCount(Histogram histogram);
+    static quint64 transitionCount(AuthenticationState from, AuthenticationState to);
+
+    // Exposure is opt-in; recording is not
+    static bool isEnabled();
+
+    static QJsonObject toJson(const Gauges &gauges);
+    static QByteArray toPrometheus(const Gauges &gauges);
+
+    static const char *counterName(Counter counter);
+    static const char *histogramName(Histogram histogram);
+
+    // Upper bounds of the histogram buckets in milliseconds; one more bucket catches the rest
+    static constexpr int BUCKET_BOUNDS_MS[] = {5, 10, 25, 50, 100, 250, 500, 1000, 2500, 5000, 10000, 30000};
+    static constexpr int BUCKET_COUNT = int(sizeof(BUCKET_BOUNDS_MS) / sizeof(BUCKET_BOUNDS_MS[0])) + 1;
+
+#ifdef BUILD_TESTING
+    static void testReset();
+#endif
+};
@@ -18,53 +18,137 @@
 
 #include "nfc-detector.h"
 #include "logging.h"
-#include <QProcess>
-#include <QStringList>
+#include <QDir>
+#include <QFile>
+#include <QSocketNotifier>
+#include <QTimer>
 
-bool UsbNfcDetector::isPresent()
-{
-    QProcess lsusb;
-    lsusb.start("lsusb");
+#include <cerrno>
+#include <cstring>
+#include <linux/netlink.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace {
+
+// Known NFC/FIDO device identifiers
+// Add new device vendor IDs or product names here as needed
+struct KnownDevice {
+    const char *vendorId;  // sysfs idVendor, lowercase hex
+    const char *name;      // for logging
+};
 
-    // Check if process started successfully
-    if (lsusb.state() == QProcess::NotRunning) {
-        qCDebug(polkitAgent) << "Failed to start lsusb - command not available";
-        return false;
+constexpr KnownDevice KNOWN_DEVICES[] = {
+    {"072f", "ACS (ACR122U and other readers)"},
+    {"1050", "Yubico"},
+    // Add more devices here as needed
+};
+
+QByteArray readAttribute(const QString &path)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return QByteArray();
     }
+    return file.readAll().trimmed().toLower();
+}
+
+} // namespace
+
+UsbNfcDetector::UsbNfcDetector(const QString &sysfsRoot, QObject *parent)
+    : INfcDetector(parent)
+    , m_sysfsRoot(sysfsRoot)
+    , m_present(false)
+    , m_ueventFd(-1)
+    , m_ueventNotifier(nullptr)
+    , m_rescanTimer(new QTimer(this))
+{
+    m_rescanTimer->setSingleShot(true);
+    m_rescanTimer->setInterval(RESCAN_DELAY_MS);
+    connect(m_rescanTimer, &QTimer::timeout, this, &UsbNfcDetector::rescan);
 
-    // Timeout increased to handle systems with many USB devices or under load
-    if (!lsusb.waitForFinished(500)) {
-        qCDebug(polkitAgent) << "lsusb command timed out:" << lsusb.errorString();
-        lsusb.kill();
-        return false;
+    m_present = scanSysfs();
+    qCDebug(polkitAgent) << "Initial NFC/FIDO reader scan:" << (m_present ? "present" : "not present");
+
+    startHotplugMonitor();
+}
+
+UsbNfcDetector::~UsbNfcDetector()
+{
+    if (m_ueventFd >= 0) {
+        ::close(m_ueventFd);
     }
+}
 
-    // Check for process errors after completion
-    if (lsusb.exitStatus() != QProcess::NormalExit || lsusb.exitCode() != 0) {
-        qCDebug(polkitAgent) << "lsusb command failed:" << lsusb.errorString();
-        return false;
+void UsbNfcDetector::rescan()
+{
+    bool present = scanSysfs();
+    if (present == m_present) {
+        return;
     }
 
-    QString output = QString::fromUtf8(lsusb.readAllStandardOutput()).toLower();
-
-    // Known NFC/FIDO device identifiers
-    // Add new device vendor IDs or product names here as needed
-    static const QStringList knownDevices = {
-        "072f:",     // ACS (ACR122U and other readers)
-        "acr122",    // ACR122U by name
-        "1050:",     // Yubico vendor ID
-        "yubikey",   // YubiKey by name
-        // Add more devices here as needed
-    };
-
-    // Check if any known device is present
-    for (const QString& device : knownDevices) {
-        if (output.contains(device)) {
-            qCDebug(polkitAgent) << "NFC/FIDO device detected:" << device;
-            return true;
+    m_present = present;
+    qCDebug(polkitAgent) << "NFC/FIDO reader" << (present ? "connected" : "removed");
+    emit presenceChanged(present);
+}
+
+bool UsbNfcDetector::scanSysfs() const
+{
+    // Device entries carry idVendor; interface entries (e.g. 1-1:1.0) don't and are skipped
+    const QStringList entries = QDir(m_sysfsRoot).entryList(QDir::Dirs | QDir::NoDotAndDotDot);
+    for (const QString &entry : entries) {
+        const QByteArray vendorId = readAttribute(m_sysfsRoot + '/' + entry + "/idVendor");
+        if (vendorId.isEmpty()) {
+            continue;
+        }
+
+        for (const KnownDevice &device : KNOWN_DEVICES) {
+            if (vendorId == device.vendorId) {
+                qCDebug(polkitAgent) << "NFC/FIDO device detected:" << device.name << "at" << entry;
+                return true;
+            }
         }
     }
 
-    qCDebug(polkitAgent) << "No NFC/FIDO reader detected";
     return false;
 }
+
+void UsbNfcDetector::startHotplugMonitor()
+{
+    m_ueventFd = ::socket(AF_NETLINK, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, NETLINK_KOBJECT_UEVENT);
+    if (m_ueventFd < 0) {
+        qCDebug(polkitAgent) << "Hotplug monitoring unavailable:" << strerror(errno);
+        return;
+    }
+
+    // Kernel uevent multicast group; no udev daemon required
+    sockaddr_nl address = {};
+    address.nl_family = AF_NETLINK;
+    address.nl_groups = 1;
+    if (::bind(m_ueventFd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) < 0) {
+        qCDebug(polkitAgent) << "Hotplug monitoring unavailable:" << strerror(errno);
+        ::close(m_ueventFd);
+        m_ueventFd = -1;
+        return;
+    }
+
+    m_ueventNotifier = new QSocketNotifier(m_ueventFd, QSocketNotifier::Read, this);
+    connect(m_ueventNotifier, &QSocketNotifier::activated, this, &UsbNfcDetector::onUeventReadable);
+}
+
+void UsbNfcDetector::onUeventReadable()
+{
+    // Drain every queued uevent; only USB ones can change the answer
+    char buffer[4096];
+    bool usbEvent = false;
+    ssize_t length;
+    while ((length = ::recv(m_ueventFd, buffer, sizeof(buffer), 0)) > 0) {
+        if (QByteArray::fromRawData(buffer, length).contains("SUBSYSTEM=usb")) {
+            usbEvent = true;
+        }
+    }
+
+    if (usbEvent) {
+        m_rescanTimer->start();
+    }
+}
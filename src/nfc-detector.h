@@ -18,15 +18,25 @@
 
 #pragma once
 
+#include <QObject>
+#include <QString>
+
+class QSocketNotifier;
+class QTimer;
+
 /**
  * Interface for NFC reader detection
  *
  * Allows dependency injection for testing FIDO authentication flows
  * without requiring actual hardware.
  */
-class INfcDetector
+class INfcDetector : public QObject
 {
+    Q_OBJECT
+
 public:
+    explicit INfcDetector(QObject *parent = nullptr)
+        : QObject(parent) {}
     virtual ~INfcDetector() = default;
 
     /**
@@ -34,15 +44,52 @@ public:
      * @return true if NFC reader detected, false otherwise
      */
     virtual bool isPresent() = 0;
+
+signals:
+    /**
+     * Emitted when a reader is plugged in or removed
+     * @param present The new value of isPresent()
+     */
+    void presenceChanged(bool present);
 };
 
 /**
  * Real NFC detector using USB device enumeration
+ *
+ * Enumerates idVendor/product under sysfs once at construction and keeps the
+ * result current from kernel uevents (NETLINK_KOBJECT_UEVENT), so isPresent()
+ * is a cached read that never blocks the event loop.
  */
 class UsbNfcDetector : public INfcDetector
 {
+    Q_OBJECT
+
 public:
-    bool isPresent() override;
+    explicit UsbNfcDetector(const QString &sysfsRoot = QStringLiteral("/sys/bus/usb/devices"),
+                            QObject *parent = nullptr);
+    ~UsbNfcDetector() override;
+
+    bool isPresent() override { return m_present; }
+
+    /**
+     * Re-enumerate sysfs, emitting presenceChanged() if the result changed
+     */
+    void rescan();
+
+private slots:
+    void onUeventReadable();
+
+private:
+    bool scanSysfs() const;
+    void startHotplugMonitor();
+
+    QString m_sysfsRoot;
+    bool m_present;
+    int m_ueventFd;
+    QSocketNotifier *m_ueventNotifier;
+    QTimer *m_rescanTimer;  // Coalesces the burst of uevents one plug generates
+
+    static constexpr int RESCAN_DELAY_MS = 200;
 };
 
 /**
@@ -52,13 +99,21 @@ public:
 #ifdef BUILD_TESTING
 class MockNfcDetector : public INfcDetector
 {
+    Q_OBJECT
+
 public:
     explicit MockNfcDetector(bool present = false)
         : m_present(present) {}
 
     bool isPresent() override { return m_present; }
 
-    void setPresent(bool present) { m_present = present; }
+    void setPresent(bool present)
+    {
+        if (m_present != present) {
+            m_present = present;
+            emit presenceChanged(present);
+        }
+    }
 
 private:
     bool m_present;
@@ -0,0 +1,169 @@
+/*
+ * quickshell-polkit-agent
+ * Copyright (C) 2025 Benny Powers
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "peer-credentials.h"
+#include "logging.h"
+
+#include <QStringList>
+
+#include <cerrno>
+#include <cstring>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+PeerCredentials::~PeerCredentials()
+{
+    if (m_pidfd >= 0) {
+        ::close(m_pidfd);
+    }
+}
+
+PeerCredentials::PeerCredentials(PeerCredentials &&other) noexcept
+    : m_valid(other.m_valid), m_uid(other.m_uid), m_gid(other.m_gid), m_pid(other.m_pid), m_pidfd(other.m_pidfd)
+{
+    other.m_valid = false;
+    other.m_pidfd = -1;
+}
+
+PeerCredentials &PeerCredentials::operator=(PeerCredentials &&other) noexcept
+{
+    if (this != &other) {
+        if (m_pidfd >= 0) {
+            ::close(m_pidfd);
+        }
+        m_valid = other.m_valid;
+        m_uid = other.m_uid;
+        m_gid = other.m_gid;
+        m_pid = other.m_pid;
+        m_pidfd = other.m_pidfd;
+        other.m_valid = false;
+        other.m_pidfd = -1;
+    }
+    return *this;
+}
+
+PeerCredentials PeerCredentials::fromSocket(qintptr socketDescriptor)
+{
+    PeerCredentials peer;
+    if (socketDescriptor < 0) {
+        return peer;
+    }
+    const int fd = int(socketDescriptor);
+
+    struct ucred credentials = {};
+    socklen_t length = sizeof(credentials);
+    if (::getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &credentials, &length) != 0 ||
+        length != sizeof(credentials)) {
+        qCWarning(ipcServer) << "SO_PEERCRED failed:" << strerror(errno);
+        return peer;
+    }
+    peer.m_valid = true;
+    peer.m_uid = credentials.uid;
+    peer.m_gid = credentials.gid;
+    peer.m_pid = credentials.pid;
+
+    // The pidfd is a bonus: without it the uid check still holds
+#ifdef SO_PEERPIDFD
+    int pidfd = -1;
+    length = sizeof(pidfd);
+    if (::getsockopt(fd, SOL_SOCKET, SO_PEERPIDFD, &pidfd, &length) == 0 && pidfd >= 0) {
+        peer.m_pidfd = pidfd;
+        return peer;
+    }
+#endif
+#ifdef SYS_pidfd_open
+    // Racier than SO_PEERPIDFD, but still pins whatever currently owns the pid
+    if (peer.m_pid > 0) {
+        const long pidfd = ::syscall(SYS_pidfd_open, peer.m_pid, 0);
+        if (pidfd >= 0) {
+            peer.m_pidfd = int(pidfd);
+        }
+    }
+#endif
+    return peer;
+}
+
+QString PeerCredentials::describe() const
+{
+    if (!m_valid) {
+        return QString("peer=unknown");
+    }
+    return QString("uid=%1 pid=%2").arg(m_uid).arg(m_pid);
+}
+
+PeerPolicy::PeerPolicy(uid_t ownUid, const QList<uid_t> &allowedUids)
+    : m_ownUid(ownUid), m_allowedUids(allowedUids)
+{
+}
+
+PeerPolicy PeerPolicy::fromEnvironment()
+{
+    const QString list = qEnvironmentVariable("QUICKSHELL_POLKIT_ALLOWED_UIDS");
+    bool ok = true;
+    const QList<uid_t> allowed = parseUidList(list, &ok);
+    if (!ok) {
+        qCWarning(ipcServer) << "Ignoring malformed entries in QUICKSHELL_POLKIT_ALLOWED_UIDS:" << list;
+    }
+    if (!allowed.isEmpty()) {
+        qCDebug(ipcServer) << "Additional client uids allowed:" << allowed;
+    }
+    return PeerPolicy(::getuid(), allowed);
+}
+
+QList<uid_t> PeerPolicy::parseUidList(const QString &list, bool *ok)
+{
+    QList<uid_t> uids;
+    bool allValid = true;
+    for (const QString &entry : list.split(',', Qt::SkipEmptyParts)) {
+        bool valid = false;
+        const uint uid = entry.trimmed().toUInt(&valid);
+        if (!valid || uid == uint(uid_t(-1))) {
+            allValid = false;
+            continue;
+        }
+        if (!uids.contains(uid_t(uid))) {
+            uids.append(uid_t(uid));
+        }
+    }
+    if (ok) {
+        *ok = allValid;
+    }
+    return uids;
+}
+
+PeerPolicy::Decision PeerPolicy::evaluate(const PeerCredentials &peer) const
+{
+    if (!peer.isValid()) {
+        return Decision::Denied;
+    }
+    if (peer.uid() == m_ownUid) {
+        return Decision::Trusted;
+    }
+    return m_allowedUids.contains(peer.uid()) ? Decision::Allowed : Decision::Denied;
+}
+
+const char *PeerPolicy::decisionName(Decision decision)
+{
+    switch (decision) {
+    case Decision::Denied: return "denied";
+    case Decision::Allowed: return "allowed";
+    case Decision::Trusted: return "trusted";
+    }
+    return "unknown";
+}
@@ -0,0 +1,97 @@
+/*
+ * quickshell-polkit-agent
+ * Copyright (C) 2025 Benny Powers
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <QList>
+#include <QString>
+#include <QtGlobal>
+
+#include <sys/types.h>
+
+/*
+ * Kernel-attested identity of a connected client
+ *
+ * Read once per connection with SO_PEERCRED, which reports the uid, gid
+ * and pid of the process that called connect(). Where the kernel supports
+ * it the pid is also pinned as a pidfd (SO_PEERPIDFD, or pidfd_open as a
+ * fallback), so the process cannot exit and have its pid reused while the
+ * connection is open. Owns the pidfd; move-only.
+ */
+class PeerCredentials
+{
+public:
+    PeerCredentials() = default;
+    ~PeerCredentials();
+    PeerCredentials(PeerCredentials &&other) noexcept;
+    PeerCredentials &operator=(PeerCredentials &&other) noexcept;
+    PeerCredentials(const PeerCredentials &) = delete;
+    PeerCredentials &operator=(const PeerCredentials &) = delete;
+
+    // Invalid credentials if the descriptor is not a connected Unix socket
+    static PeerCredentials fromSocket(qintptr socketDescriptor);
+
+    bool isValid() const { return m_valid; }
+    uid_t uid() const { return m_uid; }
+    gid_t gid() const { return m_gid; }
+    pid_t pid() const { return m_pid; }
+    int pidfd() const { return m_pidfd; }
+
+    // "uid=1000 pid=4242" for audit entries
+    QString describe() const;
+
+private:
+    bool m_valid = false;
+    uid_t m_uid = uid_t(-1);
+    gid_t m_gid = gid_t(-1);
+    pid_t m_pid = -1;
+    int m_pidfd = -1;
+};
+
+/*
+ * Which peers may talk to the agent
+ *
+ * The agent's own uid is always allowed and is the only trusted one: the
+ * socket is private to that user, and a same-user process could read any
+ * key we hand out anyway, so per-message HMACs from it add cost without
+ * adding assurance. Further uids can be allowed with
+ * QUICKSHELL_POLKIT_ALLOWED_UIDS (comma-separated); their signed frames
+ * are still verified. Everyone else is disconnected.
+ */
+class PeerPolicy
+{
+public:
+    enum class Decision {
+        Denied = 0,
+        Allowed,   // Listed uid: optional HMACs are checked
+        Trusted    // The agent's own uid: HMAC checks are skipped
+    };
+
+    explicit PeerPolicy(uid_t ownUid, const QList<uid_t> &allowedUids = {});
+
+    // Own uid plus QUICKSHELL_POLKIT_ALLOWED_UIDS; malformed entries are ignored with a warning
+    static PeerPolicy fromEnvironment();
+    static QList<uid_t> parseUidList(const QString &list, bool *ok = nullptr);
+
+    Decision evaluate(const PeerCredentials &peer) const;
+    static const char *decisionName(Decision decision);
+
+private:
+    uid_t m_ownUid;
+    QList<uid_t> m_allowedUids;
+};
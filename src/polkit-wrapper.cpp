@@ -22,7 +22,14 @@
 #include <QDebug>
 #include <QRegularExpression>
 #include <QFile>
+#include "idle-trimmer.h"
 #include "logging.h"
+#include "latency-tracer.h"
+#include "metrics.h"
+#include "tracing.h"
+#include "command-resolver.h"
+#include <QFutureWatcher>
+#include <QtConcurrent/QtConcurrentRun>
 #include <QTimer>
 #include <unistd.h>
 
@@ -31,7 +38,17 @@ PolkitWrapper::PolkitWrapper(INfcDetector *nfcDetector, QObject *parent)
     , m_authority(PolkitQt1::Authority::instance())
     , m_nfcDetector(nfcDetector)
     , m_ownDetector(false)
+    , m_authTimeoutMs(AUTH_TIMEOUT_MS)
+    , m_registrationAttempts(0)
 {
+    // Message templates come from the environment; read them once, not per request
+    QString disableTransform = qEnvironmentVariable("QUICKSHELL_POLKIT_DISABLE_TRANSFORM");
+    m_transformEnabled = disableTransform.isEmpty() || disableTransform == "0" ||
+                         disableTransform.toLower() == "false";
+    m_messageRules = MessageRules::load();
+    m_actionIndex = new ActionIndex(ActionIndex::defaultDirectories(), ActionIndex::defaultCachePath(),
+                                    QString(), this);
+
     // NFC detector is passive/informational only - it does NOT control authentication flow.
     // The agent operates PAM-reactively: it displays whatever PAM asks for.
     // FIDO authentication is handled entirely by PAM (via pam_u2f if configured).
@@ -40,10 +57,15 @@ PolkitWrapper::PolkitWrapper(INfcDetector *nfcDetector, QObject *parent)
         m_nfcDetector = new UsbNfcDetector();
         m_ownDetector = true;
     }
-
-    // Connect authority signals
-    connect(m_authority, &PolkitQt1::Authority::checkAuthorizationFinished,
-            this, &PolkitWrapper::onCheckAuthorizationFinished);
+    connect(m_nfcDetector, &INfcDetector::presenceChanged,
+            this, &PolkitWrapper::securityKeyPresenceChanged);
+
+    // Idle means no live slot, so only spare capacity is held. The action
+    // index stays: the session that wakes the agent looks it up straight
+    // away, and rebuilding it there would stall polkitd's call.
+    IdleTrimmer::instance()->addHooks(this, [this]() {
+        m_cookieToHandle.squeeze();
+    }, nullptr);
 }
 
 PolkitWrapper::~PolkitWrapper()
@@ -74,11 +96,37 @@ bool PolkitWrapper::registerAgent()
         qCDebug(polkitAgent) << "Successfully registered as polkit agent";
         return true;
     } else {
-        qCritical() << "Failed to register as polkit agent";
+        qCWarning(polkitAgent) << "Failed to register as polkit agent";
         return false;
     }
 }
 
+void PolkitWrapper::registerAgentWithRetry()
+{
+    m_registrationAttempts = 0;
+    attemptRegistration();
+}
+
+void PolkitWrapper::attemptRegistration()
+{
+    m_registrationAttempts++;
+    if (registerAgent()) {
+        emit agentRegistered();
+        return;
+    }
+
+    if (m_registrationAttempts >= REGISTRATION_MAX_ATTEMPTS) {
+        qCritical() << "Giving up on polkit agent registration after" << m_registrationAttempts << "attempts";
+        emit agentRegistrationFailed();
+        return;
+    }
+
+    const int delay = qMin(REGISTRATION_INITIAL_DELAY_MS << (m_registrationAttempts - 1), REGISTRATION_MAX_DELAY_MS);
+    qCWarning(polkitAgent) << "polkitd not ready, retrying registration in" << delay << "ms (attempt"
+                           << m_registrationAttempts << "of" << REGISTRATION_MAX_ATTEMPTS << ")";
+    DeadlineScheduler::instance()->schedule(this, delay, [this]() { attemptRegistration(); });
+}
+
 void PolkitWrapper::unregisterAgent()
 {
     // The base class handles unregistration in its destructor
@@ -88,12 +136,10 @@ void PolkitWrapper::unregisterAgent()
 void PolkitWrapper::checkAuthorization(const QString &actionId, const QString &details)
 {
     if (m_authority->hasError()) {
-        emit authorizationError(QString("Polkit authority error: %1").arg(m_authority->errorDetails()));
+        emit authorizationError(QString("Polkit authority error: %1").arg(m_authority->errorDetails()), QString());
         return;
     }
 
-    m_currentActionId = actionId;
-    
     qCDebug(polkitAgent) << "checkAuthorization called for action:" << actionId;
     
     // When used as an agent, we should NOT call m_authority->checkAuthorization() here
@@ -102,48 +148,24 @@ void PolkitWrapper::checkAuthorization(const QString &actionId, const QString &d
     emit showAuthDialog(actionId, QString("Authentication required for %1").arg(actionId), "dialog-password", "");
 }
 
-void PolkitWrapper::cancelAuthorization()
+void PolkitWrapper::cancelAuthorization(const QString &cookie)
 {
-    qCDebug(polkitAgent) << "Cancelling authorization check";
-
-    // Cancel the authority check
-    m_authority->checkAuthorizationCancel();
-
-    // Cancel all active sessions using unified cleanup
-    QStringList cookiesToCleanup = m_sessions.keys();
-    for (const QString &cookie : cookiesToCleanup) {
-        SessionState *session = getSession(cookie);
-        if (session) {
-            setState(cookie, AuthenticationState::CANCELLED);
-            cleanupSession(cookie);
-        }
+    if (cookie.isEmpty()) {
+        qCDebug(polkitAgent) << "Cancelling all authentication sessions";
+        cancelAllSessions();
+        return;
     }
 
-    emit authorizationResult(false, m_currentActionId);
-}
-
-void PolkitWrapper::onCheckAuthorizationFinished(PolkitQt1::Authority::Result result)
-{
-    bool authorized = false;
-    
-    switch (result) {
-    case PolkitQt1::Authority::Yes:
-        authorized = true;
-        qCDebug(polkitAgent) << "Authorization granted for" << m_currentActionId;
-        break;
-    case PolkitQt1::Authority::No:
-        qCDebug(polkitAgent) << "Authorization denied for" << m_currentActionId;
-        break;
-    case PolkitQt1::Authority::Challenge:
-        qCDebug(polkitAgent) << "Authorization requires challenge for" << m_currentActionId;
-        break;
-    default:
-        qCDebug(polkitAgent) << "Unknown authorization result for" << m_currentActionId;
-        emit authorizationError("Unknown authorization result");
+    // Only this prompt goes away; overlapping requests keep running
+    const SessionHandle handle = sessionHandle(cookie);
+    if (!handle.isValid()) {
+        qCDebug(polkitAgent) << "Cancel for unknown or finished session ignored";
+        qCDebug(polkitSensitive) << "Unknown cancel cookie:" << cookie;
         return;
     }
-    
-    emit authorizationResult(authorized, m_currentActionId);
+
+    qCDebug(polkitSensitive) << "Cancelling session for cookie:" << cookie;
+    cancelSession(handle);
 }
 
 // PolkitQt1::Agent::Listener interface implementation
@@ -158,16 +180,18 @@ void PolkitWrapper::initiateAuthentication(const QString &actionId,
     qCDebug(polkitAgent) << "initiateAuthentication for" << actionId;
     qCDebug(polkitSensitive) << "initiateAuthentication cookie:" << cookie;
 
-    // Create new session state
-    SessionState sessionState;
-    sessionState.cookie = cookie;
-    sessionState.actionId = actionId;
-    sessionState.result = result;
-    sessionState.state = AuthenticationState::IDLE;
-    m_sessions[cookie] = sessionState;
+    // Create new session state; from here on the session is addressed by handle
+    const SessionHandle handle = createSession(cookie);
+    LatencyTracer::begin(cookie, actionId);
+    SessionState *sessionState = getSession(handle);
+    sessionState->actionId = actionId;
+    sessionState->result = result;
+    if (const ActionMetadata *metadata = m_actionIndex->lookup(actionId)) {
+        sessionState->metadata = *metadata;
+    }
 
     // Set initial state
-    setState(cookie, AuthenticationState::INITIATED);
+    setState(handle, AuthenticationState::INITIATED);
 
     // Create polkit session for the first identity
     if (!identities.isEmpty()) {
@@ -177,19 +201,22 @@ void PolkitWrapper::initiateAuthentication(const QString &actionId,
         PolkitQt1::Agent::Session *pamSession = new PolkitQt1::Agent::Session(identity, cookie);
 
         // Store PAM session in our SessionState
-        SessionState *state = getSession(cookie);
+        SessionState *state = getSession(handle);
         if (state) {
             state->session = pamSession;
         }
-        
+
         // Connect session signals
         connect(pamSession, &PolkitQt1::Agent::Session::completed,
-                this, [this, cookie, actionId](bool gainedAuthorization) {
+                this, [this, handle, cookie, actionId](bool gainedAuthorization) {
+                    LatencyTracer::mark(cookie, LatencyTracer::Point::Completed);
+                    TRACEPOINT(pam_completed, handle.index, handle.generation, int(gainedAuthorization));
                     qCDebug(polkitAgent) << "Polkit session completed, authorized:" << gainedAuthorization;
                     qCDebug(polkitSensitive) << "Session cookie:" << cookie;
 
-                    // Get session once and reuse to avoid use-after-free
-                    SessionState *session = getSession(cookie);
+                    // Slot addresses are stable, so this pointer survives the
+                    // signals emitted below until cleanupSession() frees the slot
+                    SessionState *session = getSession(handle);
                     if (!session) {
                         qCWarning(polkitAgent) << "Session not found in completed handler for cookie:" << cookie;
                         return;
@@ -197,15 +224,16 @@ void PolkitWrapper::initiateAuthentication(const QString &actionId,
 
                     // Update state and handle retry logic
                     if (gainedAuthorization) {
-                        setState(cookie, AuthenticationState::COMPLETED);
+                        setState(handle, AuthenticationState::COMPLETED);
                     } else {
                         session->retryCount++;
+                        Metrics::increment(Metrics::Counter::AuthRetries);
                         qCDebug(polkitAgent) << "Authentication failed, retry count:" << session->retryCount
                                              << "/" << MAX_AUTH_RETRIES;
 
                         if (session->retryCount >= MAX_AUTH_RETRIES) {
                             qCWarning(polkitAgent) << "Maximum authentication attempts reached for" << cookie;
-                            setState(cookie, AuthenticationState::MAX_RETRIES_EXCEEDED);
+                            setState(handle, AuthenticationState::MAX_RETRIES_EXCEEDED);
 
                             // Emit error with default message
                             QString defaultMsg = getDefaultErrorMessage(AuthenticationState::MAX_RETRIES_EXCEEDED, session->method);
@@ -213,7 +241,7 @@ void PolkitWrapper::initiateAuthentication(const QString &actionId,
                                                     session->method, defaultMsg,
                                                     QString("Retry count: %1/%2").arg(session->retryCount).arg(MAX_AUTH_RETRIES));
                         } else {
-                            setState(cookie, AuthenticationState::AUTHENTICATION_FAILED);
+                            setState(handle, AuthenticationState::AUTHENTICATION_FAILED);
 
                             // Emit error with default message
                             QString defaultMsg = getDefaultErrorMessage(AuthenticationState::AUTHENTICATION_FAILED, session->method);
@@ -241,17 +269,17 @@ void PolkitWrapper::initiateAuthentication(const QString &actionId,
                         }
                     }
 
-                    emit authorizationResult(gainedAuthorization, actionId);
+                    emit authorizationResult(gainedAuthorization, actionId, cookie);
 
                     // Clean up or restart session
                     if (shouldCleanup) {
-                        cleanupSession(cookie);
-                    } else {
+                        cleanupSession(handle);
+                    } else if ((session = getSession(handle))) {
                         // Test harness mode: restart PAM session for retry
                         qCDebug(polkitAgent) << "Restarting PAM session for retry (test harness mode)";
 
                         // Transition back to WAITING_FOR_PASSWORD to allow retry
-                        setState(cookie, AuthenticationState::WAITING_FOR_PASSWORD);
+                        setState(handle, AuthenticationState::WAITING_FOR_PASSWORD);
 
                         // NOTE: We keep the existing session and just call initiate() again
                         // The session will reconnect and PAM will prompt for password again
@@ -262,11 +290,13 @@ void PolkitWrapper::initiateAuthentication(const QString &actionId,
                 });
 
         connect(pamSession, &PolkitQt1::Agent::Session::request,
-                this, [this, cookie, actionId](const QString &request, bool echo) {
-                    qCDebug(polkitAgent) << "Session request:" << request << "echo:" << echo;
+                this, [this, handle, cookie, actionId](const QString &request, bool echo) {
+                    LatencyTracer::mark(cookie, LatencyTracer::Point::FirstRequest);
+                    TRACEPOINT(pam_request, handle.index, handle.generation, int(echo));
+                    qCVerbose(polkitAgent) << "Session request:" << request << "echo:" << echo;
                     qCDebug(polkitSensitive) << "Request for cookie:" << cookie;
 
-                    SessionState *session = getSession(cookie);
+                    SessionState *session = getSession(handle);
                     if (!session || !session->session) {
                         qCWarning(polkitAgent) << "Session not found for cookie in request handler";
                         return;
@@ -279,23 +309,29 @@ void PolkitWrapper::initiateAuthentication(const QString &actionId,
                         return;
                     }
 
+                    // PAM made progress; the user gets a full timeout to answer
+                    resetAuthenticationTimeout(handle);
+
                     // Show password prompt and wait for user input
                     // PAM will handle FIDO (pam_u2f) if configured - we just respond to prompts
                     // User can submit empty response if they want to use FIDO
-                    qCDebug(polkitAgent) << "Password request from PAM";
-                    setState(cookie, AuthenticationState::WAITING_FOR_PASSWORD);
-                    setMethod(cookie, AuthenticationMethod::PASSWORD);
+                    qCVerbose(polkitAgent) << "Password request from PAM";
+                    session->prompt = request;
+                    session->promptEcho = echo;
+                    setState(handle, AuthenticationState::WAITING_FOR_PASSWORD);
+                    LatencyTracer::mark(cookie, LatencyTracer::Point::PasswordRequestEmitted);
                     emit showPasswordRequest(actionId, request, echo, cookie);
                 });
 
         connect(pamSession, &PolkitQt1::Agent::Session::showError,
-                this, [this, cookie, actionId](const QString &text) {
+                this, [this, handle, cookie, actionId](const QString &text) {
+                    TRACEPOINT(pam_error, handle.index, handle.generation);
                     qCWarning(polkitAgent) << "Session error:" << text;
                     qCDebug(polkitSensitive) << "Session error for cookie:" << cookie;
 
-                    setState(cookie, AuthenticationState::ERROR);
+                    setState(handle, AuthenticationState::ERROR);
 
-                    SessionState *session = getSession(cookie);
+                    SessionState *session = getSession(handle);
                     if (session) {
                         // Emit error with default message
                         QString defaultMsg = getDefaultErrorMessage(AuthenticationState::ERROR, session->method);
@@ -308,13 +344,14 @@ void PolkitWrapper::initiateAuthentication(const QString &actionId,
                         }
                     }
 
-                    emit authorizationResult(false, actionId);
+                    emit authorizationResult(false, actionId, cookie);
 
-                    cleanupSession(cookie);
+                    cleanupSession(handle);
                 });
 
         connect(pamSession, &PolkitQt1::Agent::Session::showInfo,
-                this, [this, cookie](const QString &text) {
+                this, [handle](const QString &text) {
+                    TRACEPOINT(pam_info, handle.index, handle.generation);
                     qCDebug(polkitAgent) << "Session info:" << text;
                 });
 
@@ -328,11 +365,17 @@ void PolkitWrapper::initiateAuthentication(const QString &actionId,
          * SPDX-License-Identifier: GPL-2.0-or-later (for GDM reference pattern)
          */
         qCDebug(polkitAgent) << "Starting PAM authentication session for" << cookie;
+        LatencyTracer::mark(cookie, LatencyTracer::Point::SessionInitiate);
         pamSession->initiate();
     }
 
     // Transform message for user-friendly text
-    QString transformedMessage = transformAuthMessage(actionId, message, details);
+    QString transformedMessage = transformAuthMessage(actionId, message, details, handle);
+    LatencyTracer::mark(cookie, LatencyTracer::Point::MessageTransformed);
+    if (SessionState *shown = getSession(handle)) {
+        shown->message = transformedMessage;
+        shown->iconName = iconName;
+    }
 
     // Show auth dialog
     emit showAuthDialog(actionId, transformedMessage, iconName, cookie);
@@ -351,17 +394,14 @@ void PolkitWrapper::cancelAuthentication()
 {
     qCDebug(polkitAgent) << "Polkit agent: authentication cancelled (Listener interface)";
 
-    // Cancel all active sessions using unified cleanup
-    QStringList cookiesToCleanup = m_sessions.keys();
-    for (const QString &cookie : cookiesToCleanup) {
-        setState(cookie, AuthenticationState::CANCELLED);
-        cleanupSession(cookie);
-    }
+    cancelAllSessions();
 }
 
 void PolkitWrapper::submitAuthenticationResponse(const QString &cookie, const QString &response)
 {
-    SessionState *session = getSession(cookie);
+    // The only cookie lookup on this path; the rest works on the handle
+    const SessionHandle handle = sessionHandle(cookie);
+    SessionState *session = getSession(handle);
     if (!session || !session->session) {
         qCWarning(polkitAgent) << "No active polkit session found";
         qCDebug(polkitSensitive) << "Missing session for cookie:" << cookie;
@@ -396,120 +436,71 @@ void PolkitWrapper::submitAuthenticationResponse(const QString &cookie, const QS
     qCDebug(polkitAgent) << "Submitting authentication response";
     qCDebug(polkitSensitive) << "Response for cookie:" << cookie;
 
-    setState(cookie, AuthenticationState::AUTHENTICATING);
-    setMethod(cookie, AuthenticationMethod::PASSWORD);
+    setState(handle, AuthenticationState::AUTHENTICATING);
+    LatencyTracer::mark(cookie, LatencyTracer::Point::ResponseSubmitted);
     session->session->setResponse(response);
 }
 
-QString PolkitWrapper::transformAuthMessage(const QString &actionId, const QString &message, const PolkitQt1::Details &details)
+QString PolkitWrapper::transformAuthMessage(const QString &actionId, const QString &message,
+                                           const PolkitQt1::Details &details, SessionHandle handle)
 {
     // Check if message transformation is disabled
-    QString disableTransform = qgetenv("QUICKSHELL_POLKIT_DISABLE_TRANSFORM");
-    if (!disableTransform.isEmpty() && disableTransform != "0" && disableTransform.toLower() != "false") {
+    if (!m_transformEnabled) {
         return message;
     }
     
-    // Check if this is a systemd run0 (transient service) request
-    if (actionId == "org.freedesktop.systemd1.manage-units") {
-        qCDebug(polkitAgent) << "Checking systemd manage-units action, message:" << message;
-        
-        // Check if the message indicates a transient service (broader pattern matching)
-        if (message.contains("transient", Qt::CaseInsensitive)) {
-            
-            qCDebug(polkitAgent) << "Detected systemd run0 authorization request";
-            
-            // Try to extract command information using PID from polkit details
-            QString commandInfo;
-            QStringList detailKeys = details.keys();
-            qCDebug(polkitAgent) << "Available detail keys:" << detailKeys;
-            
-            // Get the subject PID to extract command
-            QString subjectPid = details.lookup("polkit.subject-pid");
-            if (!subjectPid.isEmpty()) {
-                qCDebug(polkitAgent) << "Attempting to get command for PID:" << subjectPid;
+    // One hash probe per request; regexes were compiled at startup
+    const MessageRule *rule = m_messageRules.match(actionId, message, [&details](const QString &key) {
+        return details.lookup(key);
+    });
+    if (!rule) {
+        return message;
+    }
+    
+    MessageContext context;
+    context.actionId = actionId;
+    context.message = message;
+    for (const QString &key : rule->referencedDetailKeys()) {
+        context.details.insert(key, details.lookup(key));
+    }
+    
+    if (!rule->needsCommand()) {
+        return rule->render(context);
+    }
+    
+    // Get the subject PID to extract command
+    bool ok = false;
+    qint64 subjectPid = details.lookup("polkit.subject-pid").toLongLong(&ok);
+    if (!ok || subjectPid <= 0) {
+        return rule->render(context);
+    }
+    
+    // Reading /proc must not delay the dialog. Show what the cache last knew
+    // for this pid, which is right for the repeated prompts of a run0 retry
+    // loop, and let the worker confirm or correct it.
+    context.command = CommandResolver::cached(subjectPid);
+    qCDebug(polkitAgent) << "Resolving command for PID:" << subjectPid;
+    auto *watcher = new QFutureWatcher<QString>(this);
+    connect(watcher, &QFutureWatcher<QString>::finished,
+            this, [this, watcher, handle, context, rule = *rule]() mutable {
+                watcher->deleteLater();
                 
-                // Try to read the command from /proc/PID/cmdline
-                QString cmdlinePath = QString("/proc/%1/cmdline").arg(subjectPid);
-                QFile cmdlineFile(cmdlinePath);
-                if (cmdlineFile.open(QIODevice::ReadOnly)) {
-                    QByteArray cmdlineData = cmdlineFile.readAll();
-                    cmdlineFile.close();
-                    
-                    // /proc/PID/cmdline has null-separated arguments
-                    QStringList args = QString::fromUtf8(cmdlineData).split('\0', Qt::SkipEmptyParts);
-                    qCDebug(polkitAgent) << "Command line args:" << args;
-                    
-                    if (!args.isEmpty()) {
-                        // Get the command name (remove path)
-                        QString command = args.first();
-                        if (command.contains('/')) {
-                            command = command.split('/').last();
-                        }
-                        
-                        // If it's systemd-run or run0, try to get the actual command
-                        if (command == "systemd-run" || command == "run0") {
-                            qCDebug(polkitAgent) << "Found systemd-run/run0, extracting target command";
-                            // Look for the actual command after systemd-run options
-                            bool foundCommand = false;
-                            for (int i = 1; i < args.size(); ++i) {
-                                const QString &arg = args[i];
-                                // Skip systemd-run options
-                                if (arg.startsWith("--") || arg.startsWith("-")) {
-                                    // Skip option and its value if it takes one
-                                    if (arg.contains("=")) continue;
-                                    if (i + 1 < args.size() && !args[i + 1].startsWith("-")) {
-                                        i++; // Skip option value
-                                    }
-                                    continue;
-                                }
-                                // Found the actual command
-                                command = arg;
-                                if (command.contains('/')) {
-                                    command = command.split('/').last();
-                                }
-                                foundCommand = true;
-                                qCDebug(polkitAgent) << "Found target command:" << command;
-                                break;
-                            }
-                            if (!foundCommand && args.size() > 1) {
-                                command = args.last(); // Fallback to last argument
-                                if (command.contains('/')) {
-                                    command = command.split('/').last();
-                                }
-                                qCDebug(polkitAgent) << "Using fallback command:" << command;
-                            }
-                        }
-                        
-                        commandInfo = command;
-                        qCDebug(polkitAgent) << "Final extracted command:" << commandInfo;
-                    }
-                } else {
-                    qCDebug(polkitAgent) << "Could not read cmdline for PID:" << subjectPid;
-                }
-            }
-            
-            // Check for custom message template from environment
-            QString customTemplate = qgetenv("QUICKSHELL_POLKIT_RUN0_MESSAGE");
-            
-            // Generate user-friendly message
-            if (!customTemplate.isEmpty()) {
-                // Use custom template, replace %1 with command if available
-                if (!commandInfo.isEmpty() && commandInfo != actionId) {
-                    return customTemplate.arg(commandInfo);
-                } else {
-                    // Remove %1 placeholder if no command info available
-                    return customTemplate.replace("%1", "command");
+                const QString command = watcher->result();
+                SessionState *session = getSession(handle);
+                if (command == context.command || !session) {
+                    return;  // The shown text stands, or the request is already gone
                 }
-            } else if (!commandInfo.isEmpty() && commandInfo != actionId) {
-                return QString("Authentication required to run '%1' with elevated privileges").arg(commandInfo);
-            } else {
-                return "Authentication required to run command with elevated privileges";
-            }
-        }
-    }
+                
+                // An empty result retracts a cached command whose pid was recycled
+                context.command = command;
+                
+                qCDebug(polkitAgent) << "Final extracted command:" << context.command;
+                session->message = rule.render(context);
+                emit authMessageUpdated(session->cookie, session->message);
+            });
+    watcher->setFuture(QtConcurrent::run(&CommandResolver::resolve, subjectPid));
     
-    // For non-run0 requests, return original message
-    return message;
+    return rule->render(context);
 }
 
 // =============================================================================
@@ -517,27 +508,59 @@ QString PolkitWrapper::transformAuthMessage(const QString &actionId, const QStri
 // =============================================================================
 
 /*
- * Get session state by cookie
+ * Allocate a slot for a new session
  *
- * Pattern inspired by GDM's find_conversation_by_name
+ * Pattern inspired by GDM's find_conversation_by_name, with the cookie lookup
+ * done once here instead of on every state change.
  * See: https://gitlab.gnome.org/GNOME/gdm/-/blob/main/daemon/gdm-session.c
  */
-SessionState* PolkitWrapper::getSession(const QString &cookie)
+SessionHandle PolkitWrapper::createSession(const QString &cookie)
 {
-    auto it = m_sessions.find(cookie);
-    if (it != m_sessions.end()) {
-        return &it.value();
+    // Wakes the agent if it went idle, before anything below allocates
+    IdleTrimmer::instance()->acquire();
+
+    // Polkitd never reuses a live cookie, but a stale entry must not leak its
+    // PAM helper or keep receiving that helper's signals
+    const SessionHandle existing = m_cookieToHandle.value(cookie);
+    if (existing.isValid()) {
+        qCWarning(polkitAgent) << "Replacing session that was still active for its cookie";
+        cleanupSession(existing);
     }
-    return nullptr;
+
+    quint32 index;
+    if (!m_freeSlots.isEmpty()) {
+        index = m_freeSlots.takeLast();
+    } else {
+        index = quint32(m_slots.size());
+        m_slots.emplace_back();
+    }
+
+    SessionSlot &slot = m_slots[index];
+    slot.live = true;
+    slot.state = SessionState();
+    slot.state.cookie = cookie;
+
+    const SessionHandle handle{index, slot.generation};
+    m_cookieToHandle.insert(cookie, handle);
+    return handle;
 }
 
-const SessionState* PolkitWrapper::getSession(const QString &cookie) const
+SessionState* PolkitWrapper::getSession(SessionHandle handle)
 {
-    auto it = m_sessions.find(cookie);
-    if (it != m_sessions.end()) {
-        return &it.value();
+    if (handle.index >= m_slots.size()) {
+        return nullptr;
     }
-    return nullptr;
+    SessionSlot &slot = m_slots[handle.index];
+    return (slot.live && slot.generation == handle.generation) ? &slot.state : nullptr;
+}
+
+const SessionState* PolkitWrapper::getSession(SessionHandle handle) const
+{
+    if (handle.index >= m_slots.size()) {
+        return nullptr;
+    }
+    const SessionSlot &slot = m_slots[handle.index];
+    return (slot.live && slot.generation == handle.generation) ? &slot.state : nullptr;
 }
 
 /*
@@ -545,12 +568,17 @@ const SessionState* PolkitWrapper::getSession(const QString &cookie) const
  *
  * Pattern inspired by GDM's gdm_session_worker_set_state
  * See: https://gitlab.gnome.org/GNOME/gdm/-/blob/main/daemon/gdm-session-worker.c
+ *
+ * Moves not in AuthStateMachine::TRANSITIONS are refused and counted, so a
+ * late PAM signal cannot revive a finished session. The new state's entry
+ * actions run after the change is announced, keeping the state signal ahead
+ * of the method signal as clients have always seen them.
  */
-void PolkitWrapper::setState(const QString &cookie, AuthenticationState newState)
+void PolkitWrapper::setState(SessionHandle handle, AuthenticationState newState)
 {
-    SessionState *session = getSession(cookie);
+    SessionState *session = getSession(handle);
     if (!session) {
-        qCWarning(polkitAgent) << "Attempted to set state for non-existent session:" << cookie;
+        qCWarning(polkitAgent) << "Attempted to set state for non-existent session in slot" << handle.index;
         return;
     }
 
@@ -559,21 +587,44 @@ void PolkitWrapper::setState(const QString &cookie, AuthenticationState newState
         return;  // No change
     }
 
+    if (!AuthStateMachine::isLegal(oldState, newState)) {
+        qCWarning(polkitAgent) << "Refusing illegal state transition"
+                               << stateToString(oldState) << "→" << stateToString(newState);
+        qCDebug(polkitSensitive) << "Illegal transition for cookie:" << session->cookie;
+        Metrics::increment(Metrics::Counter::IllegalTransitions);
+        return;
+    }
+
     session->state = newState;
-    qCDebug(polkitAgent) << "State transition for" << cookie << ":"
-                         << stateToString(oldState) << "→" << stateToString(newState);
+    Metrics::stateTransition(oldState, newState);
+    TRACEPOINT(state_transition, handle.index, handle.generation, int(oldState), int(newState));
+    qCVerbose(polkitAgent) << "State transition for" << session->cookie << ":"
+                           << stateToString(oldState) << "→" << stateToString(newState);
 
-    emit authenticationStateChanged(cookie, newState);
+    emit authenticationStateChanged(session->cookie, newState);
+
+    // Slots are stable, but a handler may have cleaned this one up
+    const quint8 actions = AuthStateMachine::entryActions(newState);
+    if (actions & AuthStateMachine::PasswordMethod) {
+        setMethod(handle, AuthenticationMethod::PASSWORD);
+    }
+    if (actions & AuthStateMachine::ResetTimeout) {
+        resetAuthenticationTimeout(handle);
+    }
+    if ((actions & AuthStateMachine::StopTimeout) && (session = getSession(handle))) {
+        DeadlineScheduler::instance()->cancel(session->timeout);
+        session->timeout = 0;
+    }
 }
 
 /*
  * Set authentication method for a session
  */
-void PolkitWrapper::setMethod(const QString &cookie, AuthenticationMethod method)
+void PolkitWrapper::setMethod(SessionHandle handle, AuthenticationMethod method)
 {
-    SessionState *session = getSession(cookie);
+    SessionState *session = getSession(handle);
     if (!session) {
-        qCWarning(polkitAgent) << "Attempted to set method for non-existent session:" << cookie;
+        qCWarning(polkitAgent) << "Attempted to set method for non-existent session in slot" << handle.index;
         return;
     }
 
@@ -583,10 +634,11 @@ void PolkitWrapper::setMethod(const QString &cookie, AuthenticationMethod method
     }
 
     session->method = method;
-    qCDebug(polkitAgent) << "Method changed for" << cookie << ":"
-                         << methodToString(oldMethod) << "→" << methodToString(method);
+    TRACEPOINT(method_changed, handle.index, handle.generation, int(oldMethod), int(method));
+    qCVerbose(polkitAgent) << "Method changed for" << session->cookie << ":"
+                           << methodToString(oldMethod) << "→" << methodToString(method);
 
-    emit authenticationMethodChanged(cookie, method);
+    emit authenticationMethodChanged(session->cookie, method);
 }
 
 /*
@@ -595,13 +647,14 @@ void PolkitWrapper::setMethod(const QString &cookie, AuthenticationMethod method
  * Unified cleanup pattern inspired by GDM's free_conversation
  * See: https://gitlab.gnome.org/GNOME/gdm/-/blob/main/daemon/gdm-session.c
  */
-void PolkitWrapper::cleanupSession(const QString &cookie)
+void PolkitWrapper::cleanupSession(SessionHandle handle)
 {
-    SessionState *session = getSession(cookie);
+    SessionState *session = getSession(handle);
     if (!session) {
         return;  // Already cleaned up
     }
 
+    const QString cookie = session->cookie;
     qCDebug(polkitAgent) << "Cleaning up session:" << cookie
                          << "in state:" << stateToString(session->state);
 
@@ -625,12 +678,116 @@ void PolkitWrapper::cleanupSession(const QString &cookie)
         session->session = nullptr;
     }
 
-    // Remove from map
-    m_sessions.remove(cookie);
+    DeadlineScheduler::instance()->cancel(session->timeout);
+
+    // Release the slot; bumping the generation invalidates every outstanding
+    // handle to it, including ones captured by queued lambdas
+    SessionSlot &slot = m_slots[handle.index];
+    slot.live = false;
+    slot.state = SessionState();
+    if (++slot.generation == 0) {
+        slot.generation = 1;
+    }
+    m_freeSlots.append(handle.index);
+    m_cookieToHandle.remove(cookie);
+    LatencyTracer::finish(cookie);
+    IdleTrimmer::instance()->release();
 
     qCDebug(polkitAgent) << "Session cleanup complete for:" << cookie;
 }
 
+/*
+ * Cancel one session and report it to the client
+ *
+ * The result carries the session's own cookie and action, so a client with
+ * several prompts open closes only the one that was cancelled.
+ */
+void PolkitWrapper::cancelSession(SessionHandle handle)
+{
+    SessionState *session = getSession(handle);
+    if (!session) {
+        return;
+    }
+
+    const QString cookie = session->cookie;
+    const QString actionId = session->actionId;
+    setState(handle, AuthenticationState::CANCELLED);
+    cleanupSession(handle);
+
+    emit authorizationResult(false, actionId, cookie);
+}
+
+/*
+ * Cancel every live session
+ *
+ * Walks the slot table by index rather than snapshotting the cookies:
+ * cleanup only flips slots to free and the deque never shrinks, so the
+ * walk stays valid even if a signal handler starts a new session.
+ */
+void PolkitWrapper::cancelAllSessions()
+{
+    for (quint32 index = 0; index < m_slots.size(); ++index) {
+        if (m_slots[index].live) {
+            cancelSession(SessionHandle{index, m_slots[index].generation});
+        }
+    }
+}
+
+/*
+ * Arm or push back the session's inactivity deadline
+ *
+ * Restarted whenever the conversation moves (session start, PAM request,
+ * user response), so only a session where neither the helper nor the user
+ * does anything for m_authTimeoutMs is reclaimed.
+ */
+void PolkitWrapper::resetAuthenticationTimeout(SessionHandle handle)
+{
+    SessionState *session = getSession(handle);
+    if (!session) {
+        return;
+    }
+
+    DeadlineScheduler *scheduler = DeadlineScheduler::instance();
+    if (scheduler->isScheduled(session->timeout)) {
+        scheduler->reschedule(session->timeout, m_authTimeoutMs);
+    } else {
+        session->timeout = scheduler->schedule(this, m_authTimeoutMs,
+                                               [this, handle]() { onAuthenticationTimeout(handle); });
+    }
+}
+
+void PolkitWrapper::onAuthenticationTimeout(SessionHandle handle)
+{
+    SessionState *session = getSession(handle);
+    if (!session) {
+        return;
+    }
+    session->timeout = 0;
+
+    qCWarning(polkitAgent) << "Authentication session timed out in state" << stateToString(session->state)
+                           << "after" << m_authTimeoutMs << "ms without progress";
+    qCDebug(polkitSensitive) << "Timed out cookie:" << session->cookie;
+
+    const QString cookie = session->cookie;
+    const QString actionId = session->actionId;
+    const AuthenticationMethod method = session->method;
+    setState(handle, AuthenticationState::ERROR);
+    emit authenticationError(cookie, AuthenticationState::ERROR, method,
+                             "Authentication timed out. Please try again.",
+                             QString("No progress for %1 ms").arg(m_authTimeoutMs));
+
+    // Tell polkitd before the PAM helper is cancelled
+    session = getSession(handle);
+    if (session && session->result) {
+        session->result->setError("Authentication timed out");
+        session->result->setCompleted();
+        session->result = nullptr;
+    }
+
+    emit authorizationResult(false, actionId, cookie);
+    cleanupSession(handle);
+}
+
 // =============================================================================
 // State Inspection Methods
 // =============================================================================
@@ -639,54 +796,108 @@ AuthenticationState PolkitWrapper::authenticationState(const QString &cookie) co
 {
     if (cookie.isEmpty()) {
         // Return global state (first active session or IDLE)
-        if (m_sessions.isEmpty()) {
-            return AuthenticationState::IDLE;
+        for (const SessionSlot &slot : m_slots) {
+            if (slot.live) {
+                return slot.state.state;
+            }
         }
-        return m_sessions.first().state;
+        return AuthenticationState::IDLE;
     }
 
-    const SessionState *session = getSession(cookie);
-    return session ? session->state : AuthenticationState::IDLE;
+    return authenticationState(sessionHandle(cookie));
 }
 
 AuthenticationMethod PolkitWrapper::authenticationMethod(const QString &cookie) const
 {
-    const SessionState *session = getSession(cookie);
-    return session ? session->method : AuthenticationMethod::NONE;
+    return authenticationMethod(sessionHandle(cookie));
 }
 
 bool PolkitWrapper::hasActiveSessions() const
 {
-    return !m_sessions.isEmpty();
+    return !m_cookieToHandle.isEmpty();
 }
 
 int PolkitWrapper::sessionRetryCount(const QString &cookie) const
 {
-    const SessionState *session = getSession(cookie);
+    return sessionRetryCount(sessionHandle(cookie));
+}
+
+SessionHandle PolkitWrapper::sessionHandle(const QString &cookie) const
+{
+    return m_cookieToHandle.value(cookie);
+}
+
+QString PolkitWrapper::sessionCookie(SessionHandle handle) const
+{
+    const SessionState *session = getSession(handle);
+    return session ? session->cookie : QString();
+}
+
+AuthenticationState PolkitWrapper::authenticationState(SessionHandle handle) const
+{
+    const SessionState *session = getSession(handle);
+    return session ? session->state : AuthenticationState::IDLE;
+}
+
+AuthenticationMethod PolkitWrapper::authenticationMethod(SessionHandle handle) const
+{
+    const SessionState *session = getSession(handle);
+    return session ? session->method : AuthenticationMethod::NONE;
+}
+
+int PolkitWrapper::sessionRetryCount(SessionHandle handle) const
+{
+    const SessionState *session = getSession(handle);
     return session ? session->retryCount : 0;
 }
 
+QList<SessionSnapshot> PolkitWrapper::sessionSnapshots() const
+{
+    QList<SessionSnapshot> snapshots;
+    for (const SessionSlot &slot : m_slots) {
+        if (!slot.live) {
+            continue;
+        }
+        const SessionState &session = slot.state;
+        SessionSnapshot snapshot;
+        snapshot.cookie = session.cookie;
+        snapshot.actionId = session.actionId;
+        snapshot.metadata = session.metadata;
+        snapshot.message = session.message;
+        snapshot.iconName = session.iconName;
+        snapshot.state = session.state;
+        snapshot.prompt = session.prompt;
+        snapshot.promptEcho = session.promptEcho;
+        snapshots.append(snapshot);
+    }
+    return snapshots;
+}
+
+ActionMetadata PolkitWrapper::sessionMetadata(const QString &cookie) const
+{
+    const SessionState *session = getSession(sessionHandle(cookie));
+    return session ? session->metadata : ActionMetadata();
+}
+
+bool PolkitWrapper::securityKeyPresent() const
+{
+    return m_nfcDetector->isPresent();
+}
+
 // =============================================================================
 // Helper Methods
 // =============================================================================
 
-QString PolkitWrapper::stateToString(AuthenticationState state) const
+QString PolkitWrapper::stateToString(AuthenticationState state)
 {
-    switch (state) {
-    case AuthenticationState::IDLE: return "IDLE";
-    case AuthenticationState::INITIATED: return "INITIATED";
-    case AuthenticationState::WAITING_FOR_PASSWORD: return "WAITING_FOR_PASSWORD";
-    case AuthenticationState::AUTHENTICATING: return "AUTHENTICATING";
-    case AuthenticationState::AUTHENTICATION_FAILED: return "AUTHENTICATION_FAILED";
-    case AuthenticationState::MAX_RETRIES_EXCEEDED: return "MAX_RETRIES_EXCEEDED";
-    case AuthenticationState::COMPLETED: return "COMPLETED";
-    case AuthenticationState::CANCELLED: return "CANCELLED";
-    case AuthenticationState::ERROR: return "ERROR";
+    const int index = static_cast<int>(state);
+    if (index < 0 || index >= AuthStateMachine::STATE_COUNT) {
+        return "UNKNOWN";
     }
-    return "UNKNOWN";
+    return QLatin1String(AuthStateMachine::stateName(state));
 }
 
-QString PolkitWrapper::methodToString(AuthenticationMethod method) const
+QString PolkitWrapper::methodToString(AuthenticationMethod method)
 {
     switch (method) {
     case AuthenticationMethod::NONE: return "NONE";
@@ -731,7 +942,7 @@ void PolkitWrapper::testTriggerAuthentication(const QString &actionId,
 
 void PolkitWrapper::testCompleteSession(const QString &cookie, bool success)
 {
-    SessionState *session = getSession(cookie);
+    SessionState *session = getSession(sessionHandle(cookie));
     if (!session || !session->session) {
         qCWarning(polkitAgent) << "testCompleteSession: No session found for cookie:" << cookie;
         return;
@@ -747,6 +958,21 @@ void PolkitWrapper::testCompleteSession(const QString &cookie, bool success)
     // - Session restart or cleanup
     emit session->session->completed(success);
 }
+
+void PolkitWrapper::testSetAuthenticationTimeout(int timeoutMs)
+{
+    m_authTimeoutMs = timeoutMs;
+}
+
+SessionHandle PolkitWrapper::testInsertSession(const QString &cookie, const QString &actionId,
+                                               AuthenticationState state)
+{
+    const SessionHandle handle = createSession(cookie);
+    SessionState *session = getSession(handle);
+    session->actionId = actionId;
+    session->state = state;
+    return handle;
+}
 #endif
 
 // =============================================================================
@@ -20,34 +20,21 @@
 
 #include <QObject>
 #include <QString>
-#include <QMap>
+#include <QHash>
+#include <QList>
 #include <QSet>
 #include <QTimer>
+#include <deque>
 #include <polkitqt1-authority.h>
 #include <polkitqt1-subject.h>
 #include <polkitqt1-agent-listener.h>
 #include <polkitqt1-agent-session.h>
 
+#include "action-index.h"
+#include "auth-state-machine.h"
+#include "deadline-scheduler.h"
 #include "nfc-detector.h"
-
-/*
- * Authentication state machine
- *
- * Inspired by GDM's GdmSessionWorkerState pattern
- * See: https://gitlab.gnome.org/GNOME/gdm/-/blob/main/daemon/gdm-session-worker.h
- * SPDX-License-Identifier: GPL-2.0-or-later (for GDM reference pattern)
- */
-enum class AuthenticationState {
-    IDLE = 0,                    // No authentication in progress
-    INITIATED,                   // Authentication request received, session created
-    WAITING_FOR_PASSWORD,        // Password prompt shown, waiting for user input
-    AUTHENTICATING,              // PAM is processing credentials
-    AUTHENTICATION_FAILED,       // PAM rejected credentials (recoverable)
-    MAX_RETRIES_EXCEEDED,        // Too many failed attempts (terminal)
-    COMPLETED,                   // Authentication succeeded
-    CANCELLED,                   // User cancelled authentication
-    ERROR                        // Unrecoverable error occurred
-};
+#include "message-rules.h"
 
 /*
  * Authentication method being attempted
@@ -69,13 +56,57 @@ struct SessionState {
     AuthenticationMethod method = AuthenticationMethod::NONE;
     QString cookie;
     QString actionId;
+    ActionMetadata metadata;  // From the action's .policy file, empty if it has none
     int retryCount = 0;
+    DeadlineScheduler::TimerId timeout = 0;  // Reclaims the session if PAM or the user stalls
+
+    // What the client was last shown, so a reconnecting client can be rebuilt
+    QString message;      // Dialog text after transformation and refinement
+    QString iconName;
+    QString prompt;       // Latest PAM request, empty until PAM asks
+    bool promptEcho = false;
 
     // Polkit objects
     PolkitQt1::Agent::AsyncResult *result = nullptr;
     PolkitQt1::Agent::Session *session = nullptr;
 };
 
+/*
+ * Interned reference to a live session
+ *
+ * A slot index into PolkitWrapper's session table plus the generation the
+ * slot had when the session was created. Cleanup bumps the generation, so a
+ * handle held by a late PAM signal or a stale caller resolves to nothing
+ * instead of aliasing whichever session reuses the slot. Generation 0 is
+ * never issued and marks an invalid handle.
+ */
+struct SessionHandle {
+    quint32 index = 0;
+    quint32 generation = 0;
+
+    bool isValid() const { return generation != 0; }
+    friend bool operator==(SessionHandle a, SessionHandle b)
+    {
+        return a.index == b.index && a.generation == b.generation;
+    }
+    friend bool operator!=(SessionHandle a, SessionHandle b) { return !(a == b); }
+};
+Q_DECLARE_METATYPE(SessionHandle)
+
+/*
+ * Client-visible view of one live session
+ */
+struct SessionSnapshot {
+    QString cookie;
+    QString actionId;
+    ActionMetadata metadata;
+    QString message;
+    QString iconName;
+    AuthenticationState state = AuthenticationState::IDLE;
+    QString prompt;
+    bool promptEcho = false;
+};
+
 class PolkitWrapper : public PolkitQt1::Agent::Listener
 {
     Q_OBJECT
@@ -90,12 +121,43 @@ public:
     bool registerAgent();
     void unregisterAgent();
 
+    /*
+     * Register without giving up while polkitd is still starting
+     *
+     * At login the agent can come up before polkitd. A failed attempt is
+     * retried from the event loop with exponential backoff, so the IPC
+     * socket keeps serving clients in between. Ends in agentRegistered()
+     * or, after REGISTRATION_MAX_ATTEMPTS, agentRegistrationFailed().
+     */
+    void registerAgentWithRetry();
+    int registrationAttempts() const { return m_registrationAttempts; }
+
     // State inspection (for testing and debugging)
     AuthenticationState authenticationState(const QString &cookie = QString()) const;
     AuthenticationMethod authenticationMethod(const QString &cookie) const;
     bool hasActiveSessions() const;
     int sessionRetryCount(const QString &cookie) const;
 
+    // Handle-based inspection: resolve the cookie once, then query without hashing
+    SessionHandle sessionHandle(const QString &cookie) const;
+    QString sessionCookie(SessionHandle handle) const;
+    AuthenticationState authenticationState(SessionHandle handle) const;
+    AuthenticationMethod authenticationMethod(SessionHandle handle) const;
+    int sessionRetryCount(SessionHandle handle) const;
+
+    // Every live session, oldest slot first (client resync after a gap)
+    QList<SessionSnapshot> sessionSnapshots() const;
+
+    // Vendor, description and implicit authorizations captured when the session began
+    ActionMetadata sessionMetadata(const QString &cookie) const;
+
+    // Stable names for logs and metrics labels
+    static QString stateToString(AuthenticationState state);
+    static QString methodToString(AuthenticationMethod method);
+
+    // Cached NFC/FIDO reader presence (informational, does not affect the PAM flow)
+    bool securityKeyPresent() const;
+
 #ifdef BUILD_TESTING
     /*
      * Test-only method to trigger authentication
@@ -118,22 +180,35 @@ public:
      * @param success Whether authentication succeeded
      */
     void testCompleteSession(const QString &cookie, bool success);
+
+    // Shorten AUTH_TIMEOUT_MS for sessions started after this call
+    void testSetAuthenticationTimeout(int timeoutMs);
+
+    // Add a session with no PAM conversation or timeout behind it, so the
+    // session table can be exercised without polkit-agent-helper-1
+    SessionHandle testInsertSession(const QString &cookie, const QString &actionId,
+                                    AuthenticationState state);
 #endif
 
 public slots:
     void checkAuthorization(const QString &actionId, const QString &details = QString());
-    void cancelAuthorization();
+
+    // Cancel the session for cookie, or every session when cookie is empty
+    void cancelAuthorization(const QString &cookie = QString());
     void submitAuthenticationResponse(const QString &cookie, const QString &response);
 
 signals:
     // Signal to show auth dialog in quickshell
     void showAuthDialog(const QString &actionId, const QString &message, const QString &iconName, const QString &cookie);
 
-    // Signal when authorization completes
-    void authorizationResult(bool authorized, const QString &actionId);
+    // Signal when authorization completes (once per session)
+    void authorizationResult(bool authorized, const QString &actionId, const QString &cookie);
+
+    // Signal for errors (cookie is empty for errors not tied to a session)
+    void authorizationError(const QString &error, const QString &cookie);
 
-    // Signal for errors
-    void authorizationError(const QString &error);
+    // Signal when a shown dialog's message has been refined (e.g. run0 command resolved)
+    void authMessageUpdated(const QString &cookie, const QString &message);
 
     // Signal for password requests (FIDO fallback)
     void showPasswordRequest(const QString &actionId, const QString &request, bool echo, const QString &cookie);
@@ -143,6 +218,13 @@ signals:
     void authenticationMethodChanged(const QString &cookie, AuthenticationMethod method);
     void authenticationMethodFailed(const QString &cookie, AuthenticationMethod method, const QString &reason);
 
+    // Signal when an NFC/FIDO reader is plugged in or removed
+    void securityKeyPresenceChanged(bool present);
+
+    // Outcome of registerAgentWithRetry()
+    void agentRegistered();
+    void agentRegistrationFailed();
+
     /*
      * Comprehensive error signal (Option C: Defaults + Overrides)
      *
@@ -178,31 +260,50 @@ protected:
     bool initiateAuthenticationFinish() override;
     void cancelAuthentication() override;
 
-private slots:
-    void onCheckAuthorizationFinished(PolkitQt1::Authority::Result result);
-
 private:
     PolkitQt1::Authority *m_authority;
-    QString m_currentActionId;
 
-    // Unified session state tracking (replaces three separate maps)
-    QMap<QString, SessionState> m_sessions;
+    /*
+     * Session storage
+     *
+     * Sessions live in a slot table whose elements never move (std::deque
+     * only appends), so a SessionState* stays valid across later inserts.
+     * Freed slots are recycled through m_freeSlots. Polkitd and the IPC
+     * client only know cookies; m_cookieToHandle resolves those once at the
+     * boundary and everything after that works on the handle.
+     */
+    struct SessionSlot {
+        quint32 generation = 1;
+        bool live = false;
+        SessionState state;
+    };
+    std::deque<SessionSlot> m_slots;
+    QList<quint32> m_freeSlots;
+    QHash<QString, SessionHandle> m_cookieToHandle;
 
     // NFC reader detection (dependency injection)
     INfcDetector *m_nfcDetector;
     bool m_ownDetector;  // True if we created the detector (need to delete)
 
-    // Message transformation for user-friendly text
-    QString transformAuthMessage(const QString &actionId, const QString &message, const PolkitQt1::Details &details);
+    // Message transformation for user-friendly text. May start an asynchronous
+    // refinement that is delivered through authMessageUpdated().
+    QString transformAuthMessage(const QString &actionId, const QString &message,
+                                 const PolkitQt1::Details &details, SessionHandle handle);
+    bool m_transformEnabled;
+    MessageRules m_messageRules;  // Compiled once from config plus built-ins (run0)
+    ActionIndex *m_actionIndex;   // .policy metadata, built on the first authentication
 
     // State machine helpers
-    void setState(const QString &cookie, AuthenticationState newState);
-    void setMethod(const QString &cookie, AuthenticationMethod method);
-    void cleanupSession(const QString &cookie);
-    SessionState* getSession(const QString &cookie);
-    const SessionState* getSession(const QString &cookie) const;
-    QString stateToString(AuthenticationState state) const;
-    QString methodToString(AuthenticationMethod method) const;
+    SessionHandle createSession(const QString &cookie);
+    void setState(SessionHandle handle, AuthenticationState newState);
+    void setMethod(SessionHandle handle, AuthenticationMethod method);
+    void cleanupSession(SessionHandle handle);
+    void cancelSession(SessionHandle handle);
+    void cancelAllSessions();
+    void resetAuthenticationTimeout(SessionHandle handle);
+    void onAuthenticationTimeout(SessionHandle handle);
+    SessionState* getSession(SessionHandle handle);
+    const SessionState* getSession(SessionHandle handle) const;
 
     // Error message generation (inspired by GDM's get_friendly_error_message)
     // See: https://gitlab.gnome.org/GNOME/gdm/-/blob/main/daemon/gdm-session-worker.c:846
@@ -210,4 +311,13 @@ private:
 
     // Configuration
     static constexpr int MAX_AUTH_RETRIES = 3;     // Max failed attempts before lockout
+    static constexpr int AUTH_TIMEOUT_MS = 300000; // Idle time before a session is reclaimed (5 minutes)
+    int m_authTimeoutMs;
+
+    // Registration retry (first retry after 250ms, doubling up to 8s: about a minute in all)
+    void attemptRegistration();
+    static constexpr int REGISTRATION_MAX_ATTEMPTS = 12;
+    static constexpr int REGISTRATION_INITIAL_DELAY_MS = 250;
+    static constexpr int REGISTRATION_MAX_DELAY_MS = 8000;
+    int m_registrationAttempts;
 };
\ No newline at end of file
@@ -0,0 +1,109 @@
+/*
+ * quickshell-polkit-agent
+ * Copyright (C) 2025 Benny Powers
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "rate-limiter.h"
+
+namespace {
+constexpr qint64 MILLI = 1000;
+}
+
+RateLimiter::RateLimiter()
+{
+    const int capacities[] = {HEARTBEAT_CAPACITY, AUTH_CAPACITY, CONTROL_CAPACITY};
+    const int rates[] = {HEARTBEAT_REFILL_PER_SECOND, AUTH_REFILL_PER_SECOND, CONTROL_REFILL_PER_SECOND};
+    
+    for (size_t i = 0; i < m_buckets.size(); ++i) {
+        // Buckets start full so a fresh connection can burst
+        m_buckets[i].capacityMilliTokens = capacities[i] * MILLI;
+        m_buckets[i].milliTokens = m_buckets[i].capacityMilliTokens;
+        m_buckets[i].refillPerSecond = rates[i];
+    }
+}
+
+bool RateLimiter::admit(MessageClass messageClass, qint64 nowMs)
+{
+    Bucket &bucket = m_buckets[static_cast<size_t>(messageClass)];
+    
+    if (bucket.lastRefillMs >= 0 && nowMs > bucket.lastRefillMs) {
+        // refillPerSecond tokens per 1000 ms is refillPerSecond milli-tokens per ms
+        const qint64 elapsed = nowMs - bucket.lastRefillMs;
+        bucket.milliTokens = qMin(bucket.capacityMilliTokens,
+                                  bucket.milliTokens + elapsed * bucket.refillPerSecond);
+    }
+    if (bucket.lastRefillMs < nowMs) {
+        bucket.lastRefillMs = nowMs;
+    }
+    
+    if (bucket.milliTokens < MILLI) {
+        ++bucket.shed;
+        bucket.limited = true;
+        return false;
+    }
+    
+    bucket.milliTokens -= MILLI;
+    bucket.limited = false;
+    return true;
+}
+
+void RateLimiter::refund(MessageClass messageClass)
+{
+    Bucket &bucket = m_buckets[static_cast<size_t>(messageClass)];
+    bucket.milliTokens = qMin(bucket.capacityMilliTokens, bucket.milliTokens + MILLI);
+}
+
+bool RateLimiter::isLimited(MessageClass messageClass) const
+{
+    return m_buckets[static_cast<size_t>(messageClass)].limited;
+}
+
+quint64 RateLimiter::shedCount(MessageClass messageClass) const
+{
+    return m_buckets[static_cast<size_t>(messageClass)].shed;
+}
+
+quint64 RateLimiter::totalShed() const
+{
+    quint64 total = 0;
+    for (const Bucket &bucket : m_buckets) {
+        total += bucket.shed;
+    }
+    return total;
+}
+
+RateLimiter::MessageClass RateLimiter::classify(QByteArrayView type)
+{
+    if (type == "heartbeat") {
+        return MessageClass::Heartbeat;
+    }
+    if (type == "check_authorization" || type == "submit_authentication" ||
+        type == "cancel_authorization") {
+        return MessageClass::Auth;
+    }
+    return MessageClass::Control;
+}
+
+const char *RateLimiter::className(MessageClass messageClass)
+{
+    switch (messageClass) {
+    case MessageClass::Heartbeat: return "heartbeat";
+    case MessageClass::Auth: return "auth";
+    case MessageClass::Control: return "control";
+    case MessageClass::Count: break;
+    }
+    return "unknown";
+}
@@ -0,0 +1,87 @@
+/*
+ * quickshell-polkit-agent
+ * Copyright (C) 2025 Benny Powers
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <QByteArrayView>
+#include <QtGlobal>
+
+#include <array>
+
+/*
+ * Per-connection token-bucket rate limiting
+ *
+ * Each client message class has its own bucket, so a client streaming
+ * heartbeats cannot starve its own auth submissions and a burst of
+ * control messages cannot exhaust the heartbeat budget. A bucket is two
+ * integers and a timestamp: tokens are kept in thousandths and refilled
+ * lazily from the elapsed monotonic time on each check, so admitting a
+ * frame is O(1) with no allocation.
+ *
+ * Classification works on the raw type bytes so frames can be shed before
+ * they are parsed (see WireFormat::peekMessageType).
+ */
+class RateLimiter
+{
+public:
+    enum class MessageClass {
+        Heartbeat = 0,  // heartbeat
+        Auth,           // check_authorization, cancel_authorization, submit_authentication
+        Control,        // select_encoding and anything unrecognised
+        Count
+    };
+
+    RateLimiter();
+
+    // Charge one frame of the given class; false if its bucket is empty
+    bool admit(MessageClass messageClass, qint64 nowMs);
+
+    // Return the token of an admitted frame whose cost is charged otherwise
+    void refund(MessageClass messageClass);
+
+    // True from the first rejection until the class admits a frame again.
+    // Used to report an overload episode once rather than per frame.
+    bool isLimited(MessageClass messageClass) const;
+
+    // Frames rejected for this class over the connection's lifetime
+    quint64 shedCount(MessageClass messageClass) const;
+    quint64 totalShed() const;
+
+    static MessageClass classify(QByteArrayView type);
+    static const char *className(MessageClass messageClass);
+
+    // Budgets: burst capacity and sustained refill rate per second
+    static constexpr int HEARTBEAT_CAPACITY = 10;
+    static constexpr int HEARTBEAT_REFILL_PER_SECOND = 5;
+    static constexpr int AUTH_CAPACITY = 10;
+    static constexpr int AUTH_REFILL_PER_SECOND = 10;
+    static constexpr int CONTROL_CAPACITY = 5;
+    static constexpr int CONTROL_REFILL_PER_SECOND = 2;
+
+private:
+    struct Bucket {
+        qint64 milliTokens = 0;
+        qint64 capacityMilliTokens = 0;
+        int refillPerSecond = 0;
+        qint64 lastRefillMs = -1;
+        quint64 shed = 0;
+        bool limited = false;
+    };
+
+    std::array<Bucket, static_cast<size_t>(MessageClass::Count)> m_buckets;
+};
@@ -0,0 +1,116 @@
+/*
+ * quickshell-polkit-agent
+ * Copyright (C) 2025 Benny Powers
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "replay-outbox.h"
+
+#include <QList>
+
+#include <algorithm>
+
+int ReplayOutbox::kindOf(const QString &type)
+{
+    if (type == QLatin1String("show_auth_dialog")) {
+        return Dialog;
+    }
+    if (type == QLatin1String("auth_dialog_update")) {
+        return DialogUpdate;
+    }
+    if (type == QLatin1String("password_request")) {
+        return Prompt;
+    }
+    if (type == QLatin1String("authorization_error")) {
+        return Error;
+    }
+    return -1;
+}
+
+bool ReplayOutbox::record(const QJsonObject &message)
+{
+    const QString type = message["type"].toString();
+    const QString cookie = message["cookie"].toString();
+    
+    // Frames without a session answer a request from a client that is gone
+    if (cookie.isEmpty()) {
+        return false;
+    }
+    
+    if (type == QLatin1String("authorization_result")) {
+        purge(cookie);
+        return false;
+    }
+    
+    const int kind = kindOf(type);
+    if (kind < 0) {
+        return false;
+    }
+    
+    auto it = m_entries.find(cookie);
+    if (it == m_entries.end()) {
+        if (m_entries.size() >= MAX_SESSIONS) {
+            auto oldest = std::min_element(m_entries.begin(), m_entries.end(),
+                                           [](const Entry &a, const Entry &b) { return a.order < b.order; });
+            m_entries.erase(oldest);
+            m_evicted++;
+        }
+        it = m_entries.insert(cookie, Entry());
+        it->order = m_nextOrder++;
+    } else if (kind == Dialog) {
+        // A new dialog for the cookie starts the session over
+        it->frames = {};
+    }
+    
+    // Replay is a state catch-up, not an event: without its original
+    // event_seq it cannot advance a resuming client past events it missed
+    QJsonObject state = message;
+    state.remove("event_seq");
+    it->frames[kind] = WireFormat::encode(state, ENCODING);
+    return true;
+}
+
+void ReplayOutbox::purge(const QString &cookie)
+{
+    m_entries.remove(cookie);
+}
+
+QByteArray ReplayOutbox::takeFrames(const std::function<bool(const QString &cookie)> &isLive)
+{
+    QList<std::pair<quint64, QString>> sessions;
+    sessions.reserve(m_entries.size());
+    qsizetype size = 0;
+    for (auto it = m_entries.cbegin(); it != m_entries.cend(); ++it) {
+        if (isLive && !isLive(it.key())) {
+            continue;
+        }
+        sessions.append({it->order, it.key()});
+        for (const QByteArray &frame : it->frames) {
+            size += frame.size();
+        }
+    }
+    std::sort(sessions.begin(), sessions.end());
+    
+    QByteArray frames;
+    frames.reserve(size);
+    for (const auto &session : std::as_const(sessions)) {
+        for (const QByteArray &frame : m_entries[session.second].frames) {
+            frames.append(frame);
+        }
+    }
+    
+    m_entries.clear();
+    return frames;
+}
@@ -0,0 +1,87 @@
+/*
+ * quickshell-polkit-agent
+ * Copyright (C) 2025 Benny Powers
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <QByteArray>
+#include <QHash>
+#include <QJsonObject>
+#include <QString>
+
+#include <array>
+#include <functional>
+
+#include "wire-format.h"
+
+/*
+ * Pending polkit state for a client that is not connected yet
+ *
+ * Events broadcast while no client is listening are folded into one entry
+ * per session cookie rather than kept as a history: a newer dialog, prompt
+ * or error replaces the older one of the same kind, and the session's
+ * authorization_result removes the entry entirely, because a finished
+ * session has nothing left to show. Frames are encoded when recorded, so
+ * replay is a concatenation of stored bytes.
+ *
+ * Stored frames drop "event_seq". They are sent right after the welcome,
+ * before a reconnecting client's resume, and a sequence number on them
+ * would make the client discard the earlier events the delta brings.
+ *
+ * A client speaks JSON until it selects another encoding, which it can
+ * only do after the welcome frame, so stored frames are always JSON.
+ */
+class ReplayOutbox
+{
+public:
+    // Fold one broadcast event in; false if it carries nothing to replay
+    bool record(const QJsonObject &message);
+
+    // Forget everything stored for a session
+    void purge(const QString &cookie);
+
+    // All stored frames in session arrival order, as one buffer, leaving the
+    // outbox empty. Sessions for which isLive returns false are skipped.
+    QByteArray takeFrames(const std::function<bool(const QString &cookie)> &isLive = nullptr);
+
+    // Give back table capacity left over from a burst of sessions
+    void squeeze() { m_entries.squeeze(); }
+
+    bool isEmpty() const { return m_entries.isEmpty(); }
+    int sessionCount() const { return int(m_entries.size()); }
+
+    // Sessions pushed out because MAX_SESSIONS were already pending
+    quint64 evictedCount() const { return m_evicted; }
+
+    static constexpr int MAX_SESSIONS = 50;
+    static constexpr WireEncoding ENCODING = WireEncoding::Json;
+
+private:
+    // Replay order within a session: the dialog first, then what refines it
+    enum Kind { Dialog = 0, DialogUpdate, Prompt, Error, KindCount };
+
+    struct Entry {
+        quint64 order = 0;  // When the session was first recorded
+        std::array<QByteArray, KindCount> frames;
+    };
+
+    static int kindOf(const QString &type);
+
+    QHash<QString, Entry> m_entries;
+    quint64 m_nextOrder = 0;
+    quint64 m_evicted = 0;
+};
@@ -1,11 +1,16 @@
 #include "security.h"
 #include "logging.h"
+#include "audit-log.h"
 #include <QCryptographicHash>
 #include <QMessageAuthenticationCode>
 #include <QRandomGenerator>
+#include <QVarLengthArray>
 #include <QJsonDocument>
+#include <QCborMap>
+#include <QCborValue>
 #include <QDateTime>
 #include <QDebug>
+#include <cstring>
 
 QByteArray SecurityManager::s_hmacKey;
 bool SecurityManager::s_initialized = false;
@@ -45,8 +50,9 @@ bool SecurityManager::verifyHMAC(const QByteArray &data, const QString &expected
         return false;
     }
     
-    QString computedHMAC = generateHMAC(data);
-    bool valid = (computedHMAC == expectedHMAC);
+    QByteArray computed = QByteArray::fromHex(generateHMAC(data).toLatin1());
+    QByteArray expected = QByteArray::fromHex(expectedHMAC.toLatin1());
+    bool valid = constantTimeEquals(computed, expected);
     
     if (!valid) {
         qCWarning(polkitAgent) << "HMAC verification failed";
@@ -95,13 +101,23 @@ bool SecurityManager::verifyMessage(const QJsonObject &message)
         return false;
     }
     
+    return isTimestampFresh(message);
+}
+
+bool SecurityManager::isTimestampFresh(const QJsonObject &message)
+{
+    QJsonValue timestamp = message.value(QLatin1String("timestamp"));
+    if (!timestamp.isDouble()) {
+        qCWarning(polkitAgent) << "Message missing security fields";
+        auditLog("MESSAGE_VERIFICATION", "Missing HMAC or timestamp", "FAILURE");
+        return false;
+    }
+    
     // Check message timestamp for replay protection
-    qint64 messageTimestamp = static_cast<qint64>(message["timestamp"].toDouble());
+    qint64 messageTimestamp = static_cast<qint64>(timestamp.toDouble());
     qint64 currentTime = getCurrentTimestamp();
     qint64 timeDiff = currentTime - messageTimestamp;
     
-    // Allow 30 seconds clock skew
-    static constexpr qint64 MAX_TIME_SKEW_MS = 30000;
     if (timeDiff > MAX_TIME_SKEW_MS || timeDiff < -MAX_TIME_SKEW_MS) {
         qCWarning(polkitAgent) << "Message timestamp out of acceptable range:" << timeDiff << "ms";
         auditLog("MESSAGE_VERIFICATION", QString("Timestamp skew: %1ms").arg(timeDiff), "FAILURE");
@@ -111,6 +127,38 @@ bool SecurityManager::verifyMessage(const QJsonObject &message)
     return true;
 }
 
+bool SecurityManager::readSequence(const QJsonObject &message, quint64 *sequence)
+{
+    // Largest integer a JSON number carries exactly
+    static constexpr double MAX_SEQUENCE = 9007199254740992.0;
+    
+    QJsonValue value = message.value(QLatin1String("seq"));
+    if (!value.isDouble()) {
+        return false;
+    }
+    
+    double number = value.toDouble();
+    if (number < 1 || number > MAX_SEQUENCE || number != static_cast<double>(static_cast<quint64>(number))) {
+        return false;
+    }
+    
+    *sequence = static_cast<quint64>(number);
+    return true;
+}
+
+bool SecurityManager::constantTimeEquals(QByteArrayView a, QByteArrayView b)
+{
+    if (a.size() != b.size()) {
+        return false;
+    }
+    
+    unsigned char diff = 0;
+    for (qsizetype i = 0; i < a.size(); ++i) {
+        diff |= static_cast<unsigned char>(a[i]) ^ static_cast<unsigned char>(b[i]);
+    }
+    return diff == 0;
+}
+
 bool SecurityManager::isSessionExpired(qint64 sessionStartTime)
 {
     qint64 currentTime = getCurrentTimestamp();
@@ -122,41 +170,172 @@ qint64 SecurityManager::getCurrentTimestamp()
     return QDateTime::currentMSecsSinceEpoch();
 }
 
-void SecurityManager::auditLog(const QString &event, const QString &details, const QString &result)
+void SecurityManager::auditLog(const QString &event, const QString &details, const QString &result,
+                               const QString &actionId)
 {
-    QString auditMessage = formatAuditMessage(event, details, result);
-    
-    // Log to Qt logging system with special audit category
-    qCInfo(polkitAgent) << "AUDIT:" << auditMessage;
-    
-    // Could also log to syslog, file, or audit daemon here if needed
+    AuditLog::record(event, details, result, actionId);
+}
+
+void SecurityManager::shutdown()
+{
+    AuditLog::shutdown();
 }
 
 QByteArray SecurityManager::generateRandomKey(int size)
 {
-    QByteArray key;
-    key.reserve(size);
+    // One bulk read from the system source instead of a call per byte; the
+    // word buffer avoids assuming QByteArray storage is quint32-aligned
+    QVarLengthArray<quint32, 16> words((size + 3) / 4);
+    QRandomGenerator::system()->fillRange(words.data(), words.size());
+    
+    QByteArray key(reinterpret_cast<const char *>(words.constData()), size);
+    std::memset(words.data(), 0, words.size() * sizeof(quint32));
+    return key;
+}
+
+namespace {
+
+// ,"hmac":"<64 hex>"} ends a signed JSON frame
+constexpr QByteArrayView JSON_HMAC_PREFIX(",\"hmac\":\"");
+constexpr qsizetype JSON_HMAC_TAIL = JSON_HMAC_PREFIX.size() + 2 * MessageAuthenticator::DIGEST_SIZE + 2;
+
+// text(4) "hmac", bytes(32) header, then the digest
+constexpr char CBOR_HMAC_PREFIX[] = {'\x64', 'h', 'm', 'a', 'c', '\x58', '\x20'};
+constexpr qsizetype CBOR_HMAC_TAIL = sizeof(CBOR_HMAC_PREFIX) + MessageAuthenticator::DIGEST_SIZE;
+
+int hexValue(char c)
+{
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+} // namespace
+
+MessageAuthenticator::MessageAuthenticator()
+    : m_mac(QCryptographicHash::Sha256)
+    , m_keyed(SecurityManager::s_initialized)
+{
+    if (m_keyed) {
+        m_mac.setKey(SecurityManager::s_hmacKey);
+    } else {
+        qCWarning(polkitAgent) << "Security manager not initialized, signed frames will be rejected";
+    }
+}
+
+QByteArray MessageAuthenticator::digest(QByteArrayView data)
+{
+    m_mac.reset();  // Keeps the key
+    m_mac.addData(data.data(), data.size());
+    return m_mac.result();
+}
+
+bool MessageAuthenticator::verifyFrame(QByteArrayView frame, WireEncoding encoding)
+{
+    if (!m_keyed) {
+        return false;
+    }
     
-    QRandomGenerator *generator = QRandomGenerator::system();
-    for (int i = 0; i < size; ++i) {
-        key.append(static_cast<char>(generator->bounded(256)));
+    char provided[DIGEST_SIZE];
+    qsizetype signedLength = 0;
+    
+    if (encoding == WireEncoding::Cbor) {
+        if (frame.size() <= CBOR_HMAC_TAIL) {
+            return false;
+        }
+        signedLength = frame.size() - CBOR_HMAC_TAIL;
+        if (frame.sliced(signedLength, sizeof(CBOR_HMAC_PREFIX)) != QByteArrayView(CBOR_HMAC_PREFIX, sizeof(CBOR_HMAC_PREFIX))) {
+            return false;
+        }
+        memcpy(provided, frame.constData() + frame.size() - DIGEST_SIZE, DIGEST_SIZE);
+    } else {
+        // Tolerate the '\r' of CRLF-terminated frames and trailing spaces
+        while (!frame.isEmpty() && (frame.back() == '\r' || frame.back() == ' ' || frame.back() == '\t')) {
+            frame.chop(1);
+        }
+        if (frame.size() <= JSON_HMAC_TAIL || !frame.endsWith("\"}")) {
+            return false;
+        }
+        signedLength = frame.size() - JSON_HMAC_TAIL;
+        if (frame.sliced(signedLength, JSON_HMAC_PREFIX.size()) != JSON_HMAC_PREFIX) {
+            return false;
+        }
+        const char *hex = frame.constData() + signedLength + JSON_HMAC_PREFIX.size();
+        for (qsizetype i = 0; i < DIGEST_SIZE; ++i) {
+            int high = hexValue(hex[2 * i]);
+            int low = hexValue(hex[2 * i + 1]);
+            if (high < 0 || low < 0) {
+                return false;
+            }
+            provided[i] = static_cast<char>((high << 4) | low);
+        }
     }
     
-    return key;
+    bool valid = SecurityManager::constantTimeEquals(digest(frame.first(signedLength)),
+                                                      QByteArrayView(provided, DIGEST_SIZE));
+    if (!valid) {
+        qCWarning(polkitAgent) << "HMAC verification failed";
+        SecurityManager::auditLog("HMAC_VERIFICATION", "Message authentication failed", "FAILURE");
+    }
+    return valid;
 }
 
-QString SecurityManager::formatAuditMessage(const QString &event, const QString &details, const QString &result)
+QByteArray MessageAuthenticator::signFrame(const QJsonObject &message, WireEncoding encoding)
 {
-    QString timestamp = QDateTime::currentDateTime().toString(Qt::ISODate);
-    QString message = QString("[%1] event=%2").arg(timestamp, event);
+    QJsonObject unsignedMessage = message;
+    unsignedMessage.remove(QLatin1String("hmac"));
     
-    if (!details.isEmpty()) {
-        message += QString(" details=\"%1\"").arg(details);
+    if (encoding == WireEncoding::Cbor) {
+        // Encode with a placeholder so the map header already counts the hmac pair
+        QCborMap map = QCborMap::fromJsonObject(unsignedMessage);
+        map.insert(QLatin1String("hmac"), QByteArray(DIGEST_SIZE, '\0'));
+        QByteArray frame = map.toCborValue().toCbor();
+        
+        const qsizetype signedLength = frame.size() - CBOR_HMAC_TAIL;
+        const QByteArray mac = digest(QByteArrayView(frame).first(signedLength));
+        frame.replace(frame.size() - DIGEST_SIZE, DIGEST_SIZE, mac);
+        return frame;
+    }
+    
+    // Reopen the compact object to append hmac as its last member
+    QByteArray frame = QJsonDocument(unsignedMessage).toJson(QJsonDocument::Compact);
+    frame.chop(1);
+    const QByteArray mac = digest(frame);
+    frame.append(JSON_HMAC_PREFIX.data(), JSON_HMAC_PREFIX.size());
+    frame.append(mac.toHex());
+    frame.append("\"}\n");
+    return frame;
+}
+
+bool ReplayWindow::check(quint64 sequence) const
+{
+    if (sequence == 0) {
+        return false;
+    }
+    if (sequence > m_highest) {
+        return true;
     }
     
-    if (!result.isEmpty()) {
-        message += QString(" result=%1").arg(result);
+    const quint64 offset = m_highest - sequence;
+    if (offset >= WINDOW_SIZE) {
+        return false;  // Too old to tell, so reject
+    }
+    return !(m_bitmap & (quint64(1) << offset));
+}
+
+void ReplayWindow::accept(quint64 sequence)
+{
+    if (sequence > m_highest) {
+        const quint64 shift = sequence - m_highest;
+        m_bitmap = shift >= WINDOW_SIZE ? 0 : m_bitmap << shift;
+        m_bitmap |= 1;
+        m_highest = sequence;
+        return;
     }
     
-    return message;
-}
\ No newline at end of file
+    const quint64 offset = m_highest - sequence;
+    if (offset < WINDOW_SIZE) {
+        m_bitmap |= quint64(1) << offset;
+    }
+}
@@ -2,8 +2,12 @@
 
 #include <QString>
 #include <QByteArray>
+#include <QByteArrayView>
 #include <QJsonObject>
 #include <QDateTime>
+#include <QMessageAuthenticationCode>
+
+#include "wire-format.h"
 
 class SecurityManager
 {
@@ -11,31 +15,115 @@ public:
     // Initialize security manager with random key generation
     static void initialize();
     
+    // Flush and stop the audit log writer (see AuditLog)
+    static void shutdown();
+    
     // HMAC authentication for IPC messages
     static QString generateHMAC(const QByteArray &data);
     static bool verifyHMAC(const QByteArray &data, const QString &expectedHMAC);
     
-    // Message authentication helpers
+    // Message authentication helpers (object level; these re-encode the
+    // message, the IPC path checks frames with MessageAuthenticator)
     static QJsonObject signMessage(const QJsonObject &message);
     static bool verifyMessage(const QJsonObject &message);
     
+    // Replay protection for a message whose MAC has been checked
+    static bool isTimestampFresh(const QJsonObject &message);
+    
+    // The "seq" of a signed message: an integer from 1 to 2^53
+    static bool readSequence(const QJsonObject &message, quint64 *sequence);
+    
+    // Compare digests without an early exit on the first differing byte
+    static bool constantTimeEquals(QByteArrayView a, QByteArrayView b);
+    
     // Session timeout management
     static bool isSessionExpired(qint64 sessionStartTime);
     static qint64 getCurrentTimestamp();
     
-    // Audit logging
+    // Audit logging; queued and written off the event loop (see AuditLog)
     static void auditLog(const QString &event, const QString &details = QString(), 
-                        const QString &result = QString());
+                        const QString &result = QString(), const QString &actionId = QString());
     
     // Security configuration
     static constexpr int SESSION_TIMEOUT_MS = 300000; // 5 minutes
     static constexpr int HMAC_KEY_SIZE = 32; // 256 bits
+    static constexpr qint64 MAX_TIME_SKEW_MS = 30000; // Allowed clock skew for signed messages
     
 private:
+    friend class MessageAuthenticator;
+
     static QByteArray s_hmacKey;
     static bool s_initialized;
     
     static QByteArray generateRandomKey(int size);
-    static QString formatAuditMessage(const QString &event, const QString &details, 
-                                    const QString &result);
-};
\ No newline at end of file
+};
+
+/*
+ * Keyed HMAC-SHA256 over wire frames
+ *
+ * Holds one keyed QMessageAuthenticationCode that is reset between
+ * messages rather than rebuilt, so an instance belongs to one connection
+ * (it is not thread-safe).
+ *
+ * A signed frame carries "hmac" as its final member and the MAC covers
+ * every byte of the frame before that member, so it is checked directly
+ * on the received bytes without re-encoding:
+ *
+ *   JSON: {"timestamp":...,"type":"heartbeat","hmac":"<64 hex digits>"}
+ *         MAC over the frame up to (not including) ,"hmac":"
+ *   CBOR: map whose last pair is text "hmac" => 32-byte byte string
+ *         MAC over the item up to (not including) the "hmac" key
+ *
+ * The CBOR map header counts the hmac pair, so the signer encodes it with
+ * a zeroed digest and fills the digest in afterwards (see signFrame).
+ */
+class MessageAuthenticator
+{
+public:
+    MessageAuthenticator();
+    
+    // Raw HMAC-SHA256 of data with the session key
+    QByteArray digest(QByteArrayView data);
+    
+    // Check a received frame (without its '\n' delimiter for JSON)
+    bool verifyFrame(QByteArrayView frame, WireEncoding encoding);
+    
+    // Encode message with a trailing hmac member, including framing
+    QByteArray signFrame(const QJsonObject &message, WireEncoding encoding);
+    
+    static constexpr qsizetype DIGEST_SIZE = 32;
+    
+private:
+    QMessageAuthenticationCode m_mac;
+    bool m_keyed;
+};
+
+/*
+ * Anti-replay window for per-connection sequence numbers
+ *
+ * RFC 4303 (IPsec ESP) style: remembers the highest sequence number
+ * accepted and a bitmap of which of the WINDOW_SIZE numbers below it have
+ * been seen. Sequence numbers start at 1 and must increase, but may arrive
+ * out of order within the window. Constant memory, O(1) per check.
+ *
+ * check() is cheap and is meant to run before the MAC; accept() must only
+ * be called once the frame has been authenticated, so forged frames cannot
+ * advance the window.
+ */
+class ReplayWindow
+{
+public:
+    // False for 0, anything already seen, or anything older than the window
+    bool check(quint64 sequence) const;
+    
+    // Record an authenticated sequence number
+    void accept(quint64 sequence);
+    
+    quint64 highest() const { return m_highest; }
+    
+    static constexpr quint64 WINDOW_SIZE = 64;
+    
+private:
+    quint64 m_highest = 0;
+    quint64 m_bitmap = 0;  // Bit n set: m_highest - n was seen (bit 0 is m_highest)
+};
@@ -0,0 +1,96 @@
+/*
+ * quickshell-polkit-agent
+ * Copyright (C) 2025 Benny Powers
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "startup-profile.h"
+#include "logging.h"
+
+#include <QElapsedTimer>
+#include <QStringList>
+
+namespace {
+struct Phase {
+    const char *name;
+    qint64 durationNs;
+};
+
+struct Profile {
+    QElapsedTimer clock;
+    qint64 lastMarkNs = 0;
+    Phase phases[StartupProfile::MAX_PHASES];
+    int phaseCount = 0;
+};
+
+Profile g_profile;
+
+QString milliseconds(qint64 ns)
+{
+    return QString::number(double(ns) / 1e6, 'f', 2) + QLatin1String("ms");
+}
+}
+
+void StartupProfile::start()
+{
+    g_profile.clock.start();
+    g_profile.lastMarkNs = 0;
+    g_profile.phaseCount = 0;
+}
+
+void StartupProfile::mark(const char *phase)
+{
+    if (!g_profile.clock.isValid()) {
+        return;
+    }
+    const qint64 now = g_profile.clock.nsecsElapsed();
+    if (g_profile.phaseCount < MAX_PHASES) {
+        g_profile.phases[g_profile.phaseCount++] = {phase, now - g_profile.lastMarkNs};
+    }
+    g_profile.lastMarkNs = now;
+}
+
+QString StartupProfile::summary()
+{
+    QStringList parts;
+    for (int i = 0; i < g_profile.phaseCount; ++i) {
+        parts.append(QLatin1String(g_profile.phases[i].name) + '=' + milliseconds(g_profile.phases[i].durationNs));
+    }
+    parts.append(QLatin1String("total=") + milliseconds(elapsedNs()));
+    return parts.join(' ');
+}
+
+void StartupProfile::report(const char *milestone)
+{
+    if (!g_profile.clock.isValid()) {
+        return;
+    }
+    qCInfo(polkitLatency).noquote() << QString("Startup %1: %2").arg(QLatin1String(milestone), summary());
+    g_profile.phaseCount = 0;
+}
+
+qint64 StartupProfile::elapsedNs()
+{
+    return g_profile.clock.isValid() ? g_profile.clock.nsecsElapsed() : 0;
+}
+
+#ifdef BUILD_TESTING
+void StartupProfile::testReset()
+{
+    g_profile.clock.invalidate();
+    g_profile.lastMarkNs = 0;
+    g_profile.phaseCount = 0;
+}
+#endif
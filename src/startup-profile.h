@@ -0,0 +1,53 @@
+/*
+ * quickshell-polkit-agent
+ * Copyright (C) 2025 Benny Powers
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <QString>
+#include <QtGlobal>
+
+/*
+ * Cold-start phase timing
+ *
+ * main() marks the end of each startup phase against one monotonic clock
+ * started at its first line. report() logs the phases marked since the last
+ * report as a single polkit.latency line, so every release's startup can be
+ * compared from the journal:
+ *
+ *   Startup ready for clients: security_init=0.21ms ipc_listen=0.95ms total=1.40ms
+ *
+ * Phases that finish after the event loop starts, like agent registration,
+ * get a second report of their own. Single-threaded, like main().
+ */
+class StartupProfile
+{
+public:
+    static void start();
+    static void mark(const char *phase);
+    static void report(const char *milestone);
+
+    // Phases marked since the last report, "name=1.23ms ... total=4.56ms"
+    static QString summary();
+    static qint64 elapsedNs();
+
+#ifdef BUILD_TESTING
+    static void testReset();
+#endif
+
+    static constexpr int MAX_PHASES = 16;
+};
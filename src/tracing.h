@@ -0,0 +1,55 @@
+/*
+ * quickshell-polkit-agent
+ * Copyright (C) 2025 Benny Powers
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+/*
+ * Static tracepoints (USDT)
+ *
+ * With HAVE_SYS_SDT_H each TRACEPOINT() is a single nop plus an ELF note
+ * describing where its arguments live; nothing is evaluated or branched on
+ * until a tracer attaches. Without it they compile to nothing. Arguments
+ * must be integers or pointers, and pointers must be stable C strings (e.g.
+ * MessageValidator::messageTypeName()), never temporaries.
+ *
+ * Probes, all under the quickshell_polkit provider:
+ *
+ *   client_connected(int version, int clients)
+ *   client_disconnected(int version, int clients)
+ *   frame_received(int version, int type, const char *type_name, long bytes)
+ *   frame_rejected(int version, int type)
+ *   frame_sent(int version, long bytes, int critical)
+ *   client_flush(int version, long bytes)
+ *   state_transition(uint slot, uint generation, int from, int to)
+ *   method_changed(uint slot, uint generation, int from, int to)
+ *   pam_request(uint slot, uint generation, int echo)
+ *   pam_completed(uint slot, uint generation, int authorized)
+ *   pam_error(uint slot, uint generation)
+ *   pam_info(uint slot, uint generation)
+ *
+ * States and methods are the AuthenticationState and AuthenticationMethod
+ * values. List them on a binary with:
+ *
+ *   bpftrace -l 'usdt:/usr/libexec/quickshell-polkit-agent:*'
+ */
+#ifdef HAVE_SYS_SDT_H
+#include <sys/sdt.h>
+#define TRACEPOINT(name, ...) STAP_PROBEV(quickshell_polkit, name, __VA_ARGS__)
+#else
+#define TRACEPOINT(name, ...) do { } while (0)
+#endif
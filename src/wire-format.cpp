@@ -0,0 +1,155 @@
+/*
+ * quickshell-polkit-agent
+ * Copyright (C) 2025 Benny Powers
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "wire-format.h"
+#include <QCborMap>
+#include <QCborStreamReader>
+#include <QCborValue>
+#include <QJsonDocument>
+
+QByteArray WireFormat::encode(const QJsonObject &message, WireEncoding encoding)
+{
+    if (encoding == WireEncoding::Cbor) {
+        return QCborMap::fromJsonObject(message).toCborValue().toCbor();
+    }
+
+    QByteArray frame = QJsonDocument(message).toJson(QJsonDocument::Compact);
+    frame.append('\n');  // Newline framing for SplitParser
+    return frame;
+}
+
+WireFormat::DecodeStatus WireFormat::decodeJson(const QByteArray &frame, QJsonObject *message, QString *error)
+{
+    QJsonParseError parseError;
+    QJsonDocument doc = QJsonDocument::fromJson(frame, &parseError);
+
+    if (parseError.error != QJsonParseError::NoError) {
+        *error = parseError.errorString();
+        return DecodeStatus::Invalid;
+    }
+
+    *message = doc.object();
+    return DecodeStatus::Complete;
+}
+
+WireFormat::DecodeStatus WireFormat::decodeCbor(const QByteArray &buffer, qsizetype offset,
+                                                QJsonObject *message, qsizetype *consumed, QString *error)
+{
+    if (offset >= buffer.size()) {
+        return DecodeStatus::Incomplete;
+    }
+
+    // Parse in place; the reader never outlives this call
+    QCborStreamReader reader(QByteArray::fromRawData(buffer.constData() + offset, buffer.size() - offset));
+    QCborValue value = QCborValue::fromCbor(reader);
+    QCborError cborError = reader.lastError();
+
+    if (cborError == QCborError::EndOfFile) {
+        return DecodeStatus::Incomplete;
+    }
+    if (cborError != QCborError::NoError) {
+        *error = cborError.toString();
+        return DecodeStatus::Invalid;
+    }
+    if (!value.isMap()) {
+        *error = "Top-level CBOR item must be a map";
+        return DecodeStatus::Invalid;
+    }
+
+    *message = value.toMap().toJsonObject();
+    *consumed = reader.currentOffset();
+    return DecodeStatus::Complete;
+}
+
+QByteArrayView WireFormat::peekMessageType(QByteArrayView frame)
+{
+    constexpr QByteArrayView key("\"type\"");
+    const QByteArrayView window = frame.first(qMin(frame.size(), PEEK_LIMIT));
+
+    auto skipSpace = [&window](qsizetype pos) {
+        while (pos < window.size() && (window[pos] == ' ' || window[pos] == '\t' ||
+                                       window[pos] == '\r' || window[pos] == '\n')) {
+            ++pos;
+        }
+        return pos;
+    };
+
+    qsizetype from = 0;
+    while (true) {
+        const qsizetype at = window.indexOf(key, from);
+        if (at < 0) {
+            return {};
+        }
+        from = at + key.size();
+
+        // A key is preceded by '{' or ',' (after whitespace); anything else
+        // means the text sits inside a string value
+        qsizetype before = at - 1;
+        while (before >= 0 && (window[before] == ' ' || window[before] == '\t' ||
+                               window[before] == '\r' || window[before] == '\n')) {
+            --before;
+        }
+        if (before < 0 || (window[before] != '{' && window[before] != ',')) {
+            continue;
+        }
+
+        qsizetype pos = skipSpace(from);
+        if (pos >= window.size() || window[pos] != ':') {
+            continue;
+        }
+        pos = skipSpace(pos + 1);
+        if (pos >= window.size() || window[pos] != '"') {
+            return {};
+        }
+
+        const qsizetype start = pos + 1;
+        const qsizetype limit = qMin(window.size(), start + MAX_PEEKED_TYPE_LENGTH + 1);
+        for (qsizetype end = start; end < limit; ++end) {
+            if (window[end] == '"') {
+                return window.sliced(start, end - start);
+            }
+            if (window[end] == '\\') {
+                return {};  // Escaped type names are never valid ones
+            }
+        }
+        return {};
+    }
+}
+
+QString WireFormat::encodingName(WireEncoding encoding)
+{
+    return encoding == WireEncoding::Cbor ? "cbor" : "json";
+}
+
+bool WireFormat::encodingFromName(const QString &name, WireEncoding *encoding)
+{
+    if (name == "json") {
+        *encoding = WireEncoding::Json;
+        return true;
+    }
+    if (name == "cbor") {
+        *encoding = WireEncoding::Cbor;
+        return true;
+    }
+    return false;
+}
+
+QStringList WireFormat::supportedEncodings()
+{
+    return {"json", "cbor"};
+}
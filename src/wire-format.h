@@ -0,0 +1,72 @@
+/*
+ * quickshell-polkit-agent
+ * Copyright (C) 2025 Benny Powers
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <QByteArray>
+#include <QByteArrayView>
+#include <QJsonObject>
+#include <QString>
+#include <QStringList>
+
+/*
+ * Encodings a client can speak on the IPC socket
+ *
+ * Json is newline-delimited compact JSON (the default, used by PolkitAgent.qml).
+ * Cbor is an RFC 8742 CBOR sequence: each message is one self-delimiting CBOR
+ * map, so no separator is needed. Both decode to the same QJsonObject shape,
+ * so validation and dispatch do not care which one was used.
+ */
+enum class WireEncoding {
+    Json,
+    Cbor
+};
+
+class WireFormat
+{
+public:
+    enum class DecodeStatus {
+        Complete,    // One message decoded
+        Incomplete,  // More bytes are needed
+        Invalid      // The stream cannot be decoded
+    };
+
+    // Serialize one outgoing message including its framing
+    static QByteArray encode(const QJsonObject &message, WireEncoding encoding);
+
+    // Decode one '\n'-delimited JSON frame (without the newline)
+    static DecodeStatus decodeJson(const QByteArray &frame, QJsonObject *message, QString *error);
+
+    // Decode the next CBOR item of a sequence starting at offset in buffer.
+    // On Complete, consumed holds the size of the item in bytes.
+    static DecodeStatus decodeCbor(const QByteArray &buffer, qsizetype offset,
+                                   QJsonObject *message, qsizetype *consumed, QString *error);
+
+    // Find the "type" value of a JSON frame without parsing it, for load
+    // shedding. Returns an empty view if there is no plain string value for a
+    // top-level-looking "type" key within the first PEEK_LIMIT bytes. This is a
+    // heuristic; the frame is still fully parsed and validated if admitted.
+    static QByteArrayView peekMessageType(QByteArrayView frame);
+    static constexpr qsizetype PEEK_LIMIT = 512;
+    static constexpr qsizetype MAX_PEEKED_TYPE_LENGTH = 32;
+
+    // Names used in the welcome capabilities and select_encoding
+    static QString encodingName(WireEncoding encoding);
+    static bool encodingFromName(const QString &name, WireEncoding *encoding);
+    static QStringList supportedEncodings();
+};
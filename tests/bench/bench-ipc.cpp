@@ -0,0 +1,332 @@
+#include <QTest>
+#include <QJsonObject>
+#include <QJsonArray>
+#include "../../src/message-validator.h"
+#include "../../src/security.h"
+#include "../../src/wire-format.h"
+#include "../../src/rate-limiter.h"
+#include "../../src/polkit-wrapper.h"
+
+/**
+ * Micro-benchmarks for the IPC hot path
+ *
+ * Unlike test-performance-stress, nothing here touches PAM or polkitd, so
+ * the numbers are stable enough to compare between builds:
+ *
+ *   ./bench-ipc -o results.json,json
+ *
+ * Each benchmark covers code the agent controls: validation, framing,
+ * authentication, load shedding and session table queries.
+ */
+class BenchIpc : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void cleanupTestCase();
+
+    // Inbound
+    void validateMessage_data();
+    void validateMessage();
+    void signMessage();
+    void verifyMessage();
+    void verifyFrame_data();
+    void verifyFrame();
+
+    // Outbound
+    void encode_data();
+    void encode();
+    void decode_data();
+    void decode();
+
+    // Load shedding
+    void peekAndClassify();
+    void rateLimitFlood();
+
+    // Session table
+    void stateQueryByCookie();
+    void stateQueryByHandle();
+    void sessionSnapshots();
+
+private:
+    static QJsonObject outboundMessage(const QString &type);
+    static void addOutboundRows();
+
+    PolkitWrapper *m_wrapper = nullptr;
+    QStringList m_cookies;
+    QList<SessionHandle> m_handles;
+
+    static constexpr int SESSION_COUNT = 32;
+};
+
+void BenchIpc::initTestCase()
+{
+    SecurityManager::initialize();
+
+    // Sessions without a PAM conversation behind them (BUILD_TESTING hook)
+    m_wrapper = new PolkitWrapper(nullptr, this);
+    for (int i = 0; i < SESSION_COUNT; ++i) {
+        const QString cookie = QString("bench-cookie-%1").arg(i);
+        m_cookies.append(cookie);
+        m_handles.append(m_wrapper->testInsertSession(cookie, QString("org.example.bench.action-%1").arg(i),
+                                                      AuthenticationState::WAITING_FOR_PASSWORD));
+    }
+}
+
+void BenchIpc::cleanupTestCase()
+{
+    m_wrapper->cancelAuthorization();
+    SecurityManager::shutdown();
+}
+
+void BenchIpc::validateMessage_data()
+{
+    QTest::addColumn<QJsonObject>("message");
+
+    QJsonObject check;
+    check["type"] = "check_authorization";
+    check["action_id"] = "org.freedesktop.systemd1.manage-units";
+    check["details"] = "Restart sshd.service";
+    QTest::newRow("check_authorization") << check;
+
+    QJsonObject cancel;
+    cancel["type"] = "cancel_authorization";
+    cancel["cookie"] = "3-3d4f8a9c2b1e-1-0123456789abcdef";
+    QTest::newRow("cancel_authorization") << cancel;
+
+    QJsonObject submit;
+    submit["type"] = "submit_authentication";
+    submit["cookie"] = "3-3d4f8a9c2b1e-1-0123456789abcdef";
+    submit["response"] = "correct horse battery staple";
+    QTest::newRow("submit_authentication") << submit;
+
+    QJsonObject heartbeat;
+    heartbeat["type"] = "heartbeat";
+    heartbeat["timestamp"] = 1700000000000.0;
+    QTest::newRow("heartbeat") << heartbeat;
+
+    QJsonObject encoding;
+    encoding["type"] = "select_encoding";
+    encoding["encoding"] = "cbor";
+    QTest::newRow("select_encoding") << encoding;
+
+    QJsonObject resume;
+    resume["type"] = "resume";
+    resume["last_seq"] = 1234;
+    resume["epoch"] = "9f86d081884c7d65";
+    QTest::newRow("resume") << resume;
+
+    QJsonObject invalid;
+    invalid["type"] = "submit_authentication";
+    invalid["cookie"] = "bad cookie!";
+    invalid["response"] = "x";
+    QTest::newRow("rejected") << invalid;
+}
+
+void BenchIpc::validateMessage()
+{
+    QFETCH(QJsonObject, message);
+    QBENCHMARK {
+        MessageValidator::validateMessage(message);
+    }
+}
+
+void BenchIpc::signMessage()
+{
+    QJsonObject message;
+    message["type"] = "heartbeat";
+    QBENCHMARK {
+        SecurityManager::signMessage(message);
+    }
+}
+
+void BenchIpc::verifyMessage()
+{
+    QJsonObject message;
+    message["type"] = "heartbeat";
+    const QJsonObject signedMessage = SecurityManager::signMessage(message);
+    QBENCHMARK {
+        SecurityManager::verifyMessage(signedMessage);
+    }
+}
+
+void BenchIpc::verifyFrame_data()
+{
+    QTest::addColumn<int>("encoding");
+    QTest::newRow("json") << int(WireEncoding::Json);
+    QTest::newRow("cbor") << int(WireEncoding::Cbor);
+}
+
+void BenchIpc::verifyFrame()
+{
+    QFETCH(int, encoding);
+    const WireEncoding wire = static_cast<WireEncoding>(encoding);
+
+    QJsonObject message;
+    message["type"] = "submit_authentication";
+    message["cookie"] = "3-3d4f8a9c2b1e-1-0123456789abcdef";
+    message["response"] = "correct horse battery staple";
+    message["timestamp"] = static_cast<double>(SecurityManager::getCurrentTimestamp());
+    message["seq"] = 1;
+
+    MessageAuthenticator authenticator;
+    QByteArray frame = authenticator.signFrame(message, wire);
+    if (wire == WireEncoding::Json) {
+        frame.chop(1);  // verifyFrame sees JSON frames without their delimiter
+    }
+    QVERIFY(authenticator.verifyFrame(frame, wire));
+
+    QBENCHMARK {
+        authenticator.verifyFrame(frame, wire);
+    }
+}
+
+QJsonObject BenchIpc::outboundMessage(const QString &type)
+{
+    QJsonObject message;
+    message["type"] = type;
+    if (type == "show_auth_dialog") {
+        message["action_id"] = "org.freedesktop.systemd1.manage-units";
+        message["message"] = "Authentication is required to restart 'sshd.service'.";
+        message["icon_name"] = "dialog-password";
+        message["cookie"] = "3-3d4f8a9c2b1e-1-0123456789abcdef";
+    } else if (type == "password_request") {
+        message["action_id"] = "org.freedesktop.systemd1.manage-units";
+        message["request"] = "Password: ";
+        message["echo"] = false;
+        message["cookie"] = "3-3d4f8a9c2b1e-1-0123456789abcdef";
+    } else if (type == "auth_dialog_update") {
+        message["message"] = "Run 'systemctl restart sshd' as root";
+        message["cookie"] = "3-3d4f8a9c2b1e-1-0123456789abcdef";
+    } else if (type == "authorization_result") {
+        message["authorized"] = true;
+        message["action_id"] = "org.freedesktop.systemd1.manage-units";
+        message["cookie"] = "3-3d4f8a9c2b1e-1-0123456789abcdef";
+    } else if (type == "authorization_error") {
+        message["error"] = "Authentication failed";
+        message["cookie"] = "3-3d4f8a9c2b1e-1-0123456789abcdef";
+    } else if (type == "heartbeat_ack") {
+        message["timestamp"] = 1700000000000.0;
+        return message;  // Replies are not numbered
+    } else if (type == "welcome") {
+        message["message"] = "Connected to quickshell-polkit-agent";
+        message["connection_version"] = 7;
+        message["encodings"] = QJsonArray::fromStringList(WireFormat::supportedEncodings());
+        message["security_key_present"] = false;
+        message["log_seq"] = 4242;
+        message["event_epoch"] = "9f86d081884c7d65";
+        return message;
+    }
+    message["event_seq"] = 4242;  // Broadcasts carry their log position
+    return message;
+}
+
+void BenchIpc::addOutboundRows()
+{
+    QTest::addColumn<QJsonObject>("message");
+    QTest::addColumn<int>("encoding");
+
+    const QStringList types = {"show_auth_dialog", "password_request", "auth_dialog_update",
+                               "authorization_result", "authorization_error", "heartbeat_ack", "welcome"};
+    for (const QString &type : types) {
+        QTest::addRow("%s/json", qPrintable(type)) << outboundMessage(type) << int(WireEncoding::Json);
+        QTest::addRow("%s/cbor", qPrintable(type)) << outboundMessage(type) << int(WireEncoding::Cbor);
+    }
+}
+
+void BenchIpc::encode_data()
+{
+    addOutboundRows();
+}
+
+void BenchIpc::encode()
+{
+    QFETCH(QJsonObject, message);
+    QFETCH(int, encoding);
+    const WireEncoding wire = static_cast<WireEncoding>(encoding);
+    QBENCHMARK {
+        WireFormat::encode(message, wire);
+    }
+}
+
+void BenchIpc::decode_data()
+{
+    addOutboundRows();
+}
+
+void BenchIpc::decode()
+{
+    QFETCH(QJsonObject, message);
+    QFETCH(int, encoding);
+    const WireEncoding wire = static_cast<WireEncoding>(encoding);
+    QByteArray frame = WireFormat::encode(message, wire);
+
+    QJsonObject decoded;
+    QString error;
+    if (wire == WireEncoding::Json) {
+        frame.chop(1);
+        QBENCHMARK {
+            WireFormat::decodeJson(frame, &decoded, &error);
+        }
+    } else {
+        qsizetype consumed = 0;
+        QBENCHMARK {
+            WireFormat::decodeCbor(frame, 0, &decoded, &consumed, &error);
+        }
+    }
+    QCOMPARE(decoded["type"].toString(), message["type"].toString());
+}
+
+void BenchIpc::peekAndClassify()
+{
+    // The work done for every frame before it is parsed
+    const QByteArray frame = R"({"type":"heartbeat","timestamp":1700000000000})";
+    QBENCHMARK {
+        RateLimiter::classify(WireFormat::peekMessageType(frame));
+    }
+}
+
+void BenchIpc::rateLimitFlood()
+{
+    // Past the burst every call takes the shedding path, as under a flood
+    RateLimiter limiter;
+    const qint64 now = 1000;
+    for (int i = 0; i < RateLimiter::AUTH_CAPACITY; ++i) {
+        limiter.admit(RateLimiter::MessageClass::Auth, now);
+    }
+    QBENCHMARK {
+        limiter.admit(RateLimiter::MessageClass::Auth, now);
+    }
+    QVERIFY(limiter.isLimited(RateLimiter::MessageClass::Auth));
+}
+
+void BenchIpc::stateQueryByCookie()
+{
+    int i = 0;
+    QBENCHMARK {
+        const QString &cookie = m_cookies.at(i++ % SESSION_COUNT);
+        m_wrapper->authenticationState(cookie);
+        m_wrapper->sessionRetryCount(cookie);
+    }
+}
+
+void BenchIpc::stateQueryByHandle()
+{
+    int i = 0;
+    QBENCHMARK {
+        const SessionHandle handle = m_handles.at(i++ % SESSION_COUNT);
+        m_wrapper->authenticationState(handle);
+        m_wrapper->sessionRetryCount(handle);
+    }
+}
+
+void BenchIpc::sessionSnapshots()
+{
+    QBENCHMARK {
+        m_wrapper->sessionSnapshots();
+    }
+}
+
+QTEST_MAIN(BenchIpc)
+#include "bench-ipc.moc"
@@ -0,0 +1,597 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QLocalSocket>
+#include <QProcess>
+#include <QProcessEnvironment>
+#include <QTemporaryDir>
+#include <QElapsedTimer>
+#include <QDateTime>
+#include <QThread>
+#include <QRandomGenerator>
+#include <QTimer>
+#include <QFile>
+#include <QHash>
+#include <QJsonObject>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QTextStream>
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <utility>
+#include <vector>
+#include <unistd.h>
+
+/**
+ * Socket-level load generator for quickshell-polkit-agent
+ *
+ * Opens N concurrent clients, sends an open-loop mix of heartbeat,
+ * check_authorization and submit_authentication frames at a target rate
+ * and records per-message round-trip latency, shed (rate limited) frames
+ * and the agent's CPU time and RSS.
+ *
+ *   ./ipc-load-generator --agent ./quickshell-polkit-agent --clients 16 \
+ *       --rate 50 --mix heartbeat=70,check=20,submit=10 --duration 30
+ *
+ * How replies are matched:
+ *   heartbeat  heartbeat_ack; acks are coalesced by the agent, so one ack
+ *              resolves every heartbeat outstanding on that connection
+ *   check      the show_auth_dialog broadcast carrying the unique action_id
+ *              this client sent (broadcasts for other clients are counted)
+ *   submit     synthetic cookies match no session and get no reply; only
+ *              sends and shed frames are reported
+ */
+
+namespace {
+
+enum TrafficType { Heartbeat = 0, Check, Submit, TrafficTypeCount };
+
+const char *const TRAFFIC_NAMES[TrafficTypeCount] = {"heartbeat", "check", "submit"};
+
+/*
+ * Round-trip samples for one traffic type
+ *
+ * Samples are kept exactly (a 30s run at 1000 msg/s is 240KB) so the
+ * percentiles are not bucket approximations; the log2 histogram is derived
+ * for display.
+ */
+struct LatencySamples {
+    QList<qint64> ns;
+    qint64 sent = 0;
+
+    qint64 percentile(double p) const
+    {
+        if (ns.isEmpty()) {
+            return 0;
+        }
+        QList<qint64> sorted = ns;
+        std::sort(sorted.begin(), sorted.end());
+        const qsizetype rank = qsizetype(std::ceil(p / 100.0 * sorted.size())) - 1;
+        return sorted.at(std::clamp<qsizetype>(rank, 0, sorted.size() - 1));
+    }
+
+    qint64 max() const
+    {
+        return ns.isEmpty() ? 0 : *std::max_element(ns.cbegin(), ns.cend());
+    }
+
+    // Bucket i counts samples in [2^i, 2^(i+1)) microseconds
+    QList<qint64> histogram() const
+    {
+        QList<qint64> buckets(32, 0);
+        for (qint64 sample : ns) {
+            const qint64 us = std::max<qint64>(sample / 1000, 1);
+            const int bucket = std::min(63 - __builtin_clzll(quint64(us)), 31);
+            ++buckets[bucket];
+        }
+        while (!buckets.isEmpty() && buckets.constLast() == 0) {
+            buckets.removeLast();
+        }
+        return buckets;
+    }
+};
+
+/*
+ * Agent process counters from /proc
+ */
+struct ProcessSample {
+    bool valid = false;
+    qint64 cpuTicks = 0;   // utime + stime
+    qint64 rssKb = 0;
+    qint64 wallNs = 0;
+};
+
+ProcessSample sampleProcess(qint64 pid, const QElapsedTimer &clock)
+{
+    ProcessSample sample;
+    if (pid <= 0) {
+        return sample;
+    }
+
+    QFile stat(QString("/proc/%1/stat").arg(pid));
+    if (!stat.open(QIODevice::ReadOnly)) {
+        return sample;
+    }
+    // comm may contain spaces; the fields after it are space separated
+    const QByteArray line = stat.readAll();
+    const QList<QByteArray> fields = line.mid(line.lastIndexOf(')') + 2).split(' ');
+    if (fields.size() < 13) {
+        return sample;
+    }
+    sample.cpuTicks = fields.at(11).toLongLong() + fields.at(12).toLongLong();  // fields 14, 15
+
+    QFile status(QString("/proc/%1/status").arg(pid));
+    if (status.open(QIODevice::ReadOnly)) {
+        while (!status.atEnd()) {
+            const QByteArray entry = status.readLine();
+            if (entry.startsWith("VmRSS:")) {
+                sample.rssKb = entry.mid(6).trimmed().split(' ').first().toLongLong();
+                break;
+            }
+        }
+    }
+
+    sample.wallNs = clock.nsecsElapsed();
+    sample.valid = true;
+    return sample;
+}
+
+struct Options {
+    QString socketPath;
+    int clients = 8;
+    double rate = 20.0;            // Messages per second per client
+    int weights[TrafficTypeCount] = {70, 20, 10};
+    int durationMs = 10000;
+    int drainMs = 1000;
+    quint32 seed = 1;
+};
+
+/*
+ * One simulated shell connection
+ *
+ * Sending is open loop: every millisecond the client catches up to
+ * elapsed * rate frames, so a slow agent shows up as latency rather than
+ * as a lower offered load.
+ */
+class LoadClient
+{
+public:
+    LoadClient(int id, const Options &options, const QElapsedTimer &clock, quint32 seed)
+        : m_id(id), m_options(options), m_clock(clock), m_random(seed)
+    {
+        QObject::connect(&m_socket, &QLocalSocket::readyRead, [this] { onReadyRead(); });
+    }
+
+    bool connectToAgent()
+    {
+        m_socket.connectToServer(m_options.socketPath);
+        return m_socket.waitForConnected(3000);
+    }
+
+    void start(qint64 startNs) { m_startNs = startNs; }
+
+    void tick()
+    {
+        const qint64 elapsedNs = m_clock.nsecsElapsed() - m_startNs;
+        const qint64 due = qint64(double(elapsedNs) / 1e9 * m_options.rate);
+        while (m_sentTotal < due) {
+            sendOne();
+        }
+        m_socket.flush();
+    }
+
+    const LatencySamples &samples(TrafficType type) const { return m_samples[type]; }
+    qint64 shed() const { return m_shed; }
+    qint64 otherErrors() const { return m_otherErrors; }
+    qint64 coalescedAcks() const { return m_coalescedAcks; }
+    qint64 foreignBroadcasts() const { return m_foreignBroadcasts; }
+    qint64 unanswered() const { return m_pendingHeartbeats.size() + m_pendingChecks.size(); }
+    bool isConnected() const { return m_socket.state() == QLocalSocket::ConnectedState; }
+
+private:
+    TrafficType pickType()
+    {
+        const int total = m_options.weights[Heartbeat] + m_options.weights[Check] + m_options.weights[Submit];
+        int roll = int(m_random.bounded(quint32(total)));
+        for (int type = 0; type < TrafficTypeCount; ++type) {
+            roll -= m_options.weights[type];
+            if (roll < 0) {
+                return TrafficType(type);
+            }
+        }
+        return Heartbeat;
+    }
+
+    void sendOne()
+    {
+        const TrafficType type = pickType();
+        const qint64 sequence = m_sentTotal++;
+        const qint64 now = m_clock.nsecsElapsed();
+
+        QJsonObject message;
+        switch (type) {
+        case Heartbeat:
+            message["type"] = "heartbeat";
+            message["timestamp"] = double(QDateTime::currentMSecsSinceEpoch());
+            m_pendingHeartbeats.append(now);
+            break;
+        case Check: {
+            const QString actionId = QString("org.quickshell.load.c%1.n%2").arg(m_id).arg(sequence);
+            message["type"] = "check_authorization";
+            message["action_id"] = actionId;
+            message["details"] = "ipc-load-generator";
+            m_pendingChecks.insert(actionId, now);
+            break;
+        }
+        case Submit:
+            message["type"] = "submit_authentication";
+            message["cookie"] = QString("load-c%1-n%2").arg(m_id).arg(sequence);
+            message["response"] = "load-generator-response";
+            break;
+        case TrafficTypeCount:
+            break;
+        }
+
+        ++m_samples[type].sent;
+        m_socket.write(QJsonDocument(message).toJson(QJsonDocument::Compact) + '\n');
+    }
+
+    void onReadyRead()
+    {
+        const qint64 now = m_clock.nsecsElapsed();
+        m_buffer.append(m_socket.readAll());
+
+        qsizetype start = 0;
+        qsizetype newline;
+        while ((newline = m_buffer.indexOf('\n', start)) != -1) {
+            const QJsonObject message = QJsonDocument::fromJson(m_buffer.mid(start, newline - start)).object();
+            start = newline + 1;
+            handleMessage(message, now);
+        }
+        m_buffer.remove(0, start);
+    }
+
+    void handleMessage(const QJsonObject &message, qint64 now)
+    {
+        const QString type = message["type"].toString();
+        if (type == "heartbeat_ack") {
+            if (m_pendingHeartbeats.size() > 1) {
+                m_coalescedAcks += m_pendingHeartbeats.size() - 1;
+            }
+            for (qint64 sentAt : std::as_const(m_pendingHeartbeats)) {
+                m_samples[Heartbeat].ns.append(now - sentAt);
+            }
+            m_pendingHeartbeats.clear();
+        } else if (type == "show_auth_dialog") {
+            const auto pending = m_pendingChecks.constFind(message["action_id"].toString());
+            if (pending != m_pendingChecks.cend()) {
+                m_samples[Check].ns.append(now - pending.value());
+                m_pendingChecks.erase(pending);
+            } else {
+                ++m_foreignBroadcasts;
+            }
+        } else if (type == "error") {
+            if (message["error"].toString() == "Rate limit exceeded") {
+                ++m_shed;
+            } else {
+                ++m_otherErrors;
+            }
+        }
+    }
+
+    int m_id;
+    const Options &m_options;
+    const QElapsedTimer &m_clock;
+    QRandomGenerator m_random;
+    QLocalSocket m_socket;
+    QByteArray m_buffer;
+
+    qint64 m_startNs = 0;
+    qint64 m_sentTotal = 0;
+    LatencySamples m_samples[TrafficTypeCount];
+    QList<qint64> m_pendingHeartbeats;          // Send times, oldest first
+    QHash<QString, qint64> m_pendingChecks;     // action_id -> send time
+    qint64 m_shed = 0;
+    qint64 m_otherErrors = 0;
+    qint64 m_coalescedAcks = 0;
+    qint64 m_foreignBroadcasts = 0;
+};
+
+bool parseMix(const QString &spec, int weights[TrafficTypeCount])
+{
+    int parsed[TrafficTypeCount] = {0, 0, 0};
+    for (const QString &part : spec.split(',', Qt::SkipEmptyParts)) {
+        const QStringList pair = part.split('=');
+        bool ok = false;
+        const int weight = pair.size() == 2 ? pair.at(1).toInt(&ok) : -1;
+        if (!ok || weight < 0) {
+            return false;
+        }
+        int type = 0;
+        while (type < TrafficTypeCount && pair.at(0) != QLatin1String(TRAFFIC_NAMES[type])) {
+            ++type;
+        }
+        if (type == TrafficTypeCount) {
+            return false;
+        }
+        parsed[type] = weight;
+    }
+    if (parsed[Heartbeat] + parsed[Check] + parsed[Submit] == 0) {
+        return false;
+    }
+    std::copy(parsed, parsed + TrafficTypeCount, weights);
+    return true;
+}
+
+QProcess *spawnAgent(const QString &program, const QString &socketPath)
+{
+    auto *agent = new QProcess;
+    QProcessEnvironment env = QProcessEnvironment::systemEnvironment();
+    env.insert("QUICKSHELL_POLKIT_SOCKET", socketPath);
+    if (!env.contains("QT_LOGGING_RULES")) {
+        // Per-message debug output would dominate the agent's CPU time
+        env.insert("QT_LOGGING_RULES", "*.debug=false");
+    }
+    agent->setProcessEnvironment(env);
+    agent->setProcessChannelMode(QProcess::ForwardedErrorChannel);
+    agent->start(program, {});
+    if (!agent->waitForStarted(5000)) {
+        delete agent;
+        return nullptr;
+    }
+
+    // The socket appears once the server is listening
+    QElapsedTimer wait;
+    wait.start();
+    while (wait.elapsed() < 5000) {
+        QLocalSocket probe;
+        probe.connectToServer(socketPath);
+        if (probe.waitForConnected(100)) {
+            probe.disconnectFromServer();
+            return agent;
+        }
+        QThread::msleep(50);
+    }
+    agent->kill();
+    agent->waitForFinished();
+    delete agent;
+    return nullptr;
+}
+
+double toUs(qint64 ns)
+{
+    return double(ns) / 1000.0;
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("ipc-load-generator");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Drive quickshell-polkit-agent with concurrent socket clients and "
+                                     "report round-trip latency, shedding and agent CPU/RSS.");
+    parser.addHelpOption();
+    parser.addOptions({
+        {"socket", "Connect to an already running agent at <path>.", "path"},
+        {"agent", "Start the agent binary at <path> on a private socket.", "path"},
+        {"agent-pid", "Sample CPU and RSS of <pid> (implied by --agent).", "pid"},
+        {"clients", "Concurrent connections (default 8).", "n", "8"},
+        {"rate", "Messages per second per client (default 20).", "n", "20"},
+        {"mix", "Traffic weights (default heartbeat=70,check=20,submit=10).", "spec",
+         "heartbeat=70,check=20,submit=10"},
+        {"duration", "Seconds of load (default 10).", "s", "10"},
+        {"drain", "Milliseconds to wait for replies after the load stops (default 1000).", "ms", "1000"},
+        {"seed", "Random seed for the traffic mix (default 1).", "n", "1"},
+        {"json", "Also write the results to <file> as JSON.", "file"},
+    });
+    parser.process(app);
+
+    QTextStream out(stdout);
+    QTextStream err(stderr);
+
+    Options options;
+    bool ok = true;
+    options.clients = parser.value("clients").toInt(&ok);
+    if (!ok || options.clients < 1) {
+        err << "--clients must be a positive integer\n";
+        return 2;
+    }
+    options.rate = parser.value("rate").toDouble(&ok);
+    if (!ok || options.rate <= 0) {
+        err << "--rate must be positive\n";
+        return 2;
+    }
+    options.durationMs = int(parser.value("duration").toDouble(&ok) * 1000);
+    if (!ok || options.durationMs <= 0) {
+        err << "--duration must be positive\n";
+        return 2;
+    }
+    options.drainMs = parser.value("drain").toInt();
+    options.seed = parser.value("seed").toUInt();
+    if (!parseMix(parser.value("mix"), options.weights)) {
+        err << "--mix expects e.g. heartbeat=70,check=20,submit=10\n";
+        return 2;
+    }
+
+    QTemporaryDir socketDir;
+    QProcess *agent = nullptr;
+    qint64 agentPid = parser.value("agent-pid").toLongLong();
+    if (parser.isSet("agent")) {
+        options.socketPath = socketDir.path() + "/quickshell-polkit-load";
+        agent = spawnAgent(parser.value("agent"), options.socketPath);
+        if (!agent) {
+            err << "Failed to start agent " << parser.value("agent") << "\n";
+            return 1;
+        }
+        agentPid = agent->processId();
+    } else if (parser.isSet("socket")) {
+        options.socketPath = parser.value("socket");
+    } else {
+        err << "One of --socket or --agent is required\n";
+        return 2;
+    }
+
+    QElapsedTimer clock;
+    clock.start();
+
+    std::vector<std::unique_ptr<LoadClient>> clients;
+    for (int i = 0; i < options.clients; ++i) {
+        auto client = std::make_unique<LoadClient>(i, options, clock, options.seed + quint32(i));
+        if (!client->connectToAgent()) {
+            err << "Client " << i << " failed to connect to " << options.socketPath << "\n";
+            return 1;
+        }
+        clients.push_back(std::move(client));
+    }
+
+    // Let the welcome frames settle before the clock starts
+    QTimer::singleShot(200, &app, [&] { app.exit(0); });
+    app.exec();
+
+    const ProcessSample before = sampleProcess(agentPid, clock);
+    qint64 peakRssKb = before.rssKb;
+    const qint64 startNs = clock.nsecsElapsed();
+    for (auto &client : clients) {
+        client->start(startNs);
+    }
+
+    QTimer sendTimer;
+    sendTimer.setTimerType(Qt::PreciseTimer);
+    QObject::connect(&sendTimer, &QTimer::timeout, [&] {
+        for (auto &client : clients) {
+            client->tick();
+        }
+    });
+    sendTimer.start(1);
+
+    QTimer sampleTimer;
+    QObject::connect(&sampleTimer, &QTimer::timeout, [&] {
+        peakRssKb = std::max(peakRssKb, sampleProcess(agentPid, clock).rssKb);
+    });
+    sampleTimer.start(250);
+
+    ProcessSample after;
+    QTimer::singleShot(options.durationMs, &app, [&] {
+        sendTimer.stop();
+        after = sampleProcess(agentPid, clock);
+        peakRssKb = std::max(peakRssKb, after.rssKb);
+        QTimer::singleShot(options.drainMs, &app, [&] { app.exit(0); });
+    });
+    app.exec();
+    sampleTimer.stop();
+
+    // Aggregate
+    LatencySamples totals[TrafficTypeCount];
+    qint64 shed = 0, otherErrors = 0, coalesced = 0, foreign = 0, unanswered = 0, disconnected = 0;
+    for (const auto &client : clients) {
+        for (int type = 0; type < TrafficTypeCount; ++type) {
+            totals[type].sent += client->samples(TrafficType(type)).sent;
+            totals[type].ns.append(client->samples(TrafficType(type)).ns);
+        }
+        shed += client->shed();
+        otherErrors += client->otherErrors();
+        coalesced += client->coalescedAcks();
+        foreign += client->foreignBroadcasts();
+        unanswered += client->unanswered();
+        disconnected += client->isConnected() ? 0 : 1;
+    }
+
+    const double seconds = options.durationMs / 1000.0;
+    out << QString("%1 clients x %2 msg/s for %3s (mix heartbeat=%4,check=%5,submit=%6)\n\n")
+               .arg(options.clients).arg(options.rate).arg(seconds)
+               .arg(options.weights[Heartbeat]).arg(options.weights[Check]).arg(options.weights[Submit]);
+    out << QString("%1 %2 %3 %4 %5 %6 %7\n")
+               .arg(QLatin1String("type"), -10).arg(QLatin1String("sent"), 9).arg(QLatin1String("answered"), 9)
+               .arg(QLatin1String("p50 us"), 10).arg(QLatin1String("p90 us"), 10)
+               .arg(QLatin1String("p99 us"), 10).arg(QLatin1String("max us"), 10);
+
+    QJsonObject report;
+    QJsonObject latency;
+    for (int type = 0; type < TrafficTypeCount; ++type) {
+        const LatencySamples &samples = totals[type];
+        out << QString("%1 %2 %3 %4 %5 %6 %7\n")
+                   .arg(QLatin1String(TRAFFIC_NAMES[type]), -10).arg(samples.sent, 9).arg(samples.ns.size(), 9)
+                   .arg(toUs(samples.percentile(50)), 10, 'f', 1)
+                   .arg(toUs(samples.percentile(90)), 10, 'f', 1)
+                   .arg(toUs(samples.percentile(99)), 10, 'f', 1)
+                   .arg(toUs(samples.max()), 10, 'f', 1);
+
+        QJsonArray histogram;
+        for (qint64 count : samples.histogram()) {
+            histogram.append(count);
+        }
+        QJsonObject entry;
+        entry["sent"] = samples.sent;
+        entry["answered"] = samples.ns.size();
+        entry["p50_us"] = toUs(samples.percentile(50));
+        entry["p90_us"] = toUs(samples.percentile(90));
+        entry["p99_us"] = toUs(samples.percentile(99));
+        entry["max_us"] = toUs(samples.max());
+        entry["log2_us_histogram"] = histogram;
+        latency[QLatin1String(TRAFFIC_NAMES[type])] = entry;
+    }
+    report["latency"] = latency;
+
+    out << QString("\nshed (rate limited): %1   other errors: %2   unanswered: %3   disconnected: %4\n")
+               .arg(shed).arg(otherErrors).arg(unanswered).arg(disconnected);
+    out << QString("coalesced heartbeat acks: %1   broadcasts for other clients: %2\n")
+               .arg(coalesced).arg(foreign);
+
+    QJsonObject counters;
+    counters["shed"] = shed;
+    counters["other_errors"] = otherErrors;
+    counters["unanswered"] = unanswered;
+    counters["disconnected"] = disconnected;
+    counters["coalesced_acks"] = coalesced;
+    counters["foreign_broadcasts"] = foreign;
+    report["counters"] = counters;
+
+    if (before.valid && after.valid) {
+        const double cpuSeconds = double(after.cpuTicks - before.cpuTicks) / double(sysconf(_SC_CLK_TCK));
+        const double wallSeconds = double(after.wallNs - before.wallNs) / 1e9;
+        out << QString("agent: cpu %1s (%2%)   rss %3 -> %4 kB (peak %5 kB)\n")
+                   .arg(cpuSeconds, 0, 'f', 2).arg(100.0 * cpuSeconds / wallSeconds, 0, 'f', 1)
+                   .arg(before.rssKb).arg(after.rssKb).arg(peakRssKb);
+
+        QJsonObject agentStats;
+        agentStats["cpu_seconds"] = cpuSeconds;
+        agentStats["cpu_percent"] = 100.0 * cpuSeconds / wallSeconds;
+        agentStats["rss_start_kb"] = before.rssKb;
+        agentStats["rss_end_kb"] = after.rssKb;
+        agentStats["rss_peak_kb"] = peakRssKb;
+        report["agent"] = agentStats;
+    } else {
+        out << "agent: no /proc data (pass --agent or --agent-pid)\n";
+    }
+
+    if (parser.isSet("json")) {
+        QJsonObject config;
+        config["clients"] = options.clients;
+        config["rate"] = options.rate;
+        config["duration_s"] = seconds;
+        config["mix"] = parser.value("mix");
+        config["seed"] = qint64(options.seed);
+        report["config"] = config;
+
+        QFile file(parser.value("json"));
+        if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+            err << "Cannot write " << file.fileName() << "\n";
+        } else {
+            file.write(QJsonDocument(report).toJson());
+        }
+    }
+
+    clients.clear();
+    if (agent) {
+        agent->terminate();
+        if (!agent->waitForFinished(3000)) {
+            agent->kill();
+            agent->waitForFinished();
+        }
+        delete agent;
+    }
+    return 0;
+}
@@ -0,0 +1,227 @@
+#include <QTest>
+#include <QTemporaryDir>
+#include <QFile>
+#include <QDir>
+#include <memory>
+#include "../src/action-index.h"
+
+class TestActionIndex : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void init();
+    void testParsePolicy();
+    void testLocalizedDescription();
+    void testMalformedPolicy();
+    void testLazyBuild();
+    void testCacheRoundTrip();
+    void testStaleCacheIgnored();
+    void testInotifyInvalidation();
+
+private:
+    void writePolicy(const QString &fileName, const QByteArray &xml);
+    static QByteArray policy(const QString &actionId, const QString &description = QString("Manage things"));
+
+    std::unique_ptr<QTemporaryDir> m_dir;
+    QString m_actionsDir;
+    QString m_cachePath;
+};
+
+static const QByteArray SYSTEMD_POLICY = R"(<?xml version="1.0" encoding="UTF-8"?>
+<!DOCTYPE policyconfig PUBLIC "-//freedesktop//DTD polkit Policy Configuration 1.0//EN"
+        "http://www.freedesktop.org/software/polkit/policyconfig-1.dtd">
+<policyconfig>
+        <vendor>The systemd Project</vendor>
+        <vendor_url>https://systemd.io</vendor_url>
+        <action id="org.freedesktop.systemd1.manage-units">
+                <description>Manage system services or other units</description>
+                <description xml:lang="de">Systemdienste und Units verwalten</description>
+                <description xml:lang="pt_BR">Gerenciar serviços do sistema</description>
+                <message>Authentication is required to manage system services or other units.</message>
+                <defaults>
+                        <allow_any>auth_admin</allow_any>
+                        <allow_inactive>auth_admin</allow_inactive>
+                        <allow_active>auth_admin_keep</allow_active>
+                </defaults>
+                <annotate key="org.freedesktop.policykit.imply">org.freedesktop.systemd1.reload-daemon</annotate>
+        </action>
+        <action id="org.freedesktop.systemd1.reload-daemon">
+                <description>Reload the systemd state</description>
+                <vendor>Overridden Vendor</vendor>
+                <icon_name>view-refresh</icon_name>
+                <defaults>
+                        <allow_active>auth_admin_keep</allow_active>
+                </defaults>
+        </action>
+</policyconfig>
+)";
+
+void TestActionIndex::init()
+{
+    m_dir = std::make_unique<QTemporaryDir>();
+    QVERIFY(m_dir->isValid());
+    m_actionsDir = m_dir->filePath("actions");
+    m_cachePath = m_dir->filePath("cache/actions.cache");
+    QVERIFY(QDir().mkpath(m_actionsDir));
+}
+
+void TestActionIndex::writePolicy(const QString &fileName, const QByteArray &xml)
+{
+    QFile file(m_actionsDir + "/" + fileName);
+    QVERIFY(file.open(QIODevice::WriteOnly | QIODevice::Truncate));
+    file.write(xml);
+}
+
+QByteArray TestActionIndex::policy(const QString &actionId, const QString &description)
+{
+    return QString("<policyconfig><vendor>Example</vendor><action id=\"%1\">"
+                   "<description>%2</description><defaults><allow_active>yes</allow_active></defaults>"
+                   "</action></policyconfig>").arg(actionId, description).toUtf8();
+}
+
+void TestActionIndex::testParsePolicy()
+{
+    QHash<QString, ActionMetadata> index;
+    QVERIFY(ActionIndex::parsePolicy(SYSTEMD_POLICY, "en_US", &index));
+    QCOMPARE(int(index.size()), 2);
+
+    const ActionMetadata manage = index.value("org.freedesktop.systemd1.manage-units");
+    QCOMPARE(manage.vendor, QString("The systemd Project"));
+    QCOMPARE(manage.vendorUrl, QString("https://systemd.io"));
+    QCOMPARE(manage.description, QString("Manage system services or other units"));
+    QCOMPARE(manage.allowAny, QString("auth_admin"));
+    QCOMPARE(manage.allowInactive, QString("auth_admin"));
+    QCOMPARE(manage.allowActive, QString("auth_admin_keep"));
+    QVERIFY(manage.iconName.isEmpty());
+
+    // Action-level elements override the file-level ones
+    const ActionMetadata reload = index.value("org.freedesktop.systemd1.reload-daemon");
+    QCOMPARE(reload.vendor, QString("Overridden Vendor"));
+    QCOMPARE(reload.vendorUrl, QString("https://systemd.io"));
+    QCOMPARE(reload.iconName, QString("view-refresh"));
+    QVERIFY(reload.allowAny.isEmpty());
+}
+
+void TestActionIndex::testLocalizedDescription()
+{
+    QHash<QString, ActionMetadata> german;
+    QVERIFY(ActionIndex::parsePolicy(SYSTEMD_POLICY, "de_DE", &german));
+    QCOMPARE(german.value("org.freedesktop.systemd1.manage-units").description,
+             QString("Systemdienste und Units verwalten"));
+
+    QHash<QString, ActionMetadata> brazilian;
+    QVERIFY(ActionIndex::parsePolicy(SYSTEMD_POLICY, "pt_BR", &brazilian));
+    QCOMPARE(brazilian.value("org.freedesktop.systemd1.manage-units").description,
+             QString("Gerenciar serviços do sistema"));
+
+    // No translation: the untranslated text
+    QHash<QString, ActionMetadata> french;
+    QVERIFY(ActionIndex::parsePolicy(SYSTEMD_POLICY, "fr_FR", &french));
+    QCOMPARE(french.value("org.freedesktop.systemd1.reload-daemon").description,
+             QString("Reload the systemd state"));
+}
+
+void TestActionIndex::testMalformedPolicy()
+{
+    QHash<QString, ActionMetadata> index;
+    QVERIFY(!ActionIndex::parsePolicy("<policyconfig><action id=\"org.example.a\">", "C", &index));
+    QVERIFY(!ActionIndex::parsePolicy("<notpolicy/>", "C", &index));
+    QVERIFY(!ActionIndex::parsePolicy("", "C", &index));
+    QVERIFY(index.isEmpty());  // Nothing from a broken file leaks into the index
+}
+
+void TestActionIndex::testLazyBuild()
+{
+    writePolicy("org.freedesktop.systemd1.policy", SYSTEMD_POLICY);
+    writePolicy("org.example.policy", policy("org.example.one"));
+    writePolicy("README", "not a policy file");
+
+    ActionIndex index({m_actionsDir}, QString(), "en_US");
+    QVERIFY(!index.isBuilt());
+
+    const ActionMetadata *metadata = index.lookup("org.example.one");
+    QVERIFY(index.isBuilt());
+    QVERIFY(metadata);
+    QCOMPARE(metadata->vendor, QString("Example"));
+    QCOMPARE(metadata->allowActive, QString("yes"));
+    QCOMPARE(index.size(), 3);
+    QVERIFY(!index.lookup("org.example.missing"));
+    QVERIFY(!index.loadedFromCache());
+    QVERIFY(!QFile::exists(m_cachePath));  // Cache disabled
+}
+
+void TestActionIndex::testCacheRoundTrip()
+{
+    writePolicy("org.freedesktop.systemd1.policy", SYSTEMD_POLICY);
+
+    {
+        ActionIndex first({m_actionsDir}, m_cachePath, "de_DE");
+        QVERIFY(first.lookup("org.freedesktop.systemd1.manage-units"));
+        QVERIFY(!first.loadedFromCache());
+    }
+    QVERIFY(QFile::exists(m_cachePath));
+
+    ActionIndex second({m_actionsDir}, m_cachePath, "de_DE");
+    const ActionMetadata *metadata = second.lookup("org.freedesktop.systemd1.manage-units");
+    QVERIFY(second.loadedFromCache());
+    QVERIFY(metadata);
+    QCOMPARE(metadata->description, QString("Systemdienste und Units verwalten"));
+    QCOMPARE(metadata->allowActive, QString("auth_admin_keep"));
+    QCOMPARE(second.size(), 2);
+
+    // The locale is part of the key
+    ActionIndex english({m_actionsDir}, m_cachePath, "en_US");
+    QCOMPARE(english.lookup("org.freedesktop.systemd1.manage-units")->description,
+             QString("Manage system services or other units"));
+    QVERIFY(!english.loadedFromCache());
+}
+
+void TestActionIndex::testStaleCacheIgnored()
+{
+    writePolicy("org.example.policy", policy("org.example.one"));
+    {
+        ActionIndex first({m_actionsDir}, m_cachePath, "C");
+        QVERIFY(first.lookup("org.example.one"));
+    }
+
+    // A new file changes the signature even if the cache is younger
+    writePolicy("org.example.two.policy", policy("org.example.two"));
+    ActionIndex second({m_actionsDir}, m_cachePath, "C");
+    QVERIFY(second.lookup("org.example.two"));
+    QVERIFY(!second.loadedFromCache());
+
+    // A corrupt cache falls back to parsing
+    QFile cache(m_cachePath);
+    QVERIFY(cache.open(QIODevice::WriteOnly | QIODevice::Truncate));
+    cache.write("QPAI garbage");
+    cache.close();
+    ActionIndex third({m_actionsDir}, m_cachePath, "C");
+    QVERIFY(third.lookup("org.example.one"));
+    QVERIFY(!third.loadedFromCache());
+}
+
+void TestActionIndex::testInotifyInvalidation()
+{
+    writePolicy("org.example.policy", policy("org.example.one", "Before"));
+
+    ActionIndex index({m_actionsDir}, QString(), "C");
+    QCOMPARE(index.lookup("org.example.one")->description, QString("Before"));
+
+    // Unrelated files leave the index alone
+    writePolicy("org.example.policy.tmp", "partial");
+    QTest::qWait(100);
+    QVERIFY(index.isBuilt());
+
+    writePolicy("org.example.policy", policy("org.example.one", "After"));
+    QTRY_VERIFY(!index.isBuilt());
+    QCOMPARE(index.lookup("org.example.one")->description, QString("After"));
+
+    // Removal is noticed too
+    QVERIFY(QFile::remove(m_actionsDir + "/org.example.policy"));
+    QTRY_VERIFY(!index.isBuilt());
+    QVERIFY(!index.lookup("org.example.one"));
+}
+
+QTEST_MAIN(TestActionIndex)
+#include "test-action-index.moc"
@@ -0,0 +1,134 @@
+#include <QTest>
+#include <QMutex>
+#include <QStringList>
+#include "../src/audit-log.h"
+#include "../src/security.h"
+
+class TestAuditLog : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void init();
+    void cleanup();
+    void testRecordAndFlush();
+    void testFieldTruncation();
+    void testBurstIsBounded();
+    void testSynchronousAfterShutdown();
+
+private:
+    static void captureMessage(QtMsgType type, const QMessageLogContext &context, const QString &message);
+    static QStringList capturedLines();
+
+    static QMutex s_mutex;
+    static QStringList s_lines;
+    QtMessageHandler m_previousHandler = nullptr;
+};
+
+QMutex TestAuditLog::s_mutex;
+QStringList TestAuditLog::s_lines;
+
+void TestAuditLog::captureMessage(QtMsgType type, const QMessageLogContext &context, const QString &message)
+{
+    Q_UNUSED(type);
+    Q_UNUSED(context);
+    // Written from the drain thread
+    QMutexLocker locker(&s_mutex);
+    if (message.contains("AUDIT:")) {
+        s_lines.append(message);
+    }
+}
+
+QStringList TestAuditLog::capturedLines()
+{
+    QMutexLocker locker(&s_mutex);
+    return s_lines;
+}
+
+void TestAuditLog::init()
+{
+    QMutexLocker locker(&s_mutex);
+    s_lines.clear();
+    locker.unlock();
+    m_previousHandler = qInstallMessageHandler(captureMessage);
+}
+
+void TestAuditLog::cleanup()
+{
+    AuditLog::flush();
+    qInstallMessageHandler(m_previousHandler);
+}
+
+void TestAuditLog::testRecordAndFlush()
+{
+    SecurityManager::auditLog("TEST_EVENT", "Test details", "SUCCESS", "org.example.test");
+    AuditLog::flush();
+    
+    const QStringList lines = capturedLines();
+    QCOMPARE(lines.size(), 1);
+    QVERIFY(lines[0].contains("event=TEST_EVENT"));
+    QVERIFY(lines[0].contains("action_id=org.example.test"));
+    QVERIFY(lines[0].contains("Test details"));
+    QVERIFY(lines[0].contains("result=SUCCESS"));
+}
+
+void TestAuditLog::testFieldTruncation()
+{
+    // Oversized fields are cut to the record layout
+    SecurityManager::auditLog("TRUNCATED", QString(AuditLog::DETAILS_SIZE + 50, 'x'), "OK");
+    
+    // A multi-byte character that does not fit is dropped whole, never split
+    const QString boundary = QString(AuditLog::DETAILS_SIZE - 2, 'y') + QChar(0x00e9);
+    SecurityManager::auditLog("BOUNDARY", boundary, "OK");
+    AuditLog::flush();
+    
+    const QStringList lines = capturedLines();
+    QCOMPARE(lines.size(), 2);
+    QVERIFY(lines[0].contains(QString(AuditLog::DETAILS_SIZE - 1, 'x')));
+    QVERIFY(!lines[0].contains(QString(AuditLog::DETAILS_SIZE, 'x')));
+    QVERIFY(lines[0].contains("result=OK"));
+    
+    QVERIFY(lines[1].contains(QString(AuditLog::DETAILS_SIZE - 2, 'y')));
+    QVERIFY(!lines[1].contains(QChar(0x00e9)));
+    QVERIFY(!lines[1].contains("00e9", Qt::CaseInsensitive));
+    QVERIFY(!lines[1].contains(QChar(QChar::ReplacementCharacter)));
+}
+
+void TestAuditLog::testBurstIsBounded()
+{
+    // A flood never blocks the producer; whatever does not fit is counted
+    const quint64 droppedBefore = AuditLog::droppedCount();
+    const int burst = 4 * AuditLog::RING_CAPACITY;
+    for (int i = 0; i < burst; ++i) {
+        SecurityManager::auditLog("RATE_LIMIT", QString("n=%1").arg(i), "BLOCKED");
+    }
+    AuditLog::flush();
+    
+    const QStringList lines = capturedLines();
+    const quint64 dropped = AuditLog::droppedCount() - droppedBefore;
+    int written = 0;
+    bool reportedDrop = false;
+    for (const QString &line : lines) {
+        if (line.contains("event=RATE_LIMIT")) {
+            ++written;
+        } else if (line.contains("event=AUDIT_DROPPED")) {
+            reportedDrop = true;
+        }
+    }
+    QCOMPARE(quint64(written) + dropped, quint64(burst));
+    QCOMPARE(reportedDrop, dropped > 0);
+}
+
+void TestAuditLog::testSynchronousAfterShutdown()
+{
+    SecurityManager::shutdown();
+    
+    // No thread left to drain, so the record is written immediately
+    SecurityManager::auditLog("AFTER_SHUTDOWN", QString(), "SUCCESS");
+    const QStringList lines = capturedLines();
+    QCOMPARE(lines.size(), 1);
+    QVERIFY(lines[0].contains("event=AFTER_SHUTDOWN"));
+}
+
+QTEST_MAIN(TestAuditLog)
+#include "test-audit-log.moc"
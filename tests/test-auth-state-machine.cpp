@@ -0,0 +1,133 @@
+#include <QTest>
+#include "../src/auth-state-machine.h"
+
+using S = AuthenticationState;
+
+class TestAuthStateMachine : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void testLegalTransitions_data();
+    void testLegalTransitions();
+    void testIllegalTransitions_data();
+    void testIllegalTransitions();
+    void testTerminalStates();
+    void testEntryActions();
+    void testEdgeIndexIsDense();
+    void testStateNames();
+
+private:
+    static void addEdgeColumns();
+};
+
+void TestAuthStateMachine::addEdgeColumns()
+{
+    QTest::addColumn<int>("from");
+    QTest::addColumn<int>("to");
+}
+
+void TestAuthStateMachine::testLegalTransitions_data()
+{
+    addEdgeColumns();
+    // The flows PolkitWrapper drives: prompt, FIDO without a prompt, retry, abort
+    QTest::newRow("idle-initiated") << int(S::IDLE) << int(S::INITIATED);
+    QTest::newRow("initiated-waiting") << int(S::INITIATED) << int(S::WAITING_FOR_PASSWORD);
+    QTest::newRow("initiated-completed") << int(S::INITIATED) << int(S::COMPLETED);
+    QTest::newRow("waiting-authenticating") << int(S::WAITING_FOR_PASSWORD) << int(S::AUTHENTICATING);
+    QTest::newRow("authenticating-waiting") << int(S::AUTHENTICATING) << int(S::WAITING_FOR_PASSWORD);
+    QTest::newRow("authenticating-completed") << int(S::AUTHENTICATING) << int(S::COMPLETED);
+    QTest::newRow("authenticating-failed") << int(S::AUTHENTICATING) << int(S::AUTHENTICATION_FAILED);
+    QTest::newRow("authenticating-max") << int(S::AUTHENTICATING) << int(S::MAX_RETRIES_EXCEEDED);
+    QTest::newRow("failed-waiting") << int(S::AUTHENTICATION_FAILED) << int(S::WAITING_FOR_PASSWORD);
+    QTest::newRow("failed-authenticating") << int(S::AUTHENTICATION_FAILED) << int(S::AUTHENTICATING);
+    QTest::newRow("max-cancelled") << int(S::MAX_RETRIES_EXCEEDED) << int(S::CANCELLED);
+    QTest::newRow("max-error") << int(S::MAX_RETRIES_EXCEEDED) << int(S::ERROR);
+    QTest::newRow("waiting-cancelled") << int(S::WAITING_FOR_PASSWORD) << int(S::CANCELLED);
+    QTest::newRow("initiated-error") << int(S::INITIATED) << int(S::ERROR);
+}
+
+void TestAuthStateMachine::testLegalTransitions()
+{
+    QFETCH(int, from);
+    QFETCH(int, to);
+    QVERIFY(AuthStateMachine::isLegal(static_cast<S>(from), static_cast<S>(to)));
+}
+
+void TestAuthStateMachine::testIllegalTransitions_data()
+{
+    addEdgeColumns();
+    QTest::newRow("idle-waiting") << int(S::IDLE) << int(S::WAITING_FOR_PASSWORD);
+    QTest::newRow("idle-completed") << int(S::IDLE) << int(S::COMPLETED);
+    QTest::newRow("waiting-initiated") << int(S::WAITING_FOR_PASSWORD) << int(S::INITIATED);
+    QTest::newRow("waiting-idle") << int(S::WAITING_FOR_PASSWORD) << int(S::IDLE);
+    QTest::newRow("max-authenticating") << int(S::MAX_RETRIES_EXCEEDED) << int(S::AUTHENTICATING);
+    QTest::newRow("max-waiting") << int(S::MAX_RETRIES_EXCEEDED) << int(S::WAITING_FOR_PASSWORD);
+    QTest::newRow("max-completed") << int(S::MAX_RETRIES_EXCEEDED) << int(S::COMPLETED);
+    QTest::newRow("failed-failed") << int(S::AUTHENTICATION_FAILED) << int(S::AUTHENTICATION_FAILED);
+    QTest::newRow("completed-error") << int(S::COMPLETED) << int(S::ERROR);
+    QTest::newRow("completed-cancelled") << int(S::COMPLETED) << int(S::CANCELLED);
+    QTest::newRow("cancelled-completed") << int(S::CANCELLED) << int(S::COMPLETED);
+    QTest::newRow("error-waiting") << int(S::ERROR) << int(S::WAITING_FOR_PASSWORD);
+}
+
+void TestAuthStateMachine::testIllegalTransitions()
+{
+    QFETCH(int, from);
+    QFETCH(int, to);
+    QVERIFY(!AuthStateMachine::isLegal(static_cast<S>(from), static_cast<S>(to)));
+}
+
+void TestAuthStateMachine::testTerminalStates()
+{
+    for (int i = 0; i < AuthStateMachine::STATE_COUNT; ++i) {
+        const S state = static_cast<S>(i);
+        const bool terminal = state == S::COMPLETED || state == S::CANCELLED || state == S::ERROR;
+        QCOMPARE(AuthStateMachine::isTerminal(state), terminal);
+
+        // Nothing leaves a terminal state, not even an abort
+        for (int j = 0; terminal && j < AuthStateMachine::STATE_COUNT; ++j) {
+            QVERIFY(!AuthStateMachine::isLegal(state, static_cast<S>(j)));
+        }
+    }
+}
+
+void TestAuthStateMachine::testEntryActions()
+{
+    using namespace AuthStateMachine;
+    QCOMPARE(entryActions(S::INITIATED), quint8(ResetTimeout));
+    QCOMPARE(entryActions(S::WAITING_FOR_PASSWORD), quint8(ResetTimeout | PasswordMethod));
+    QCOMPARE(entryActions(S::AUTHENTICATING), quint8(ResetTimeout | PasswordMethod));
+
+    // A failure is not progress: the deadline set by the submit keeps running
+    QCOMPARE(entryActions(S::AUTHENTICATION_FAILED), quint8(NoAction));
+    QCOMPARE(entryActions(S::MAX_RETRIES_EXCEEDED), quint8(NoAction));
+
+    QCOMPARE(entryActions(S::COMPLETED), quint8(StopTimeout));
+    QCOMPARE(entryActions(S::CANCELLED), quint8(StopTimeout));
+    QCOMPARE(entryActions(S::ERROR), quint8(StopTimeout));
+}
+
+void TestAuthStateMachine::testEdgeIndexIsDense()
+{
+    QList<bool> seen(AuthStateMachine::EDGE_COUNT, false);
+    for (int from = 0; from < AuthStateMachine::STATE_COUNT; ++from) {
+        for (int to = 0; to < AuthStateMachine::STATE_COUNT; ++to) {
+            const int index = AuthStateMachine::edgeIndex(static_cast<S>(from), static_cast<S>(to));
+            QVERIFY(index >= 0 && index < AuthStateMachine::EDGE_COUNT);
+            QVERIFY(!seen.at(index));
+            seen[index] = true;
+        }
+    }
+}
+
+void TestAuthStateMachine::testStateNames()
+{
+    QCOMPARE(QByteArray(AuthStateMachine::stateName(S::IDLE)), QByteArray("IDLE"));
+    QCOMPARE(QByteArray(AuthStateMachine::stateName(S::WAITING_FOR_PASSWORD)), QByteArray("WAITING_FOR_PASSWORD"));
+    QCOMPARE(QByteArray(AuthStateMachine::stateName(S::MAX_RETRIES_EXCEEDED)), QByteArray("MAX_RETRIES_EXCEEDED"));
+    QCOMPARE(QByteArray(AuthStateMachine::stateName(S::ERROR)), QByteArray("ERROR"));
+}
+
+QTEST_MAIN(TestAuthStateMachine)
+#include "test-auth-state-machine.moc"
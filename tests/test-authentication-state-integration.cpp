@@ -43,6 +43,7 @@ private slots:
     void testSessionCleanupAfterFailure();
     void testSessionCleanupOnCancellation();
     void testConcurrentAuthenticationRequests();
+    void testPerCookieCancellation();
 
     // Error recovery tests
     void testRecoveryAfterPamError();
@@ -772,9 +773,7 @@ void TestAuthenticationStateIntegration::testConcurrentAuthenticationRequests()
     QVERIFY2(foundCookie1, "Expected state change for cookie1");
     QVERIFY2(foundCookie2, "Expected state change for cookie2");
 
-    // Cancel all sessions
-    // NOTE: Current API limitation - cancelAuthorization() cancels ALL sessions
-    // Individual session cancellation would require polkit daemon integration
+    // Cancel all sessions (no cookie)
     m_wrapper->cancelAuthorization();
     QTest::qWait(50);
 
@@ -784,6 +783,52 @@ void TestAuthenticationStateIntegration::testConcurrentAuthenticationRequests()
     QCOMPARE(m_wrapper->authenticationState(cookie2), AuthenticationState::IDLE);
 }
 
+/*
+ * TEST: Cancelling one of two overlapping prompts
+ *
+ * A package manager prompt and a run0 prompt are open together; the user
+ * dismisses one. Only that session ends, the result names its cookie, and
+ * the other prompt can still complete on its own.
+ */
+void TestAuthenticationStateIntegration::testPerCookieCancellation()
+{
+    QString cookie1 = "cookie-scoped-cancel-1";
+    QString cookie2 = "cookie-scoped-cancel-2";
+
+    m_wrapper->testTriggerAuthentication("org.example.scoped-1", "First", "dialog-password", cookie1);
+    m_wrapper->testTriggerAuthentication("org.example.scoped-2", "Second", "dialog-password", cookie2);
+    QTest::qWait(50);
+
+    QSignalSpy resultSpy(m_wrapper, &PolkitWrapper::authorizationResult);
+
+    m_wrapper->cancelAuthorization(cookie1);
+
+    // VERIFY: Exactly one result, scoped to the cancelled session
+    QCOMPARE(resultSpy.count(), 1);
+    QCOMPARE(resultSpy.at(0).at(0).toBool(), false);
+    QCOMPARE(resultSpy.at(0).at(1).toString(), QString("org.example.scoped-1"));
+    QCOMPARE(resultSpy.at(0).at(2).toString(), cookie1);
+
+    // VERIFY: The other session is untouched
+    QCOMPARE(m_wrapper->authenticationState(cookie1), AuthenticationState::IDLE);
+    QVERIFY(m_wrapper->authenticationState(cookie2) != AuthenticationState::IDLE);
+    QVERIFY(m_wrapper->hasActiveSessions());
+
+    // VERIFY: Unknown or already cancelled cookies are a no-op
+    m_wrapper->cancelAuthorization(cookie1);
+    m_wrapper->cancelAuthorization("cookie-never-issued");
+    QCOMPARE(resultSpy.count(), 1);
+    QVERIFY(m_wrapper->authenticationState(cookie2) != AuthenticationState::IDLE);
+
+    // VERIFY: The surviving prompt still completes independently
+    m_wrapper->testCompleteSession(cookie2, true);
+    QTest::qWait(50);
+    QCOMPARE(resultSpy.count(), 2);
+    QCOMPARE(resultSpy.at(1).at(0).toBool(), true);
+    QCOMPARE(resultSpy.at(1).at(2).toString(), cookie2);
+    QVERIFY(!m_wrapper->hasActiveSessions());
+}
+
 /*
  * TEST: Recovery after PAM error
  *
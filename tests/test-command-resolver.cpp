@@ -0,0 +1,102 @@
+#include <QTest>
+#include <QCoreApplication>
+#include <QFileInfo>
+#include <QProcess>
+#include "../src/command-resolver.h"
+
+class TestCommandResolver : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void testParseCommandLine_data();
+    void testParseCommandLine();
+    void testProcessStartTime();
+    void testResolveSelf();
+    void testResolveUnknownPid();
+    void testCachedIsProvisional();
+    
+private:
+    static QByteArray cmdline(const QList<QByteArray> &args);
+};
+
+QByteArray TestCommandResolver::cmdline(const QList<QByteArray> &args)
+{
+    QByteArray data;
+    for (const QByteArray &arg : args) {
+        data += arg;
+        data += '\0';
+    }
+    return data;
+}
+
+void TestCommandResolver::testParseCommandLine_data()
+{
+    QTest::addColumn<QByteArray>("cmdline");
+    QTest::addColumn<QString>("command");
+    
+    QTest::newRow("empty") << QByteArray() << QString();
+    QTest::newRow("plain command") << cmdline({"/usr/bin/pkexec", "ls"}) << QString("pkexec");
+    QTest::newRow("run0 with command") << cmdline({"run0", "/usr/bin/dnf", "upgrade"}) << QString("dnf");
+    QTest::newRow("run0 option with value") << cmdline({"/usr/bin/run0", "--user", "root", "vim"}) << QString("vim");
+    QTest::newRow("run0 option with equals") << cmdline({"run0", "--setenv=FOO=1", "htop"}) << QString("htop");
+    QTest::newRow("run0 consecutive options") << cmdline({"run0", "-i", "--pty", "bash"}) << QString("bash");
+    QTest::newRow("systemd-run fallback") << cmdline({"systemd-run", "--wait", "-p", "x"}) << QString("x");
+    QTest::newRow("run0 alone") << cmdline({"run0"}) << QString("run0");
+    QTest::newRow("no trailing nul") << QByteArray("run0\0/bin/true", 14) << QString("true");
+}
+
+void TestCommandResolver::testParseCommandLine()
+{
+    QFETCH(QByteArray, cmdline);
+    QFETCH(QString, command);
+    
+    QCOMPARE(CommandResolver::parseCommandLine(cmdline), command);
+}
+
+void TestCommandResolver::testProcessStartTime()
+{
+    qint64 startTime = CommandResolver::processStartTime(QCoreApplication::applicationPid());
+    QVERIFY(startTime > 0);
+    
+    // Stable for the lifetime of the process
+    QCOMPARE(CommandResolver::processStartTime(QCoreApplication::applicationPid()), startTime);
+}
+
+void TestCommandResolver::testResolveSelf()
+{
+    const qint64 pid = QCoreApplication::applicationPid();
+    const QString expected = QFileInfo(QCoreApplication::applicationFilePath()).fileName();
+    
+    QVERIFY(CommandResolver::cached(pid).isEmpty());
+    QCOMPARE(CommandResolver::resolve(pid), expected);
+    
+    // Second lookup is served from the cache
+    QCOMPARE(CommandResolver::cached(pid), expected);
+}
+
+void TestCommandResolver::testResolveUnknownPid()
+{
+    // Beyond the kernel's pid_max
+    QVERIFY(CommandResolver::resolve(1 << 23).isEmpty());
+    QVERIFY(CommandResolver::cached(1 << 23).isEmpty());
+}
+
+void TestCommandResolver::testCachedIsProvisional()
+{
+    QProcess child;
+    child.start("sleep", {"30"});
+    QVERIFY(child.waitForStarted());
+    const qint64 pid = child.processId();
+    QCOMPARE(CommandResolver::resolve(pid), QString("sleep"));
+    
+    child.kill();
+    QVERIFY(child.waitForFinished());
+    
+    // The cache answers without /proc; only resolve() notices the process is gone
+    QCOMPARE(CommandResolver::cached(pid), QString("sleep"));
+    QVERIFY(CommandResolver::resolve(pid).isEmpty());
+}
+
+QTEST_MAIN(TestCommandResolver)
+#include "test-command-resolver.moc"
@@ -0,0 +1,138 @@
+#include <QTest>
+#include <QElapsedTimer>
+#include "../src/deadline-scheduler.h"
+
+class TestDeadlineScheduler : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void testFiresInDeadlineOrder();
+    void testCancel();
+    void testPushBack();
+    void testPullForward();
+    void testContextDestroyed();
+    void testRescheduleFromCallback();
+    void testManyDeadlines();
+};
+
+void TestDeadlineScheduler::testFiresInDeadlineOrder()
+{
+    DeadlineScheduler scheduler;
+    QList<int> fired;
+    
+    scheduler.schedule(this, 60, [&fired]() { fired << 3; });
+    scheduler.schedule(this, 20, [&fired]() { fired << 1; });
+    scheduler.schedule(this, 40, [&fired]() { fired << 2; });
+    QCOMPARE(scheduler.pendingCount(), 3);
+    
+    QTRY_COMPARE_WITH_TIMEOUT(fired.size(), 3, 2000);
+    QCOMPARE(fired, (QList<int>{1, 2, 3}));
+    QCOMPARE(scheduler.pendingCount(), 0);
+}
+
+void TestDeadlineScheduler::testCancel()
+{
+    DeadlineScheduler scheduler;
+    bool fired = false;
+    
+    DeadlineScheduler::TimerId id = scheduler.schedule(this, 20, [&fired]() { fired = true; });
+    QVERIFY(scheduler.isScheduled(id));
+    scheduler.cancel(id);
+    QVERIFY(!scheduler.isScheduled(id));
+    QCOMPARE(scheduler.remainingTime(id), qint64(-1));
+    
+    QTest::qWait(100);
+    QVERIFY(!fired);
+    
+    // Unknown ids are harmless
+    scheduler.cancel(0);
+    scheduler.reschedule(12345, 10);
+}
+
+void TestDeadlineScheduler::testPushBack()
+{
+    // A heartbeat-style deadline that keeps being pushed back never fires
+    DeadlineScheduler scheduler;
+    bool fired = false;
+    
+    DeadlineScheduler::TimerId id = scheduler.schedule(this, 80, [&fired]() { fired = true; });
+    for (int i = 0; i < 5; ++i) {
+        QTest::qWait(40);
+        scheduler.reschedule(id, 80);
+    }
+    QVERIFY(!fired);
+    QVERIFY(scheduler.remainingTime(id) > 40);
+    
+    QTRY_VERIFY_WITH_TIMEOUT(fired, 2000);
+    QVERIFY(!scheduler.isScheduled(id));
+}
+
+void TestDeadlineScheduler::testPullForward()
+{
+    DeadlineScheduler scheduler;
+    bool fired = false;
+    QElapsedTimer elapsed;
+    elapsed.start();
+    
+    DeadlineScheduler::TimerId id = scheduler.schedule(this, 10000, [&fired]() { fired = true; });
+    scheduler.reschedule(id, 20);
+    
+    QTRY_VERIFY_WITH_TIMEOUT(fired, 2000);
+    QVERIFY(elapsed.elapsed() < 5000);
+}
+
+void TestDeadlineScheduler::testContextDestroyed()
+{
+    DeadlineScheduler scheduler;
+    bool fired = false;
+    
+    QObject *context = new QObject;
+    scheduler.schedule(context, 20, [&fired]() { fired = true; });
+    delete context;
+    
+    QTRY_COMPARE_WITH_TIMEOUT(scheduler.pendingCount(), 0, 2000);
+    QVERIFY(!fired);
+}
+
+void TestDeadlineScheduler::testRescheduleFromCallback()
+{
+    DeadlineScheduler scheduler;
+    int count = 0;
+    
+    std::function<void()> tick;
+    tick = [&]() {
+        if (++count < 3) {
+            scheduler.schedule(this, 10, tick);
+        }
+    };
+    scheduler.schedule(this, 10, tick);
+    
+    QTRY_COMPARE_WITH_TIMEOUT(count, 3, 2000);
+    QCOMPARE(scheduler.pendingCount(), 0);
+}
+
+void TestDeadlineScheduler::testManyDeadlines()
+{
+    // Lots of cancelled entries are compacted away rather than accumulating
+    DeadlineScheduler scheduler;
+    int fired = 0;
+    
+    QList<DeadlineScheduler::TimerId> ids;
+    for (int i = 0; i < 1000; ++i) {
+        ids << scheduler.schedule(this, 60000 + i, [&fired]() { ++fired; });
+    }
+    for (int i = 0; i < 990; ++i) {
+        scheduler.cancel(ids[i]);
+    }
+    QCOMPARE(scheduler.pendingCount(), 10);
+    
+    for (int i = 990; i < 1000; ++i) {
+        scheduler.reschedule(ids[i], 10);
+    }
+    QTRY_COMPARE_WITH_TIMEOUT(fired, 10, 2000);
+    QCOMPARE(scheduler.pendingCount(), 0);
+}
+
+QTEST_MAIN(TestDeadlineScheduler)
+#include "test-deadline-scheduler.moc"
@@ -0,0 +1,149 @@
+#include <QTest>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include "../src/event-log.h"
+
+class TestEventLog : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void testSequencesAreStamped();
+    void testDeltaAfterSequence();
+    void testCoverageAfterWrap();
+    void testFutureSequenceNotCovered();
+    void testEpochDiffersPerLog();
+    void testReleaseKeepsNumbering();
+
+private:
+    static QJsonObject event(int n);
+    static QList<QJsonObject> decode(const QByteArray &frames);
+};
+
+QJsonObject TestEventLog::event(int n)
+{
+    QJsonObject message;
+    message["type"] = "password_request";
+    message["cookie"] = QString("cookie-%1").arg(n);
+    return message;
+}
+
+QList<QJsonObject> TestEventLog::decode(const QByteArray &frames)
+{
+    QList<QJsonObject> messages;
+    for (const QByteArray &line : frames.split('\n')) {
+        if (!line.isEmpty()) {
+            messages.append(QJsonDocument::fromJson(line).object());
+        }
+    }
+    return messages;
+}
+
+void TestEventLog::testSequencesAreStamped()
+{
+    EventLog log;
+    QCOMPARE(log.lastSeq(), quint64(0));
+    QCOMPARE(log.size(), 0);
+    
+    QJsonObject first = event(1);
+    QJsonObject second = event(2);
+    QCOMPARE(log.append(first), quint64(1));
+    QCOMPARE(log.append(second), quint64(2));
+    
+    // The caller's copy carries the number that goes on the wire
+    QCOMPARE(first["event_seq"].toInteger(), qint64(1));
+    QCOMPARE(second["event_seq"].toInteger(), qint64(2));
+    QCOMPARE(log.lastSeq(), quint64(2));
+    QCOMPARE(log.size(), 2);
+}
+
+void TestEventLog::testDeltaAfterSequence()
+{
+    EventLog log;
+    for (int i = 1; i <= 5; ++i) {
+        QJsonObject message = event(i);
+        log.append(message);
+    }
+    
+    int count = -1;
+    QList<QJsonObject> delta = decode(log.framesAfter(3, WireEncoding::Json, &count));
+    QCOMPARE(count, 2);
+    QCOMPARE(delta.size(), 2);
+    QCOMPARE(delta[0]["event_seq"].toInteger(), qint64(4));
+    QCOMPARE(delta[1]["cookie"].toString(), QString("cookie-5"));
+    
+    // Up to date, and from the very beginning
+    QVERIFY(log.covers(5));
+    QVERIFY(log.framesAfter(5, WireEncoding::Json, &count).isEmpty());
+    QCOMPARE(count, 0);
+    QCOMPARE(decode(log.framesAfter(0, WireEncoding::Json)).size(), 5);
+}
+
+void TestEventLog::testCoverageAfterWrap()
+{
+    EventLog log;
+    const int total = EventLog::CAPACITY + 10;
+    for (int i = 1; i <= total; ++i) {
+        QJsonObject message = event(i);
+        log.append(message);
+    }
+    QCOMPARE(log.size(), EventLog::CAPACITY);
+    
+    // The oldest retained event is total - CAPACITY + 1
+    const quint64 oldestMissable = quint64(total - EventLog::CAPACITY);
+    QVERIFY(log.covers(oldestMissable));
+    QVERIFY(!log.covers(oldestMissable - 1));
+    
+    int count = 0;
+    QList<QJsonObject> delta = decode(log.framesAfter(oldestMissable, WireEncoding::Json, &count));
+    QCOMPARE(count, EventLog::CAPACITY);
+    QCOMPARE(delta.first()["event_seq"].toInteger(), qint64(oldestMissable + 1));
+    QCOMPARE(delta.last()["event_seq"].toInteger(), qint64(total));
+    
+    // A gap the ring lost yields nothing rather than a partial delta
+    QVERIFY(log.framesAfter(oldestMissable - 1, WireEncoding::Json, &count).isEmpty());
+    QCOMPARE(count, 0);
+}
+
+void TestEventLog::testFutureSequenceNotCovered()
+{
+    // A client remembering a longer-lived previous instance
+    EventLog log;
+    QJsonObject message = event(1);
+    log.append(message);
+    QVERIFY(!log.covers(2));
+    QVERIFY(!log.covers(1000));
+}
+
+void TestEventLog::testEpochDiffersPerLog()
+{
+    EventLog a;
+    EventLog b;
+    QVERIFY(!a.epoch().isEmpty());
+    QVERIFY(a.epoch() != b.epoch());
+}
+
+void TestEventLog::testReleaseKeepsNumbering()
+{
+    EventLog log;
+    for (int i = 1; i <= 3; ++i) {
+        QJsonObject message = event(i);
+        log.append(message);
+    }
+    log.release();
+    QCOMPARE(log.size(), 0);
+    QCOMPARE(log.lastSeq(), quint64(3));
+    
+    // An up-to-date client still resumes; one that missed a dropped event gets a snapshot
+    QVERIFY(log.covers(3));
+    QVERIFY(!log.covers(2));
+    
+    QJsonObject next = event(4);
+    QCOMPARE(log.append(next), quint64(4));
+    QCOMPARE(log.size(), 1);
+    QVERIFY(log.covers(3));
+    QCOMPARE(decode(log.framesAfter(3, WireEncoding::Json)).first()["cookie"].toString(), QString("cookie-4"));
+}
+
+QTEST_MAIN(TestEventLog)
+#include "test-event-log.moc"
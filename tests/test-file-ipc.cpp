@@ -0,0 +1,200 @@
+#include <QTest>
+#include <QSignalSpy>
+#include <QTemporaryDir>
+#include <QFile>
+#include <QDir>
+#include <QFileInfo>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <sys/stat.h>
+#include "../src/file-ipc.h"
+#include "../src/polkit-wrapper.h"
+
+class TestFileIPC : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void init();
+    void cleanup();
+
+    void testResponseLineIsHandled();
+    void testPartialLineWaitsForNewline();
+    void testInvalidResponsesIgnored();
+    void testResponseRotation();
+    void testRequestRotation();
+    void testRefusesWithoutRuntimeDir();
+
+private:
+    void appendResponse(const QByteArray &bytes);
+    QList<QJsonObject> requests() const;
+    static QByteArray cancelLine(const QString &cookie);
+    static quint64 inode(const QString &path);
+
+    QTemporaryDir m_runtimeDir;
+    PolkitWrapper *m_wrapper = nullptr;
+    FileIPC *m_ipc = nullptr;
+};
+
+void TestFileIPC::initTestCase()
+{
+    QVERIFY(m_runtimeDir.isValid());
+    qputenv("XDG_RUNTIME_DIR", QFile::encodeName(m_runtimeDir.path()));
+}
+
+void TestFileIPC::init()
+{
+    m_wrapper = new PolkitWrapper(nullptr, this);
+    m_ipc = new FileIPC(m_wrapper, this);
+    QVERIFY(m_ipc->initialize());
+}
+
+void TestFileIPC::cleanup()
+{
+    delete m_ipc;
+    m_ipc = nullptr;
+    m_wrapper->cancelAuthorization();
+    delete m_wrapper;
+    m_wrapper = nullptr;
+}
+
+void TestFileIPC::appendResponse(const QByteArray &bytes)
+{
+    // As a client would: open, append, close (IN_CLOSE_WRITE)
+    QFile file(m_ipc->responseFilePath());
+    QVERIFY(file.open(QIODevice::WriteOnly | QIODevice::Append));
+    QCOMPARE(file.write(bytes), qint64(bytes.size()));
+    file.close();
+}
+
+QList<QJsonObject> TestFileIPC::requests() const
+{
+    QFile file(m_ipc->requestFilePath());
+    if (!file.open(QIODevice::ReadOnly)) {
+        return {};
+    }
+    QList<QJsonObject> messages;
+    for (const QByteArray &line : file.readAll().split('\n')) {
+        if (!line.isEmpty()) {
+            messages.append(QJsonDocument::fromJson(line).object());
+        }
+    }
+    return messages;
+}
+
+QByteArray TestFileIPC::cancelLine(const QString &cookie)
+{
+    QJsonObject message;
+    message["type"] = "cancel_authorization";
+    message["cookie"] = cookie;
+    return QJsonDocument(message).toJson(QJsonDocument::Compact) + '\n';
+}
+
+quint64 TestFileIPC::inode(const QString &path)
+{
+    struct stat status;
+    return ::stat(QFile::encodeName(path).constData(), &status) == 0 ? quint64(status.st_ino) : 0;
+}
+
+void TestFileIPC::testResponseLineIsHandled()
+{
+    m_wrapper->testInsertSession("file-cookie-1", "org.example.file", AuthenticationState::WAITING_FOR_PASSWORD);
+    QSignalSpy results(m_wrapper, &PolkitWrapper::authorizationResult);
+
+    appendResponse(cancelLine("file-cookie-1"));
+    QTRY_COMPARE(results.count(), 1);
+    QVERIFY(!m_wrapper->sessionHandle("file-cookie-1").isValid());
+
+    // The result is appended to the request log for the client
+    const QList<QJsonObject> written = requests();
+    QCOMPARE(written.size(), 1);
+    QCOMPARE(written.first()["type"].toString(), QString("authorization_result"));
+    QCOMPARE(written.first()["cookie"].toString(), QString("file-cookie-1"));
+}
+
+void TestFileIPC::testPartialLineWaitsForNewline()
+{
+    m_wrapper->testInsertSession("file-cookie-2", "org.example.file", AuthenticationState::WAITING_FOR_PASSWORD);
+    const QByteArray line = cancelLine("file-cookie-2");
+
+    appendResponse(line.left(10));
+    QTest::qWait(100);
+    QVERIFY(m_wrapper->sessionHandle("file-cookie-2").isValid());
+
+    appendResponse(line.mid(10));
+    QTRY_VERIFY(!m_wrapper->sessionHandle("file-cookie-2").isValid());
+}
+
+void TestFileIPC::testInvalidResponsesIgnored()
+{
+    m_wrapper->testInsertSession("file-cookie-3", "org.example.file", AuthenticationState::WAITING_FOR_PASSWORD);
+
+    // Garbage and schema violations are skipped; the valid line after them still lands
+    appendResponse("not json\n");
+    appendResponse(R"({"type":"cancel_authorization","cookie":"bad cookie!"})" "\n");
+    appendResponse(R"({"type":"check_authorization","action_id":"org.example.file"})" "\n");
+    appendResponse(cancelLine("file-cookie-3"));
+    QTRY_VERIFY(!m_wrapper->sessionHandle("file-cookie-3").isValid());
+}
+
+void TestFileIPC::testResponseRotation()
+{
+    const quint64 originalInode = inode(m_ipc->responseFilePath());
+    m_wrapper->testInsertSession("file-cookie-4", "org.example.file", AuthenticationState::WAITING_FOR_PASSWORD);
+    m_wrapper->testInsertSession("file-cookie-5", "org.example.file", AuthenticationState::WAITING_FOR_PASSWORD);
+
+    // Cancels for unknown cookies are no-ops; together they pass ROTATE_BYTES
+    QByteArray filler;
+    for (int i = 0; filler.size() < FileIPC::ROTATE_BYTES; ++i) {
+        filler += cancelLine(QString("unknown-%1").arg(i));
+    }
+    appendResponse(filler + cancelLine("file-cookie-4"));
+    QTRY_VERIFY(!m_wrapper->sessionHandle("file-cookie-4").isValid());
+
+    // Replaced by rename, not truncated: a new, empty inode under the same name
+    QTRY_VERIFY(inode(m_ipc->responseFilePath()) != originalInode);
+    QCOMPARE(QFileInfo(m_ipc->responseFilePath()).size(), qint64(0));
+
+    // The new log is read from its start
+    appendResponse(cancelLine("file-cookie-5"));
+    QTRY_VERIFY(!m_wrapper->sessionHandle("file-cookie-5").isValid());
+
+    // The replacement was created under a random name and renamed into place
+    const QStringList temporaries = QDir(m_runtimeDir.path()).entryList({"quickshell-polkit-responses.*"}, QDir::Files);
+    QVERIFY2(temporaries.isEmpty(), qPrintable(temporaries.join(' ')));
+}
+
+void TestFileIPC::testRequestRotation()
+{
+    // Every check writes one event (a dialog, or an error without polkitd)
+    const QString rotated = m_ipc->requestFilePath() + ".1";
+    int checks = 0;
+    while (!QFile::exists(rotated) && checks < 10000) {
+        m_wrapper->checkAuthorization(QString("org.example.file.action%1").arg(checks++));
+    }
+    QVERIFY(QFile::exists(rotated));
+    QVERIFY(QFileInfo(rotated).size() >= FileIPC::ROTATE_BYTES);
+    QVERIFY(QFileInfo(m_ipc->requestFilePath()).size() < FileIPC::ROTATE_BYTES);
+
+    // Writing continues into the new log
+    const qsizetype before = requests().size();
+    m_wrapper->checkAuthorization("org.example.file.after");
+    QCOMPARE(requests().size(), before + 1);
+}
+
+void TestFileIPC::testRefusesWithoutRuntimeDir()
+{
+    // No fallback to fixed names in a shared /tmp
+    const QByteArray runtimeDir = qgetenv("XDG_RUNTIME_DIR");
+    qunsetenv("XDG_RUNTIME_DIR");
+    {
+        FileIPC ipc(m_wrapper);
+        QVERIFY(!ipc.initialize());
+        QVERIFY(ipc.requestFilePath().isEmpty());
+    }
+    qputenv("XDG_RUNTIME_DIR", runtimeDir);
+}
+
+QTEST_MAIN(TestFileIPC)
+#include "test-file-ipc.moc"
@@ -0,0 +1,144 @@
+#include <QTest>
+#include <QSignalSpy>
+#include "../src/idle-trimmer.h"
+#include "../src/metrics.h"
+
+class TestIdleTrimmer : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void init();
+    void testTrimsAfterQuietPeriod();
+    void testBusyBlocksTrim();
+    void testAcquireWakes();
+    void testDisabledNeverTrims();
+    void testHooksDroppedWithContext();
+    void testQuietPeriodFromEnvironment();
+    void testResidentSize();
+};
+
+void TestIdleTrimmer::init()
+{
+    Metrics::testReset();
+    qunsetenv("QUICKSHELL_POLKIT_IDLE_TRIM");
+}
+
+void TestIdleTrimmer::testTrimsAfterQuietPeriod()
+{
+    IdleTrimmer trimmer;
+    int trims = 0;
+    trimmer.addHooks(this, [&trims]() { trims++; }, nullptr);
+    QSignalSpy trimmed(&trimmer, &IdleTrimmer::trimmed);
+
+    trimmer.setQuietPeriod(30);
+    QVERIFY(trimmer.isCountingDown());
+    QTRY_COMPARE(trimmed.count(), 1);
+    QCOMPARE(trims, 1);
+    QVERIFY(trimmer.isTrimmed());
+    QVERIFY(!trimmer.isCountingDown());
+    QCOMPARE(Metrics::counter(Metrics::Counter::IdleTrims), quint64(1));
+
+    // Already idle: no second trim until something wakes it
+    QVERIFY(!trimmer.trim());
+    QTest::qWait(60);
+    QCOMPARE(trims, 1);
+}
+
+void TestIdleTrimmer::testBusyBlocksTrim()
+{
+    IdleTrimmer trimmer;
+    QSignalSpy trimmed(&trimmer, &IdleTrimmer::trimmed);
+    trimmer.setQuietPeriod(30);
+
+    trimmer.acquire();
+    trimmer.acquire();
+    QVERIFY(!trimmer.isCountingDown());
+    QVERIFY(!trimmer.trim());
+
+    // The countdown starts only once the last holder lets go
+    trimmer.release();
+    QVERIFY(!trimmer.isCountingDown());
+    trimmer.release();
+    QVERIFY(trimmer.isCountingDown());
+    QTRY_COMPARE(trimmed.count(), 1);
+}
+
+void TestIdleTrimmer::testAcquireWakes()
+{
+    IdleTrimmer trimmer;
+    QList<QString> calls;
+    trimmer.addHooks(this, [&calls]() { calls << "trim"; }, [&calls]() { calls << "wake"; });
+    QSignalSpy woken(&trimmer, &IdleTrimmer::woken);
+
+    QVERIFY(trimmer.trim());
+    QCOMPARE(calls, (QList<QString>{"trim"}));
+
+    // Wake hooks have run by the time acquire() returns
+    trimmer.acquire();
+    QCOMPARE(calls, (QList<QString>{"trim", "wake"}));
+    QCOMPARE(woken.count(), 1);
+    QVERIFY(!trimmer.isTrimmed());
+
+    // Only the first holder wakes
+    trimmer.acquire();
+    QCOMPARE(woken.count(), 1);
+    trimmer.release();
+    trimmer.release();
+    QCOMPARE(trimmer.busyCount(), 0);
+}
+
+void TestIdleTrimmer::testDisabledNeverTrims()
+{
+    IdleTrimmer trimmer;
+    QSignalSpy trimmed(&trimmer, &IdleTrimmer::trimmed);
+    trimmer.setQuietPeriod(0);
+    trimmer.acquire();
+    trimmer.release();
+    QVERIFY(!trimmer.isCountingDown());
+    QTest::qWait(50);
+    QCOMPARE(trimmed.count(), 0);
+
+    // Unbalanced releases are refused rather than going negative
+    trimmer.release();
+    QCOMPARE(trimmer.busyCount(), 0);
+}
+
+void TestIdleTrimmer::testHooksDroppedWithContext()
+{
+    IdleTrimmer trimmer;
+    int trims = 0;
+    QObject *context = new QObject;
+    trimmer.addHooks(context, [&trims]() { trims++; }, nullptr);
+    delete context;
+
+    QVERIFY(trimmer.trim());
+    QCOMPARE(trims, 0);
+}
+
+void TestIdleTrimmer::testQuietPeriodFromEnvironment()
+{
+    QCOMPARE(IdleTrimmer::quietPeriodFromEnvironment(), IdleTrimmer::DEFAULT_QUIET_PERIOD_MS);
+    qputenv("QUICKSHELL_POLKIT_IDLE_TRIM", "90");
+    QCOMPARE(IdleTrimmer::quietPeriodFromEnvironment(), qint64(90000));
+    qputenv("QUICKSHELL_POLKIT_IDLE_TRIM", "0");
+    QCOMPARE(IdleTrimmer::quietPeriodFromEnvironment(), qint64(0));
+    qputenv("QUICKSHELL_POLKIT_IDLE_TRIM", "soon");
+    QCOMPARE(IdleTrimmer::quietPeriodFromEnvironment(), IdleTrimmer::DEFAULT_QUIET_PERIOD_MS);
+}
+
+void TestIdleTrimmer::testResidentSize()
+{
+    QVERIFY(IdleTrimmer::residentKb() > 0);
+
+    // Reported before and after the hooks and malloc_trim()
+    IdleTrimmer trimmer;
+    QSignalSpy trimmed(&trimmer, &IdleTrimmer::trimmed);
+    QVERIFY(trimmer.trim());
+    QCOMPARE(trimmed.count(), 1);
+    QVERIFY(trimmed.first().at(0).toLongLong() > 0);
+    QVERIFY(trimmed.first().at(1).toLongLong() > 0);
+}
+
+QTEST_MAIN(TestIdleTrimmer)
+#include "test-idle-trimmer.moc"
@@ -3,11 +3,15 @@
 #include <QLocalSocket>
 #include <QJsonObject>
 #include <QJsonDocument>
+#include <QJsonArray>
 #include <QSignalSpy>
 #include <QTimer>
 #include <QTemporaryDir>
 #include <unistd.h>
 #include "../src/security.h"
+#include "../src/message-validator.h"
+#include "../src/rate-limiter.h"
+#include "../src/wire-format.h"
 
 /**
  * Comprehensive E2E validation test for PolkitAgent LocalSocket implementation
@@ -31,6 +35,14 @@ private slots:
     void testReconnection();
     void testMultipleMessages();
     void testMessageBuffering();
+    void testPipelinedFrames();
+    void testSplitFrame();
+    void testMultipleClients();
+    void testCborEncoding();
+    void testResume();
+    void testRateLimitShedding();
+    void testDuplicateTypeKeyCharged();
+    void testFullBatchAdmitted();
     void testConnectionStability();
     
 private:
@@ -44,6 +56,7 @@ private:
     void waitMs(int ms);
     QJsonObject sendMessageAndGetResponse(const QJsonObject &message);
     QLocalSocket* createConnection();
+    QByteArray readUntilCount(QLocalSocket *client, const QByteArray &needle, int count, int timeoutMs = 3000);
 };
 
 void TestLocalSocketValidation::initTestCase()
@@ -275,6 +288,320 @@ void TestLocalSocketValidation::testMessageBuffering()
     client->deleteLater();
 }
 
+void TestLocalSocketValidation::testPipelinedFrames()
+{
+    // Several frames arriving in a single read must all be handled
+    
+    QLocalSocket *client = createConnection();
+    QVERIFY(client);
+    
+    // Read welcome message
+    QVERIFY(client->waitForReadyRead(3000));
+    client->readAll();
+    
+    QJsonObject heartbeat;
+    heartbeat["type"] = "heartbeat";
+    QByteArray frame = QJsonDocument(heartbeat).toJson(QJsonDocument::Compact) + "\n";
+    
+    // Three heartbeats in one write, as a bursty client would send them
+    client->write(frame + frame + frame);
+    client->flush();
+    
+    QByteArray responses = readUntilCount(client, "heartbeat_ack", 3);
+    QCOMPARE(responses.count("heartbeat_ack"), 3);
+    
+    client->deleteLater();
+}
+
+void TestLocalSocketValidation::testSplitFrame()
+{
+    // A frame split across two writes must be reassembled, not dropped
+    
+    QLocalSocket *client = createConnection();
+    QVERIFY(client);
+    
+    // Read welcome message
+    QVERIFY(client->waitForReadyRead(3000));
+    client->readAll();
+    
+    QJsonObject heartbeat;
+    heartbeat["type"] = "heartbeat";
+    heartbeat["timestamp"] = static_cast<double>(SecurityManager::getCurrentTimestamp());
+    QByteArray frame = QJsonDocument(heartbeat).toJson(QJsonDocument::Compact) + "\n";
+    
+    const qsizetype half = frame.size() / 2;
+    client->write(frame.left(half));
+    client->flush();
+    waitMs(200);
+    client->write(frame.mid(half));
+    client->flush();
+    
+    QByteArray responses = readUntilCount(client, "heartbeat_ack", 1);
+    QVERIFY(responses.contains("heartbeat_ack"));
+    
+    client->deleteLater();
+}
+
+void TestLocalSocketValidation::testMultipleClients()
+{
+    // One panel per output: every client stays connected and receives polkit events
+    
+    QLocalSocket *first = createConnection();
+    QVERIFY(first);
+    QLocalSocket *second = createConnection();
+    QVERIFY(second);
+    
+    QByteArray firstWelcome = readUntilCount(first, "welcome", 1);
+    QByteArray secondWelcome = readUntilCount(second, "welcome", 1);
+    QVERIFY(firstWelcome.contains("welcome"));
+    QVERIFY(secondWelcome.contains("welcome"));
+    QCOMPARE(first->state(), QLocalSocket::ConnectedState);
+    QCOMPARE(second->state(), QLocalSocket::ConnectedState);
+    
+    // Each connection gets its own version
+    QJsonDocument firstDoc = QJsonDocument::fromJson(firstWelcome.left(firstWelcome.indexOf('\n')));
+    QJsonDocument secondDoc = QJsonDocument::fromJson(secondWelcome.left(secondWelcome.indexOf('\n')));
+    QVERIFY(firstDoc["connection_version"].toInt() != secondDoc["connection_version"].toInt());
+    
+    // Replies go only to the requesting client
+    QJsonObject heartbeat;
+    heartbeat["type"] = "heartbeat";
+    first->write(QJsonDocument(heartbeat).toJson(QJsonDocument::Compact) + "\n");
+    first->flush();
+    QVERIFY(readUntilCount(first, "heartbeat_ack", 1).contains("heartbeat_ack"));
+    QVERIFY(!readUntilCount(second, "heartbeat_ack", 1, 500).contains("heartbeat_ack"));
+    
+    // Polkit events are broadcast to every client
+    QJsonObject authRequest;
+    authRequest["type"] = "check_authorization";
+    authRequest["action_id"] = "org.example.multiclient";
+    first->write(QJsonDocument(authRequest).toJson(QJsonDocument::Compact) + "\n");
+    first->flush();
+    
+    // show_auth_dialog, or authorization_error when no polkit authority is reachable
+    QByteArray firstEvents = readUntilCount(first, "auth", 1);
+    QByteArray secondEvents = readUntilCount(second, "auth", 1);
+    QVERIFY(firstEvents.contains("show_auth_dialog") || firstEvents.contains("authorization_error"));
+    QCOMPARE(secondEvents, firstEvents);
+    
+    first->deleteLater();
+    second->deleteLater();
+}
+
+void TestLocalSocketValidation::testCborEncoding()
+{
+    // A client can opt into binary CBOR after reading the advertised encodings
+    
+    QLocalSocket *client = createConnection();
+    QVERIFY(client);
+    
+    QByteArray welcome = readUntilCount(client, "welcome", 1);
+    QJsonDocument welcomeDoc = QJsonDocument::fromJson(welcome.left(welcome.indexOf('\n')));
+    QVERIFY(welcomeDoc["encodings"].toArray().contains(QJsonValue("cbor")));
+    
+    QJsonObject select;
+    select["type"] = "select_encoding";
+    select["encoding"] = "cbor";
+    client->write(WireFormat::encode(select, WireEncoding::Json));
+    client->flush();
+    
+    // The acknowledgment still arrives as JSON
+    QByteArray ack = readUntilCount(client, "\n", 1);
+    QJsonDocument ackDoc = QJsonDocument::fromJson(ack.left(ack.indexOf('\n')));
+    QCOMPARE(ackDoc["type"].toString(), QString("encoding_selected"));
+    QCOMPARE(ackDoc["encoding"].toString(), QString("cbor"));
+    
+    QJsonObject heartbeat;
+    heartbeat["type"] = "heartbeat";
+    client->write(WireFormat::encode(heartbeat, WireEncoding::Cbor));
+    client->flush();
+    
+    QByteArray response = readUntilCount(client, "heartbeat_ack", 1);
+    QJsonObject decoded;
+    qsizetype consumed = 0;
+    QString error;
+    QCOMPARE(WireFormat::decodeCbor(response, 0, &decoded, &consumed, &error), WireFormat::DecodeStatus::Complete);
+    QCOMPARE(decoded["type"].toString(), QString("heartbeat_ack"));
+    
+    client->deleteLater();
+}
+
+void TestLocalSocketValidation::testResume()
+{
+    // The welcome advertises where the event log stands; resuming from there
+    // costs nothing, while a foreign epoch gets a snapshot of live sessions
+    
+    QLocalSocket *client = createConnection();
+    QVERIFY(client);
+    
+    QByteArray welcome = readUntilCount(client, "welcome", 1);
+    QJsonDocument welcomeDoc = QJsonDocument::fromJson(welcome.left(welcome.indexOf('\n')));
+    QVERIFY(welcomeDoc["log_seq"].isDouble());
+    QVERIFY(!welcomeDoc.object().contains("event_seq"));  // Clients filter numbered frames
+    const QString epoch = welcomeDoc["event_epoch"].toString();
+    QVERIFY(!epoch.isEmpty());
+    
+    QJsonObject resume;
+    resume["type"] = "resume";
+    resume["last_seq"] = welcomeDoc["log_seq"].toDouble();
+    resume["epoch"] = epoch;
+    client->write(WireFormat::encode(resume, WireEncoding::Json));
+    client->flush();
+    
+    auto completeFrame = [](const QByteArray &received) {
+        for (const QByteArray &line : received.split('\n')) {
+            if (line.contains("resume_complete")) {
+                return QJsonDocument::fromJson(line);
+            }
+        }
+        return QJsonDocument();
+    };
+    
+    QJsonDocument complete = completeFrame(readUntilCount(client, "resume_complete", 1));
+    QCOMPARE(complete["mode"].toString(), QString("delta"));
+    QCOMPARE(complete["event_epoch"].toString(), epoch);
+    QCOMPARE(complete["log_seq"].toDouble(), welcomeDoc["log_seq"].toDouble());
+    QVERIFY(!complete.object().contains("event_seq"));
+    
+    // A sequence from another agent instance cannot be trusted
+    resume["epoch"] = "previous-instance";
+    client->write(WireFormat::encode(resume, WireEncoding::Json));
+    client->flush();
+    
+    complete = completeFrame(readUntilCount(client, "resume_complete", 1));
+    QCOMPARE(complete["mode"].toString(), QString("snapshot"));
+    QVERIFY(complete["sessions"].isDouble());
+    
+    client->deleteLater();
+}
+
+void TestLocalSocketValidation::testRateLimitShedding()
+{
+    // A flood is shed before parsing and reported once, without dropping the client
+    
+    QLocalSocket *client = createConnection();
+    QVERIFY(client);
+    
+    // Read welcome message
+    QVERIFY(client->waitForReadyRead(3000));
+    client->readAll();
+    
+    QJsonObject heartbeat;
+    heartbeat["type"] = "heartbeat";
+    QByteArray frame = QJsonDocument(heartbeat).toJson(QJsonDocument::Compact) + "\n";
+    
+    QByteArray flood;
+    for (int i = 0; i < 40; ++i) {
+        flood += frame;
+    }
+    client->write(flood);
+    client->flush();
+    
+    QByteArray responses = readUntilCount(client, "Rate limit exceeded", 2, 1000);
+    QCOMPARE(responses.count("Rate limit exceeded"), 1);
+    QCOMPARE(client->state(), QLocalSocket::ConnectedState);
+    
+    // The heartbeat budget refills
+    waitMs(1000);
+    client->write(frame);
+    client->flush();
+    QVERIFY(readUntilCount(client, "heartbeat_ack", 1).contains("heartbeat_ack"));
+    
+    client->deleteLater();
+}
+
+void TestLocalSocketValidation::testDuplicateTypeKeyCharged()
+{
+    // The raw-byte peek sees the first "type", the parser keeps the last:
+    // a frame posing as a heartbeat is still charged as the control message it is
+    
+    QLocalSocket *client = createConnection();
+    QVERIFY(client);
+    
+    // Read welcome message
+    QVERIFY(client->waitForReadyRead(3000));
+    client->readAll();
+    
+    const QByteArray disguised = R"({"type":"heartbeat","type":"resume","last_seq":0,"epoch":"other"})" "\n";
+    QByteArray burst;
+    for (int i = 0; i < 8; ++i) {
+        burst += disguised;  // Within the heartbeat burst, past the control burst
+    }
+    client->write(burst);
+    client->flush();
+    
+    QByteArray responses = readUntilCount(client, "Rate limit exceeded", 1, 2000);
+    QCOMPARE(responses.count("Rate limit exceeded"), 1);
+    QCOMPARE(responses.count("resume_complete"), RateLimiter::CONTROL_CAPACITY);
+    QCOMPARE(client->state(), QLocalSocket::ConnectedState);
+    
+    client->deleteLater();
+}
+
+void TestLocalSocketValidation::testFullBatchAdmitted()
+{
+    // A batch is charged by its items alone: a full batch whose items fit
+    // their class budgets runs to the end, control items included
+    
+    QLocalSocket *client = createConnection();
+    QVERIFY(client);
+    
+    // Read welcome message
+    QVERIFY(client->waitForReadyRead(3000));
+    client->readAll();
+    
+    QJsonArray messages;
+    for (int i = 0; i < RateLimiter::CONTROL_CAPACITY; ++i) {
+        QJsonObject resume;
+        resume["type"] = "resume";
+        resume["last_seq"] = 0;
+        resume["epoch"] = "other";
+        messages.append(resume);
+    }
+    for (int i = 0; i < 3; ++i) {
+        QJsonObject cancel;
+        cancel["type"] = "cancel_authorization";
+        cancel["cookie"] = QString("batch-cookie-%1").arg(i);
+        messages.append(cancel);
+    }
+    while (messages.size() < MessageValidator::MAX_BATCH_MESSAGES) {
+        QJsonObject heartbeat;
+        heartbeat["type"] = "heartbeat";
+        messages.append(heartbeat);
+    }
+    for (qsizetype i = 0; i < messages.size(); ++i) {
+        QJsonObject item = messages.at(i).toObject();
+        item["id"] = int(i);
+        messages[i] = item;
+    }
+    
+    QJsonObject batch;
+    batch["type"] = "batch";
+    batch["id"] = "full";
+    batch["messages"] = messages;
+    client->write(QJsonDocument(batch).toJson(QJsonDocument::Compact) + "\n");
+    client->flush();
+    
+    QByteArray responses = readUntilCount(client, "\"replies\"", 1, 2000);
+    QVERIFY(!responses.contains("Rate limit exceeded"));
+    
+    QJsonObject reply;
+    for (const QByteArray &line : responses.split('\n')) {
+        const QJsonObject frame = QJsonDocument::fromJson(line).object();
+        if (frame["type"].toString() == "batch") {
+            reply = frame;
+        }
+    }
+    QCOMPARE(reply["id"].toString(), QString("full"));
+    const QJsonArray replies = reply["replies"].toArray();
+    QCOMPARE(int(replies.size()), MessageValidator::MAX_BATCH_MESSAGES);
+    QCOMPARE(replies.at(RateLimiter::CONTROL_CAPACITY - 1).toObject()["type"].toString(),
+             QString("resume_complete"));
+    QCOMPARE(replies.last().toObject()["type"].toString(), QString("heartbeat_ack"));
+    
+    client->deleteLater();
+}
+
 void TestLocalSocketValidation::testConnectionStability()
 {
     // Test connection stability over time - important for long-running QML sessions
@@ -407,6 +734,21 @@ QJsonObject TestLocalSocketValidation::sendMessageAndGetResponse(const QJsonObje
     return QJsonObject();
 }
 
+QByteArray TestLocalSocketValidation::readUntilCount(QLocalSocket *client, const QByteArray &needle, int count, int timeoutMs)
+{
+    QByteArray received;
+    QElapsedTimer timer;
+    timer.start();
+    
+    while (received.count(needle) < count && timer.elapsed() < timeoutMs) {
+        if (client->waitForReadyRead(100)) {
+            received += client->readAll();
+        }
+    }
+    
+    return received;
+}
+
 QLocalSocket* TestLocalSocketValidation::createConnection()
 {
     QLocalSocket *client = new QLocalSocket(this);
@@ -0,0 +1,193 @@
+#include <QTest>
+#include <QHash>
+#include "../src/message-rules.h"
+
+/**
+ * Tests for MessageRules
+ *
+ * Details are supplied from a QHash instead of PolkitQt1::Details so the
+ * rule table can be tested without polkit.
+ */
+class TestMessageRules : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void testBuiltinRun0Rule();
+    void testBuiltinRun0CustomTemplate();
+    void testNoMatchReturnsNull();
+    void testPrefixMatch();
+    void testExactBeatsPrefix();
+    void testDetailKeys();
+    void testConfigRulesPrecedeBuiltins();
+    void testFallback();
+    void testInvalidRulesSkipped();
+    void testInvalidJson();
+    
+private:
+    static MessageRule::DetailLookup lookup(const QHash<QString, QString> &details);
+    static QString render(const MessageRule *rule, const QString &actionId, const QString &message,
+                          const QHash<QString, QString> &details = {}, const QString &command = QString());
+};
+
+MessageRule::DetailLookup TestMessageRules::lookup(const QHash<QString, QString> &details)
+{
+    return [details](const QString &key) { return details.value(key); };
+}
+
+QString TestMessageRules::render(const MessageRule *rule, const QString &actionId, const QString &message,
+                                 const QHash<QString, QString> &details, const QString &command)
+{
+    MessageContext context;
+    context.actionId = actionId;
+    context.message = message;
+    context.command = command;
+    for (const QString &key : rule->referencedDetailKeys()) {
+        context.details.insert(key, details.value(key));
+    }
+    return rule->render(context);
+}
+
+void TestMessageRules::testBuiltinRun0Rule()
+{
+    MessageRules rules;
+    rules.addBuiltinRules();
+    
+    const QString actionId = "org.freedesktop.systemd1.manage-units";
+    const QString message = "Authentication is required to manage Transient units";
+    const MessageRule *rule = rules.match(actionId, message, lookup({}));
+    QVERIFY(rule);
+    QVERIFY(rule->needsCommand());
+    
+    QCOMPARE(render(rule, actionId, message, {}, "dnf"),
+             QString("Authentication required to run 'dnf' with elevated privileges"));
+    QCOMPARE(render(rule, actionId, message),
+             QString("Authentication required to run command with elevated privileges"));
+    
+    // Same action without the transient marker is left alone
+    QVERIFY(!rules.match(actionId, "Authentication is required to stop units", lookup({})));
+}
+
+void TestMessageRules::testBuiltinRun0CustomTemplate()
+{
+    MessageRules rules;
+    rules.addBuiltinRules("Allow %1 to run as root?");
+    
+    const QString actionId = "org.freedesktop.systemd1.manage-units";
+    const MessageRule *rule = rules.match(actionId, "transient", lookup({}));
+    QVERIFY(rule);
+    QCOMPARE(render(rule, actionId, "transient", {}, "htop"), QString("Allow htop to run as root?"));
+    QCOMPARE(render(rule, actionId, "transient"), QString("Allow command to run as root?"));
+}
+
+void TestMessageRules::testNoMatchReturnsNull()
+{
+    MessageRules rules;
+    rules.addBuiltinRules();
+    QVERIFY(!rules.match("org.example.test", "Something", lookup({})));
+}
+
+void TestMessageRules::testPrefixMatch()
+{
+    MessageRules rules;
+    QVERIFY(rules.loadJson(R"({"rules": [
+        {"action": "org.freedesktop.udisks2.*", "template": "Disk access: {message} ({action_id})"}
+    ]})"));
+    
+    const MessageRule *rule = rules.match("org.freedesktop.udisks2.filesystem-mount", "Mount it", lookup({}));
+    QVERIFY(rule);
+    QCOMPARE(render(rule, "org.freedesktop.udisks2.filesystem-mount", "Mount it"),
+             QString("Disk access: Mount it (org.freedesktop.udisks2.filesystem-mount)"));
+    
+    // The prefix itself, and siblings, don't match
+    QVERIFY(!rules.match("org.freedesktop.udisks2", "x", lookup({})));
+    QVERIFY(!rules.match("org.freedesktop.udisks", "x", lookup({})));
+}
+
+void TestMessageRules::testExactBeatsPrefix()
+{
+    MessageRules rules;
+    QVERIFY(rules.loadJson(R"({"rules": [
+        {"action": "org.example.*", "template": "prefix"},
+        {"action": "org.example.deep.*", "template": "longer prefix"},
+        {"action": "org.example.deep.action", "template": "exact"}
+    ]})"));
+    QCOMPARE(rules.ruleCount(), 3);
+    
+    QCOMPARE(render(rules.match("org.example.deep.action", "", lookup({})), "", ""), QString("exact"));
+    QCOMPARE(render(rules.match("org.example.deep.other", "", lookup({})), "", ""), QString("longer prefix"));
+    QCOMPARE(render(rules.match("org.example.other", "", lookup({})), "", ""), QString("prefix"));
+}
+
+void TestMessageRules::testDetailKeys()
+{
+    MessageRules rules;
+    QVERIFY(rules.loadJson(R"({"rules": [
+        {"action": "org.example.mount", "detail_keys": ["drive"], "template": "Mount {detail.drive}"},
+        {"action": "org.example.mount", "template": "Mount a drive"}
+    ]})"));
+    
+    QHash<QString, QString> details = {{"drive", "USB Stick"}};
+    const MessageRule *rule = rules.match("org.example.mount", "", lookup(details));
+    QVERIFY(rule);
+    QCOMPARE(rule->referencedDetailKeys(), QStringList({"drive"}));
+    QCOMPARE(render(rule, "org.example.mount", "", details), QString("Mount USB Stick"));
+    
+    // Without the detail the next rule in file order applies
+    rule = rules.match("org.example.mount", "", lookup({}));
+    QVERIFY(rule);
+    QCOMPARE(render(rule, "org.example.mount", ""), QString("Mount a drive"));
+}
+
+void TestMessageRules::testConfigRulesPrecedeBuiltins()
+{
+    MessageRules rules;
+    QVERIFY(rules.loadJson(R"({"rules": [
+        {"action": "org.freedesktop.systemd1.manage-units", "message_regex": "(?i)transient",
+         "template": "run0: {command}", "template_unresolved": "run0 request"}
+    ]})"));
+    rules.addBuiltinRules();
+    
+    const QString actionId = "org.freedesktop.systemd1.manage-units";
+    const MessageRule *rule = rules.match(actionId, "Transient", lookup({}));
+    QVERIFY(rule);
+    QCOMPARE(render(rule, actionId, "Transient", {}, "vim"), QString("run0: vim"));
+    QCOMPARE(render(rule, actionId, "Transient"), QString("run0 request"));
+}
+
+void TestMessageRules::testFallback()
+{
+    MessageRules rules;
+    QVERIFY(rules.loadJson(R"({"fallback": "[{action_id}] {message}"})"));
+    
+    const MessageRule *rule = rules.match("org.example.any", "Hello", lookup({}));
+    QVERIFY(rule);
+    QCOMPARE(render(rule, "org.example.any", "Hello"), QString("[org.example.any] Hello"));
+}
+
+void TestMessageRules::testInvalidRulesSkipped()
+{
+    MessageRules rules;
+    QVERIFY(rules.loadJson(R"({"rules": [
+        {"action": "org.example.bad", "message_regex": "(unclosed", "template": "x"},
+        {"action": "org.example.notemplate"},
+        {"action": "org.example.good", "template": "Unknown {placeholder} kept"}
+    ]})"));
+    QCOMPARE(rules.ruleCount(), 1);
+    
+    const MessageRule *rule = rules.match("org.example.good", "", lookup({}));
+    QVERIFY(rule);
+    QCOMPARE(render(rule, "org.example.good", ""), QString("Unknown {placeholder} kept"));
+}
+
+void TestMessageRules::testInvalidJson()
+{
+    MessageRules rules;
+    QString error;
+    QVERIFY(!rules.loadJson("{ not json", &error));
+    QVERIFY(!error.isEmpty());
+    QVERIFY(!rules.loadJson("[]", &error));
+}
+
+QTEST_MAIN(TestMessageRules)
+#include "test-message-rules.moc"
@@ -1,5 +1,6 @@
 #include <QTest>
 #include <QJsonObject>
+#include <QJsonArray>
 #include <QJsonDocument>
 #include "../src/message-validator.h"
 
@@ -12,15 +13,24 @@ private slots:
     void testInvalidCheckAuthorization();
     void testValidCancelAuthorization();
     void testInvalidCancelAuthorization();
+    void testCancelAuthorizationCookie();
     void testValidSubmitAuthentication();
     void testInvalidSubmitAuthentication();
     void testValidHeartbeat();
     void testInvalidHeartbeat();
+    void testSelectEncoding();
+    void testResume();
+    void testGetStats();
+    void testBatch();
+    void testInvalidBatch();
     void testMissingMessageType();
     void testInvalidMessageType();
     void testStringValidation();
     void testLengthLimits();
     void testSecurityValidation();
+    void testUnexpectedFields();
+    void testEnvelopeFields();
+    void testResolvedType();
 };
 
 void TestMessageValidator::testValidCheckAuthorization()
@@ -83,6 +93,27 @@ void TestMessageValidator::testInvalidCancelAuthorization()
     QVERIFY(result.error.contains("Unexpected field"));
 }
 
+void TestMessageValidator::testCancelAuthorizationCookie()
+{
+    // Scoped cancel names one session
+    QJsonObject message;
+    message["type"] = "cancel_authorization";
+    message["cookie"] = "test-cookie-123";
+    QVERIFY(MessageValidator::validateMessage(message).valid);
+    
+    // The cookie follows the same rules as in submit_authentication
+    message["cookie"] = "bad cookie!";
+    ValidationResult result = MessageValidator::validateMessage(message);
+    QVERIFY(!result.valid);
+    QVERIFY(result.error.contains("invalid characters"));
+    
+    message["cookie"] = "";
+    QVERIFY(!MessageValidator::validateMessage(message).valid);
+    
+    message["cookie"] = 42;
+    QVERIFY(!MessageValidator::validateMessage(message).valid);
+}
+
 void TestMessageValidator::testValidSubmitAuthentication()
 {
     QJsonObject message;
@@ -142,6 +173,171 @@ void TestMessageValidator::testInvalidHeartbeat()
     QVERIFY(result.error.contains("timestamp"));
 }
 
+void TestMessageValidator::testSelectEncoding()
+{
+    QJsonObject message;
+    message["type"] = "select_encoding";
+    message["encoding"] = "cbor";
+    QVERIFY(MessageValidator::validateMessage(message).valid);
+    
+    message["encoding"] = "json";
+    QVERIFY(MessageValidator::validateMessage(message).valid);
+    
+    // Unknown encoding
+    message["encoding"] = "msgpack";
+    ValidationResult result1 = MessageValidator::validateMessage(message);
+    QVERIFY(!result1.valid);
+    QVERIFY(result1.error.contains("encoding"));
+    
+    // Missing encoding
+    QJsonObject message2;
+    message2["type"] = "select_encoding";
+    ValidationResult result2 = MessageValidator::validateMessage(message2);
+    QVERIFY(!result2.valid);
+    QVERIFY(result2.error.contains("encoding"));
+}
+
+void TestMessageValidator::testResume()
+{
+    QJsonObject message;
+    message["type"] = "resume";
+    message["last_seq"] = 42;
+    message["epoch"] = "1a2b3c4d5e6f";
+    ValidationResult result = MessageValidator::validateMessage(message);
+    QVERIFY(result.valid);
+    QCOMPARE(result.type, MessageType::Resume);
+    
+    // Without an epoch the agent answers with a snapshot
+    message.remove("epoch");
+    QVERIFY(MessageValidator::validateMessage(message).valid);
+    
+    message["last_seq"] = "42";
+    QVERIFY(!MessageValidator::validateMessage(message).valid);
+    
+    QJsonObject missing;
+    missing["type"] = "resume";
+    ValidationResult result2 = MessageValidator::validateMessage(missing);
+    QVERIFY(!result2.valid);
+    QVERIFY(result2.error.contains("last_seq"));
+    
+    QJsonObject longEpoch;
+    longEpoch["type"] = "resume";
+    longEpoch["last_seq"] = 0;
+    longEpoch["epoch"] = QString(MessageValidator::MAX_EPOCH_LENGTH + 1, 'a');
+    QVERIFY(!MessageValidator::validateMessage(longEpoch).valid);
+}
+
+void TestMessageValidator::testGetStats()
+{
+    QJsonObject message;
+    message["type"] = "get_stats";
+    ValidationResult result = MessageValidator::validateMessage(message);
+    QVERIFY(result.valid);
+    QCOMPARE(result.type, MessageType::GetStats);
+    
+    message["verbose"] = true;
+    ValidationResult result2 = MessageValidator::validateMessage(message);
+    QVERIFY(!result2.valid);
+    QVERIFY(result2.error.contains("verbose"));
+}
+
+void TestMessageValidator::testBatch()
+{
+    QJsonObject heartbeat;
+    heartbeat["type"] = "heartbeat";
+    heartbeat["id"] = 1;
+    QJsonObject submit;
+    submit["type"] = "submit_authentication";
+    submit["id"] = "submit-1";
+    submit["cookie"] = "test-cookie-123";
+    submit["response"] = "password";
+    
+    QJsonObject batch;
+    batch["type"] = "batch";
+    batch["messages"] = QJsonArray{heartbeat, submit};
+    ValidationResult result = MessageValidator::validateMessage(batch);
+    QVERIFY2(result.valid, qPrintable(result.error));
+    QCOMPARE(result.type, MessageType::Batch);
+    QVERIFY(MessageValidator::validateBatch(batch).valid);
+    
+    // The batch itself may be signed and correlated like any message
+    batch["hmac"] = "abc123";
+    batch["seq"] = 7;
+    batch["id"] = "outer";
+    QVERIFY(MessageValidator::validateMessage(batch).valid);
+    
+    QJsonArray full;
+    for (int i = 0; i < MessageValidator::MAX_BATCH_MESSAGES; ++i) {
+        heartbeat["id"] = i;
+        full.append(heartbeat);
+    }
+    batch["messages"] = full;
+    QVERIFY(MessageValidator::validateMessage(batch).valid);
+}
+
+void TestMessageValidator::testInvalidBatch()
+{
+    QJsonObject heartbeat;
+    heartbeat["type"] = "heartbeat";
+    heartbeat["id"] = 1;
+    
+    auto batchOf = [](const QJsonArray &messages) {
+        QJsonObject batch;
+        batch["type"] = "batch";
+        batch["messages"] = messages;
+        return batch;
+    };
+    auto rejects = [](const QJsonObject &batch, const char *fragment) {
+        const ValidationResult result = MessageValidator::validateMessage(batch);
+        return !result.valid && result.error.contains(QLatin1String(fragment));
+    };
+    
+    QJsonObject missing;
+    missing["type"] = "batch";
+    QVERIFY(rejects(missing, "messages"));
+    
+    QJsonObject notArray = missing;
+    notArray["messages"] = "heartbeat";
+    QVERIFY(rejects(notArray, "must be an array"));
+    QVERIFY(rejects(batchOf({}), "cannot be empty"));
+    
+    QJsonArray tooMany;
+    for (int i = 0; i <= MessageValidator::MAX_BATCH_MESSAGES; ++i) {
+        tooMany.append(heartbeat);
+    }
+    QVERIFY(rejects(batchOf(tooMany), "maximum"));
+    
+    QVERIFY(rejects(batchOf({QJsonValue("heartbeat")}), "messages[0] must be an object"));
+    
+    QJsonObject noId = heartbeat;
+    noId.remove("id");
+    QVERIFY(rejects(batchOf({heartbeat, noId}), "messages[1] needs"));
+    QJsonObject longId = heartbeat;
+    longId["id"] = QString(MessageValidator::MAX_CORRELATION_ID_LENGTH + 1, 'a');
+    QVERIFY(rejects(batchOf({longId}), "needs"));
+    
+    QJsonObject signedItem = heartbeat;
+    signedItem["hmac"] = "abc123";
+    QVERIFY(rejects(batchOf({signedItem}), "sign the batch"));
+    
+    QJsonObject nested = batchOf({heartbeat});
+    nested["id"] = 2;
+    QVERIFY(rejects(batchOf({nested}), "batch cannot be batched"));
+    
+    QJsonObject encoding;
+    encoding["type"] = "select_encoding";
+    encoding["encoding"] = "cbor";
+    encoding["id"] = 3;
+    QVERIFY(rejects(batchOf({encoding}), "select_encoding cannot be batched"));
+    
+    // One bad sub-message rejects the whole batch, and says which one
+    QJsonObject badCookie;
+    badCookie["type"] = "cancel_authorization";
+    badCookie["id"] = 4;
+    badCookie["cookie"] = "bad cookie!";
+    QVERIFY(rejects(batchOf({heartbeat, badCookie}), "messages[1]: cookie contains invalid characters"));
+}
+
 void TestMessageValidator::testMissingMessageType()
 {
     QJsonObject message;
@@ -203,5 +399,61 @@ void TestMessageValidator::testSecurityValidation()
     QVERIFY(result.error.contains("must be a string"));
 }
 
+void TestMessageValidator::testUnexpectedFields()
+{
+    // Every schema rejects keys it does not know about
+    QJsonObject message;
+    message["type"] = "check_authorization";
+    message["action_id"] = "org.example.test";
+    message["extra"] = "x";
+    
+    ValidationResult result = MessageValidator::validateMessage(message);
+    QVERIFY(!result.valid);
+    QCOMPARE(result.error, QString("Unexpected field in check_authorization: extra"));
+    
+    QJsonObject submit;
+    submit["type"] = "submit_authentication";
+    submit["cookie"] = "cookie-1";
+    submit["response"] = "secret";
+    submit["password"] = "secret";
+    QVERIFY(!MessageValidator::validateMessage(submit).valid);
+}
+
+void TestMessageValidator::testEnvelopeFields()
+{
+    // Signed messages carry hmac and timestamp on top of their own fields
+    QJsonObject message;
+    message["type"] = "cancel_authorization";
+    message["timestamp"] = 1700000000000.0;
+    message["hmac"] = "abcdef";
+    message["seq"] = 1;
+    QVERIFY(MessageValidator::validateMessage(message).valid);
+    
+    message["type"] = "check_authorization";
+    message["action_id"] = "org.example.test";
+    QVERIFY(MessageValidator::validateMessage(message).valid);
+}
+
+void TestMessageValidator::testResolvedType()
+{
+    QJsonObject message;
+    message["type"] = "heartbeat";
+    ValidationResult result = MessageValidator::validateMessage(message);
+    QVERIFY(result.valid);
+    QCOMPARE(result.type, MessageType::Heartbeat);
+    
+    QCOMPARE(MessageValidator::messageType("submit_authentication"), MessageType::SubmitAuthentication);
+    QCOMPARE(MessageValidator::messageType("nope"), MessageType::Unknown);
+    QCOMPARE(QString(MessageValidator::messageTypeName(MessageType::SelectEncoding)),
+             QString("select_encoding"));
+    
+    // Non-ASCII letters are no longer accepted in cookies
+    QJsonObject submit;
+    submit["type"] = "submit_authentication";
+    submit["cookie"] = QString::fromUtf8("caf\xc3\xa9");
+    submit["response"] = "secret";
+    QVERIFY(!MessageValidator::validateMessage(submit).valid);
+}
+
 QTEST_MAIN(TestMessageValidator)
 #include "test-message-validator.moc"
\ No newline at end of file
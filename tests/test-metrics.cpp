@@ -0,0 +1,163 @@
+#include <QTest>
+#include <QJsonArray>
+#include <QJsonObject>
+#include <QThread>
+#include "../src/metrics.h"
+
+class TestMetrics : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void init();
+    void testCountersPerType();
+    void testHistogramBuckets();
+    void testConcurrentIncrements();
+    void testJsonShape();
+    void testPrometheusText();
+    void testTransitionEdges();
+};
+
+void TestMetrics::init()
+{
+    Metrics::testReset();
+}
+
+void TestMetrics::testCountersPerType()
+{
+    Metrics::messageReceived(MessageType::Heartbeat);
+    Metrics::messageReceived(MessageType::Heartbeat);
+    Metrics::messageReceived(MessageType::SubmitAuthentication);
+    Metrics::messageRejected(MessageType::Unknown);
+    Metrics::messageRateLimited(RateLimiter::MessageClass::Auth);
+    Metrics::increment(Metrics::Counter::BytesIn, 128);
+    Metrics::increment(Metrics::Counter::BytesIn, 64);
+
+    QCOMPARE(Metrics::received(MessageType::Heartbeat), quint64(2));
+    QCOMPARE(Metrics::received(MessageType::SubmitAuthentication), quint64(1));
+    QCOMPARE(Metrics::received(MessageType::CheckAuthorization), quint64(0));
+    QCOMPARE(Metrics::rejected(MessageType::Unknown), quint64(1));
+    QCOMPARE(Metrics::rateLimited(RateLimiter::MessageClass::Auth), quint64(1));
+    QCOMPARE(Metrics::counter(Metrics::Counter::BytesIn), quint64(192));
+}
+
+void TestMetrics::testHistogramBuckets()
+{
+    // 3ms and 5ms land in the first bucket (le 5ms), 7ms in the second,
+    // a minute in the overflow bucket
+    Metrics::observe(Metrics::Histogram::TimeToPrompt, 3'000'000);
+    Metrics::observe(Metrics::Histogram::TimeToPrompt, 5'000'000);
+    Metrics::observe(Metrics::Histogram::TimeToPrompt, 7'000'000);
+    Metrics::observe(Metrics::Histogram::TimeToPrompt, 60'000'000'000);
+    Metrics::observe(Metrics::Histogram::TimeToPrompt, -1);  // Clock went backwards: ignored
+    QCOMPARE(Metrics::histogramCount(Metrics::Histogram::TimeToPrompt), quint64(4));
+    QCOMPARE(Metrics::histogramCount(Metrics::Histogram::PamCompletion), quint64(0));
+
+    const QJsonObject histogram = Metrics::toJson({})["histograms"].toObject()["time_to_prompt"].toObject();
+    const QJsonArray buckets = histogram["buckets"].toArray();
+    QCOMPARE(int(buckets.size()), Metrics::BUCKET_COUNT);
+    QCOMPARE(buckets.at(0).toObject()["count"].toInteger(), qint64(2));
+    QCOMPARE(buckets.at(1).toObject()["count"].toInteger(), qint64(1));
+    QCOMPARE(buckets.last().toObject()["count"].toInteger(), qint64(1));
+    QVERIFY(!buckets.last().toObject().contains("le_ms"));
+    QCOMPARE(histogram["sum_ms"].toDouble(), 60015.0);
+}
+
+void TestMetrics::testConcurrentIncrements()
+{
+    constexpr int THREADS = 4;
+    constexpr int PER_THREAD = 10000;
+
+    QList<QThread *> threads;
+    for (int t = 0; t < THREADS; ++t) {
+        threads.append(QThread::create([] {
+            for (int i = 0; i < PER_THREAD; ++i) {
+                Metrics::increment(Metrics::Counter::BytesOut);
+            }
+        }));
+        threads.last()->start();
+    }
+    for (QThread *thread : threads) {
+        thread->wait();
+        delete thread;
+    }
+
+    QCOMPARE(Metrics::counter(Metrics::Counter::BytesOut), quint64(THREADS * PER_THREAD));
+}
+
+void TestMetrics::testJsonShape()
+{
+    Metrics::messageReceived(MessageType::GetStats);
+
+    Metrics::Gauges gauges;
+    gauges.clients = 2;
+    gauges.replaySessions = 1;
+    gauges.outputBytesPending = 512;
+    gauges.sessionsByState = {{"WAITING_FOR_PASSWORD", 3}, {"AUTHENTICATING", 0}};
+
+    const QJsonObject stats = Metrics::toJson(gauges);
+    QCOMPARE(stats["received"].toObject()["get_stats"].toInteger(), qint64(1));
+    QCOMPARE(stats["received"].toObject()["unknown"].toInteger(), qint64(0));
+    QVERIFY(stats["rate_limited"].toObject().contains("heartbeat"));
+    QVERIFY(stats["counters"].toObject().contains("auth_retries"));
+
+    const QJsonObject values = stats["gauges"].toObject();
+    QCOMPARE(values["clients"].toInt(), 2);
+    QCOMPARE(values["replay_sessions"].toInt(), 1);
+    QCOMPARE(values["output_bytes_pending"].toInteger(), qint64(512));
+    QCOMPARE(values["sessions"].toObject()["WAITING_FOR_PASSWORD"].toInt(), 3);
+}
+
+void TestMetrics::testPrometheusText()
+{
+    Metrics::messageReceived(MessageType::CheckAuthorization);
+    Metrics::observe(Metrics::Histogram::PamCompletion, 20'000'000);
+    Metrics::observe(Metrics::Histogram::PamCompletion, 200'000'000);
+
+    Metrics::Gauges gauges;
+    gauges.clients = 1;
+    gauges.sessionsByState = {{"INITIATED", 1}};
+    const QByteArray text = Metrics::toPrometheus(gauges);
+
+    QVERIFY(text.contains("# TYPE quickshell_polkit_messages_received_total counter\n"));
+    QVERIFY(text.contains("quickshell_polkit_messages_received_total{type=\"check_authorization\"} 1\n"));
+    QVERIFY(text.contains("quickshell_polkit_clients 1\n"));
+    QVERIFY(text.contains("quickshell_polkit_sessions{state=\"INITIATED\"} 1\n"));
+
+    // Buckets are cumulative and in seconds
+    QVERIFY(text.contains("# TYPE quickshell_polkit_pam_completion_seconds histogram\n"));
+    QVERIFY(text.contains("quickshell_polkit_pam_completion_seconds_bucket{le=\"0.01\"} 0\n"));
+    QVERIFY(text.contains("quickshell_polkit_pam_completion_seconds_bucket{le=\"0.025\"} 1\n"));
+    QVERIFY(text.contains("quickshell_polkit_pam_completion_seconds_bucket{le=\"0.25\"} 2\n"));
+    QVERIFY(text.contains("quickshell_polkit_pam_completion_seconds_bucket{le=\"+Inf\"} 2\n"));
+    QVERIFY(text.contains("quickshell_polkit_pam_completion_seconds_sum 0.22\n"));
+    QVERIFY(text.contains("quickshell_polkit_pam_completion_seconds_count 2\n"));
+    QVERIFY(text.endsWith('\n'));
+}
+
+void TestMetrics::testTransitionEdges()
+{
+    Metrics::stateTransition(AuthenticationState::INITIATED, AuthenticationState::WAITING_FOR_PASSWORD);
+    Metrics::stateTransition(AuthenticationState::WAITING_FOR_PASSWORD, AuthenticationState::AUTHENTICATING);
+    Metrics::stateTransition(AuthenticationState::WAITING_FOR_PASSWORD, AuthenticationState::AUTHENTICATING);
+    QCOMPARE(Metrics::transitionCount(AuthenticationState::WAITING_FOR_PASSWORD,
+                                      AuthenticationState::AUTHENTICATING), quint64(2));
+    QCOMPARE(Metrics::transitionCount(AuthenticationState::AUTHENTICATING,
+                                      AuthenticationState::WAITING_FOR_PASSWORD), quint64(0));
+
+    // Edges never taken are left out
+    const QJsonObject transitions = Metrics::toJson({})["transitions"].toObject();
+    QCOMPARE(int(transitions.size()), 2);
+    QCOMPARE(transitions["INITIATED->WAITING_FOR_PASSWORD"].toInteger(), qint64(1));
+    QCOMPARE(transitions["WAITING_FOR_PASSWORD->AUTHENTICATING"].toInteger(), qint64(2));
+
+    const QByteArray text = Metrics::toPrometheus({});
+    QVERIFY(text.contains("# TYPE quickshell_polkit_state_transitions_total counter\n"));
+    QVERIFY(text.contains("quickshell_polkit_state_transitions_total"
+                          "{from=\"WAITING_FOR_PASSWORD\",to=\"AUTHENTICATING\"} 2\n"));
+    QVERIFY(!text.contains("to=\"IDLE\""));
+    QVERIFY(text.contains("quickshell_polkit_illegal_transitions_total 0\n"));
+}
+
+QTEST_MAIN(TestMetrics)
+#include "test-metrics.moc"
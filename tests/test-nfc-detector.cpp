@@ -0,0 +1,118 @@
+#include <QTest>
+#include <QSignalSpy>
+#include <QTemporaryDir>
+#include <QDir>
+#include <QFile>
+#include "../src/nfc-detector.h"
+
+/**
+ * Tests for UsbNfcDetector against a fake sysfs tree
+ *
+ * The real detector reads /sys/bus/usb/devices; pointing it at a temporary
+ * directory lets us plug and unplug devices without hardware.
+ */
+class TestNfcDetector : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void init();
+    void testNoDevices();
+    void testKnownDeviceAtStartup();
+    void testUnknownDeviceIgnored();
+    void testInterfaceEntriesIgnored();
+    void testPresenceChangedOnRescan();
+    void testNoSignalWithoutChange();
+    
+private:
+    void addDevice(const QString &entry, const QByteArray &vendorId);
+    void removeDevice(const QString &entry);
+    
+    QScopedPointer<QTemporaryDir> m_sysfs;
+};
+
+void TestNfcDetector::init()
+{
+    m_sysfs.reset(new QTemporaryDir);
+    QVERIFY(m_sysfs->isValid());
+}
+
+void TestNfcDetector::addDevice(const QString &entry, const QByteArray &vendorId)
+{
+    QDir(m_sysfs->path()).mkpath(entry);
+    QFile file(m_sysfs->path() + '/' + entry + "/idVendor");
+    QVERIFY(file.open(QIODevice::WriteOnly));
+    file.write(vendorId + "\n");
+}
+
+void TestNfcDetector::removeDevice(const QString &entry)
+{
+    QVERIFY(QDir(m_sysfs->path() + '/' + entry).removeRecursively());
+}
+
+void TestNfcDetector::testNoDevices()
+{
+    UsbNfcDetector detector(m_sysfs->path());
+    QVERIFY(!detector.isPresent());
+}
+
+void TestNfcDetector::testKnownDeviceAtStartup()
+{
+    addDevice("1-2", "1050");  // Yubico
+    
+    UsbNfcDetector detector(m_sysfs->path());
+    QVERIFY(detector.isPresent());
+}
+
+void TestNfcDetector::testUnknownDeviceIgnored()
+{
+    addDevice("1-1", "046d");  // Logitech
+    
+    UsbNfcDetector detector(m_sysfs->path());
+    QVERIFY(!detector.isPresent());
+}
+
+void TestNfcDetector::testInterfaceEntriesIgnored()
+{
+    // Interface directories have no idVendor
+    QDir(m_sysfs->path()).mkpath("1-2:1.0");
+    
+    UsbNfcDetector detector(m_sysfs->path());
+    QVERIFY(!detector.isPresent());
+}
+
+void TestNfcDetector::testPresenceChangedOnRescan()
+{
+    UsbNfcDetector detector(m_sysfs->path());
+    QSignalSpy spy(&detector, &INfcDetector::presenceChanged);
+    QVERIFY(!detector.isPresent());
+    
+    addDevice("3-1", "072F");  // ACS reader, upper-case hex
+    detector.rescan();
+    QVERIFY(detector.isPresent());
+    QCOMPARE(spy.count(), 1);
+    QCOMPARE(spy.at(0).at(0).toBool(), true);
+    
+    removeDevice("3-1");
+    detector.rescan();
+    QVERIFY(!detector.isPresent());
+    QCOMPARE(spy.count(), 2);
+    QCOMPARE(spy.at(1).at(0).toBool(), false);
+}
+
+void TestNfcDetector::testNoSignalWithoutChange()
+{
+    addDevice("1-2", "1050");
+    
+    UsbNfcDetector detector(m_sysfs->path());
+    QSignalSpy spy(&detector, &INfcDetector::presenceChanged);
+    
+    // Unrelated hotplug activity must not produce spurious notifications
+    addDevice("1-3", "046d");
+    detector.rescan();
+    QVERIFY(detector.isPresent());
+    QCOMPARE(spy.count(), 0);
+}
+
+QTEST_MAIN(TestNfcDetector)
+#include "test-nfc-detector.moc"
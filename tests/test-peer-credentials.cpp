@@ -0,0 +1,123 @@
+#include <QTest>
+#include <QLocalServer>
+#include <QLocalSocket>
+#include <QTemporaryDir>
+#include <fcntl.h>
+#include <unistd.h>
+#include "../src/peer-credentials.h"
+
+class TestPeerCredentials : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void testConnectedPeer();
+    void testInvalidDescriptors();
+    void testMoveTransfersPidfd();
+    void testPolicyDecisions();
+    void testParseUidList();
+
+private:
+    PeerCredentials connectAndRead();
+
+    QTemporaryDir m_dir;
+    QLocalServer m_server;
+};
+
+void TestPeerCredentials::initTestCase()
+{
+    QVERIFY(m_dir.isValid());
+    QVERIFY(m_server.listen(m_dir.filePath("peer-test")));
+}
+
+PeerCredentials TestPeerCredentials::connectAndRead()
+{
+    QLocalSocket client;
+    client.connectToServer(m_server.fullServerName());
+    if (!client.waitForConnected(1000) || !m_server.waitForNewConnection(1000)) {
+        return {};
+    }
+    QLocalSocket *accepted = m_server.nextPendingConnection();
+    PeerCredentials peer = PeerCredentials::fromSocket(accepted->socketDescriptor());
+    delete accepted;
+    return peer;
+}
+
+void TestPeerCredentials::testConnectedPeer()
+{
+    // Both ends are this process
+    const PeerCredentials peer = connectAndRead();
+    QVERIFY(peer.isValid());
+    QCOMPARE(peer.uid(), getuid());
+    QCOMPARE(peer.gid(), getgid());
+    QCOMPARE(peer.pid(), getpid());
+    QCOMPARE(peer.describe(), QString("uid=%1 pid=%2").arg(getuid()).arg(getpid()));
+}
+
+void TestPeerCredentials::testInvalidDescriptors()
+{
+    QVERIFY(!PeerCredentials::fromSocket(-1).isValid());
+
+    // Not a socket
+    int fds[2];
+    QCOMPARE(::pipe(fds), 0);
+    QVERIFY(!PeerCredentials::fromSocket(fds[0]).isValid());
+    ::close(fds[0]);
+    ::close(fds[1]);
+
+    QCOMPARE(PeerCredentials().describe(), QString("peer=unknown"));
+}
+
+void TestPeerCredentials::testMoveTransfersPidfd()
+{
+    PeerCredentials peer = connectAndRead();
+    QVERIFY(peer.isValid());
+    const int pidfd = peer.pidfd();
+
+    PeerCredentials moved(std::move(peer));
+    QVERIFY(moved.isValid());
+    QCOMPARE(moved.pidfd(), pidfd);
+    QVERIFY(!peer.isValid());
+    QCOMPARE(peer.pidfd(), -1);
+
+    if (pidfd < 0) {
+        QSKIP("Kernel without pidfd support");
+    }
+    // Owned exactly once: still open after the move, closed with its owner
+    QVERIFY(::fcntl(pidfd, F_GETFD) != -1);
+    moved = PeerCredentials();
+    QCOMPARE(::fcntl(pidfd, F_GETFD), -1);
+}
+
+void TestPeerCredentials::testPolicyDecisions()
+{
+    const PeerCredentials peer = connectAndRead();
+    QVERIFY(peer.isValid());
+
+    QCOMPARE(PeerPolicy(getuid()).evaluate(peer), PeerPolicy::Decision::Trusted);
+    QCOMPARE(PeerPolicy(getuid() + 1).evaluate(peer), PeerPolicy::Decision::Denied);
+    QCOMPARE(PeerPolicy(getuid() + 1, {getuid()}).evaluate(peer), PeerPolicy::Decision::Allowed);
+
+    // Unknown peers are never admitted, whatever the policy lists
+    QCOMPARE(PeerPolicy(getuid(), {getuid()}).evaluate(PeerCredentials()), PeerPolicy::Decision::Denied);
+}
+
+void TestPeerCredentials::testParseUidList()
+{
+    bool ok = false;
+    QCOMPARE(PeerPolicy::parseUidList("1001,1002", &ok), QList<uid_t>({1001, 1002}));
+    QVERIFY(ok);
+
+    QCOMPARE(PeerPolicy::parseUidList(" 1001 , ,1001", &ok), QList<uid_t>({1001}));
+    QVERIFY(ok);
+
+    QCOMPARE(PeerPolicy::parseUidList("1001,nobody,-5,4294967295", &ok), QList<uid_t>({1001}));
+    QVERIFY(!ok);
+
+    QVERIFY(PeerPolicy::parseUidList(QString(), &ok).isEmpty());
+    QVERIFY(ok);
+}
+
+QTEST_MAIN(TestPeerCredentials)
+#include "test-peer-credentials.moc"
@@ -1,6 +1,7 @@
 #include <QTest>
 #include <QSignalSpy>
 #include <QElapsedTimer>
+#include <QMap>
 #include <QSet>
 #include "../src/polkit-wrapper.h"
 #include "../src/logging.h"
@@ -228,6 +229,8 @@ void TestPerformanceStress::testRapidSessionCreationCleanup()
  * - State queries remain fast even with many sessions
  * - No O(n²) or worse scaling behavior
  * - Consistent performance across session counts
+ * - Handle queries (slot index, no string hashing) are no slower than cookie queries
+ * - Handles go stale once their session is cleaned up
  */
 void TestPerformanceStress::testSessionMapScalability()
 {
@@ -236,6 +239,7 @@ void TestPerformanceStress::testSessionMapScalability()
 #else
     QList<int> sessionCounts = {5, 10, 15};  // Reduced to avoid long FIDO timeouts
     QMap<int, qint64> queryTimes;
+    QMap<int, qint64> handleQueryTimes;
 
     for (int sessionCount : sessionCounts) {
         qDebug() << "Testing with" << sessionCount << "sessions...";
@@ -268,9 +272,34 @@ void TestPerformanceStress::testSessionMapScalability()
         qDebug() << "  " << QUERY_ITERATIONS << "queries in" << elapsed / 1000000.0 << "ms"
                  << "(" << avgQueryTime << "μs per query)";
 
+        // Same queries through handles resolved once up front
+        QList<SessionHandle> handles;
+        for (int i = 0; i < sessionCount; i++) {
+            SessionHandle handle = m_wrapper->sessionHandle(generateCookie(i));
+            QVERIFY(handle.isValid());
+            QCOMPARE(m_wrapper->sessionCookie(handle), generateCookie(i));
+            handles.append(handle);
+        }
+
+        timer.restart();
+        for (int i = 0; i < QUERY_ITERATIONS; i++) {
+            SessionHandle handle = handles.at(i % sessionCount);
+            m_wrapper->authenticationState(handle);
+            m_wrapper->sessionRetryCount(handle);
+        }
+        qint64 handleElapsed = timer.nsecsElapsed();
+        handleQueryTimes[sessionCount] = handleElapsed;
+        qDebug() << "  " << QUERY_ITERATIONS << "handle queries in" << handleElapsed / 1000000.0 << "ms";
+
         // Cleanup for next iteration
         m_wrapper->cancelAuthorization();
         QTest::qWait(100);
+
+        // Freed slots are reused with a new generation, so old handles must not resolve
+        for (const SessionHandle &handle : std::as_const(handles)) {
+            QCOMPARE(m_wrapper->authenticationState(handle), AuthenticationState::IDLE);
+            QVERIFY(m_wrapper->sessionCookie(handle).isEmpty());
+        }
     }
 
     // VERIFY: Query time doesn't scale badly
@@ -284,6 +313,12 @@ void TestPerformanceStress::testSessionMapScalability()
     QVERIFY2(scalingFactor < 5.0,
              qPrintable(QString("Query scaling factor %.2f exceeds 5x threshold")
                        .arg(scalingFactor)));
+
+    // The cookie loop also builds a QString per query, so the handle loop
+    // should win comfortably; allow slack for scheduler noise
+    qDebug() << "Handle vs cookie query time (15 sessions):"
+             << handleQueryTimes[15] << "ns vs" << queryTimes[15] << "ns";
+    QVERIFY(handleQueryTimes[15] <= queryTimes[15] * 2);
 #endif
 }
 
@@ -0,0 +1,129 @@
+#include <QTest>
+#include "../src/rate-limiter.h"
+
+class TestRateLimiter : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void testBurstThenShed();
+    void testRefill();
+    void testClassesAreIndependent();
+    void testLimitedEpisode();
+    void testRefund();
+    void testClassify();
+};
+
+void TestRateLimiter::testBurstThenShed()
+{
+    RateLimiter limiter;
+    const qint64 now = 1000;
+    
+    // A full bucket admits exactly its capacity at one instant
+    for (int i = 0; i < RateLimiter::AUTH_CAPACITY; ++i) {
+        QVERIFY(limiter.admit(RateLimiter::MessageClass::Auth, now));
+    }
+    QVERIFY(!limiter.admit(RateLimiter::MessageClass::Auth, now));
+    QVERIFY(!limiter.admit(RateLimiter::MessageClass::Auth, now));
+    
+    QCOMPARE(limiter.shedCount(RateLimiter::MessageClass::Auth), quint64(2));
+    QCOMPARE(limiter.totalShed(), quint64(2));
+}
+
+void TestRateLimiter::testRefill()
+{
+    RateLimiter limiter;
+    qint64 now = 5000;
+    
+    for (int i = 0; i < RateLimiter::CONTROL_CAPACITY; ++i) {
+        QVERIFY(limiter.admit(RateLimiter::MessageClass::Control, now));
+    }
+    QVERIFY(!limiter.admit(RateLimiter::MessageClass::Control, now));
+    
+    // Not enough time for a whole token
+    now += 1000 / RateLimiter::CONTROL_REFILL_PER_SECOND - 1;
+    QVERIFY(!limiter.admit(RateLimiter::MessageClass::Control, now));
+    
+    // Fractional refill carries over to the next check
+    now += 1;
+    QVERIFY(limiter.admit(RateLimiter::MessageClass::Control, now));
+    QVERIFY(!limiter.admit(RateLimiter::MessageClass::Control, now));
+    
+    // Idle time never banks more than the capacity
+    now += 60 * 1000;
+    for (int i = 0; i < RateLimiter::CONTROL_CAPACITY; ++i) {
+        QVERIFY(limiter.admit(RateLimiter::MessageClass::Control, now));
+    }
+    QVERIFY(!limiter.admit(RateLimiter::MessageClass::Control, now));
+}
+
+void TestRateLimiter::testClassesAreIndependent()
+{
+    RateLimiter limiter;
+    const qint64 now = 0;
+    
+    for (int i = 0; i < RateLimiter::HEARTBEAT_CAPACITY; ++i) {
+        QVERIFY(limiter.admit(RateLimiter::MessageClass::Heartbeat, now));
+    }
+    QVERIFY(!limiter.admit(RateLimiter::MessageClass::Heartbeat, now));
+    
+    // A heartbeat flood leaves the auth budget untouched
+    QVERIFY(limiter.admit(RateLimiter::MessageClass::Auth, now));
+    QCOMPARE(limiter.shedCount(RateLimiter::MessageClass::Auth), quint64(0));
+}
+
+void TestRateLimiter::testLimitedEpisode()
+{
+    RateLimiter limiter;
+    qint64 now = 0;
+    
+    QVERIFY(!limiter.isLimited(RateLimiter::MessageClass::Auth));
+    for (int i = 0; i <= RateLimiter::AUTH_CAPACITY; ++i) {
+        limiter.admit(RateLimiter::MessageClass::Auth, now);
+    }
+    QVERIFY(limiter.isLimited(RateLimiter::MessageClass::Auth));
+    
+    now += 1000;
+    QVERIFY(limiter.admit(RateLimiter::MessageClass::Auth, now));
+    QVERIFY(!limiter.isLimited(RateLimiter::MessageClass::Auth));
+}
+
+void TestRateLimiter::testRefund()
+{
+    RateLimiter limiter;
+    const qint64 now = 0;
+    
+    for (int i = 0; i < RateLimiter::CONTROL_CAPACITY; ++i) {
+        QVERIFY(limiter.admit(RateLimiter::MessageClass::Control, now));
+    }
+    QVERIFY(!limiter.admit(RateLimiter::MessageClass::Control, now));
+    
+    // A refunded token is spent again at once
+    limiter.refund(RateLimiter::MessageClass::Control);
+    QVERIFY(limiter.admit(RateLimiter::MessageClass::Control, now));
+    QVERIFY(!limiter.admit(RateLimiter::MessageClass::Control, now));
+    
+    // Refunds never lift a bucket past its capacity
+    RateLimiter full;
+    full.refund(RateLimiter::MessageClass::Control);
+    for (int i = 0; i < RateLimiter::CONTROL_CAPACITY; ++i) {
+        QVERIFY(full.admit(RateLimiter::MessageClass::Control, now));
+    }
+    QVERIFY(!full.admit(RateLimiter::MessageClass::Control, now));
+}
+
+void TestRateLimiter::testClassify()
+{
+    QCOMPARE(RateLimiter::classify("heartbeat"), RateLimiter::MessageClass::Heartbeat);
+    QCOMPARE(RateLimiter::classify("check_authorization"), RateLimiter::MessageClass::Auth);
+    QCOMPARE(RateLimiter::classify("submit_authentication"), RateLimiter::MessageClass::Auth);
+    QCOMPARE(RateLimiter::classify("cancel_authorization"), RateLimiter::MessageClass::Auth);
+    QCOMPARE(RateLimiter::classify("select_encoding"), RateLimiter::MessageClass::Control);
+    
+    // Frames whose type could not be peeked get the strictest budget
+    QCOMPARE(RateLimiter::classify(QByteArrayView()), RateLimiter::MessageClass::Control);
+    QCOMPARE(RateLimiter::classify("bogus"), RateLimiter::MessageClass::Control);
+}
+
+QTEST_MAIN(TestRateLimiter)
+#include "test-rate-limiter.moc"
@@ -0,0 +1,332 @@
+#include <QTest>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include "../src/event-log.h"
+#include "../src/replay-outbox.h"
+
+class TestReplayOutbox : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void testNewerEventsSupersede();
+    void testResultPurgesSession();
+    void testSessionlessFramesDropped();
+    void testReplayOrderAndLiveness();
+    void testEviction();
+    void testReplayDoesNotHideResumeDelta();
+    void testReconnectToSameAgent();
+    void testReconnectAfterRestart();
+
+private:
+    static QJsonObject event(const QString &type, const QString &cookie, const QString &text = QString());
+    static QList<QJsonObject> decode(const QByteArray &frames);
+    
+    // IPCServer's welcome and resume reply, built from its event log
+    static QJsonObject welcome(const EventLog &log);
+    static QList<QJsonObject> resume(const EventLog &log, const QJsonObject &request);
+};
+
+/*
+ * handleMessage from PolkitAgent.qml: the duplicate filter, then the
+ * welcome and resume_complete bookkeeping. Any other frame is recorded
+ * as handled.
+ */
+struct ModelClient
+{
+    quint64 lastEventSeq = 0;
+    QString eventEpoch;
+    QJsonObject resumeRequest;
+    QStringList handled;
+    
+    void deliver(const QList<QJsonObject> &messages)
+    {
+        for (const QJsonObject &message : messages) {
+            if (message.contains("event_seq")) {
+                const quint64 seq = quint64(message["event_seq"].toInteger());
+                if (seq <= lastEventSeq) {
+                    continue;
+                }
+                lastEventSeq = seq;
+            }
+            
+            const QString type = message["type"].toString();
+            if (type == "welcome") {
+                const quint64 resumeFrom = lastEventSeq;
+                const QString resumeEpoch = eventEpoch;
+                if (message["event_epoch"].toString() != eventEpoch) {
+                    eventEpoch = message["event_epoch"].toString();
+                    lastEventSeq = 0;
+                }
+                if (!resumeEpoch.isEmpty()) {
+                    resumeRequest = QJsonObject();
+                    resumeRequest["type"] = "resume";
+                    resumeRequest["last_seq"] = static_cast<double>(resumeFrom);
+                    resumeRequest["epoch"] = resumeEpoch;
+                }
+            } else if (type == "resume_complete") {
+                eventEpoch = message["event_epoch"].toString();
+                lastEventSeq = qMax(lastEventSeq, quint64(message["log_seq"].toInteger()));
+            } else {
+                handled.append(type + ":" + message["cookie"].toString());
+            }
+        }
+    }
+};
+
+QJsonObject TestReplayOutbox::event(const QString &type, const QString &cookie, const QString &text)
+{
+    QJsonObject message;
+    message["type"] = type;
+    message["cookie"] = cookie;
+    if (!text.isEmpty()) {
+        message["message"] = text;
+    }
+    return message;
+}
+
+QList<QJsonObject> TestReplayOutbox::decode(const QByteArray &frames)
+{
+    QList<QJsonObject> messages;
+    for (const QByteArray &line : frames.split('\n')) {
+        if (!line.isEmpty()) {
+            messages.append(QJsonDocument::fromJson(line).object());
+        }
+    }
+    return messages;
+}
+
+QJsonObject TestReplayOutbox::welcome(const EventLog &log)
+{
+    QJsonObject message;
+    message["type"] = "welcome";
+    message["log_seq"] = static_cast<double>(log.lastSeq());
+    message["event_epoch"] = log.epoch();
+    return message;
+}
+
+QList<QJsonObject> TestReplayOutbox::resume(const EventLog &log, const QJsonObject &request)
+{
+    const quint64 lastSeq = quint64(request["last_seq"].toInteger());
+    QList<QJsonObject> replies;
+    QJsonObject complete;
+    complete["type"] = "resume_complete";
+    if (request["epoch"].toString() == log.epoch() && log.covers(lastSeq)) {
+        replies = decode(log.framesAfter(lastSeq, WireEncoding::Json));
+        complete["mode"] = "delta";
+    } else {
+        complete["mode"] = "snapshot";  // No live sessions in these cases
+    }
+    complete["log_seq"] = static_cast<double>(log.lastSeq());
+    complete["event_epoch"] = log.epoch();
+    replies.append(complete);
+    return replies;
+}
+
+void TestReplayOutbox::testNewerEventsSupersede()
+{
+    ReplayOutbox outbox;
+    QVERIFY(outbox.record(event("show_auth_dialog", "c1", "first")));
+    QVERIFY(outbox.record(event("password_request", "c1", "prompt 1")));
+    QVERIFY(outbox.record(event("password_request", "c1", "prompt 2")));
+    QVERIFY(outbox.record(event("auth_dialog_update", "c1", "refined")));
+    QCOMPARE(outbox.sessionCount(), 1);
+    
+    // One frame per kind, newest wins, dialog first
+    QList<QJsonObject> replay = decode(outbox.takeFrames());
+    QCOMPARE(replay.size(), 3);
+    QCOMPARE(replay[0]["type"].toString(), QString("show_auth_dialog"));
+    QCOMPARE(replay[1]["message"].toString(), QString("refined"));
+    QCOMPARE(replay[2]["message"].toString(), QString("prompt 2"));
+    QVERIFY(outbox.isEmpty());
+    
+    // A fresh dialog for the cookie forgets the old prompt
+    outbox.record(event("password_request", "c1", "stale"));
+    outbox.record(event("show_auth_dialog", "c1", "again"));
+    replay = decode(outbox.takeFrames());
+    QCOMPARE(replay.size(), 1);
+    QCOMPARE(replay[0]["message"].toString(), QString("again"));
+}
+
+void TestReplayOutbox::testResultPurgesSession()
+{
+    ReplayOutbox outbox;
+    outbox.record(event("show_auth_dialog", "done"));
+    outbox.record(event("password_request", "done"));
+    outbox.record(event("show_auth_dialog", "live"));
+    
+    QVERIFY(!outbox.record(event("authorization_result", "done")));
+    QCOMPARE(outbox.sessionCount(), 1);
+    
+    QList<QJsonObject> replay = decode(outbox.takeFrames());
+    QCOMPARE(replay.size(), 1);
+    QCOMPARE(replay[0]["cookie"].toString(), QString("live"));
+}
+
+void TestReplayOutbox::testSessionlessFramesDropped()
+{
+    ReplayOutbox outbox;
+    QVERIFY(!outbox.record(event("show_auth_dialog", QString())));
+    QVERIFY(!outbox.record(event("authorization_error", QString())));
+    QVERIFY(!outbox.record(event("heartbeat_ack", "c1")));
+    QVERIFY(!outbox.record(event("security_key_presence", "c1")));
+    QVERIFY(outbox.isEmpty());
+    QVERIFY(outbox.takeFrames().isEmpty());
+}
+
+void TestReplayOutbox::testReplayOrderAndLiveness()
+{
+    ReplayOutbox outbox;
+    const QStringList cookies = {"s-0", "s-1", "s-2", "s-3"};
+    for (const QString &cookie : cookies) {
+        outbox.record(event("show_auth_dialog", cookie));
+    }
+    // Later events do not move a session in the replay order
+    outbox.record(event("password_request", "s-0"));
+    
+    QList<QJsonObject> replay = decode(outbox.takeFrames([](const QString &cookie) {
+        return cookie != "s-2";
+    }));
+    
+    QCOMPARE(replay.size(), 4);
+    QCOMPARE(replay[0]["cookie"].toString(), QString("s-0"));
+    QCOMPARE(replay[1]["cookie"].toString(), QString("s-0"));
+    QCOMPARE(replay[2]["cookie"].toString(), QString("s-1"));
+    QCOMPARE(replay[3]["cookie"].toString(), QString("s-3"));
+    QVERIFY(outbox.isEmpty());
+}
+
+void TestReplayOutbox::testEviction()
+{
+    ReplayOutbox outbox;
+    for (int i = 0; i <= ReplayOutbox::MAX_SESSIONS; ++i) {
+        outbox.record(event("show_auth_dialog", QString("s-%1").arg(i)));
+    }
+    
+    QCOMPARE(outbox.sessionCount(), ReplayOutbox::MAX_SESSIONS);
+    QCOMPARE(outbox.evictedCount(), quint64(1));
+    
+    // The oldest session made room
+    QList<QJsonObject> replay = decode(outbox.takeFrames());
+    QCOMPARE(replay.size(), ReplayOutbox::MAX_SESSIONS);
+    QCOMPARE(replay.first()["cookie"].toString(), QString("s-1"));
+}
+
+void TestReplayOutbox::testReplayDoesNotHideResumeDelta()
+{
+    // What IPCServer::broadcastMessage does with no client connected
+    EventLog log;
+    ReplayOutbox outbox;
+    auto broadcastWhileAway = [&log, &outbox](QJsonObject message) {
+        log.append(message);
+        outbox.record(message);
+    };
+    
+    for (int i = 1; i <= 5; ++i) {
+        QJsonObject seen = event("auth_dialog_update", "a", QString("update %1").arg(i));
+        log.append(seen);  // Delivered before the client went away
+    }
+    const quint64 lastSeen = log.lastSeq();
+    
+    QJsonObject resultA = event("authorization_result", "a");
+    resultA["authorized"] = false;
+    broadcastWhileAway(resultA);                         // seq 6, purges "a"
+    broadcastWhileAway(event("show_auth_dialog", "b"));  // seq 7, stored
+    
+    // The client's filter (PolkitAgent.qml): numbered events at or below the
+    // last seen sequence are duplicates, unnumbered frames are always handled
+    quint64 clientSeq = lastSeen;
+    QStringList handled;
+    auto deliver = [&clientSeq, &handled](const QList<QJsonObject> &messages) {
+        for (const QJsonObject &message : messages) {
+            if (message.contains("event_seq")) {
+                const quint64 seq = quint64(message["event_seq"].toInteger());
+                if (seq <= clientSeq) {
+                    continue;
+                }
+                clientSeq = seq;
+            }
+            handled.append(message["type"].toString() + ":" + message["cookie"].toString());
+        }
+    };
+    
+    // Reconnect: outbox replay after the welcome, then the resume delta
+    const QList<QJsonObject> replay = decode(outbox.takeFrames());
+    QCOMPARE(replay.size(), 1);
+    QVERIFY(!replay.first().contains("event_seq"));
+    deliver(replay);
+    QCOMPARE(clientSeq, lastSeen);
+    
+    QVERIFY(log.covers(clientSeq));
+    deliver(decode(log.framesAfter(clientSeq, WireEncoding::Json)));
+    QVERIFY(handled.contains("authorization_result:a"));
+    QCOMPARE(clientSeq, log.lastSeq());
+}
+
+void TestReplayOutbox::testReconnectToSameAgent()
+{
+    EventLog log;
+    ModelClient client;
+    client.deliver({welcome(log)});
+    QVERIFY(client.resumeRequest.isEmpty());  // Nothing to resume on first connect
+    
+    for (int i = 1; i <= 3; ++i) {
+        QJsonObject seen = event("show_auth_dialog", QString("seen-%1").arg(i));
+        log.append(seen);
+        client.deliver({seen});
+    }
+    QCOMPARE(client.lastEventSeq, log.lastSeq());
+    
+    // Events broadcast while disconnected advance the head the welcome reports
+    QJsonObject missed = event("show_auth_dialog", "missed");
+    log.append(missed);
+    QJsonObject result = event("authorization_result", "seen-1");
+    log.append(result);
+    
+    client.deliver({welcome(log)});
+    QCOMPARE(quint64(client.resumeRequest["last_seq"].toInteger()), quint64(3));
+    
+    client.deliver(resume(log, client.resumeRequest));
+    QVERIFY(client.handled.contains("show_auth_dialog:missed"));
+    QVERIFY(client.handled.contains("authorization_result:seen-1"));
+    QCOMPARE(client.lastEventSeq, log.lastSeq());
+    QCOMPARE(client.eventEpoch, log.epoch());
+}
+
+void TestReplayOutbox::testReconnectAfterRestart()
+{
+    ModelClient client;
+    {
+        EventLog previous;
+        client.deliver({welcome(previous)});
+        for (int i = 1; i <= 5; ++i) {
+            QJsonObject seen = event("auth_dialog_update", "old", QString("update %1").arg(i));
+            previous.append(seen);
+            client.deliver({seen});
+        }
+    }
+    const QString previousEpoch = client.eventEpoch;
+    
+    // The new instance numbers from scratch, below what the client has seen
+    EventLog log;
+    
+    client.deliver({welcome(log)});
+    QCOMPARE(client.eventEpoch, log.epoch());
+    QCOMPARE(client.resumeRequest["epoch"].toString(), previousEpoch);
+    
+    const QList<QJsonObject> replies = resume(log, client.resumeRequest);
+    QCOMPARE(replies.last()["mode"].toString(), QString("snapshot"));
+    client.deliver(replies);
+    QCOMPARE(client.eventEpoch, log.epoch());
+    QCOMPARE(client.lastEventSeq, log.lastSeq());
+    
+    // Live events of the new instance are handled, not taken for duplicates
+    QJsonObject prompt = event("show_auth_dialog", "new");
+    log.append(prompt);
+    QVERIFY(quint64(prompt["event_seq"].toInteger()) < 5);
+    client.deliver({prompt});
+    QVERIFY(client.handled.contains("show_auth_dialog:new"));
+}
+
+QTEST_MAIN(TestReplayOutbox)
+#include "test-replay-outbox.moc"
@@ -19,6 +19,11 @@ private slots:
     void testTimestampValidation();
     void testAuditLogging();
     void testReplayProtection();
+    void testConstantTimeEquals();
+    void testJsonFrameSigning();
+    void testCborFrameSigning();
+    void testReplayWindow();
+    void testReadSequence();
     
 private:
     void waitMs(int ms);
@@ -219,6 +224,137 @@ void TestSecurityManager::testReplayProtection()
     QVERIFY(!SecurityManager::verifyMessage(oldSignedMessage));
 }
 
+void TestSecurityManager::testConstantTimeEquals()
+{
+    QVERIFY(SecurityManager::constantTimeEquals("abc", "abc"));
+    QVERIFY(!SecurityManager::constantTimeEquals("abc", "abd"));
+    QVERIFY(!SecurityManager::constantTimeEquals("abc", "ab"));
+    QVERIFY(SecurityManager::constantTimeEquals(QByteArrayView(), QByteArrayView()));
+}
+
+void TestSecurityManager::testJsonFrameSigning()
+{
+    MessageAuthenticator authenticator;
+    
+    QJsonObject message;
+    message["type"] = "heartbeat";
+    message["timestamp"] = static_cast<double>(SecurityManager::getCurrentTimestamp());
+    
+    QByteArray frame = authenticator.signFrame(message, WireEncoding::Json);
+    QVERIFY(frame.endsWith("\"}\n"));
+    frame.chop(1);
+    
+    // hmac is the last member and the frame is still plain JSON
+    QJsonObject decoded = QJsonDocument::fromJson(frame).object();
+    QCOMPARE(decoded["type"].toString(), QString("heartbeat"));
+    QCOMPARE(decoded["hmac"].toString().size(), 2 * MessageAuthenticator::DIGEST_SIZE);
+    QVERIFY(frame.indexOf("\"hmac\"") > frame.indexOf("\"type\""));
+    
+    // Verified repeatedly with the same keyed MAC
+    QVERIFY(authenticator.verifyFrame(frame, WireEncoding::Json));
+    QVERIFY(authenticator.verifyFrame(frame, WireEncoding::Json));
+    QVERIFY(authenticator.verifyFrame(frame + "\r", WireEncoding::Json));
+    
+    // Another connection's authenticator shares the session key
+    MessageAuthenticator other;
+    QVERIFY(other.verifyFrame(frame, WireEncoding::Json));
+    
+    // Any change to the signed span is detected
+    QByteArray tampered = frame;
+    tampered.replace("heartbeat", "heartbeaT");
+    QVERIFY(!authenticator.verifyFrame(tampered, WireEncoding::Json));
+    
+    // ...and so is a corrupted digest
+    QByteArray badDigest = frame;
+    badDigest[badDigest.size() - 3] = badDigest[badDigest.size() - 3] == '0' ? '1' : '0';
+    QVERIFY(!authenticator.verifyFrame(badDigest, WireEncoding::Json));
+    
+    // hmac anywhere but last is not a signed frame
+    QJsonObject reordered = decoded;
+    QByteArray sorted = QJsonDocument(reordered).toJson(QJsonDocument::Compact);
+    QVERIFY(!authenticator.verifyFrame(sorted, WireEncoding::Json));
+}
+
+void TestSecurityManager::testCborFrameSigning()
+{
+    MessageAuthenticator authenticator;
+    
+    QJsonObject message;
+    message["type"] = "submit_authentication";
+    message["cookie"] = "cookie-1";
+    message["response"] = "secret";
+    message["timestamp"] = static_cast<double>(SecurityManager::getCurrentTimestamp());
+    
+    QByteArray frame = authenticator.signFrame(message, WireEncoding::Cbor);
+    QVERIFY(authenticator.verifyFrame(frame, WireEncoding::Cbor));
+    
+    // A JSON-framed check of CBOR bytes fails rather than misreading them
+    QVERIFY(!authenticator.verifyFrame(frame, WireEncoding::Json));
+    
+    QByteArray tampered = frame;
+    tampered.replace("secret", "Secret");
+    QVERIFY(!authenticator.verifyFrame(tampered, WireEncoding::Cbor));
+    
+    QVERIFY(!authenticator.verifyFrame(frame.first(frame.size() - 1), WireEncoding::Cbor));
+}
+
+void TestSecurityManager::testReplayWindow()
+{
+    ReplayWindow window;
+    
+    // Zero is never a valid sequence number
+    QVERIFY(!window.check(0));
+    
+    QVERIFY(window.check(1));
+    window.accept(1);
+    QVERIFY(!window.check(1));
+    
+    // Gaps are fine and the skipped numbers may still arrive late
+    window.accept(5);
+    QVERIFY(window.check(3));
+    window.accept(3);
+    QVERIFY(!window.check(3));
+    QVERIFY(window.check(4));
+    QVERIFY(!window.check(5));
+    QCOMPARE(window.highest(), quint64(5));
+    
+    // Sliding keeps the bits for numbers still inside the window
+    window.accept(5 + ReplayWindow::WINDOW_SIZE - 3);
+    QVERIFY(!window.check(5));
+    QVERIFY(window.check(4));
+    
+    // Anything that fell out of the window is rejected
+    window.accept(1000);
+    QVERIFY(!window.check(1000 - ReplayWindow::WINDOW_SIZE));
+    QVERIFY(window.check(1000 - ReplayWindow::WINDOW_SIZE + 1));
+    
+    // A jump larger than the window clears it
+    window.accept(1000 + 10 * ReplayWindow::WINDOW_SIZE);
+    QVERIFY(window.check(1000 + 10 * ReplayWindow::WINDOW_SIZE - 1));
+    QVERIFY(!window.check(1000));
+}
+
+void TestSecurityManager::testReadSequence()
+{
+    quint64 sequence = 0;
+    QJsonObject message;
+    
+    QVERIFY(!SecurityManager::readSequence(message, &sequence));
+    
+    message["seq"] = 42;
+    QVERIFY(SecurityManager::readSequence(message, &sequence));
+    QCOMPARE(sequence, quint64(42));
+    
+    message["seq"] = 0;
+    QVERIFY(!SecurityManager::readSequence(message, &sequence));
+    message["seq"] = -3;
+    QVERIFY(!SecurityManager::readSequence(message, &sequence));
+    message["seq"] = 1.5;
+    QVERIFY(!SecurityManager::readSequence(message, &sequence));
+    message["seq"] = "7";
+    QVERIFY(!SecurityManager::readSequence(message, &sequence));
+}
+
 void TestSecurityManager::waitMs(int ms)
 {
     QThread::msleep(ms);
@@ -0,0 +1,70 @@
+#include <QTest>
+#include <QRegularExpression>
+#include "../src/startup-profile.h"
+
+class TestStartupProfile : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void init();
+    void testPhasesInOrder();
+    void testReportStartsNewGroup();
+    void testBeforeStartIsInert();
+    void testPhaseLimit();
+};
+
+void TestStartupProfile::init()
+{
+    StartupProfile::testReset();
+}
+
+void TestStartupProfile::testPhasesInOrder()
+{
+    StartupProfile::start();
+    StartupProfile::mark("first");
+    QTest::qSleep(5);
+    StartupProfile::mark("second");
+
+    const QString summary = StartupProfile::summary();
+    const QRegularExpression shape("^first=\\d+\\.\\d\\dms second=(\\d+\\.\\d\\d)ms total=(\\d+\\.\\d\\d)ms$");
+    const QRegularExpressionMatch match = shape.match(summary);
+    QVERIFY2(match.hasMatch(), qPrintable(summary));
+    QVERIFY(match.captured(1).toDouble() >= 5.0);
+    QVERIFY(match.captured(2).toDouble() >= match.captured(1).toDouble());
+    QVERIFY(StartupProfile::elapsedNs() >= 5'000'000);
+}
+
+void TestStartupProfile::testReportStartsNewGroup()
+{
+    StartupProfile::start();
+    StartupProfile::mark("before_exec");
+    QTest::ignoreMessage(QtInfoMsg, QRegularExpression("^Startup ready for clients: before_exec=.* total="));
+    StartupProfile::report("ready for clients");
+
+    // The next report covers only what came after, timed from the last mark
+    QTest::qSleep(2);
+    StartupProfile::mark("agent_register");
+    QVERIFY(StartupProfile::summary().startsWith("agent_register="));
+    QVERIFY(!StartupProfile::summary().contains("before_exec"));
+}
+
+void TestStartupProfile::testBeforeStartIsInert()
+{
+    StartupProfile::mark("ignored");
+    StartupProfile::report("never");
+    QCOMPARE(StartupProfile::elapsedNs(), qint64(0));
+    QCOMPARE(StartupProfile::summary(), QString("total=0.00ms"));
+}
+
+void TestStartupProfile::testPhaseLimit()
+{
+    StartupProfile::start();
+    for (int i = 0; i < StartupProfile::MAX_PHASES + 4; ++i) {
+        StartupProfile::mark("phase");
+    }
+    QCOMPARE(int(StartupProfile::summary().count("phase=")), StartupProfile::MAX_PHASES);
+}
+
+QTEST_MAIN(TestStartupProfile)
+#include "test-startup-profile.moc"
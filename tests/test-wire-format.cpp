@@ -0,0 +1,159 @@
+#include <QTest>
+#include <QJsonObject>
+#include <QCborValue>
+#include "../src/wire-format.h"
+
+class TestWireFormat : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void testJsonRoundTrip();
+    void testInvalidJson();
+    void testCborRoundTrip();
+    void testCborSequence();
+    void testCborPartialFrame();
+    void testCborNotAMap();
+    void testEncodingNames();
+    void testPeekMessageType();
+    
+private:
+    QJsonObject sampleMessage();
+};
+
+QJsonObject TestWireFormat::sampleMessage()
+{
+    QJsonObject message;
+    message["type"] = "submit_authentication";
+    message["cookie"] = "cookie-123";
+    message["response"] = "hunter2";
+    message["timestamp"] = 1700000000.0;
+    return message;
+}
+
+void TestWireFormat::testJsonRoundTrip()
+{
+    QByteArray frame = WireFormat::encode(sampleMessage(), WireEncoding::Json);
+    QVERIFY(frame.endsWith('\n'));
+    QCOMPARE(frame.count('\n'), 1);
+    
+    QJsonObject decoded;
+    QString error;
+    frame.chop(1);
+    QCOMPARE(WireFormat::decodeJson(frame, &decoded, &error), WireFormat::DecodeStatus::Complete);
+    QCOMPARE(decoded, sampleMessage());
+}
+
+void TestWireFormat::testInvalidJson()
+{
+    QJsonObject decoded;
+    QString error;
+    QCOMPARE(WireFormat::decodeJson("{\"type\":", &decoded, &error), WireFormat::DecodeStatus::Invalid);
+    QVERIFY(!error.isEmpty());
+}
+
+void TestWireFormat::testCborRoundTrip()
+{
+    QByteArray frame = WireFormat::encode(sampleMessage(), WireEncoding::Cbor);
+    
+    // Binary is more compact than the equivalent text frame
+    QVERIFY(frame.size() < WireFormat::encode(sampleMessage(), WireEncoding::Json).size());
+    
+    QJsonObject decoded;
+    qsizetype consumed = 0;
+    QString error;
+    QCOMPARE(WireFormat::decodeCbor(frame, 0, &decoded, &consumed, &error), WireFormat::DecodeStatus::Complete);
+    QCOMPARE(consumed, frame.size());
+    QCOMPARE(decoded["type"].toString(), QString("submit_authentication"));
+    QCOMPARE(decoded["cookie"].toString(), QString("cookie-123"));
+    QCOMPARE(decoded["response"].toString(), QString("hunter2"));
+    QVERIFY(decoded["timestamp"].isDouble());
+    QCOMPARE(decoded["timestamp"].toDouble(), 1700000000.0);
+}
+
+void TestWireFormat::testCborSequence()
+{
+    QJsonObject heartbeat;
+    heartbeat["type"] = "heartbeat";
+    
+    QByteArray stream = WireFormat::encode(heartbeat, WireEncoding::Cbor) +
+                        WireFormat::encode(sampleMessage(), WireEncoding::Cbor);
+    
+    QJsonObject first;
+    QJsonObject second;
+    qsizetype consumed = 0;
+    QString error;
+    QCOMPARE(WireFormat::decodeCbor(stream, 0, &first, &consumed, &error), WireFormat::DecodeStatus::Complete);
+    QCOMPARE(first["type"].toString(), QString("heartbeat"));
+    
+    qsizetype offset = consumed;
+    QCOMPARE(WireFormat::decodeCbor(stream, offset, &second, &consumed, &error), WireFormat::DecodeStatus::Complete);
+    QCOMPARE(second["type"].toString(), QString("submit_authentication"));
+    QCOMPARE(offset + consumed, stream.size());
+    
+    // Nothing left to decode
+    QCOMPARE(WireFormat::decodeCbor(stream, stream.size(), &second, &consumed, &error), WireFormat::DecodeStatus::Incomplete);
+}
+
+void TestWireFormat::testCborPartialFrame()
+{
+    QByteArray frame = WireFormat::encode(sampleMessage(), WireEncoding::Cbor);
+    
+    QJsonObject decoded;
+    qsizetype consumed = 0;
+    QString error;
+    for (qsizetype length = 1; length < frame.size(); ++length) {
+        QCOMPARE(WireFormat::decodeCbor(frame.left(length), 0, &decoded, &consumed, &error),
+                 WireFormat::DecodeStatus::Incomplete);
+    }
+}
+
+void TestWireFormat::testCborNotAMap()
+{
+    QByteArray frame = QCborValue(QStringLiteral("heartbeat")).toCbor();
+    
+    QJsonObject decoded;
+    qsizetype consumed = 0;
+    QString error;
+    QCOMPARE(WireFormat::decodeCbor(frame, 0, &decoded, &consumed, &error), WireFormat::DecodeStatus::Invalid);
+    QVERIFY(error.contains("map"));
+}
+
+void TestWireFormat::testEncodingNames()
+{
+    WireEncoding encoding = WireEncoding::Json;
+    QVERIFY(WireFormat::encodingFromName("cbor", &encoding));
+    QCOMPARE(encoding, WireEncoding::Cbor);
+    QCOMPARE(WireFormat::encodingName(encoding), QString("cbor"));
+    
+    QVERIFY(WireFormat::encodingFromName("json", &encoding));
+    QCOMPARE(encoding, WireEncoding::Json);
+    
+    QVERIFY(!WireFormat::encodingFromName("xml", &encoding));
+    QCOMPARE(WireFormat::supportedEncodings(), QStringList({"json", "cbor"}));
+}
+
+void TestWireFormat::testPeekMessageType()
+{
+    QCOMPARE(WireFormat::peekMessageType("{\"type\":\"heartbeat\"}").toByteArray(), QByteArray("heartbeat"));
+    QCOMPARE(WireFormat::peekMessageType("{ \"cookie\":\"c\", \"type\" : \"submit_authentication\"}").toByteArray(),
+             QByteArray("submit_authentication"));
+    
+    // Same answer as a full parse for what we send ourselves
+    QByteArray frame = WireFormat::encode(sampleMessage(), WireEncoding::Json);
+    QCOMPARE(WireFormat::peekMessageType(frame).toByteArray(), QByteArray("submit_authentication"));
+    
+    // "type" inside a string value is not the key
+    QVERIFY(WireFormat::peekMessageType("{\"details\":\"\\\"type\\\":\\\"x\\\"\"}").isEmpty());
+    QCOMPARE(WireFormat::peekMessageType("{\"details\":\"a \\\"type\\\"\",\"type\":\"heartbeat\"}").toByteArray(),
+             QByteArray("heartbeat"));
+    
+    // Missing, non-string, or too long to be a real type
+    QVERIFY(WireFormat::peekMessageType("{\"action_id\":\"org.example\"}").isEmpty());
+    QVERIFY(WireFormat::peekMessageType("{\"type\":42}").isEmpty());
+    QVERIFY(WireFormat::peekMessageType("{\"type\":\"" + QByteArray(100, 'x') + "\"}").isEmpty());
+    QVERIFY(WireFormat::peekMessageType("not json").isEmpty());
+}
+
+QTEST_MAIN(TestWireFormat)
+#include "test-wire-format.moc"